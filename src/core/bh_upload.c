@@ -77,8 +77,21 @@
 #define BH_MAX_QHIT_SIZE	3500	/**< Flush hits larger than this */
 #define BH_MAX_QH2_SIZE		16384	/**< Flush hits larger than this */
 #define BH_SCAN_AHEAD		100		/**< Amount of files scanned ahead */
+#define BH_MAX_PENDING		32768	/**< Max size of pending hits */
+#define BH_FILE_OVERHEAD	80		/**< Estimated hit size, besides name */
 
 #define BH_BUFSIZ			16384	/**< Buffer size for TX deflation */
+#define BH_WINDOW_BITS		13		/**< Deflating window size (log2) */
+#define BH_MEM_LEVEL		6		/**< Deflating memory level */
+
+/**
+ * The amount of concurrent browse sessions is limited by the outgoing
+ * HTTP bandwidth: each session needs BH_SESSION_BW bytes/sec to progress
+ * at a reasonable pace.
+ */
+#define BH_SESSION_BW		(8 * 1024)	/**< Bandwidth per session */
+#define BH_SESSIONS_MIN		2			/**< Always allow that many */
+#define BH_SESSIONS_MAX		16			/**< Never allow more */
 
 enum bh_state {
 	BH_STATE_HEADER = 0,	/* Sending header */
@@ -113,6 +126,8 @@ struct browse_host_upload {
 	void *cb_arg;			/**< Callback argument */
 };
 
+static uint bh_sessions;	/**< Amount of opened browse sessions */
+
 static struct browse_host_upload *
 cast_to_browse_host_upload(struct special_upload *p)
 {
@@ -422,9 +437,16 @@ browse_host_read_qhits(struct special_upload *ctx,
 
 	if (NULL == bh->hits) {
 		pslist_t *files = NULL, *sl;
+		size_t pending = 0;
 		int i;
 
-		for (i = 0; i < BH_SCAN_AHEAD; i++) {
+		/*
+		 * Bound the amount of files we select by the estimated size of the
+		 * hits we are going to build, so that the memory used by the session
+		 * does not depend on the length of the file names.
+		 */
+
+		for (i = 0; i < BH_SCAN_AHEAD && pending < BH_MAX_PENDING; i++) {
 			shared_file_t *sf;
 
 			do {
@@ -437,6 +459,7 @@ browse_host_read_qhits(struct special_upload *ctx,
 				break;
 
 			files = pslist_prepend(files, sf);
+			pending += BH_FILE_OVERHEAD + shared_file_name_nfc_len(sf);
 		}
 
 		if (NULL == files)		/* Did not find any more file to include */
@@ -565,6 +588,9 @@ browse_host_close(struct special_upload *ctx, bool fully_served)
 	}
 	tx_free(bh->tx);
 
+	g_assert(uint_is_positive(bh_sessions));
+	bh_sessions--;
+
 	/*
 	 * Update statistics if fully served.
 	 */
@@ -652,6 +678,8 @@ browse_host_open(
 		args.cb = deflate_cb;
 		args.nagle = FALSE;
 		args.reduced = FALSE;
+		args.window_bits = BH_WINDOW_BITS;	/* Keep memory footprint low */
+		args.mem_level = BH_MEM_LEVEL;
 		args.gzip = 0 != (flags & BH_F_GZIP);
 		args.buffer_flush = INT_MAX;		/* Flush only at the end */
 		args.buffer_size = BH_BUFSIZ;
@@ -668,6 +696,8 @@ browse_host_open(
 		bh->tx = tx;
 	}
 
+	bh_sessions++;
+
 	/*
 	 * Put stack in "eager" mode: we want to be notified whenever
 	 * we can write something.
@@ -690,4 +720,39 @@ browse_host_open(
 	return &bh->special;
 }
 
+/**
+ * @return the maximum amount of concurrent browse sessions we allow.
+ */
+static uint
+browse_host_max_sessions(void)
+{
+	uint64 bw;
+
+	/*
+	 * When outgoing bandwidth is not limited, we have no way to know how
+	 * much we can really use, so allow the maximum.
+	 */
+
+	if (!bsched_is_enabled(BSCHED_BWS_OUT))
+		return BH_SESSIONS_MAX;
+
+	bw = bsched_bw_per_second(BSCHED_BWS_OUT);
+	if (0 == bw)
+		return BH_SESSIONS_MAX;
+
+	return MAX(BH_SESSIONS_MIN, MIN(BH_SESSIONS_MAX, bw / BH_SESSION_BW));
+}
+
+/**
+ * Check whether we can accept one more browse session.
+ *
+ * @return TRUE if we already run as many sessions as our outgoing bandwidth
+ * can sustain.
+ */
+bool
+browse_host_is_busy(void)
+{
+	return bh_sessions >= browse_host_max_sessions();
+}
+
 /* vi: set ts=4 sw=4 cindent: */
@@ -72,6 +72,8 @@ struct special_upload *browse_host_open(
 	struct wrap_io *wio,
 	int flags);
 
+bool browse_host_is_busy(void);
+
 #endif /* _core_bh_upload_h_ */
 
 /* vi: set ts=4 sw=4 cindent: */
@@ -50,6 +50,7 @@
 #include "lib/plist.h"
 #include "lib/pslist.h"
 #include "lib/stringify.h"
+#include "lib/timestamp.h"
 #include "lib/vmm.h"
 #include "lib/walloc.h"
 
@@ -172,6 +173,8 @@ static int64 bws_in_ema = 0;
 
 #define BW_UDP_OVERSIZE	1024 /**< Allow that many bytes over available b/w */
 
+#define BW_AUTOTUNE_FREQ	5	 /**< Socket buffer autotuning period (secs) */
+
 static inline void
 bsched_check(const bsched_t * const bs)
 {
@@ -265,6 +268,16 @@ bsched_free(bsched_t *bs)
 	WFREE(bs);
 }
 
+/**
+ * Is bandwidth scheduler enabled, i.e. is bandwidth currently limited?
+ */
+bool
+bsched_is_enabled(bsched_bws_t bws)
+{
+	const bsched_t *bs = bsched_get(bws);
+	return booleanize(bs->flags & BS_F_ENABLED);
+}
+
 /**
  * Is bandwidth scheduler saturated currently?
  */
@@ -1744,6 +1757,11 @@ bio_write(bio_source_t *bio, const void *data, size_t len)
 
 	available = bw_available(bio, len);
 
+	if (available < len)
+		bio->flags |= BIO_F_CAPPED;
+	else
+		bio->flags &= ~BIO_F_CAPPED;
+
 	if (available == 0) {
 		errno = VAL_EAGAIN;
 		return -1;
@@ -1811,6 +1829,11 @@ bio_writev(bio_source_t *bio, iovec_t *iov, int iovcnt)
 
 	available = bw_available(bio, len);
 
+	if (available < len)
+		bio->flags |= BIO_F_CAPPED;
+	else
+		bio->flags &= ~BIO_F_CAPPED;
+
 	if (available == 0) {
 		errno = VAL_EAGAIN;
 		return -1;
@@ -3043,6 +3066,36 @@ done:
 	pslist_free(all_used);
 }
 
+/**
+ * Let the sources of the scheduler adapt their kernel socket buffers to
+ * the bandwidth they are currently using.
+ */
+static void
+bsched_autotune(bsched_t *bs)
+{
+	plist_t *iter;
+
+	bsched_check(bs);
+
+	PLIST_FOREACH(bs->sources, iter) {
+		bio_source_t *bio = iter->data;
+		int64 bps;
+
+		bio_check(bio);
+		wrap_io_check(bio->wio);
+
+		/*
+		 * Use the largest of the two EMAs so that buffers grow quickly
+		 * when traffic ramps up, but only shrink once it has settled down.
+		 */
+
+		bps = MAX(bio->bw_fast_ema, bio->bw_slow_ema) >> BIO_EMA_SHIFT;
+
+		bio->wio->autotune(bio->wio,
+			(bio->flags & BIO_F_READ) ? SOCK_BUF_RX : SOCK_BUF_TX, bps);
+	}
+}
+
 /**
  * Periodic timer.
  */
@@ -3054,6 +3107,7 @@ bsched_timer(void)
 	int64 out_used = 0;
 	int64 in_used = 0;
 	bool read_data = FALSE;
+	static time_t last_autotune;
 
 	tm_now(&tv);
 
@@ -3131,6 +3185,19 @@ bsched_timer(void)
 
 	if (read_data)
 		inet_read_activity();
+
+	/*
+	 * Periodically adapt kernel socket buffers to the measured bandwidth.
+	 */
+
+	if (delta_time(tv.tv_sec, last_autotune) >= BW_AUTOTUNE_FREQ) {
+		last_autotune = tv.tv_sec;
+
+		PSLIST_FOREACH(bws_list, l) {
+			bsched_bws_t bws = pointer_to_uint(l->data);
+			bsched_autotune(bsched_get(bws));
+		}
+	}
 }
 
 static bool
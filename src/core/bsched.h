@@ -100,6 +100,7 @@ bool bws_ignore_stolen(bsched_bws_t bws, bool ignore);
 bool bws_uniform_allocation(bsched_bws_t bws, bool uniform);
 
 bool bsched_enough_up_bandwidth(void);
+bool bsched_is_enabled(bsched_bws_t bws);
 bool bsched_saturated(bsched_bws_t bws);
 uint64 bsched_unused(bsched_bws_t bws);
 uint64 bsched_bps(bsched_bws_t bws);
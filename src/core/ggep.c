@@ -670,12 +670,12 @@ cleanup:
 }
 
 /**
- * We're done with the stream, close it.
+ * Close the stream, flagging the last extension written if requested.
  *
  * @return the length of the writen data in the whole stream.
  */
-size_t
-ggep_stream_close(ggep_stream_t *gs)
+static size_t
+ggep_stream_close_internal(ggep_stream_t *gs, bool flag_last, size_t *last)
 {
 	size_t len;
 
@@ -699,7 +699,10 @@ ggep_stream_close(ggep_stream_t *gs)
 	if (gs->last_fp == NULL) {
 		len = 0;
 	} else {
-		*gs->last_fp |= GGEP_F_LAST;
+		if (flag_last)
+			*gs->last_fp |= GGEP_F_LAST;
+		if (last != NULL)
+			*last = gs->last_fp - gs->outbuf;
 		len = gs->o - gs->outbuf;
 	}
 
@@ -710,6 +713,78 @@ ggep_stream_close(ggep_stream_t *gs)
 	return len;
 }
 
+/**
+ * We're done with the stream, close it.
+ *
+ * @return the length of the writen data in the whole stream.
+ */
+size_t
+ggep_stream_close(ggep_stream_t *gs)
+{
+	return ggep_stream_close_internal(gs, TRUE, NULL);
+}
+
+/**
+ * Close the stream without flagging the last extension, so that the
+ * extensions written can be later inserted into other GGEP streams with
+ * ggep_stream_append_block().
+ *
+ * @param gs		the GGEP stream
+ * @param last		where the offset of the flags of the last extension is
+ *					written, if any extension was written
+ *
+ * @return the length of the writen data in the whole stream, 0 if nothing
+ * was written.
+ */
+size_t
+ggep_stream_close_block(ggep_stream_t *gs, size_t *last)
+{
+	g_assert(last != NULL);
+
+	return ggep_stream_close_internal(gs, FALSE, last);
+}
+
+/**
+ * Append extensions previously written to a stream closed with
+ * ggep_stream_close_block().
+ *
+ * @param gs		the GGEP stream
+ * @param data		the data of the closed stream
+ * @param len		the length returned by ggep_stream_close_block()
+ * @param last		the offset returned by ggep_stream_close_block()
+ *
+ * @return TRUE if OK, FALSE if there's not enough room in the output.
+ */
+bool
+ggep_stream_append_block(ggep_stream_t *gs,
+	const void *data, size_t len, size_t last)
+{
+	const char *p = data;
+	char *start;
+
+	g_assert(ggep_stream_is_valid(gs));
+	g_assert(!gs->begun);
+	g_assert(len > 1);
+	g_assert(GGEP_MAGIC == (uchar) p[0]);
+	g_assert(last > 0 && last < len);
+	g_assert(0 == (p[last] & GGEP_F_LAST));
+
+	if (!gs->magic_sent) {
+		if (!ggep_stream_appendc(gs, GGEP_MAGIC))
+			return FALSE;
+		gs->magic_sent = TRUE;
+	}
+
+	start = gs->o;
+
+	if (!ggep_stream_append(gs, &p[1], len - 1))
+		return FALSE;
+
+	gs->last_fp = start + (last - 1);	/* Leading magic was skipped */
+
+	return TRUE;
+}
+
 /**
  * The vectorized version of ggep_stream_pack().
  *
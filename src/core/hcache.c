@@ -63,15 +63,16 @@
 #include "lib/ascii.h"
 #include "lib/atoms.h"
 #include "lib/cq.h"
+#include "lib/endian.h"
 #include "lib/file.h"
 #include "lib/getdate.h"
+#include "lib/halloc.h"
 #include "lib/hashlist.h"
-#include "lib/hset.h"
+#include "lib/hikset.h"
 #include "lib/htable.h"
 #include "lib/path.h"
 #include "lib/random.h"
 #include "lib/stringify.h"
-#include "lib/timestamp.h"
 #include "lib/tm.h"
 #include "lib/vmm.h"
 #include "lib/walloc.h"
@@ -87,6 +88,9 @@
 #define HCACHE_SAVE_PERIOD	63		/**< in seconds, every minute or so */
 #define MIN_RESERVE_SIZE	1024	/**< we'd like that many pongs in reserve */
 
+#define HCACHE_PREFIX4_BITS	16		/**< IPv4 hosts bucketed by /16 */
+#define HCACHE_PREFIX6_BITS	48		/**< IPv6 hosts bucketed by /48 */
+
 /**
  * An entry within the hostcache.
  *
@@ -97,12 +101,39 @@
 typedef struct hostcache_entry {
     hcache_type_t type;				/**< Hostcache which contains this host */
     time_t        time_added;		/**< Time when entry was added */
+	uint          slot;				/**< Index within its prefix bucket */
 } hostcache_entry_t;
 
 /** No metadata for host */
 static const void *no_metadata;
 #define NO_METADATA			(no_metadata)
 
+/**
+ * The hosts of a hostcache that belong to the same network.
+ */
+typedef struct hcache_bucket {
+	uint64 prefix;					/**< Network prefix (key) */
+	gnet_host_t **hosts;			/**< Hosts in that network (atoms) */
+	uint count;						/**< Amount of hosts in vector */
+	uint capacity;					/**< Allocated length of vector */
+	uint slot;						/**< Index in the bucket vector */
+	uint cursor;					/**< Random start for sampling passes */
+} hcache_bucket_t;
+
+/**
+ * Secondary index of a hostcache, grouping hosts by network prefix.
+ *
+ * The hash set finds the bucket of a given prefix and the vector lists all
+ * the non-empty buckets, so that we can pick hosts from distinct networks
+ * at random without walking the whole cache.
+ */
+struct hcache_index {
+	hikset_t *by_prefix;			/**< Prefix -> hcache_bucket_t */
+	hcache_bucket_t **buckets;		/**< Non-empty buckets */
+	uint count;						/**< Amount of buckets in vector */
+	uint capacity;					/**< Allocated length of vector */
+};
+
 /**
  * A hostcache table.
  */
@@ -114,6 +145,7 @@ typedef struct hostcache {
     bool        	addr_only;			/**< Use IP only, port always 0 */
     bool			dirty;     	      	/**< If updated since last disk flush */
     hash_list_t *   hostlist;           /**< Host list: IP/Port  */
+	struct hcache_index index;			/**< Hosts indexed by network */
 
     uint			hits;               /**< Hits to the cache */
     uint			misses;             /**< Misses to the cache */
@@ -475,6 +507,227 @@ hcache_get_metadata(hcache_class_t class, const gnet_host_t *host)
     return htable_lookup(ht, host);
 }
 
+/***
+ *** Network prefix index.
+ ***/
+
+/**
+ * Compute the network prefix used to bucket a host: the /16 for IPv4 and
+ * the /48 for IPv6, tagged with the network type so they never collide.
+ */
+static uint64
+hcache_prefix(const gnet_host_t *host)
+{
+	host_addr_t addr = gnet_host_get_addr(host);
+
+	switch (host_addr_net(addr)) {
+	case NET_TYPE_IPV4:
+		return ((uint64) NET_TYPE_IPV4 << 56) |
+			(host_addr_ipv4(addr) >> (32 - HCACHE_PREFIX4_BITS));
+	case NET_TYPE_IPV6:
+		{
+			const uint8 *ipv6 = host_addr_ipv6(&addr);
+
+			STATIC_ASSERT(48 == HCACHE_PREFIX6_BITS);
+
+			return ((uint64) NET_TYPE_IPV6 << 56) |
+				((uint64) peek_be16(ipv6) << 32) | peek_be32(&ipv6[2]);
+		}
+	case NET_TYPE_LOCAL:
+	case NET_TYPE_NONE:
+		break;
+	}
+
+	return 0;
+}
+
+/**
+ * @return network address of the bucket, with host bits zeroed.
+ */
+static host_addr_t
+hcache_bucket_network(const hcache_bucket_t *b)
+{
+	switch (b->prefix >> 56) {
+	case NET_TYPE_IPV4:
+		return host_addr_get_ipv4((uint32) b->prefix << 16);
+	case NET_TYPE_IPV6:
+		{
+			uint8 ipv6[16];
+
+			ZERO(&ipv6);
+			poke_be16(ipv6, b->prefix >> 32);
+			poke_be32(&ipv6[2], b->prefix);
+			return host_addr_peek_ipv6(ipv6);
+		}
+	}
+
+	return zero_host_addr;
+}
+
+/**
+ * Record host in the prefix index of the hostcache.
+ */
+static void
+hcache_index_add(hostcache_t *hc, gnet_host_t *host, hostcache_entry_t *hce)
+{
+	struct hcache_index *idx = &hc->index;
+	uint64 prefix = hcache_prefix(host);
+	hcache_bucket_t *b;
+
+	g_assert(hce != NULL && hce != NO_METADATA);
+
+	b = hikset_lookup(idx->by_prefix, &prefix);
+
+	if (NULL == b) {
+		WALLOC0(b);
+		b->prefix = prefix;
+		hikset_insert_key(idx->by_prefix, &b->prefix);
+
+		if (idx->count == idx->capacity) {
+			idx->capacity = MAX(32, idx->capacity * 2);
+			HREALLOC_ARRAY(idx->buckets, idx->capacity);
+		}
+		b->slot = idx->count;
+		idx->buckets[idx->count++] = b;
+	}
+
+	if (b->count == b->capacity) {
+		b->capacity = MAX(2, b->capacity * 2);
+		HREALLOC_ARRAY(b->hosts, b->capacity);
+	}
+
+	hce->slot = b->count;
+	b->hosts[b->count++] = host;
+}
+
+/**
+ * Remove host from the prefix index of the hostcache.
+ */
+static void
+hcache_index_remove(hostcache_t *hc, gnet_host_t *host, hostcache_entry_t *hce)
+{
+	struct hcache_index *idx = &hc->index;
+	uint64 prefix = hcache_prefix(host);
+	hcache_bucket_t *b;
+	gnet_host_t *last;
+
+	g_assert(hce != NULL && hce != NO_METADATA);
+
+	b = hikset_lookup(idx->by_prefix, &prefix);
+
+	g_assert(b != NULL);
+	g_assert(hce->slot < b->count);
+	g_assert(b->hosts[hce->slot] == host);
+
+	/*
+	 * Fill the hole with the last host of the bucket, whose metadata must
+	 * then be updated to reflect its new position.
+	 */
+
+	last = b->hosts[--b->count];
+
+	if (last != host) {
+		hostcache_entry_t *lhce = hcache_get_metadata(hc->class, last);
+
+		g_assert(lhce != NULL && lhce != NO_METADATA);
+		g_assert(lhce->slot == b->count);
+
+		b->hosts[hce->slot] = last;
+		lhce->slot = hce->slot;
+	}
+
+	if (b->count != 0)
+		return;
+
+	/*
+	 * Bucket is now empty, dispose of it.
+	 */
+
+	g_assert(b->slot < idx->count);
+	g_assert(idx->buckets[b->slot] == b);
+
+	idx->buckets[b->slot] = idx->buckets[--idx->count];
+	idx->buckets[b->slot]->slot = b->slot;
+
+	hikset_remove(idx->by_prefix, &b->prefix);
+	HFREE_NULL(b->hosts);
+	WFREE(b);
+}
+
+/**
+ * Fill supplied vector with distinct hosts taken at random from the cache,
+ * spreading them over as many different networks as possible.
+ *
+ * We first pick one host from each of (up to) `hcount' distinct networks
+ * chosen at random, then if the vector is not full, we perform additional
+ * passes over all the networks, taking one more host from each.
+ *
+ * @param hc		the hostcache to sample
+ * @param hosts		the vector to fill
+ * @param hcount	size of host vector
+ *
+ * @return amount of hosts filled.
+ */
+static int
+hcache_sample(hostcache_t *hc, gnet_host_t *hosts, int hcount)
+{
+	struct hcache_index *idx = &hc->index;
+	int n = 0;
+	uint i, pass;
+
+	/*
+	 * Partial Fisher-Yates shuffle of the bucket vector: the first `i'
+	 * buckets are the ones we already picked from.
+	 */
+
+	for (i = 0; i < idx->count && n < hcount; i++) {
+		uint j = i + random_value(idx->count - i - 1);
+		hcache_bucket_t *b = idx->buckets[j];
+
+		if (j != i) {
+			idx->buckets[j] = idx->buckets[i];
+			idx->buckets[j]->slot = j;
+			idx->buckets[i] = b;
+			b->slot = i;
+		}
+
+		b->cursor = random_value(b->count - 1);
+
+		/*
+		 * Cannot do a struct copy, the host atom may be shorter than
+		 * the structure when holding an IPv4 address.
+		 */
+
+		gnet_host_copy(&hosts[n++], b->hosts[b->cursor]);
+	}
+
+	/*
+	 * If we are still missing hosts, all the buckets were visited and we
+	 * can go round again, starting each bucket from where we picked.
+	 */
+
+	for (pass = 1; n < hcount; pass++) {
+		bool picked = FALSE;
+
+		for (i = 0; i < idx->count && n < hcount; i++) {
+			hcache_bucket_t *b = idx->buckets[i];
+			uint k;
+
+			if (pass >= b->count)
+				continue;
+
+			k = (b->cursor + pass) % b->count;
+			gnet_host_copy(&hosts[n++], b->hosts[k]);
+			picked = TRUE;
+		}
+
+		if (!picked)
+			break;
+	}
+
+	return n;
+}
+
 /**
  * @return TRUE if the host is in one of the "bad hosts" caches.
  */
@@ -535,6 +788,20 @@ hcache_move_entries(hostcache_t *to, hostcache_t *from)
     to->hostlist = from->hostlist;
     from->hostlist = hash_list_new(NULL, NULL);
 
+	/*
+	 * The target index is empty, swapping them keeps all the hosts at the
+	 * same place within their bucket.
+	 */
+
+	{
+		struct hcache_index tmp = to->index;
+
+		g_assert(0 == tmp.count);
+
+		to->index = from->index;
+		from->index = tmp;
+	}
+
     /*
      * Make sure that after switching hce->list points to the new
      * list HL_CAUGHT
@@ -614,6 +881,7 @@ hcache_unlink_host(hostcache_t *hc, gnet_host_t *host)
 		gnet_prop_decr_guint32(hc->hosts_in_catcher);
 
 	hc->dirty = TRUE;
+	hcache_index_remove(hc, host, hcache_get_metadata(hc->class, host));
 	hcache_ht_remove(hc->class, host);
 	atom_host_free(host);
 
@@ -975,12 +1243,14 @@ hcache_add_internal(hcache_type_t type, time_t added,
 
 		orig_key = hash_list_remove(caches[hce->type]->hostlist, host);
 		g_assert(orig_key);
+		hcache_index_remove(caches[hce->type], host, hce);
 
 		if (caches[hce->type]->mass_update == 0) {
 			gnet_prop_decr_guint32(caches[hce->type]->hosts_in_catcher);
 		}
 
 		hash_list_prepend(hc->hostlist, host);
+		hcache_index_add(hc, host, hce);
 		caches[hce->type]->dirty = hc->dirty = TRUE;
 
 		hce->type = type;
@@ -1019,7 +1289,7 @@ hcache_add_internal(hcache_type_t type, time_t added,
 		host_atom = atom_host_get(&packed);
 	}
 
-	hcache_ht_add(type, host_atom);
+	hce = hcache_ht_add(type, host_atom);
 
 	/*
 	 * We prepend to the list instead of appending because the day
@@ -1031,6 +1301,7 @@ hcache_add_internal(hcache_type_t type, time_t added,
 	 */
 
 	hash_list_prepend(hc->hostlist, host_atom);
+	hcache_index_add(hc, deconstify_pointer(host_atom), hce);
 
     hc->misses++;
 	hc->dirty = TRUE;
@@ -1497,9 +1768,6 @@ hcache_fill_caught_array(host_net_t net, host_type_t type,
 	int i;
 	hostcache_t *hc = NULL;
 	hostcache_t *hc2 = NULL;
-	hset_t *seen_host =
-		hset_create_any(gnet_host_hash, gnet_host_hash2, gnet_host_equal);
-	hash_list_iter_t *iter;
 
     switch (type) {
     case HOST_ANY:
@@ -1579,62 +1847,24 @@ hcache_fill_caught_array(host_net_t net, host_type_t type,
 
 	/*
 	 * We first try to fill IPv6 addresses, or IPv4 if they only want that.
+	 *
+	 * Hosts are sampled across distinct networks so that we do not hand out
+	 * a whole batch of addresses belonging to the same operator.  Since
+	 * both caches belong to the same class, a host can only be present in
+	 * one of them and there cannot be any duplicate in the vector.
 	 */
 
-	iter = hash_list_iterator(hc->hostlist);
-	for (i = 0; i < hcount; i++) {
-		gnet_host_t *h;
-
-		h = hash_list_iter_next(iter);
-		if (NULL == h)
-			break;
-
-		if (hset_contains(seen_host, h))
-			continue;
+	g_assert(NULL == hc2 || hc->class == hc2->class);
 
-		/*
-		 * Cannot do a struct copy, the host atom may be shorter than
-		 * the structure when holding an IPv4 address.
-		 */
-
-		gnet_host_copy(&hosts[i], h);
-
-		hset_insert(seen_host, &hosts[i]);
-	}
-	hash_list_iter_release(&iter);
+	i = hcache_sample(hc, hosts, hcount);
 
 	/*
-	 * If we have an alternate cache and if we're missing entries, iterate
-	 * once again to fill up the vector.
+	 * If we have an alternate cache and if we're missing entries, sample
+	 * it as well to fill up the vector.
 	 */
 
-	if (NULL == hc2 || i == hcount)
-		goto done;
-
-	iter = hash_list_iterator(hc2->hostlist);
-	for (/* empty */; i < hcount; i++) {
-		gnet_host_t *h;
-
-		h = hash_list_iter_next(iter);
-		if (NULL == h)
-			break;
-
-		if (hset_contains(seen_host, h))
-			continue;
-
-		/*
-		 * Cannot do a struct copy, the host atom may be shorter than
-		 * the structure when holding an IPv4 address.
-		 */
-
-		gnet_host_copy(&hosts[i], h);
-
-		hset_insert(seen_host, &hosts[i]);
-	}
-	hash_list_iter_release(&iter);
-
-done:
-	hset_free_null(&seen_host);	/* Keys point into vector */
+	if (hc2 != NULL && i < hcount)
+		i += hcache_sample(hc2, &hosts[i], hcount - i);
 
 	return i;				/* Amount of hosts we filled */
 }
@@ -1648,9 +1878,9 @@ done:
 bool
 hcache_find_nearby(host_type_t type, host_addr_t *addr, uint16 *port)
 {
-	gnet_host_t *h;
+	gnet_host_t *h = NULL;
 	hostcache_t *hc = NULL;
-	hash_list_iter_t *iter;
+	uint i;
 
     switch (type) {
     case HOST_ANY:
@@ -1678,17 +1908,29 @@ hcache_find_nearby(host_type_t type, host_addr_t *addr, uint16 *port)
 	if (!hc)
         g_error("%s: unknown host type: %d", G_STRFUNC, type);
 
-	/* iterate through whole list */
+	/*
+	 * Only look at the hosts from networks that intersect our local ones.
+	 */
 
-	iter = hash_list_iterator(hc->hostlist);
-	while (NULL != (h = hash_list_iter_next(iter))) {
-		if (host_is_nearby(gnet_host_get_addr(h))) {
-            *addr = gnet_host_get_addr(h);
-            *port = gnet_host_get_port(h);
-			break;
+	for (i = 0; i < hc->index.count && NULL == h; i++) {
+		const hcache_bucket_t *b = hc->index.buckets[i];
+		uint bits, j;
+
+		bits = NET_TYPE_IPV4 == b->prefix >> 56 ?
+			HCACHE_PREFIX4_BITS : HCACHE_PREFIX6_BITS;
+
+		if (!host_network_is_nearby(hcache_bucket_network(b), bits))
+			continue;
+
+		for (j = 0; j < b->count; j++) {
+			if (host_is_nearby(gnet_host_get_addr(b->hosts[j]))) {
+				h = b->hosts[j];
+				*addr = gnet_host_get_addr(h);
+				*port = gnet_host_get_port(h);
+				break;
+			}
 		}
 	}
-	hash_list_iter_release(&iter);
 
 	if (h) {
 		hcache_unlink_host(hc, h);
@@ -1844,6 +2086,8 @@ hcache_alloc(hcache_type_t type, gnet_property_t catcher, const char *name)
 
 	WALLOC0(hc);
 	hc->hostlist = hash_list_new(NULL, NULL);
+	hc->index.by_prefix = hikset_create(
+		offsetof(hcache_bucket_t, prefix), HASH_KEY_FIXED, sizeof(uint64));
 	hc->name = name;
 	hc->type = type;
 	hc->class = hcache_class(type);
@@ -1863,24 +2107,64 @@ hcache_free_null(hostcache_t **hc_ptr)
 
     g_assert(hc != NULL);
     g_assert(hash_list_length(hc->hostlist) == 0);
+	g_assert(0 == hc->index.count);
 
 	hash_list_free(&hc->hostlist);
+	hikset_free_null(&hc->index.by_prefix);
+	HFREE_NULL(hc->index.buckets);
 	WFREE(hc);
 	*hc_ptr = NULL;
 }
 
+/*
+ * Host caches are persisted in binary form, starting with a magic string
+ * and a version byte, followed by one record per host:
+ *
+ *   net type (1 byte): NET_TYPE_IPV4 or NET_TYPE_IPV6
+ *   address (4 or 16 bytes, network order)
+ *   port (2 bytes, big-endian)
+ *   time added (4 bytes, big-endian, seconds since the Epoch)
+ *
+ * The leading NUL of the magic string cannot start a line of the older text
+ * format, which we can therefore still load.
+ */
+static const char HCACHE_FILE_MAGIC[] = "\0gtkg-hcache";
+#define HCACHE_FILE_MAGIC_LEN	(sizeof HCACHE_FILE_MAGIC - 1)
+#define HCACHE_FILE_VERSION		1
+
 /**
- * Parse and load the hostcache file.
+ * Add host loaded from the on-disk cache.
+ *
+ * @return TRUE if there is still room in the cache for more hosts.
+ */
+static bool
+hcache_load_host(hostcache_t *hc, time_t now, time_t added,
+	const host_addr_t addr, uint16 port)
+{
+	/* NOTE: hcache_expire_cache() stops on the first item which has
+	 *		 not yet expired.
+	 */
+	if (
+		(time_t)-1 == added ||
+		delta_time(now, added) < 0 ||
+		delta_time(now, added) > HOSTCACHE_EXPIRY
+	) {
+		added = now - HOSTCACHE_EXPIRY;
+	}
+
+	hcache_add_internal(hc->type, added, addr, port, "on-disk cache");
+	return hcache_slots_left(hc->type) >= 1;
+}
+
+/**
+ * Parse and load the hostcache file, in the legacy text format.
  */
 static void G_COLD
-hcache_load_file(hostcache_t *hc, FILE *f)
+hcache_load_text(hostcache_t *hc, FILE *f)
 {
 	char buffer[1024];
 	time_t now;
 
-	g_return_if_fail(hc);
-	g_return_if_fail(f);
-
 	now = tm_time();
 	while (fgets(ARYLEN(buffer), f)) {
 		const char *endptr;
@@ -1894,27 +2178,84 @@ hcache_load_file(hostcache_t *hc, FILE *f)
 		endptr = skip_ascii_spaces(endptr);
 		added = date2time(endptr, now);
 
-		/* NOTE: hcache_expire_cache() stops on the first item which has
-		 *		 not yet expired.
-		 */
-		if (
-			(time_t)-1 == added ||
-			delta_time(now, added) < 0 ||
-			delta_time(now, added) > HOSTCACHE_EXPIRY
-		) {
-			added = now - HOSTCACHE_EXPIRY;
+		if (!hcache_load_host(hc, now, added, addr, port))
+			break;
+	}
+}
+
+/**
+ * Load the hostcache records, in binary format, past the magic string.
+ */
+static void G_COLD
+hcache_load_binary(hostcache_t *hc, FILE *f, const char *filename)
+{
+	time_t now;
+	int c;
+
+	if (HCACHE_FILE_VERSION != (c = getc(f))) {
+		g_warning("%s(): unknown version %d in \"%s\", ignoring file",
+			G_STRFUNC, c, filename);
+		return;
+	}
+
+	now = tm_time();
+	while (EOF != (c = getc(f))) {
+		uint8 buf[16 + 2 + 4];
+		host_addr_t addr;
+		size_t len;
+
+		switch (c) {
+		case NET_TYPE_IPV4:	len = 4;	break;
+		case NET_TYPE_IPV6:	len = 16;	break;
+		default:
+			g_warning("%s(): corrupted \"%s\" after %u hosts",
+				G_STRFUNC, filename, hash_list_length(hc->hostlist));
+			return;
+		}
+
+		if (1 != fread(buf, len + 6, 1, f)) {
+			g_warning("%s(): truncated \"%s\" after %u hosts",
+				G_STRFUNC, filename, hash_list_length(hc->hostlist));
+			return;
 		}
 
-		hcache_add_internal(hc->type, added, addr, port, "on-disk cache");
-		if (hcache_slots_left(hc->type) < 1)
+		addr = 4 == len ?
+			host_addr_get_ipv4(peek_be32(buf)) : host_addr_peek_ipv6(buf);
+
+		if (
+			!hcache_load_host(hc, now,
+				(time_t) peek_be32(&buf[len + 2]), addr, peek_be16(&buf[len]))
+		)
 			break;
 	}
+}
+
+/**
+ * Parse and load the hostcache file.
+ */
+static void G_COLD
+hcache_load_file(hostcache_t *hc, FILE *f, const char *filename)
+{
+	char magic[HCACHE_FILE_MAGIC_LEN];
+
+	g_return_if_fail(hc);
+	g_return_if_fail(f);
+
+	if (
+		1 == fread(magic, sizeof magic, 1, f) &&
+		0 == memcmp(magic, HCACHE_FILE_MAGIC, sizeof magic)
+	) {
+		hcache_load_binary(hc, f, filename);
+	} else {
+		rewind(f);
+		hcache_load_text(hc, f);
+	}
 
 	hcache_sort_by_added_time(hc->type);	/* Ensure cache sorted */
 }
 
 /**
- * Loads caught hosts from text file.
+ * Loads caught hosts from file.
  */
 static void
 hcache_retrieve(hostcache_t *hc, const char *filename)
@@ -1925,7 +2266,7 @@ hcache_retrieve(hostcache_t *hc, const char *filename)
 	file_path_set(fp, settings_config_dir(), filename);
 	f = file_config_open_read(hc->name, fp, N_ITEMS(fp));
 	if (f) {
-		hcache_load_file(hc, f);
+		hcache_load_file(hc, f, filename);
 		fclose(f);
 	}
 }
@@ -1942,13 +2283,36 @@ hcache_write(FILE *f, hostcache_t *hc)
 	iter = hash_list_iterator(hc->hostlist);
 	while (NULL != (h = hash_list_iter_next(iter))) {
 		const hostcache_entry_t *hce;
+		uint8 buf[1 + 16 + 2 + 4];
+		host_addr_t addr;
+		size_t len;
 
 		hce = hcache_get_metadata(hc->class, h);
     	if (hce == NULL || hce == NO_METADATA)
 			continue;
 
-		fprintf(f, "%s %s\n",
-			gnet_host_to_string(h), timestamp_utc_to_string(hce->time_added));
+		addr = gnet_host_get_addr(h);
+
+		switch (host_addr_net(addr)) {
+		case NET_TYPE_IPV4:
+			poke_be32(&buf[1], host_addr_ipv4(addr));
+			len = 1 + 4;
+			break;
+		case NET_TYPE_IPV6:
+			memcpy(&buf[1], host_addr_ipv6(&addr), 16);
+			len = 1 + 16;
+			break;
+		default:
+			continue;
+		}
+
+		buf[0] = host_addr_net(addr);
+		poke_be16(&buf[len], gnet_host_get_port(h));
+		poke_be32(&buf[len + 2], (uint32) hce->time_added);
+		len += 2 + 4;
+
+		if (1 != fwrite(buf, len, 1, f))
+			break;
 	}
 	hash_list_iter_release(&iter);
 }
@@ -1974,6 +2338,9 @@ hcache_store(hcache_type_t type, const char *filename, hcache_type_t extra)
 	if (!f)
 		return;
 
+	fwrite(HCACHE_FILE_MAGIC, HCACHE_FILE_MAGIC_LEN, 1, f);
+	fputc(HCACHE_FILE_VERSION, f);
+
 	hcache_write(f, caches[type]);
 
 	if (extra != HCACHE_NONE)
@@ -570,6 +570,36 @@ host_is_nearby(const host_addr_t addr)
 	return FALSE;
 }
 
+/**
+ * Check whether a network intersects one of the local networks, so that
+ * callers indexing hosts by network prefix can skip whole networks at once.
+ *
+ * @param net		the network address
+ * @param bits		the length of the network prefix, in bits
+ *
+ * @returns true if some host in the network could be nearby.
+ */
+bool
+host_network_is_nearby(const host_addr_t net, uint bits)
+{
+	uint i;
+
+	if (host_addr_is_ipv4(net)) {
+		uint32 mask = 0 == bits ? 0 : (uint32) -1 << (32 - MIN(bits, 32));
+
+		for (i = 0; i < number_local_networks; i++) {
+			uint32 m_mask = local_networks[i].mask & mask;
+			uint32 m_ip = local_networks[i].net;
+
+			if ((host_addr_ipv4(net) & m_mask) == (m_ip & m_mask))
+				return TRUE;
+		}
+	} else if (host_addr_is_ipv6(net)) {
+		/* XXX: Implement this! (see host_is_nearby()) */
+	}
+	return FALSE;
+}
+
 /* -------------------------- */
 
 /**
@@ -47,6 +47,7 @@ void host_close(void);
 
 void parse_netmasks(const char *value);
 bool host_is_nearby(const host_addr_t addr);
+bool host_network_is_nearby(const host_addr_t net, uint bits);
 bool host_is_valid(const host_addr_t addr, uint16 port);
 bool host_address_is_usable(const host_addr_t addr);
 
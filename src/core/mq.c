@@ -167,6 +167,16 @@ mq_node(const mqueue_t *q)
 	return q->node;
 }
 
+/**
+ * @return the top of the TX stack, to which the queue writes.
+ */
+const txdrv_t *
+mq_tx_driver(const mqueue_t *q)
+{
+	mq_check_consistency(q);
+	return q->tx_drv;
+}
+
 /**
  * Would `additional' bytes of traffic cause the queue to enter flow-control?
  */
@@ -223,6 +223,7 @@ int mq_pending(const mqueue_t *q);
 int mq_tx_pending(const mqueue_t *q);
 struct bio_source *mq_bio(const mqueue_t *q);
 struct gnutella_node *mq_node(const mqueue_t *q) G_PURE;
+const struct txdriver *mq_tx_driver(const mqueue_t *q) G_PURE;
 
 /*
  * Public interface
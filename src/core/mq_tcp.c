@@ -45,6 +45,7 @@
 
 #include "lib/plist.h"
 #include "lib/pmsg.h"
+#include "lib/tm.h"
 #include "lib/walloc.h"
 
 #include "if/gnet_property_priv.h"
@@ -309,6 +310,7 @@ mq_tcp_putq(mqueue_t *q, pmsg_t *mb, const gnutella_node_t *from)
 	mq_check_consistency(q);
 
 	dump_tx_tcp_packet(from, q->node, mb);
+	pmsg_set_stamp(mb, tm_stamp_ms());		/* For queueing delay tracing */
 
 again:
 	mq_check_consistency(q);
@@ -200,6 +200,8 @@
 #define UDP_CRAWLER_FREQ		120		/**< once every 2 minutes */
 
 #define NODE_CONN_FAILED_FREQ	900		/**< once every 15 minutes */
+#define NODE_FAST_REJECT_FREQ	60		/**< Remember rejected IPs 1 minute */
+#define NODE_FAST_REJECT_REGEN	20		/**< Rebuild 503 reply every 20 secs */
 
 #define NODE_FW_CHECK			1200	/**< 20 minutes */
 #define NODE_IPP_NEIGHBOURS		8U		/**< # of neighbouring UPs to select */
@@ -270,6 +272,7 @@ static aging_table_t *tcp_crawls;
 static aging_table_t *udp_crawls;
 
 static aging_table_t *node_connect_failures;
+static aging_table_t *node_fast_rejects;
 
 typedef struct node_bad_client {
 	const char *vendor;
@@ -1804,6 +1807,13 @@ node_init(void)
 	node_connect_failures = aging_make(NODE_CONN_FAILED_FREQ,
 		gnet_host_hash, gnet_host_equal, gnet_host_free_atom2);
 
+	/*
+	 * Records incoming hosts we turned away because we were full.
+	 */
+
+	node_fast_rejects = aging_make(NODE_FAST_REJECT_FREQ,
+		host_addr_hash_func, host_addr_eq_func, wfree_host_addr);
+
 	/*
 	 * Known patterns for vendor messages and features.
 	 *
@@ -2182,6 +2192,9 @@ node_real_remove(gnutella_node_t *n)
 	if (n->outq)
 		mq_free(n->outq);
 
+	if (n->txtrace != NULL)
+		WFREE_NULL(n->txtrace, sizeof *n->txtrace);
+
 	if (n->alive_pings)			/* Must be freed after the TX stack */
 		alive_free(n->alive_pings);
 
@@ -3297,10 +3310,16 @@ node_host_is_connected(const host_addr_t addr, uint16 port)
  * Build header line to return connection pongs during handshake.
  * We stick to strict formatting rules: no line of more than 76 chars.
  *
+ * @param field		the header field name
+ * @param attrs		the NODE_A_* attributes of the remote node
+ * @param net		which network addresses to select
+ * @param htype		type of hosts to select
+ * @param num		maximum amount of hosts to include
+ *
  * @return a pointer to static data.
  */
 static const char *
-formatted_connection_pongs(const char *field, gnutella_node_t *n,
+format_connection_pongs(const char *field, uint32 attrs,
 	host_net_t net, host_type_t htype, int num)
 {
 	struct gnutella_host hosts[CONNECT_PONGS_COUNT];
@@ -3309,7 +3328,7 @@ formatted_connection_pongs(const char *field, gnutella_node_t *n,
 
 	g_assert(num >= 0 && num <= CONNECT_PONGS_COUNT);
 
-	if (0 == num || NULL == n)
+	if (0 == num)
 		return line;
 
 	hcount = hcache_fill_caught_array(net, htype, hosts, num);
@@ -3330,9 +3349,9 @@ formatted_connection_pongs(const char *field, gnutella_node_t *n,
 		for (i = 0, added = 0; i < hcount; i++) {
 			gnet_host_t *h = &hosts[i];
 			if (gnet_host_is_ipv4(h)) {
-				if (n != NULL && n->attrs & NODE_A_IPV6_ONLY)
+				if (attrs & NODE_A_IPV6_ONLY)
 					continue;
-			} else if (n != NULL && !(n->attrs & NODE_A_CAN_IPV6))
+			} else if (!(attrs & NODE_A_CAN_IPV6))
 				continue;
 			header_fmt_append_value(fmt, gnet_host_to_string(h));
 			added++;
@@ -3347,6 +3366,21 @@ formatted_connection_pongs(const char *field, gnutella_node_t *n,
 	return line;		/* Pointer to static data */
 }
 
+/**
+ * Build header line to return connection pongs to node during handshake.
+ *
+ * @return a pointer to static data.
+ */
+static const char *
+formatted_connection_pongs(const char *field, gnutella_node_t *n,
+	host_net_t net, host_type_t htype, int num)
+{
+	if (NULL == n)
+		return "";
+
+	return format_connection_pongs(field, n->attrs, net, htype, num);
+}
+
 /**
  * qsort() callback for sorting GTKG nodes at the front.
  */
@@ -3560,6 +3594,159 @@ cleanup:
 	return buf;
 }
 
+/*
+ * Fast rejection of incoming handshakes.
+ *
+ * When all our slots are taken, the hosts we turn away with a 503 tend to
+ * come back quickly.  Under connection floods, reading their handshake
+ * headers and formatting a tailored reply each time is wasted work, so
+ * these hosts are remembered for a while and get a pre-rendered 503 reply
+ * as soon as their first handshake line has been seen.
+ */
+
+static struct node_fast_reply {
+	char buf[2048];				/**< The pre-rendered 503 reply */
+	size_t len;					/**< Length of reply, 0 if never rendered */
+	time_t rendered;			/**< When reply was last rendered */
+} node_fast_reply;
+
+/**
+ * Record that we rejected an incoming connection from host because we
+ * were full.
+ */
+static void
+node_fast_reject_record(const host_addr_t addr)
+{
+	if G_UNLIKELY(NULL == node_fast_rejects)
+		return;
+
+	aging_record(node_fast_rejects, WCOPY(&addr));
+}
+
+/**
+ * Are all the slots for incoming Gnutella and G2 connections taken?
+ *
+ * This errs on the side of caution: when in doubt, the connection will go
+ * through the regular handshaking process.
+ */
+static bool
+node_slots_exhausted(void)
+{
+	uint connected;
+
+	if (
+		GNET_PROPERTY(enable_g2) &&
+		GNET_PROPERTY(node_g2_count) < GNET_PROPERTY(max_g2_hubs)
+	)
+		return FALSE;
+
+	connected = GNET_PROPERTY(node_normal_count)
+					+ GNET_PROPERTY(node_ultra_count);
+
+	switch ((node_peer_t) GNET_PROPERTY(current_peermode)) {
+	case NODE_P_ULTRA:
+		return
+			GNET_PROPERTY(node_leaf_count) >= GNET_PROPERTY(max_leaves) &&
+			connected >= GNET_PROPERTY(max_connections);
+	case NODE_P_NORMAL:
+		return connected >= GNET_PROPERTY(max_connections);
+	case NODE_P_LEAF:
+		return GNET_PROPERTY(node_ultra_count) >= GNET_PROPERTY(max_ultrapeers);
+	case NODE_P_AUTO:
+	case NODE_P_CRAWLER:
+	case NODE_P_UDP:
+	case NODE_P_DHT:
+	case NODE_P_G2HUB:
+	case NODE_P_UNKNOWN:
+		break;
+	}
+
+	return FALSE;
+}
+
+/**
+ * Render the 503 reply sent to fast-rejected hosts.
+ *
+ * Since we don't know anything about the remote host, only IPv4 hosts are
+ * listed in X-Try-Ultrapeers and the per-connection headers we normally
+ * send (Remote-IP, X-Token) are omitted.
+ */
+static void
+node_fast_reply_render(void)
+{
+	struct node_fast_reply *r = &node_fast_reply;
+	bool saturated = bsched_saturated(BSCHED_BWS_GOUT);
+
+	r->len = str_bprintf(ARYLEN(r->buf),
+		"GNUTELLA/0.6 503 Too many Gnet connections\r\n"
+		"User-Agent: %s\r\n"
+		"X-Ultrapeer: %s\r\n"
+		"%s"		/* X-Try-Ultrapeers */
+		"\r\n",
+		saturated ? version_short_string : version_string,
+		settings_is_leaf() ? "False" : "True",
+		format_connection_pongs("X-Try-Ultrapeers", 0,
+			HOST_NET_IPV4, HOST_ULTRA,
+			saturated ? CONNECT_PONGS_LOW : CONNECT_PONGS_COUNT)
+	);
+
+	g_assert(r->len < sizeof r->buf);
+
+	r->rendered = tm_time();
+	gnet_stats_inc_general(GNR_HANDSHAKE_FAST_REJECT_RENDERED);
+}
+
+/**
+ * Reject incoming connection without going through the handshake if we
+ * are full and the host was recently turned away already.
+ *
+ * @param s_ptr		the socket, nullified when the connection is rejected
+ *
+ * @return TRUE if the connection was rejected.
+ */
+static bool
+node_fast_reject(struct gnutella_socket **s_ptr)
+{
+	struct gnutella_socket *s = *s_ptr;
+	struct node_fast_reply *r = &node_fast_reply;
+	ssize_t sent;
+
+	socket_check(s);
+
+	if (
+		NULL == node_fast_rejects ||
+		!allow_gnet_connections ||
+		!node_slots_exhausted() ||
+		NULL == aging_lookup_revitalise(node_fast_rejects, &s->addr) ||
+		whitelist_check(s->addr) ||
+		(GNET_PROPERTY(use_netmasks) && host_is_nearby(s->addr))
+	)
+		return FALSE;
+
+	if (
+		0 == r->len ||
+		delta_time(tm_time(), r->rendered) >= NODE_FAST_REJECT_REGEN
+	)
+		node_fast_reply_render();
+
+	sent = bws_write(BSCHED_BWS_GOUT, &s->wio, r->buf, r->len);
+
+	if (GNET_PROPERTY(node_debug) > 1) {
+		if ((ssize_t) -1 == sent) {
+			g_debug("%s(): unable to send 503 to %s: %m",
+				G_STRFUNC, host_addr_to_string(s->addr));
+		} else {
+			g_debug("%s(): sent 503 to %s (%zd/%zu bytes)",
+				G_STRFUNC, host_addr_to_string(s->addr), sent, r->len);
+		}
+	}
+
+	gnet_stats_inc_general(GNR_HANDSHAKE_FAST_REJECTED);
+	socket_free_null(s_ptr);
+
+	return TRUE;
+}
+
 /**
  * Send error message to remote end, a node presumably.
  *
@@ -3701,6 +3888,14 @@ send_error(
 			code, host_addr_to_string(s->addr), (unsigned) rw);
 		dump_string(stderr, gnet_response, rw, "----");
 	}
+
+	/*
+	 * Remember incoming hosts we turn away because we are full, so that
+	 * we can reject them cheaply should they come back soon.
+	 */
+
+	if (503 == code && n != NULL && (n->flags & NODE_F_INCOMING))
+		node_fast_reject_record(n->addr);
 }
 
 /**
@@ -3901,10 +4096,22 @@ node_tx_deflate_flowc(void *o, size_t amount)
 		bio_add_allocated(mq_bio(n->outq), amount);
 }
 
+static void
+node_add_tx_delay(void *o, uint32 ms)
+{
+	gnutella_node_t *n = o;
+
+	node_check(n);
+
+	if (n->txtrace != NULL)
+		lhist_record(&n->txtrace->deflate_delay, ms);
+}
+
 static struct tx_deflate_cb node_tx_deflate_cb = {
 	node_add_tx_deflated,		/* add_tx_deflated */
 	node_tx_shutdown,			/* shutdown */
 	node_tx_deflate_flowc,		/* flow_control */
+	node_add_tx_delay,			/* add_tx_delay */
 };
 
 /***
@@ -3971,17 +4178,55 @@ node_add_txdrop(void *o, int x)
 	n->tx_dropped += x;
 }
 
+static void
+node_add_tx_short(void *o, bool capped)
+{
+	gnutella_node_t *n = o;
+
+	node_check(n);
+
+	if (n->txtrace != NULL) {
+		if (capped)
+			n->txtrace->link_capped++;
+		else
+			n->txtrace->link_blocked++;
+	}
+}
+
+static void
+node_add_tx_stall(void *o, uint32 ms)
+{
+	gnutella_node_t *n = o;
+
+	node_check(n);
+
+	if (n->txtrace != NULL)
+		lhist_record(&n->txtrace->link_stall, ms);
+}
+
 static struct tx_link_cb node_tx_link_cb = {
 	node_add_tx_written,		/* add_tx_written */
 	node_tx_eof_remove,			/* eof_remove */
 	node_tx_eof_shutdown,		/* eof_shutdown */
 	node_tx_unflushq,			/* unflushq */
+	node_add_tx_short,			/* add_tx_short */
+	node_add_tx_stall,			/* add_tx_stall */
 };
 
 /***
  *** TX datagram callbacks
  ***/
 
+/**
+ * Record the time spent by message in the message queue, if traced.
+ */
+static inline void
+node_trace_mq_delay(const gnutella_node_t *n, const pmsg_t *mb)
+{
+	if (n->txtrace != NULL && pmsg_stamp(mb) != 0)
+		lhist_record(&n->txtrace->mq_delay, tm_stamp_ms() - pmsg_stamp(mb));
+}
+
 /**
  * Invoked on each successfully sent messages to update message accounting
  * and node information.
@@ -3997,6 +4242,7 @@ node_msg_accounting(void *o, const pmsg_t *mb)
 	node_check(n);
 	g_assert(!NODE_TALKS_G2(n));
 
+	node_trace_mq_delay(n, mb);
 	node_add_tx_written(n, mb_size);
 	node_sent_accounting(n, function, mb_start, mb_size);
 }
@@ -4073,6 +4319,7 @@ node_g2_msg_accounting(void *o, const pmsg_t *mb)
 	node_check(n);
 	g_assert(NODE_TALKS_G2(n));
 
+	node_trace_mq_delay(n, mb);
 	node_add_tx_written(n, mb_size);
 	node_g2_sent_accounting(n, type, mb_size);
 }
@@ -4880,8 +5127,14 @@ node_net_stack_create(gnutella_node_t *n)
 
 	/*
 	 * Create the TX stack, as we're going to transmit messages.
+	 *
+	 * Latency tracing of the stack is always on, its cost being a few
+	 * timestamps and histogram updates per message.
 	 */
 
+	if (NULL == n->txtrace)
+		WALLOC0(n->txtrace);
+
 	{
 		struct tx_link_args args;
 
@@ -4912,6 +5165,14 @@ node_net_stack_create(gnutella_node_t *n)
 		args.buffer_size = NODE_TX_BUFSIZ;
 		args.buffer_flush = NODE_TX_FLUSH;
 
+		if (args.reduced) {
+			args.window_bits = GNET_PROPERTY(node_leaf_deflate_window_bits);
+			args.mem_level = GNET_PROPERTY(node_leaf_deflate_mem_level);
+		} else {
+			args.window_bits = GNET_PROPERTY(node_deflate_window_bits);
+			args.mem_level = GNET_PROPERTY(node_deflate_mem_level);
+		}
+
 		ctx = tx_make_above(tx, tx_deflate_get_ops(), &args);
 		if (ctx == NULL) {
 			tx_free(tx);
@@ -8781,6 +9042,14 @@ node_add_socket(struct gnutella_socket *s)
 {
 	socket_check(s);
 
+	/*
+	 * Under connection floods, avoid parsing the handshake of hosts we
+	 * already turned away recently when we are still full.
+	 */
+
+	if (node_fast_reject(&s))
+		return;
+
 	/*
 	 * For incoming connections, we don't know yet whether the node will
 	 * end-up connecting as a Gnutella node or as G2: this will be negotiated
@@ -11807,6 +12076,7 @@ node_close(void)
 	aging_destroy(&tcp_crawls);
 	aging_destroy(&udp_crawls);
 	aging_destroy(&node_connect_failures);
+	aging_destroy(&node_fast_rejects);
 	pproxy_set_free_null(&proxies);
 	rxbuf_close();
 	node_udp_scheduler_destroy_all();
@@ -12488,6 +12758,24 @@ node_gnet_addr(const gnutella_node_t *n)
 	return buf;
 }
 
+/**
+ * Compute memory used by the zlib streams of the node's network stacks.
+ *
+ * @param n		the node
+ * @param tx	where memory used by the TX compressor is written
+ * @param rx	where memory used by the RX decompressor is written
+ */
+void
+node_zlib_memory(const gnutella_node_t *n, size_t *tx, size_t *rx)
+{
+	node_check(n);
+	g_assert(tx != NULL);
+	g_assert(rx != NULL);
+
+	*tx = (NULL == n->outq) ? 0 : tx_deflate_memory(mq_tx_driver(n->outq));
+	*rx = (NULL == n->rx) ? 0 : rx_inflate_memory(n->rx);
+}
+
 /**
  * Generate node information string into supplied buffer.
  *
@@ -55,6 +55,7 @@
 #include "lib/header.h"
 #include "lib/hset.h"
 #include "lib/htable.h"
+#include "lib/lhist.h"
 #include "lib/sequence.h"
 
 struct guid;
@@ -85,6 +86,23 @@ struct node_rxfc_mon {
 	time_delta_t fc_accumulator;	/**< Time spent in FC this period */
 };
 
+/**
+ * @struct node_txtrace
+ *
+ * This structure traces where time is spent by the data we send through
+ * the TX stack, from the moment messages are enqueued in the message queue
+ * to the moment the link layer can write them to the kernel.
+ *
+ * All the delays are in milliseconds.
+ */
+struct node_txtrace {
+	lhist_t mq_delay;		/**< Time spent by messages in the queue */
+	lhist_t deflate_delay;	/**< Time data were held before compression flush */
+	lhist_t link_stall;		/**< Time link could not accept all the data */
+	uint64 link_capped;		/**< Short writes due to bandwidth scheduler */
+	uint64 link_blocked;	/**< Short writes due to kernel send buffer */
+};
+
 /**
  * @def MAX_CACHE_HOPS
  * defines the maximum hop count we handle for the ping/pong caching
@@ -182,6 +200,7 @@ typedef struct gnutella_node {
 	time_t connect_date;		/**< When we got connected (after handshake) */
 	time_t tx_flowc_date;		/**< When we entered in TX flow control */
 	struct node_rxfc_mon *rxfc;	/**< Optional, time spent in RX flow control */
+	struct node_txtrace *txtrace;	/**< TX stack latency tracing */
 	time_t shutdown_date;		/**< When we entered in shutdown mode */
 	time_t up_date;				/**< When remote server started (0 if unknown) */
 	time_t leaf_flowc_start;	/**< Time when leaf flow-controlled queries */
@@ -674,6 +693,7 @@ void node_current_peermode_changed(node_peer_t mode);
 const char *node_addr(const gnutella_node_t *n);
 const char *node_addr2(const gnutella_node_t *n);
 const char *node_gnet_addr(const gnutella_node_t *n);
+void node_zlib_memory(const gnutella_node_t *n, size_t *tx, size_t *rx);
 size_t node_infostr_to_buf(const gnutella_node_t *n, char *dst, size_t size);
 const char *node_infostr(const gnutella_node_t *n);
 size_t node_id_infostr_to_buf(const struct nid *id, char *dst, size_t size);
@@ -906,25 +906,46 @@ void
 oob_got_results(gnutella_node_t *n, pslist_t *files,
 	int count, host_addr_t addr, uint16 port,
 	bool secure, bool reliable, unsigned flags)
+{
+	oob_got_query_results(gnutella_header_get_muid(&n->header),
+		files, count, addr, port, secure, reliable, flags);
+}
+
+/**
+ * Same as oob_got_results() but for a query identified by its MUID only,
+ * which is what we are left with when the query was matched by one of the
+ * query matching threads, after the query message was processed.
+ *
+ * @param muid			the MUID of the query
+ * @param files			the list of shared_file_t entries that make up results
+ * @param count			the amount of results
+ * @param addr			address where we must send the OOB result indication
+ * @param port			port where we must send the OOB result indication
+ * @param secure		whether secure OOB was requested
+ * @param reliable		whether reliable UDP should be used
+ * @param flags			a combination of QHIT_F_* flags
+ */
+void
+oob_got_query_results(const guid_t *muid, pslist_t *files,
+	int count, host_addr_t addr, uint16 port,
+	bool secure, bool reliable, unsigned flags)
 {
 	struct oob_results *r;
 	gnet_host_t to;
-	const guid_t *muid;
 
 	g_assert(count > 0);
 	g_assert(files != NULL);
+	g_assert(muid != NULL);
 
 	gnet_host_set(&to, addr, port);
-	muid = gnutella_header_get_muid(&n->header);
 	r = results_make(muid, files, count, &to, secure, reliable, flags);
 	if (r != NULL) {
 		if (!oob_send_reply_ind(r))
 			results_free_remove(r);
 	} else {
-		g_warning("%s(): ignoring duplicate %s%sOOB query %s from %s via %s",
+		g_warning("%s(): ignoring duplicate %s%sOOB query %s from %s",
 			G_STRFUNC, secure ? "secure " : "", reliable ? "reliable " : "",
-			guid_to_string(muid),
-			gnet_host_to_string(&to), node_infostr(n));
+			guid_to_string(muid), gnet_host_to_string(&to));
 
 		shared_file_slist_free_null(&files);
 	}
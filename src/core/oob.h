@@ -54,6 +54,9 @@ void oob_close(void);
 void oob_got_results(struct gnutella_node *n, struct pslist *files,
 		int count, host_addr_t addr, uint16 port,
 		bool secure_oob, bool reliable_udp, unsigned flags);
+void oob_got_query_results(const struct guid *muid, struct pslist *files,
+		int count, host_addr_t addr, uint16 port,
+		bool secure_oob, bool reliable_udp, unsigned flags);
 void oob_deliver_hits(struct gnutella_node *n, const struct guid *muid,
 		uint8 wanted, const struct array *token);
 
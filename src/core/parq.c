@@ -74,6 +74,7 @@
 #include "lib/hikset.h"
 #include "lib/hstrfn.h"
 #include "lib/htable.h"
+#include "lib/ostree.h"
 #include "lib/parse.h"
 #include "lib/plist.h"
 #include "lib/pslist.h"
@@ -177,12 +178,12 @@ enum parq_ul_queue_magic {
  */
 struct parq_ul_queue {
 	enum parq_ul_queue_magic magic;
-	plist_t *by_position;		/**< Queued items sorted on position. Newest is
+	ostree_t by_position;		/**< Queued items sorted on arrival, marked
+								 when competing for a slot. Newest is
 								 added to the end. */
-	hash_list_t *by_rel_pos;	/**< Queued items sorted by relative position */
 	hash_list_t *by_date_dead;	/**< Dead items sorted on last update */
 	statx_t *slot_stats;		/**< Slot kept-time statistics */
-	int by_position_length;	/**< Number of items in "by_position" */
+	uint64 arrivals;		/**< Arrival stamp of last queued item */
 
 	int num;				/**< Queue number */
 	int active_uploads;
@@ -203,6 +204,28 @@ parq_ul_queue_check(const struct parq_ul_queue * const q)
 	g_assert(PARQ_UL_QUEUE_MAGIC == q->magic);
 }
 
+/**
+ * @return amount of items in the queue, dead or alive.
+ */
+static inline int
+parq_ul_queue_length(const struct parq_ul_queue *q)
+{
+	return ostree_count(&q->by_position);
+}
+
+/*
+ * Iterate over all the items in the queue, in order of arrival, or only
+ * over the ones competing for an upload slot (alive, not frozen and not
+ * holding a regular slot), which make up the relative positions.
+ */
+#define PARQ_UL_FOREACH(q, puq)								\
+	for ((puq) = ostree_head(&(q)->by_position); (puq) != NULL;	\
+		(puq) = ostree_next(&(q)->by_position, (puq)))
+
+#define PARQ_UL_FOREACH_RELATIVE(q, puq)							\
+	for ((puq) = ostree_head_marked(&(q)->by_position); (puq) != NULL;	\
+		(puq) = ostree_next_marked(&(q)->by_position, (puq)))
+
 struct parq_ul_queued_by_addr {
 	int	uploading;		/**< Number of uploads uploading */
 	int	total;			/**< Total queued items for this ip */
@@ -226,9 +249,8 @@ enum parq_ul_magic {
 struct parq_ul_queued {
 	enum parq_ul_magic magic;			/**< Magic number */
 	uint32 flags;			/**< Operating flags */
-	uint position;			/**< Current position in the queue */
-	uint relative_position; /**< Relative position in the queue, if 'not alive'
-								  uploads are taken into account */
+	uint64 arrival;			/**< Arrival stamp, sorting key in the queue */
+	osnode_t pos_node;		/**< Embedded node in the "by_position" tree */
 	uint eta;				/**< Expected time in seconds till an upload slot is
 							     reached, this is a relative timestamp */
 
@@ -287,6 +309,39 @@ parq_ul_queued_check(const struct parq_ul_queued * const puq)
 	g_assert(PARQ_UL_MAGIC == puq->magic);
 }
 
+/**
+ * @return current position in the queue.
+ */
+static inline uint
+parq_ul_position(const struct parq_ul_queued *puq)
+{
+	return ostree_rank(&puq->queue->by_position, puq);
+}
+
+/**
+ * @return whether item is listed in the relative positions.
+ */
+static inline bool
+parq_ul_is_relative(const struct parq_ul_queued *puq)
+{
+	return ostree_is_marked(&puq->queue->by_position, puq);
+}
+
+/**
+ * @return relative position in the queue, i.e. among the items competing
+ * for an upload slot.  Items not competing (frozen or dead) get the position
+ * they would have if they were competing again, and items holding a regular
+ * slot get 0.
+ */
+static inline uint
+parq_ul_relative_position(const struct parq_ul_queued *puq)
+{
+	if (puq->has_slot && !parq_ul_is_relative(puq))
+		return 0;		/* Has regular slot */
+
+	return 1 + ostree_marked_before(&puq->queue->by_position, puq);
+}
+
 /*
  * Flags for parq_ul_queued.
  */
@@ -1433,7 +1488,8 @@ parq_upload_update_eta(struct parq_ul_queue *which_ul_queue)
 	uint eta = 0;
 	uint avg_bps;
 	time_delta_t running_time = delta_time(tm_time(), parq_start);
-	hash_list_iter_t *iter;
+	struct parq_ul_queued *puq;
+	uint rel = 0;
 
 	avg_bps = bsched_avg_bps(BSCHED_BWS_OUT);
 	avg_bps = MAX(1024, avg_bps);		/* Assume at least 1 KiB/s */
@@ -1446,9 +1502,7 @@ parq_upload_update_eta(struct parq_ul_queue *which_ul_queue)
 		 * Locate the first active upload in this queue.
 		 */
 
-		PLIST_FOREACH(which_ul_queue->by_position, l) {
-			struct parq_ul_queued *puq = l->data;
-
+		PARQ_UL_FOREACH(which_ul_queue, puq) {
 			parq_ul_queued_check(puq);
 
 			if (puq->has_slot) {		/* Recompute ETA */
@@ -1480,15 +1534,12 @@ parq_upload_update_eta(struct parq_ul_queue *which_ul_queue)
 			g_warning("[PARQ UL] Was unable to calculate an accurate ETA");
 	}
 
-	iter = hash_list_iterator(which_ul_queue->by_rel_pos);
-
-	while (hash_list_iter_has_next(iter)) {
-		struct parq_ul_queued *puq = hash_list_iter_next(iter);
-
+	PARQ_UL_FOREACH_RELATIVE(which_ul_queue, puq) {
 		parq_ul_queued_check(puq);
 		g_assert(puq->is_alive);
 
 		puq->eta = eta;
+		rel++;
 
 		if (puq->has_slot)
 			continue;			/* Skip already uploading uploads */
@@ -1502,9 +1553,9 @@ parq_upload_update_eta(struct parq_ul_queue *which_ul_queue)
 		 * rate from all the queues.
 		 */
 
-		if (puq->relative_position > GNET_PROPERTY(max_uploads)) {
+		if (rel > GNET_PROPERTY(max_uploads)) {
 			time_delta_t per_slot = running_time / MAX(1, parq_slots_removed);
-			uint cheap_eta = puq->relative_position * per_slot;
+			uint cheap_eta = rel * per_slot;
 
 			if (cheap_eta < eta)
 				puq->eta = cheap_eta;
@@ -1512,60 +1563,21 @@ parq_upload_update_eta(struct parq_ul_queue *which_ul_queue)
 
 		eta += parq_estimated_slot_time(puq);
 	}
-
-	hash_list_iter_release(&iter);
-}
-
-/**
- * Decreases the position of all queued items after the given queued item.
- */
-static void
-parq_upload_decrease_all_after(struct parq_ul_queued *puq)
-{
-	plist_t *l;
-	int pos_cnt = 0;	/* Used for assertion */
-
-	parq_ul_queued_check(puq);
-	parq_ul_queue_check(puq->queue);
-	g_assert(puq->queue->by_position != NULL);
-	g_assert(puq->queue->by_position_length > 0);
-
-	l = plist_find(puq->queue->by_position, puq);
-	pos_cnt = ((struct parq_ul_queued *) l->data)->position;
-
-	l = plist_next(l);	/* Decrease _after_ current parq */
-
-	/*
-	 * Cycle through list and decrease all positions by one. Position should
-	 * never reach 0 which would mean the queued item is currently uploading
-	 */
-	for (;	l; l = plist_next(l)) {
-		struct parq_ul_queued *p = l->data;
-
-		parq_ul_queued_check(p);
-
-		g_assert(p != NULL);
-		g_assert(p->position > 1);
-		g_assert(p->position - 1 == UNSIGNED(pos_cnt));
-
-		p->position--;
-		pos_cnt++;
-	}
 }
 
 /**
- * Function used to keep the relative position list sorted by absolute
- * queue positions, which refer to the order of arrival in the queue.
+ * Function used to keep the queue sorted by absolute queue positions,
+ * which refer to the order of arrival in the queue.
  */
 static int
-parq_ul_rel_pos_cmp(const void *a, const void *b)
+parq_ul_arrival_cmp(const void *a, const void *b)
 {
 	const struct parq_ul_queued *as = a, *bs = b;
 
 	parq_ul_queued_check(as);
 	parq_ul_queued_check(bs);
 
-	return CMP(as->position, bs->position);
+	return CMP(as->arrival, bs->arrival);
 }
 
 /**
@@ -1578,8 +1590,7 @@ parq_upload_insert_relative(struct parq_ul_queued *puq)
 
 	g_assert(!(puq->flags & PARQ_UL_FROZEN));
 
-	puq->relative_position = 0;
-	hash_list_insert_sorted(puq->queue->by_rel_pos, puq, parq_ul_rel_pos_cmp);
+	ostree_mark(&puq->queue->by_position, puq, TRUE);
 }
 
 /**
@@ -1591,79 +1602,10 @@ parq_upload_remove_relative(struct parq_ul_queued *puq)
 	parq_ul_queued_check(puq);
 	parq_ul_queue_check(puq->queue);
 
-	hash_list_remove(puq->queue->by_rel_pos, puq);
+	ostree_mark(&puq->queue->by_position, puq, FALSE);
 	parq_slots_removed++;
 }
 
-/**
- * Recomputes all absolute positions of given queue.
- *
- * @param q		the queue for which we wish to recompute position
- */
-static void
-parq_upload_recompute_positions(struct parq_ul_queue *q)
-{
-	uint pos = 0;
-	uint prev_pos = 0;
-	plist_t *l;
-
-	parq_ul_queue_check(q);
-
-	PLIST_FOREACH(q->by_position, l) {
-		struct parq_ul_queued *puq = l->data;
-
-		parq_ul_queued_check(puq);
-		g_assert(puq->queue == q);
-		g_assert_log(puq->position > prev_pos,	/* Was sorted by construction */
-			"pos=%u,, prev=%u", puq->position, prev_pos);
-
-		prev_pos = puq->position;
-		puq->position = ++pos;
-	}
-
-	g_assert(pos <= UNSIGNED(q->by_position_length));
-}
-
-/**
- * Recomputes all relative positions of given queue.
- *
- * @param q		the queue for which we wish to recompute position
- */
-static void
-parq_upload_recompute_relative_positions(struct parq_ul_queue *q)
-{
-	uint rel = 0;
-	uint prev_rel = 0;
-	uint prev_pos = 0;
-	hash_list_iter_t *iter;
-
-	parq_ul_queue_check(q);
-
-	iter = hash_list_iterator(q->by_rel_pos);
-
-	while (hash_list_iter_has_next(iter)) {
-		struct parq_ul_queued *puq = hash_list_iter_next(iter);
-
-		parq_ul_queued_check(puq);
-		g_assert(puq->queue == q);
-		g_assert_log(
-			0 == puq->relative_position || puq->relative_position > prev_rel,
-			"rel=%u, prev=%u", puq->relative_position, prev_rel);
-		g_assert_log(puq->position > prev_pos,			/* Was sorted */
-			"pos=%u, prev=%u", puq->position, prev_pos);
-
-		if (puq->relative_position != 0)
-			prev_rel = puq->relative_position;
-		prev_pos = puq->position;
-		puq->relative_position = ++rel;
-	}
-
-	hash_list_iter_release(&iter);
-
-	g_assert(rel <= UNSIGNED(q->by_position_length));
-	g_assert(hash_list_length(q->by_rel_pos) == rel);
-}
-
 /**
  * Set frozen flag on upload entry.
  */
@@ -1708,8 +1650,7 @@ parq_upload_free(struct parq_ul_queued *puq)
 	parq_ul_queued_check(puq);
 	parq_ul_queue_check(puq->queue);
 	g_assert(puq->addr_and_name != NULL);
-	g_assert(puq->queue->by_position_length > 0);
-	g_assert(puq->queue->by_position != NULL);
+	g_assert(parq_ul_queue_length(puq->queue) > 0);
 	g_assert(puq->by_addr != NULL);
 	g_assert(puq->by_addr->total > 0);
 	g_assert(puq->by_addr->uploading <= puq->by_addr->total);
@@ -1720,8 +1661,6 @@ parq_upload_free(struct parq_ul_queued *puq)
 		puq->u->parq_ul = NULL;
 	}
 
-	parq_upload_decrease_all_after(puq);
-
 	if (puq->flags & PARQ_UL_QUEUE)
 		hash_list_remove(ul_parq_queue, puq);
 
@@ -1752,35 +1691,29 @@ parq_upload_free(struct parq_ul_queued *puq)
 		hash_list_remove(puq->queue->by_date_dead, puq);
 	}
 
-	/* Remove the current queued item from all lists */
-	puq->queue->by_position = plist_remove(puq->queue->by_position, puq);
-
+	/*
+	 * Remove the current queued item from all lists.
+	 *
+	 * The positions of all the items following it are implicitly shifted
+	 * since they are derived from the queue tree.
+	 */
 	parq_upload_remove_relative(puq);
+	ostree_remove(&puq->queue->by_position, puq);
 
 	hikset_remove(ul_all_parq_by_addr_and_name, puq->addr_and_name);
 	htable_remove(ul_all_parq_by_id, &puq->id);
 
 	g_assert(!hash_list_contains(puq->queue->by_date_dead, puq));
-	g_assert(!hash_list_contains(puq->queue->by_rel_pos, puq));
 
 	/*
-	 * Queued upload is now removed from all lists. So queue size can be
-	 * safely decreased and new ETAs can be calculated.
-	 */
-	g_assert(puq->queue->by_position_length > 0);
-	puq->queue->by_position_length--;
-
-	/*
-	 * Don't update ETA on shutdown, we don't need this information, so speed
-	 * up the shutdown process. Also it is better not doing so as on shutdown
-	 * not all entries are removed the 'correct' way, we just want to free
-	 * the memory
+	 * The ETA of all the items behind depends on the current bandwidth and
+	 * on the slot time of all the items before them, so it cannot be derived
+	 * from the tree: flag the queue for an update at the next timer tick.
+	 *
+	 * Don't bother on shutdown, we don't need this information.
 	 */
-	if (!parq_shutdown) {
-		parq_upload_recompute_positions(puq->queue);
-		parq_upload_recompute_relative_positions(puq->queue);
-		parq_upload_update_eta(puq->queue);
-	}
+	if (!parq_shutdown)
+		puq->queue->recompute = TRUE;	/* Defer ETA update */
 
 	/* Free the memory used by the current queued item */
 	HFREE_NULL(puq->addr_and_name);
@@ -1808,7 +1741,7 @@ parq_ul_calc_retry(struct parq_ul_queued *puq)
 	parq_ul_queue_check(puq->queue);
 
 	result = PARQ_TIMER_BY_POS +
-		(puq->relative_position - 1) * (PARQ_TIMER_BY_POS / 2);
+		(parq_ul_relative_position(puq) - 1) * (PARQ_TIMER_BY_POS / 2);
 
 	if (GNET_PROPERTY(parq_optimistic)) {
 		struct parq_ul_queued *puq_prev = NULL;
@@ -1817,7 +1750,8 @@ parq_ul_calc_retry(struct parq_ul_queued *puq)
 		avg_bps = bsched_avg_bps(BSCHED_BWS_OUT);
 		avg_bps = MAX(1, avg_bps);
 
-		puq_prev = hash_list_previous(puq->queue->by_rel_pos, puq);
+		if (parq_ul_is_relative(puq))
+			puq_prev = ostree_prev_marked(&puq->queue->by_position, puq);
 
 		if (puq_prev != NULL)
 			parq_ul_queued_check(puq_prev);
@@ -1851,7 +1785,8 @@ parq_upload_new_queue(void)
 	queue->magic = PARQ_UL_QUEUE_MAGIC;
 	queue->active = TRUE;
 	queue->slot_stats = statx_make();
-	queue->by_rel_pos = hash_list_new(NULL, NULL);
+	ostree_init(&queue->by_position, parq_ul_arrival_cmp,
+		offsetof(struct parq_ul_queued, pos_node));
 	queue->by_date_dead = hash_list_new(NULL, NULL);
 
 	ul_parqs = plist_append(ul_parqs, queue);
@@ -1954,7 +1889,6 @@ parq_upload_create(struct upload *u)
 	struct parq_ul_queued *prev_puq = NULL;
 	struct parq_ul_queue *q = NULL;
 	uint eta = 0;
-	uint rel_pos = 1;
 
 	upload_check(u);
 	g_assert(ul_all_parq_by_addr_and_name != NULL);
@@ -1964,14 +1898,12 @@ parq_upload_create(struct upload *u)
 	parq_ul_queue_check(q);
 
 	/* Locate the last alive queued item so we can calculate the ETA */
-	prev_puq = hash_list_tail(q->by_rel_pos);
+	prev_puq = ostree_tail_marked(&q->by_position);
 
 	if (prev_puq != NULL) {
 		parq_ul_queued_check(prev_puq);
 		g_assert(prev_puq->is_alive);	/* Must be to belong to that list */
 
-		rel_pos = prev_puq->relative_position + 1;
-
 		eta = prev_puq->eta;
 
 		if (GNET_PROPERTY(max_uploads) <= 0) {
@@ -1981,9 +1913,6 @@ parq_upload_create(struct upload *u)
 		}
 	}
 
-	/* Will append item to the list */
-	g_assert(hash_list_length(q->by_rel_pos) + 1 == rel_pos);
-
 	/* Create new parq_upload item */
 	WALLOC0(puq);
 	puq->magic = PARQ_UL_MAGIC;
@@ -1999,8 +1928,7 @@ parq_upload_create(struct upload *u)
 	g_assert(puq->addr_and_name != NULL);
 
 	/* Fill puq structure */
-	puq->position = q->by_position_length + 1;
-	puq->relative_position = rel_pos;
+	puq->arrival = ++q->arrivals;
 	puq->eta = eta;
 	puq->enter = now;
 	puq->updated = now;
@@ -2033,18 +1961,16 @@ parq_upload_create(struct upload *u)
 	/* Save into hash table so we can find the current parq ul later */
 	htable_insert(ul_all_parq_by_id, &puq->id, puq);
 
-	q->by_position_length++;
-	q->by_position = plist_append(q->by_position, puq);
-
-	hash_list_append(puq->queue->by_rel_pos, puq);
+	ostree_insert(&q->by_position, puq);	/* Appended, as newest */
+	parq_upload_insert_relative(puq);
 
 	if (GNET_PROPERTY(parq_debug) > 3) {
 		g_debug("PARQ UL Q %d/%zd (%3d[%3d]/%3d): New: %s \"%s\"; ID=\"%s\"",
 			puq->queue->num,
 			plist_length(ul_parqs),
-			puq->position,
-			puq->relative_position,
-			puq->queue->by_position_length,
+			parq_ul_position(puq),
+			parq_ul_relative_position(puq),
+			parq_ul_queue_length(puq->queue),
 			host_addr_to_string(puq->remote_addr),
 			puq->name,
 			guid_hex_str(&puq->id));
@@ -2070,16 +1996,12 @@ parq_upload_create(struct upload *u)
 	puq->by_addr->list = plist_prepend(puq->by_addr->list, puq);
 
 	g_assert(puq != NULL);
-	g_assert(puq->position > 0);
 	g_assert(puq->addr_and_name != NULL);
 	g_assert(puq->name != NULL);
 	g_assert(puq->queue != NULL);
-	g_assert(puq->queue->by_position != NULL);
-	g_assert(puq->queue->by_rel_pos != NULL);
-	g_assert(puq->queue->by_position->data != NULL);
-	g_assert(puq->relative_position > 0);
-	g_assert(puq->relative_position <=
-		UNSIGNED(puq->queue->by_position_length));
+	g_assert(parq_ul_position(puq) == UNSIGNED(parq_ul_queue_length(q)));
+	g_assert(parq_ul_relative_position(puq) ==
+		ostree_marked_count(&q->by_position));
 	g_assert(puq->by_addr != NULL);
 	g_assert(puq->by_addr->uploading <= puq->by_addr->total);
 
@@ -2112,7 +2034,7 @@ parq_upload_free_queue(struct parq_ul_queue *queue)
 	g_assert(ul_parqs != NULL);
 
 	/* Never ever remove a queue which is in use and/or marked as active */
-	g_assert(queue->by_position_length == 0);
+	g_assert(0 == parq_ul_queue_length(queue));
 	g_assert(queue->active_uploads == 0);
 	g_assert(!queue->active);
 
@@ -2127,7 +2049,6 @@ parq_upload_free_queue(struct parq_ul_queue *queue)
 	ul_parqs_cnt--;
 
 	/* Free memory */
-	hash_list_free(&queue->by_rel_pos);
 	hash_list_free(&queue->by_date_dead);
 	statx_free(queue->slot_stats);
 	queue->magic = 0;
@@ -2246,9 +2167,9 @@ parq_upload_register_send_queue(struct parq_ul_queued *puq)
 				"not PARQ-aware, not sending QUEUE: %s '%s'",
 				  puq->queue->num,
 				  ul_parqs_cnt,
-				  puq->position,
-				  puq->relative_position,
-				  puq->queue->by_position_length,
+				  parq_ul_position(puq),
+				  parq_ul_relative_position(puq),
+				  parq_ul_queue_length(puq->queue),
 				  host_addr_to_string(puq->remote_addr),
 				  puq->name
 			);
@@ -2264,9 +2185,9 @@ parq_upload_register_send_queue(struct parq_ul_queued *puq)
 				"no valid address to send QUEUE: %s '%s'",
 				  puq->queue->num,
 				  ul_parqs_cnt,
-				  puq->position,
-				  puq->relative_position,
-				  puq->queue->by_position_length,
+				  parq_ul_position(puq),
+				  parq_ul_relative_position(puq),
+				  parq_ul_queue_length(puq->queue),
 				  host_addr_to_string(puq->remote_addr),
 				  puq->name
 			);
@@ -2348,9 +2269,9 @@ parq_upload_send_queue(struct parq_ul_queued *puq)
 			"Sending QUEUE #%d to %s for ID=%s: '%s'",
 			puq->queue->num,
 			ul_parqs_cnt,
-			puq->position,
-			puq->relative_position,
-			puq->queue->by_position_length,
+			parq_ul_position(puq),
+			parq_ul_relative_position(puq),
+			parq_ul_queue_length(puq->queue),
 			puq->queue_sent,
 			host_addr_port_to_string(puq->addr, puq->port),
 			guid_hex_str(&puq->id),
@@ -2565,15 +2486,12 @@ parq_dead_timer(void *unused_udata)
 static void
 parq_upload_queue_timer(time_t now, struct parq_ul_queue *q, pslist_t **rlp)
 {
-	hash_list_iter_t *iter;
+	struct parq_ul_queued *puq;
 	pslist_t *to_remove = *rlp;
 
 	parq_ul_queue_check(q);
 
-	iter = hash_list_iterator(q->by_rel_pos);
-
-	while (hash_list_iter_has_next(iter)) {
-		struct parq_ul_queued *puq = hash_list_iter_next(iter);
+	PARQ_UL_FOREACH_RELATIVE(q, puq) {
 		time_delta_t grace;
 
 		parq_ul_queued_check(puq);
@@ -2621,25 +2539,22 @@ parq_upload_queue_timer(time_t now, struct parq_ul_queue *q, pslist_t **rlp)
 					"Timeout: ID=%s %s '%s'",
 					puq->queue->num,
 					ul_parqs_cnt,
-					puq->position,
-					puq->relative_position,
-					puq->queue->by_position_length,
+					parq_ul_position(puq),
+					parq_ul_relative_position(puq),
+					parq_ul_queue_length(puq->queue),
 					guid_hex_str(&puq->id),
 					host_addr_to_string(puq->remote_addr),
 					puq->name);
 
 
 			/*
-			 * Mark for removal. Can't remove now as we are still using the
-			 * ul_parq_by_position linked list. (prepend is probably the
-			 * fastest function)
+			 * Mark for removal. Can't remove now as we are still iterating
+			 * over the queue. (prepend is probably the fastest function)
 			 */
 			to_remove = pslist_prepend(to_remove, puq);
 		}
 	}
 
-	hash_list_iter_release(&iter);
-
 	*rlp = to_remove;
 }
 
@@ -2801,7 +2716,7 @@ parq_upload_timer(time_t now)
 			parq_upload_frozen_clear(puq);
 
 		parq_upload_remove_relative(puq);
-		puq->queue->recompute = TRUE;	/* Defer costly recomputations */
+		puq->queue->recompute = TRUE;	/* Defer costly ETA update */
 
 		if (enable_real_passive && parq_still_sharing(puq)) {
 			hash_list_append(puq->queue->by_date_dead, puq);
@@ -2817,7 +2732,6 @@ parq_upload_timer(time_t now)
 		struct parq_ul_queue *q = queues->data;
 
 		if (q->recompute) {
-			parq_upload_recompute_relative_positions(q);
 			parq_upload_update_eta(q);
 			q->recompute = FALSE;
 		}
@@ -2837,7 +2751,7 @@ parq_upload_timer(time_t now)
 
 		parq_ul_queue_check(queue);
 
-		if (!queue->active && queue->by_position_length == 0) {
+		if (!queue->active && 0 == parq_ul_queue_length(queue)) {
 			parq_upload_free_queue(queue);
 		}
 	}
@@ -2857,9 +2771,9 @@ parq_upload_queue_full(struct upload *u)
 	upload_check(u);
 
 	q = parq_upload_which_queue(u);
-	g_assert(q->by_position_length >= q->alive);
+	g_assert(parq_ul_queue_length(q) >= q->alive);
 
-	if (UNSIGNED(q->by_position_length) < parq_max_upload_size)
+	if (UNSIGNED(parq_ul_queue_length(q)) < parq_max_upload_size)
 		return FALSE;
 
 	if (0 == hash_list_length(q->by_date_dead))
@@ -3073,11 +2987,10 @@ parq_upload_freeze_all(struct parq_ul_queued *puq)
 					uqx->is_alive ? "alive" : "dead",
 					guid_hex_str(&uqx->id), uqx->queue->num,
 					host_addr_to_string(puq->by_addr->addr),
-					uqx->relative_position);
+					parq_ul_relative_position(uqx));
 
 			parq_upload_remove_relative(uqx);
 			parq_upload_frozen_set(uqx);
-			uqx->queue->recompute = TRUE;	/* Defer update */
 			extra++;
 		}
 
@@ -3090,19 +3003,6 @@ parq_upload_freeze_all(struct parq_ul_queued *puq)
 			host_addr_to_string(puq->by_addr->addr), frozen);
 
 	g_assert(puq->by_addr->frozen == frozen);
-
-	/*
-	 * Recompute data only for the queues in which we removed items.
-	 */
-
-	PLIST_FOREACH(ul_parqs, l) {
-		struct parq_ul_queue *q = l->data;
-
-		if (q->recompute) {
-			parq_upload_recompute_relative_positions(q);
-			q->recompute = FALSE;
-		}
-	}
 }
 
 /**
@@ -3128,10 +3028,9 @@ parq_upload_unfreeze_one(struct parq_ul_queued *puq)
 
 	parq_upload_frozen_clear(puq);
 
-	g_assert(!hash_list_contains(puq->queue->by_rel_pos, puq));
+	g_assert(!parq_ul_is_relative(puq));
 
 	parq_upload_insert_relative(puq);
-	parq_upload_recompute_relative_positions(puq->queue);
 }
 
 /**
@@ -3162,7 +3061,6 @@ parq_upload_unfreeze_all(struct parq_ul_queued *puq)
 			parq_upload_frozen_clear(uqx);
 			if (uqx->is_alive) {
 				parq_upload_insert_relative(uqx);
-				uqx->queue->recompute = TRUE;		/* Defer update */
 				inserted++;
 			}
 
@@ -3182,19 +3080,6 @@ parq_upload_unfreeze_all(struct parq_ul_queued *puq)
 			host_addr_to_string(puq->by_addr->addr), inserted);
 
 	g_assert(0 == puq->by_addr->frozen);
-
-	/*
-	 * Recompute data only for the queues in which we inserted items.
-	 */
-
-	PLIST_FOREACH(ul_parqs, l) {
-		struct parq_ul_queue *q = l->data;
-
-		if (q->recompute) {
-			parq_upload_recompute_relative_positions(q);
-			q->recompute = FALSE;
-		}
-	}
 }
 
 /**
@@ -3205,41 +3090,34 @@ static void
 parq_ul_dump_earlier(struct parq_ul_queued *item)
 {
 	struct parq_ul_queue *q;
-	hash_list_iter_t *iter;
-	unsigned old_relative = 0;
+	struct parq_ul_queued *puq;
+	unsigned relative = 0, item_relative;
 
 	parq_ul_queued_check(item);
 
 	q = item->queue;
 	parq_ul_queue_check(q);
 
-	iter = hash_list_iterator(q->by_rel_pos);
-
-	while (hash_list_iter_has_next(iter)) {
-		struct parq_ul_queued *puq = hash_list_iter_next(iter);
+	item_relative = parq_ul_relative_position(item);
 
+	PARQ_UL_FOREACH_RELATIVE(q, puq) {
 		parq_ul_queued_check(puq);
-		g_assert_log(puq->relative_position > old_relative,
-			"relative=%u, old=%u", puq->relative_position, old_relative);
-		old_relative = puq->relative_position;
 
 		if (
-			puq->relative_position >= item->relative_position ||
-			puq->relative_position > GNET_PROPERTY(max_uploads)
+			++relative >= item_relative ||
+			relative > GNET_PROPERTY(max_uploads)
 		)
 			break;
 
 		g_debug("[PARQ UL] Q#%d pos=%u, rel=%u, slot<has=%s had=%s> updated=%s"
 			" active=%s, quick=%s, alive=%s, flags=0x%x, ID=%s, expire=%s ",
-			q->num, puq->position, puq->relative_position,
+			q->num, parq_ul_position(puq), relative,
 			bool_to_string(puq->has_slot), bool_to_string(puq->had_slot),
 			compact_time(delta_time(tm_time(), puq->updated)),
 			bool_to_string(puq->active_queued), bool_to_string(puq->quick),
 			bool_to_string(puq->is_alive), puq->flags, guid_hex_str(&puq->id),
 			timestamp_utc_to_string(puq->expire));
 	}
-
-	hash_list_iter_release(&iter);
 }
 
 /**
@@ -3262,7 +3140,7 @@ parq_upload_continue(struct parq_ul_queued *puq)
 
 	/*
 	 * A "frozen" entry is an entry still in the queue but removed from the
-	 * "by_rel_pos" list because it has concurrent uploads from the same
+	 * relative positions because it has concurrent uploads from the same
 	 * address and its its max number of uploads per IP.
 	 *
 	 * Such an entry gets higher retry time and expiration times, and only
@@ -3357,7 +3235,7 @@ parq_upload_continue(struct parq_ul_queued *puq)
 	 * already downloading something in another queue.
 	 */
 
-	if (puq->relative_position <= UNSIGNED(slots_free)) {
+	if (parq_ul_relative_position(puq) <= UNSIGNED(slots_free)) {
 		if (GNET_PROPERTY(parq_debug))
 			g_debug("[PARQ UL] [#%d] allowing %supload \"%s\" from %s (%s), "
 				"relative pos = %u [%s]",
@@ -3367,7 +3245,7 @@ parq_upload_continue(struct parq_ul_queued *puq)
 				host_addr_port_to_string(
 					puq->u->socket->addr, puq->u->socket->port),
 				upload_vendor_str(puq->u),
-				puq->relative_position, guid_hex_str(&puq->id));
+				parq_ul_relative_position(puq), guid_hex_str(&puq->id));
 
 		return TRUE;
 	}
@@ -3378,8 +3256,8 @@ parq_upload_continue(struct parq_ul_queued *puq)
 			puq->queue->num, puq->u->name,
 			host_addr_port_to_string(
 				puq->u->socket->addr, puq->u->socket->port),
-			upload_vendor_str(puq->u), puq->position,
-			puq->relative_position);
+			upload_vendor_str(puq->u), parq_ul_position(puq),
+			parq_ul_relative_position(puq));
 
 		if (GNET_PROPERTY(parq_debug) > 5)
 			parq_ul_dump_earlier(puq);
@@ -3530,9 +3408,9 @@ parq_upload_get(struct upload *u, const header_t *header)
 				"ETA: %s Added: %s '%s' %s",
 				puq->queue->num,
 				ul_parqs_cnt,
-				puq->position,
-				puq->relative_position,
-				puq->queue->by_position_length,
+				parq_ul_position(puq),
+				parq_ul_relative_position(puq),
+				parq_ul_queue_length(puq->queue),
 				short_time_ascii(parq_upload_lookup_eta(u)),
 				host_addr_to_string(puq->remote_addr),
 				puq->name, guid_hex_str(&puq->id));
@@ -3597,12 +3475,11 @@ parq_upload_get(struct upload *u, const header_t *header)
 		puq->queue->alive++;
 		puq->is_alive = TRUE;
 		g_assert(puq->queue->alive > 0);
-		g_assert(!hash_list_contains(puq->queue->by_rel_pos, puq));
+		g_assert(!parq_ul_is_relative(puq));
 
 		/* Re-insert in the relative position list, unless entry is frozen */
 		if (!(puq->flags & PARQ_UL_FROZEN)) {
 			parq_upload_insert_relative(puq);
-			parq_upload_recompute_relative_positions(puq->queue);
 			parq_upload_update_eta(puq->queue);
 		}
 	}
@@ -3861,11 +3738,11 @@ parq_upload_request(struct upload *u)
 
 	if (puq->has_slot) {
 		if (!puq->quick) {
-			g_assert(puq->relative_position == 0);
+			g_assert(!parq_ul_is_relative(puq));
 			return TRUE;			/* Has regular slot */
 		}
 		if (parq_upload_quick_continue(puq)) {
-			g_assert(puq->relative_position > 0);
+			g_assert(parq_ul_is_relative(puq));
 			return TRUE;			/* Has quick slot */
 		}
 		if (GNET_PROPERTY(parq_debug))
@@ -3899,7 +3776,7 @@ parq_upload_request(struct upload *u)
 		 *		--RAM, 2007-08-17
 		 */
 
-		g_assert(puq->relative_position > 0);	/* Was a quick slot */
+		g_assert(parq_ul_is_relative(puq));	/* Was a quick slot */
 
 		puq->by_addr->uploading--;
 		puq->has_slot = FALSE;
@@ -3941,7 +3818,7 @@ parq_upload_request(struct upload *u)
 			if (puq->flags & PARQ_UL_FROZEN)
 				puq->active_queued = FALSE;
 			else if (
-				puq->relative_position <=
+				parq_ul_relative_position(puq) <=
 				1 + UNSIGNED(free_upload_slots(puq->queue)) / 2
 			)
 				u->status = GTA_UL_QUEUED;	/* Maintain active queuing */
@@ -3960,7 +3837,7 @@ parq_upload_request(struct upload *u)
 					"switching from active to passive for %s (%s)",
 					puq->queue->num, guid_hex_str(&puq->id),
 					fd_avail_status_string(fds),
-					puq->relative_position, bool_to_string(u->push),
+					parq_ul_relative_position(puq), bool_to_string(u->push),
 					bool_to_string(0 != (puq->flags & PARQ_UL_FROZEN)),
 					host_addr_port_to_string(u->socket->addr, u->socket->port),
 					upload_vendor_str(u));
@@ -4002,7 +3879,7 @@ parq_upload_request(struct upload *u)
 		queueable = GNET_PROPERTY(sys_nofile) * 4 / 5 >
 			max_fd_used + (MIN_ALWAYS_QUEUE * GNET_PROPERTY(max_uploads));
 
-		if (puq->relative_position <= MIN_ALWAYS_QUEUE)
+		if (parq_ul_relative_position(puq) <= MIN_ALWAYS_QUEUE)
 			queueable = TRUE;
 
 		/*
@@ -4028,8 +3905,8 @@ parq_upload_request(struct upload *u)
 		}
 
 		if (
-			(u->push && puq->relative_position <= max_slot) ||
-			(queueable && puq->relative_position <=
+			(u->push && parq_ul_relative_position(puq) <= max_slot) ||
+			(queueable && parq_ul_relative_position(puq) <=
 				UNSIGNED(free_upload_slots(puq->queue)) + MIN_UPLOAD_ASLOT)
 		) {
 			if ((puq->flags & PARQ_UL_FROZEN) && !activeable) {
@@ -4088,7 +3965,8 @@ parq_upload_busy(struct upload *u, struct parq_ul_queued *handle)
 	if (GNET_PROPERTY(parq_debug) > 2) {
 		g_debug("PARQ UL [#%d] upload pos=%d rel=%d (%s, %s, %s) "
 			"is now busy [%s]",
-			puq->queue->num, puq->position, puq->relative_position,
+			puq->queue->num,
+			parq_ul_position(puq), parq_ul_relative_position(puq),
 			puq->active_queued ? "active" : "passive",
 			puq->has_slot ? "with slot" : "no slot yet",
 			puq->quick ? "quick" : "regular",
@@ -4112,11 +3990,8 @@ parq_upload_busy(struct upload *u, struct parq_ul_queued *handle)
 	 *		--RAM, 2007-08-16
 	 */
 
-	if (!puq->quick && puq->relative_position) {
-		parq_upload_remove_relative(puq);
-		parq_upload_recompute_relative_positions(puq->queue);
-
-		puq->relative_position = 0;		/* Signals: has regular slot */
+	if (!puq->quick && parq_ul_is_relative(puq)) {
+		parq_upload_remove_relative(puq);	/* Signals: has regular slot */
 		puq->had_slot = TRUE;			/* Had a regular slot */
 		puq->queue->active_uploads++;	/* Account active in queue */
 	}
@@ -4308,7 +4183,7 @@ parq_upload_remove(struct upload *u, bool was_sending, bool was_running)
 	 */
 
 	if (puq->has_slot) {
-		hash_list_iter_t *iter;
+		struct parq_ul_queued *puq_next;
 
 		if (GNET_PROPERTY(parq_debug) > 2)
 			g_debug("PARQ UL: [#%d] [%s] Freed an upload slot%s",
@@ -4326,11 +4201,7 @@ parq_upload_remove(struct upload *u, bool was_sending, bool was_running)
 		 * Tell next waiting upload that a slot is available, using QUEUE
 		 */
 
-		iter = hash_list_iterator(puq->queue->by_rel_pos);
-
-		while (hash_list_iter_has_next(iter)) {
-			struct parq_ul_queued *puq_next = hash_list_iter_next(iter);
-
+		PARQ_UL_FOREACH_RELATIVE(puq->queue, puq_next) {
 			parq_ul_queued_check(puq_next);
 
 			if (puq_next->has_slot)
@@ -4354,13 +4225,11 @@ parq_upload_remove(struct upload *u, bool was_sending, bool was_running)
 			break;
 		}
 
-		hash_list_iter_release(&iter);
-
 		/*
 		 * Put back in queue until it expires.
 		 */
 
-		if (0 == puq->relative_position) {
+		if (!parq_ul_is_relative(puq)) {
 			puq->queue->active_uploads--;
 			puq->expire = time_advance(now, GUARDING_TIME);
 
@@ -4373,10 +4242,7 @@ parq_upload_remove(struct upload *u, bool was_sending, bool was_running)
 			if (puq->had_slot)
 				puq->flags |= PARQ_UL_NOQUEUE;
 
-			g_assert(!hash_list_contains(puq->queue->by_rel_pos, puq));
-
 			parq_upload_insert_relative(puq);
-			parq_upload_recompute_relative_positions(puq->queue);
 		}
 
 		parq_upload_unfreeze_all(puq);	/* Allow others to compete */
@@ -4481,12 +4347,13 @@ parq_upload_add_old_queue_header(char *buf, size_t size,
 	if (small_reply) {
 		len = str_bprintf(buf, size,
 				"X-Queue: position=%d, pollMin=%u, pollMax=%u\r\n",
-				puq->relative_position, min_poll, max_poll);
+				parq_ul_relative_position(puq), min_poll, max_poll);
 	} else {
 		len = str_bprintf(buf, size,
 				"X-Queue: position=%d, length=%d, "
 				"limit=%d, pollMin=%u, pollMax=%u\r\n",
-				puq->relative_position, puq->queue->by_position_length,
+				parq_ul_relative_position(puq),
+				parq_ul_queue_length(puq->queue),
 				1, min_poll, max_poll);
 	}
 	if (len >= size || (len > 0 && '\n' != buf[len - 1])) {
@@ -4524,7 +4391,7 @@ parq_upload_add_x_queued_header(char *buf, size_t size,
 		puq->flags |= PARQ_UL_ID_SENT;
 
 		len = concat_strings(&buf[rw], size,
-			"; position=", uint32_to_string(puq->relative_position),
+			"; position=", uint32_to_string(parq_ul_relative_position(puq)),
 			NULL_PTR);
 
 		if (len < size) {
@@ -4540,7 +4407,7 @@ parq_upload_add_x_queued_header(char *buf, size_t size,
 					size -= len;
 					len = concat_strings(&buf[rw], size,
 						"; length=",
-						uint32_to_string(puq->queue->by_position_length),
+						uint32_to_string(parq_ul_queue_length(puq->queue)),
 						NULL_PTR);
 					if (len < size) {
 						rw += len;
@@ -4719,7 +4586,7 @@ parq_upload_lookup_position(const struct upload *u)
 	puq = parq_upload_find(u);
 
 	if (puq != NULL) {
-		return puq->relative_position;
+		return parq_ul_relative_position(puq);
 	} else {
 		return (uint) -1;
 	}
@@ -4975,9 +4842,9 @@ parq_store(void *data, void *file_ptr)
 		g_debug("PARQ UL Q %d/%d (%3d[%3d]/%3d): Saving %s: '%s' - %s '%s'",
 			  puq->queue->num,
 			  ul_parqs_cnt,
-			  puq->position,
-			  puq->relative_position,
-			  puq->queue->by_position_length,
+			  parq_ul_position(puq),
+			  parq_ul_relative_position(puq),
+			  parq_ul_queue_length(puq->queue),
 			  puq->supports_parq ? "PARQ" : "slot",
 			  guid_hex_str(&puq->id),
 			  host_addr_to_string(puq->remote_addr),
@@ -5003,7 +4870,7 @@ parq_store(void *data, void *file_ptr)
 		"IP: %s\n"
 		,
 		puq->queue->num,
-		puq->position,
+		parq_ul_position(puq),
 		enter_buf,
 		expire,
 		guid_hex_str(&puq->id),
@@ -5067,8 +4934,11 @@ parq_upload_save_queue(void)
 		queues = plist_last(ul_parqs) ; queues != NULL; queues = queues->prev
 	) {
 		struct parq_ul_queue *queue = queues->data;
+		struct parq_ul_queued *puq;
 
-		PLIST_FOREACH_CALL_DATA(queue->by_position, parq_store, f);
+		PARQ_UL_FOREACH(queue, puq) {
+			parq_store(puq, f);
+		}
 	}
 
 	file_config_close(f, &fp);
@@ -5097,7 +4967,7 @@ parq_save_timer(void *unused_udata)
 
 			g_debug("PARQ UL: Queue %d/%d contains %d items, "
 				  "%d uploading, %d alive, queue marked %s",
-				  q->num, ul_parqs_cnt, q->by_position_length,
+				  q->num, ul_parqs_cnt, parq_ul_queue_length(q),
 				  q->active_uploads, q->alive,
 				  q->active ? "active" : "inactive");
 		}
@@ -5484,9 +5354,9 @@ parq_upload_load_queue(void)
 					"restored: %s%s '%s'",
 					puq->queue->num,
 					ul_parqs_cnt,
-					puq->position,
-				 	puq->relative_position,
-					puq->queue->by_position_length,
+					parq_ul_position(puq),
+				 	parq_ul_relative_position(puq),
+					parq_ul_queue_length(puq->queue),
 					short_time_ascii(parq_upload_lookup_eta(fake_upload)),
 					host_addr_to_string(puq->remote_addr),
 					puq->supports_parq ? " (PARQ)" : "",
@@ -5611,13 +5481,9 @@ parq_close_pre(void)
 	 */
 	for (queues = ul_parqs; queues != NULL; queues = queues->next) {
 		struct parq_ul_queue *queue = queues->data;
+		struct parq_ul_queued *puq;
 
-		PLIST_FOREACH(queue->by_position, dl) {
-			struct parq_ul_queued *puq = dl->data;
-
-			if (puq == NULL)
-				break;
-
+		PARQ_UL_FOREACH(queue, puq) {
 			puq->by_addr->uploading = 0;
 
 			to_remove = pslist_prepend(to_remove, puq);
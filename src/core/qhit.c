@@ -56,8 +56,11 @@
 #include "if/core/main.h"			/* For main_get_build() */
 
 #include "lib/array.h"
+#include "lib/atomic.h"
+#include "lib/atoms.h"
 #include "lib/endian.h"
 #include "lib/getdate.h"
+#include "lib/halloc.h"
 #include "lib/hashing.h"
 #include "lib/hset.h"
 #include "lib/product.h"
@@ -613,6 +616,268 @@ qhit_random_index(void)
 	g_error("%s(): no luck with random number generator", G_STRFUNC);
 }
 
+/**
+ * A pre-encoded query hit record.
+ *
+ * Most of a query hit entry for a given file is static: its name, its
+ * hashes and the GGEP extensions describing the file.  These are encoded
+ * once and cached with the shared file, so that building a hit is mostly
+ * copying these bytes, plus the dynamic parts (file index, alt-locs,
+ * partial file information).
+ *
+ * The record is immutable once built, and is reference-counted since it can
+ * be replaced in the shared file whilst used to build a hit.  It keeps a
+ * reference on the values it was built from, to be able to check that it
+ * is still accurate for the file.
+ */
+enum qhit_record_magic { QHIT_RECORD_MAGIC = 0x3a7e1c05 };
+
+struct qhit_record {
+	enum qhit_record_magic magic;
+	int refcnt;					/**< Reference count */
+	const struct sha1 *sha1;	/**< SHA1 atom, NULL if not emitted */
+	const struct tth *tth;		/**< TTH atom, NULL if not emitted */
+	const char *path;			/**< Relative path atom, NULL if none */
+	filesize_t size;			/**< File size */
+	time_t ctime;				/**< File creation time */
+	size_t entry_len;			/**< Length of name, NUL and URN */
+	size_t ggep_len;			/**< Length of closed GGEP block, 0 if none */
+	size_t ggep_last;			/**< Offset of last extension in GGEP block */
+	char data[1];				/**< Entry, followed by GGEP block */
+};
+
+static inline void
+qhit_record_check(const struct qhit_record * const r)
+{
+	g_assert(r != NULL);
+	g_assert(QHIT_RECORD_MAGIC == r->magic);
+}
+
+/**
+ * Add a reference to a query hit record.
+ *
+ * @return its argument.
+ */
+struct qhit_record *
+qhit_record_ref(struct qhit_record *r)
+{
+	qhit_record_check(r);
+
+	atomic_int_inc(&r->refcnt);
+	return r;
+}
+
+/**
+ * Remove a reference to a query hit record, freeing it when it was the last
+ * one, and nullify its pointer.
+ */
+void
+qhit_record_unref(struct qhit_record **r_ptr)
+{
+	struct qhit_record *r = *r_ptr;
+
+	if (r != NULL) {
+		qhit_record_check(r);
+
+		if (atomic_int_dec_is_zero(&r->refcnt)) {
+			atom_sha1_free_null(&r->sha1);
+			atom_tth_free_null(&r->tth);
+			atom_str_free_null(&r->path);
+			r->magic = 0;
+			hfree(r);
+		}
+		*r_ptr = NULL;
+	}
+}
+
+/**
+ * Check whether record was built from the current values of the file.
+ */
+static bool
+qhit_record_is_current(const struct qhit_record *r, const shared_file_t *sf,
+	const struct sha1 *sha1, const struct tth *tth)
+{
+	qhit_record_check(r);
+
+	return r->sha1 == sha1 && r->tth == tth &&
+		r->path == shared_file_relative_path(sf) &&
+		r->size == shared_file_size(sf) &&
+		r->ctime == shared_file_creation_time(sf);
+}
+
+/**
+ * Encode the static part of the query hit entry for a file.
+ *
+ * @param sf		the shared file
+ * @param sha1		the SHA1 of the file, NULL if not available
+ * @param ggep_h	whether to emit hashes as GGEP "H"
+ *
+ * @return a new record, with one reference.
+ */
+static struct qhit_record *
+qhit_record_build(const shared_file_t *sf, const struct sha1 *sha1,
+	bool ggep_h)
+{
+	struct qhit_record *r;
+	const struct tth *tth = NULL == sha1 ? NULL : shared_file_tth(sf);
+	const char *rp = shared_file_relative_path(sf);
+	const filesize_t size = shared_file_size(sf);
+	const time_t ctime = shared_file_creation_time(sf);
+	size_t entry_len, ggep_max, ggep_len, ggep_last = 0;
+	ggep_stream_t gs;
+	char *ggep;
+	bool ok;
+
+	entry_len = shared_file_name_nfc_len(sf) + 1;
+	if (sha1 != NULL && !ggep_h)
+		entry_len += SHA1_URN_LENGTH + 1;
+
+	/*
+	 * Generous upper bound for the GGEP block: PATH is not COBS-encoded,
+	 * and the other extensions are small.
+	 */
+
+	ggep_max = 256 + (NULL == rp ? 0 : vstrlen(rp));
+
+	r = halloc(offsetof(struct qhit_record, data) + entry_len + ggep_max);
+	r->magic = QHIT_RECORD_MAGIC;
+	r->refcnt = 1;
+	r->sha1 = NULL == sha1 ? NULL : atom_sha1_get(sha1);
+	r->tth = NULL == tth ? NULL : atom_tth_get(tth);
+	r->path = NULL == rp ? NULL : atom_str_get(rp);
+	r->size = size;
+	r->ctime = ctime;
+	r->entry_len = entry_len;
+
+	{
+		char *p = r->data;
+
+		p = mempcpy(p, shared_file_name_nfc(sf), shared_file_name_nfc_len(sf));
+		*p++ = '\0';
+
+		if (sha1 != NULL && !ggep_h) {
+			/* Good old way: ASCII URN */
+			p = mempcpy(p, sha1_to_urn_string(sha1), SHA1_URN_LENGTH);
+			*p++ = '\x1c';
+		}
+
+		g_assert(ptr_diff(p, r->data) == entry_len);
+	}
+
+	ggep = &r->data[entry_len];
+	ggep_stream_init(&gs, ggep, ggep_max);
+
+	/*
+	 * Emit the SHA1 as GGEP "H" if they said they understand it. The modern
+	 * way is GGEP "H" for binary URN but only gtk-gnutella implements it.
+	 */
+
+	if (sha1 != NULL && ggep_h) {
+		const uint8 type = tth ? GGEP_H_BITPRINT : GGEP_H_SHA1;
+
+		ok =
+			ggep_stream_begin(&gs, GGEP_NAME(H), GGEP_W_COBS) &&
+			ggep_stream_write(&gs, &type, 1) &&
+			ggep_stream_write(&gs, sha1->data, SHA1_RAW_SIZE) &&
+			(tth ? ggep_stream_write(&gs, tth->data, TTH_RAW_SIZE) : TRUE) &&
+			ggep_stream_end(&gs);
+
+		if (!ok)
+			qhit_log_ggep_write_failure("H");
+	}
+
+	/*
+	 * First LimeWire emitted TTHs as plain text urn:ttroot:<base32 TTH>.
+	 * Now they are still unaware of GGEP "H" but emit GGEP "TT" with the
+	 * hash in binary form.
+	 */
+
+	if (tth != NULL && !ggep_h) {
+		ok = ggep_stream_pack(&gs,
+					GGEP_NAME(TT), tth->data, TTH_RAW_SIZE, GGEP_W_COBS);
+		if (!ok)
+			qhit_log_ggep_write_failure("TT");
+	}
+
+	/*
+	 * If the 32-bit size is the magic ~0 escape value, we need to emit
+	 * the real size in the "LF" extension.
+	 */
+
+	if (size >= (1U << 31)) {
+		char buf[sizeof(uint64)];
+		int len;
+
+		len = ggept_filesize_encode(size, ARYLEN(buf));
+
+		g_assert(len > 0 && UNSIGNED(len) <= sizeof buf);
+
+		ok = ggep_stream_pack(&gs, GGEP_NAME(LF), buf, len, GGEP_W_COBS);
+		if (!ok)
+			qhit_log_ggep_write_failure("LF");
+	}
+
+	if (rp != NULL) {
+		ok = ggep_stream_pack(&gs, GGEP_NAME(PATH), rp, vstrlen(rp), 0);
+		if (!ok)
+			qhit_log_ggep_write_failure("PATH");
+	}
+
+	if ((time_t) -1 != ctime) {
+		char buf[sizeof(uint64)];
+		int len;
+
+		/*
+		 * Suppress negative values (if time_t is signed) as this would
+		 * be interpreted as a date far in this future.
+		 */
+
+		len = ggept_ct_encode(MAX(0, ctime), ARYLEN(buf));
+		g_assert(UNSIGNED(len) <= sizeof buf);
+
+		ok = ggep_stream_pack(&gs, GGEP_NAME(CT), buf, len, GGEP_W_COBS);
+		if (!ok)
+			qhit_log_ggep_write_failure("CT");
+	}
+
+	ggep_len = ggep_stream_close_block(&gs, &ggep_last);
+
+	r->ggep_len = ggep_len;
+	r->ggep_last = ggep_last;
+
+	return hrealloc(r, offsetof(struct qhit_record, data) + entry_len + ggep_len);
+}
+
+/**
+ * Get the query hit record for a file, building it if needed.
+ *
+ * @param sf		the shared file
+ * @param sha1		the SHA1 of the file, NULL if not available
+ * @param ggep_h	whether to emit hashes as GGEP "H"
+ *
+ * @return a referenced record, to be released with qhit_record_unref().
+ */
+static struct qhit_record *
+qhit_record_get(const shared_file_t *sf, const struct sha1 *sha1, bool ggep_h)
+{
+	struct qhit_record *r;
+	const struct tth *tth = NULL == sha1 ? NULL : shared_file_tth(sf);
+	uint slot = ggep_h ? 1 : 0;
+
+	r = shared_file_qhit_record(sf, slot);
+
+	if (r != NULL) {
+		if G_LIKELY(qhit_record_is_current(r, sf, sha1, tth))
+			return r;
+		qhit_record_unref(&r);
+	}
+
+	r = qhit_record_build(sf, sha1, ggep_h);
+	shared_file_set_qhit_record(sf, slot, r);
+
+	return r;
+}
+
 /**
  * Add file to current query hit.
  *
@@ -633,6 +898,7 @@ add_file(const shared_file_t *sf)
 	void *start;
 	bool is_partial;
 	uint32 file_index;
+	struct qhit_record *rec;
 
 	is_partial = shared_file_is_partial(sf);
 	needed = 8 + 2 + shared_file_name_nfc_len(sf);	/* size of hit entry */
@@ -749,37 +1015,25 @@ add_file(const shared_file_t *sf)
 
 	fs32 = shared_file_size(sf) >= (1U << 31) ? ~0U : shared_file_size(sf);
 
+	rec = qhit_record_get(sf,
+		sha1_available ? shared_file_sha1(sf) : NULL, found_ggep_h());
+
 	poke_le32(&idx_le, file_index);
 	if (!found_write(&idx_le, sizeof idx_le))
-		return FALSE;
+		goto refused;
 	poke_le32(&fs32_le, fs32);
 	if (!found_write(&fs32_le, sizeof fs32_le))
-		return FALSE;
-	if (!found_write(shared_file_name_nfc(sf), shared_file_name_nfc_len(sf)))
-		return FALSE;
-
-	/* Position equals the next byte to be written to */
-
-	if (!found_write("", 1))
-		return FALSE;
-
-	/*
-	 * We're now between the two NULs at the end of the hit entry.
-	 */
+		goto refused;
 
 	/*
-	 * Emit the SHA1 as a plain ASCII URN if they don't grok "H".
+	 * The file name with its trailing NUL, followed by the plain ASCII URN
+	 * if they don't grok "H", come from the pre-encoded record.
+	 *
+	 * We're then between the two NULs at the end of the hit entry.
 	 */
 
-	if (sha1_available && !found_ggep_h()) {
-		const struct sha1 * const sha1 = shared_file_sha1(sf);
-
-		/* Good old way: ASCII URN */
-		if (!found_write(sha1_to_urn_string(sha1), SHA1_URN_LENGTH))
-			return FALSE;
-		if (!found_write("\x1c", 1))
-			return FALSE;
-	}
+	if (!found_write(rec->data, rec->entry_len))
+		goto refused;
 
 	/*
 	 * From now on, we emit GGEP extensions, if we emit at all.
@@ -822,60 +1076,18 @@ add_file(const shared_file_t *sf)
 	}
 
 	/*
-	 * Emit the SHA1 as GGEP "H" if they said they understand it. The modern
-	 * way is GGEP "H" for binary URN but only gtk-gnutella implements it.
+	 * The static extensions (hashes, large file size, path and creation
+	 * time) come from the pre-encoded record as well.
 	 */
 
-	if (sha1_available && found_ggep_h()) {
-		const struct sha1 * const sha1 = shared_file_sha1(sf);
-		const struct tth * const tth = shared_file_tth(sf);
-		const uint8 type = tth ? GGEP_H_BITPRINT : GGEP_H_SHA1;
-
-		ok =
-			ggep_stream_begin(&gs, GGEP_NAME(H), GGEP_W_COBS) &&
-			ggep_stream_write(&gs, &type, 1) &&
-			ggep_stream_write(&gs, sha1->data, SHA1_RAW_SIZE) &&
-			(tth ? ggep_stream_write(&gs, tth->data, TTH_RAW_SIZE) : TRUE) &&
-			ggep_stream_end(&gs);
-
+	if (rec->ggep_len != 0) {
+		ok = ggep_stream_append_block(&gs,
+				&rec->data[rec->entry_len], rec->ggep_len, rec->ggep_last);
 		if (!ok)
-			qhit_log_ggep_write_failure("H");
+			qhit_log_ggep_write_failure("static");
 	}
 
-	/*
-	 * First LimeWire emitted TTHs as plain text urn:ttroot:<base32 TTH>.
-	 * Now they are still unaware of GGEP "H" but emit GGEP "TT" with the
-	 * hash in binary form.
-	 */
-
-	if (sha1_available && !found_ggep_h()) {
-		const struct tth * const tth = shared_file_tth(sf);
-
-		if (tth) {
-			ok = ggep_stream_pack(&gs,
-						GGEP_NAME(TT), tth->data, TTH_RAW_SIZE, GGEP_W_COBS);
-			if (!ok)
-				qhit_log_ggep_write_failure("TT");
-		}
-	}
-
-	/*
-	 * If the 32-bit size is the magic ~0 escape value, we need to emit
-	 * the real size in the "LF" extension.
-	 */
-
-	if (fs32 == ~0U) {
-		char buf[sizeof(uint64)];
-		int len;
-
-		len = ggept_filesize_encode(shared_file_size(sf), ARYLEN(buf));
-
-		g_assert(len > 0 && UNSIGNED(len) <= sizeof buf);
-
-		ok = ggep_stream_pack(&gs, GGEP_NAME(LF), buf, len, GGEP_W_COBS);
-		if (!ok)
-			qhit_log_ggep_write_failure("LF");
-	}
+	qhit_record_unref(&rec);
 
 	/*
 	 * If we have known alternate locations, include a few of them for
@@ -891,39 +1103,6 @@ add_file(const shared_file_t *sf)
 			qhit_log_ggep_write_failure("ALT");
 	}
 
-	{
-		const char *rp = shared_file_relative_path(sf);
-
-		if (rp) {
-			ok = ggep_stream_pack(&gs, GGEP_NAME(PATH), rp, vstrlen(rp), 0);
-			if (!ok)
-				qhit_log_ggep_write_failure("PATH");
-		}
-	}
-
-	{
-		time_t create_time;
-
-		create_time = shared_file_creation_time(sf);
-		if ((time_t) -1 != create_time) {
-			char buf[sizeof(uint64)];
-			int len;
-
-			/*
-			 * Suppress negative values (if time_t is signed) as this would
-			 * be interpreted as a date far in this future.
-			 */
-			create_time = MAX(0, create_time);
-
-			len = ggept_ct_encode(create_time, ARYLEN(buf));
-			g_assert(UNSIGNED(len) <= sizeof buf);
-
-			ok = ggep_stream_pack(&gs, GGEP_NAME(CT), buf, len, GGEP_W_COBS);
-			if (!ok)
-				qhit_log_ggep_write_failure("CT");
-		}
-	}
-
 	/*
 	 * Because we don't know exactly the size of the GGEP extension
 	 * (could be COBS-encoded or not), we need to adjust the real
@@ -952,6 +1131,10 @@ add_file(const shared_file_t *sf)
 	}
 
 	return TRUE;		/* Hit entry accepted */
+
+refused:
+	qhit_record_unref(&rec);
+	return FALSE;
 }
 
 /**
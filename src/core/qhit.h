@@ -52,6 +52,12 @@ typedef void (*qhit_process_t)(void *data, size_t len, void *udata);
 #define QHIT_F_G2_DN		(1U << 30)	/**< Wants DN (distinguished name) */
 #define QHIT_F_G2_ALT		(1U << 29)	/**< Wants ALT (alt-locs) */
 
+/**
+ * Amount of pre-encoded records cached per shared file (one per encoding
+ * of the file hashes).
+ */
+#define QHIT_RECORD_SLOTS	2
+
 /*
  * Public interface.
  */
@@ -60,6 +66,7 @@ struct gnutella_node;
 struct array;
 struct guid;
 struct pslist;
+struct qhit_record;
 
 void qhit_init(void);
 void qhit_close(void);
@@ -71,6 +78,9 @@ void qhit_build_results(const struct pslist *files,
 	qhit_process_t cb, void *udata, const struct guid *muid, unsigned flags,
 	const struct array *token);
 
+struct qhit_record *qhit_record_ref(struct qhit_record *r);
+void qhit_record_unref(struct qhit_record **r_ptr);
+
 #endif /* _core_qhit_h_ */
 
 /* vi: set ts=4 sw=4 cindent: */
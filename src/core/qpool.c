@@ -0,0 +1,394 @@
+/*
+ * Copyright (c) 2026 agent
+ *
+ *----------------------------------------------------------------------
+ * This file is part of gtk-gnutella.
+ *
+ *  gtk-gnutella is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gtk-gnutella is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with gtk-gnutella; if not, write to the Free Software
+ *  Foundation, Inc.:
+ *      59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *----------------------------------------------------------------------
+ */
+
+/**
+ * @ingroup core
+ * @file
+ *
+ * Query matching thread pool.
+ *
+ * Matching a query against the library is the most expensive part of query
+ * processing.  When we get a flood of popular queries, doing that from the
+ * main thread delays everything else, including message routing and the
+ * handshaking of new connections.
+ *
+ * This pool lets the main thread hand over the matching to a set of worker
+ * threads.  Each job is made of three callbacks:
+ *
+ * - the "match" callback, run by one of the worker threads;
+ * - the "done" callback, run from the main thread once matching is done;
+ * - the "drop" callback, run from the main thread when the job is discarded
+ *   before it could be matched, or when we shutdown with results pending.
+ *
+ * Exactly one of "done" or "drop" is invoked for each submitted job, and
+ * that callback is responsible for releasing the job argument.
+ *
+ * Jobs are queued by decreasing priority, and in submission order for the
+ * same priority.  The queue is bounded: when it is full, the lowest-priority
+ * job is shed to make room for a more important one, or the new job is shed
+ * if nothing queued is less important.
+ *
+ * Worker threads are created on demand, up to the maximum configured by
+ * the "search_match_threads" property.  Completed jobs are collected in a
+ * list that the main thread drains through a single TEQ event, regardless
+ * of the amount of jobs completed meanwhile.
+ *
+ * @author agent
+ * @date 2026
+ */
+
+#include "common.h"
+
+#include "qpool.h"
+
+#include "if/gnet_property_priv.h"
+
+#include "lib/cond.h"
+#include "lib/erbtree.h"
+#include "lib/eslist.h"
+#include "lib/mutex.h"
+#include "lib/teq.h"
+#include "lib/thread.h"
+#include "lib/walloc.h"
+
+#include "lib/override.h"		/* Must be the last header included */
+
+#define QPOOL_THREADS_MAX	8		/**< Hard limit on worker threads */
+
+enum qpool_job_magic { QPOOL_JOB_MAGIC = 0x1e2a7c03 };
+
+/**
+ * A query matching job.
+ */
+struct qpool_job {
+	enum qpool_job_magic magic;
+	rbnode_t node;				/**< Embedded in the pending queue */
+	slink_t lk;					/**< Embedded in the completed list */
+	uint64 seq;					/**< Submission order */
+	uint prio;					/**< Job priority, larger is more important */
+	qpool_cb_t match;			/**< Run from a worker thread */
+	qpool_cb_t done;			/**< Run from main thread once matched */
+	qpool_cb_t drop;			/**< Run from main thread if discarded */
+	void *arg;					/**< Callback argument */
+};
+
+static inline void
+qpool_job_check(const struct qpool_job * const j)
+{
+	g_assert(j != NULL);
+	g_assert(QPOOL_JOB_MAGIC == j->magic);
+}
+
+static mutex_t qpool_lock = MUTEX_INIT;	/**< Protects the pool state */
+static cond_t qpool_work = COND_INIT;	/**< Signalled when jobs are queued */
+
+/**
+ * The pool state, protected by ``qpool_lock''.
+ */
+static struct qpool_vars {
+	erbtree_t pending;			/**< Jobs waiting to be matched */
+	eslist_t completed;			/**< Jobs matched, awaiting delivery */
+	uint64 seq;					/**< Job sequence number */
+	uint threads;				/**< Amount of worker threads created */
+	uint idle;					/**< Amount of worker threads waiting */
+	int tid[QPOOL_THREADS_MAX];	/**< Worker thread IDs */
+	bool exiting;				/**< Whether workers should exit */
+	bool initialized;			/**< Whether qpool_init() was called */
+} qpool_vars;
+
+#define QPOOL_LOCK		mutex_lock(&qpool_lock)
+#define QPOOL_UNLOCK	mutex_unlock(&qpool_lock)
+
+/**
+ * Job comparison routine: jobs with a higher priority come first, then
+ * jobs are sorted by submission order.
+ */
+static int
+qpool_job_cmp(const void *a, const void *b)
+{
+	const struct qpool_job *ja = a, *jb = b;
+
+	if (ja->prio != jb->prio)
+		return ja->prio > jb->prio ? -1 : +1;
+
+	return CMP(ja->seq, jb->seq);
+}
+
+/**
+ * Free job, invoking the supplied callback on its argument.
+ */
+static void
+qpool_job_free(struct qpool_job *j, qpool_cb_t cb)
+{
+	qpool_job_check(j);
+
+	(*cb)(j->arg);
+	j->magic = 0;
+	WFREE(j);
+}
+
+/**
+ * TEQ event, delivered to the main thread to process completed jobs.
+ */
+static void
+qpool_deliver(void *unused_arg)
+{
+	struct qpool_job *j;
+
+	(void) unused_arg;
+
+	for (;;) {
+		QPOOL_LOCK;
+		j = eslist_shift(&qpool_vars.completed);
+		QPOOL_UNLOCK;
+
+		if (NULL == j)
+			break;
+
+		qpool_job_free(j, j->done);
+	}
+}
+
+/**
+ * Worker thread main loop.
+ */
+static void *
+qpool_thread_main(void *unused_arg)
+{
+	struct qpool_vars *v = &qpool_vars;
+
+	(void) unused_arg;
+
+	thread_set_name("qmatch");
+
+	QPOOL_LOCK;
+
+	for (;;) {
+		struct qpool_job *j;
+
+		while (!v->exiting && 0 == erbtree_count(&v->pending)) {
+			v->idle++;
+			cond_wait(&qpool_work, &qpool_lock);
+			v->idle--;
+		}
+
+		if (v->exiting)
+			break;
+
+		j = erbtree_head(&v->pending);
+		erbtree_remove(&v->pending, &j->node);
+		QPOOL_UNLOCK;
+
+		qpool_job_check(j);
+		(*j->match)(j->arg);
+
+		QPOOL_LOCK;
+		eslist_append(&v->completed, j);
+		QPOOL_UNLOCK;
+
+		teq_safe_post_unique(THREAD_MAIN_ID, qpool_deliver, NULL);
+
+		QPOOL_LOCK;
+	}
+
+	QPOOL_UNLOCK;
+
+	return NULL;
+}
+
+/**
+ * Launch a new worker thread if we have queued jobs and no idle thread
+ * to process them, provided we have not reached the configured maximum.
+ *
+ * @attention
+ * Must be called with the pool locked.
+ */
+static void
+qpool_launch_locked(void)
+{
+	struct qpool_vars *v = &qpool_vars;
+	uint max = MIN(GNET_PROPERTY(search_match_threads), QPOOL_THREADS_MAX);
+	int r;
+
+	if (v->idle != 0 || v->threads >= max)
+		return;
+
+	r = thread_create(qpool_thread_main, NULL,
+			THREAD_F_NO_CANCEL | THREAD_F_NO_POOL | THREAD_F_WARN,
+			THREAD_STACK_DFLT);
+
+	if (-1 != r)
+		v->tid[v->threads++] = r;
+}
+
+/**
+ * @return whether queries should be matched by the thread pool.
+ */
+bool
+qpool_is_enabled(void)
+{
+	return qpool_vars.initialized && 0 != GNET_PROPERTY(search_match_threads);
+}
+
+/**
+ * @return amount of jobs waiting to be processed by the worker threads.
+ */
+size_t
+qpool_pending(void)
+{
+	size_t n;
+
+	QPOOL_LOCK;
+	n = erbtree_count(&qpool_vars.pending);
+	QPOOL_UNLOCK;
+
+	return n;
+}
+
+/**
+ * Submit a new matching job to the pool.
+ *
+ * The job is consumed in all cases: if it cannot be queued because
+ * the queue is full of more important jobs, the "drop" callback is
+ * immediately invoked on the argument.
+ *
+ * @param prio		job priority, larger values being more important
+ * @param match		callback to run from a worker thread
+ * @param done		callback to run from the main thread once matched
+ * @param drop		callback to run from the main thread if discarded
+ * @param arg		argument to pass to callbacks
+ *
+ * @return TRUE if the job was queued, FALSE if it was shed.
+ */
+bool
+qpool_submit(uint prio,
+	qpool_cb_t match, qpool_cb_t done, qpool_cb_t drop, void *arg)
+{
+	struct qpool_vars *v = &qpool_vars;
+	struct qpool_job *j, *shed = NULL;
+
+	g_assert(thread_is_main());
+	g_assert(match != NULL);
+	g_assert(done != NULL);
+	g_assert(drop != NULL);
+	g_assert(v->initialized);
+
+	WALLOC0(j);
+	j->magic = QPOOL_JOB_MAGIC;
+	j->prio = prio;
+	j->match = match;
+	j->done = done;
+	j->drop = drop;
+	j->arg = arg;
+
+	QPOOL_LOCK;
+
+	j->seq = v->seq++;
+
+	if (erbtree_count(&v->pending) >= GNET_PROPERTY(search_match_queue)) {
+		struct qpool_job *last = erbtree_tail(&v->pending);
+
+		qpool_job_check(last);
+
+		if (last->prio >= prio) {
+			shed = j;					/* Nothing less important queued */
+		} else {
+			erbtree_remove(&v->pending, &last->node);
+			shed = last;
+		}
+	}
+
+	if (shed != j) {
+		erbtree_insert(&v->pending, &j->node);
+		cond_signal(&qpool_work, &qpool_lock);
+		qpool_launch_locked();
+	}
+
+	QPOOL_UNLOCK;
+
+	if (shed != NULL)
+		qpool_job_free(shed, shed->drop);
+
+	return shed != j;
+}
+
+/**
+ * Initialize the query matching thread pool.
+ *
+ * No thread is created until the first job is submitted.
+ */
+void G_COLD
+qpool_init(void)
+{
+	struct qpool_vars *v = &qpool_vars;
+
+	erbtree_init(&v->pending, qpool_job_cmp, offsetof(struct qpool_job, node));
+	eslist_init(&v->completed, offsetof(struct qpool_job, lk));
+	v->initialized = TRUE;
+}
+
+/**
+ * Shutdown the query matching thread pool, waiting for the worker threads
+ * to terminate and discarding all the jobs not yet delivered.
+ */
+void G_COLD
+qpool_close(void)
+{
+	struct qpool_vars *v = &qpool_vars;
+	struct qpool_job *j;
+	uint i;
+
+	if (!v->initialized)
+		return;
+
+	QPOOL_LOCK;
+	v->exiting = TRUE;
+	cond_broadcast(&qpool_work, &qpool_lock);
+	QPOOL_UNLOCK;
+
+	/*
+	 * Workers may be in the middle of matching a query, which references
+	 * library data that is going to be freed by share_close(), hence we
+	 * need to wait for all of them to be gone.
+	 */
+
+	for (i = 0; i < v->threads; i++) {
+		if (-1 == thread_join(v->tid[i], NULL))
+			g_warning("%s(): cannot join with thread #%d: %m",
+				G_STRFUNC, v->tid[i]);
+	}
+
+	v->threads = 0;
+
+	while (NULL != (j = erbtree_head(&v->pending))) {
+		erbtree_remove(&v->pending, &j->node);
+		qpool_job_free(j, j->drop);
+	}
+
+	while (NULL != (j = eslist_shift(&v->completed)))
+		qpool_job_free(j, j->drop);
+
+	v->initialized = FALSE;
+}
+
+/* vi: set ts=4 sw=4 cindent: */
@@ -79,6 +79,7 @@
 #include "lib/tm.h"
 #include "lib/unsigned.h"
 #include "lib/utf8.h"
+#include "lib/vmm.h"
 #include "lib/walloc.h"
 #include "lib/wordvec.h"
 #include "lib/zlib_util.h"
@@ -193,6 +194,7 @@ struct routing_table {
 	unsigned compacted:1;	/**< Table was compacted */
 	unsigned cancelled:1;	/**< Must supersede with next version */
 	unsigned is_empty:1;	/**< Whether table is empty (all slots cleared) */
+	unsigned huge:1;		/**< Arena allocated via vmm_huge_alloc() */
 	/**
 	 * Whether this routing table can route the given URN query.
 	 */
@@ -348,6 +350,17 @@ qrp_hashcode(const char *s)
 	for (j = 0; '\0' != (uc = (uchar) *s); j = (j + 8) & 24) {
 		uint retlen;
 
+		/*
+		 * Words are canonized, hence mostly made of ASCII characters
+		 * which need not go through the UTF-8 decoder.
+		 */
+
+		if G_LIKELY(uc < 0x80) {
+			x ^= uc << j;
+			s++;
+			continue;
+		}
+
 		uc = utf8_decode_char_fast(s, &retlen);
 		if (!uc)
 			break;	/* Invalid encoding */
@@ -1128,7 +1141,12 @@ qrt_free(struct routing_table *rt)
 	g_assert(rt->refcnt == 0);
 
 	atom_sha1_free_null(&rt->digest);
-	HFREE_NULL(rt->arena);
+	if (rt->huge) {
+		vmm_huge_free(rt->arena, rt->len);
+		rt->arena = NULL;
+	} else {
+		HFREE_NULL(rt->arena);
+	}
 	HFREE_NULL(rt->name);
 
 	gnet_prop_set_guint32_val(PROP_QRP_MEMORY,
@@ -1191,12 +1209,17 @@ qrt_get_table(void)
 
 /**
  * Attempt to relocate the table arena to a better VM position.
+ *
+ * Arenas backed by huge pages are left where they are.
  */
 void
 qrt_arena_relocate(struct routing_table *rt)
 {
 	qrt_check(rt);
 
+	if (rt->huge)
+		return;
+
 	rt->arena = hrealloc(rt->arena, rt->len);
 }
 
@@ -4647,10 +4670,18 @@ qrt_handle_reset(
 	/*
 	 * Allocate the compacted area.
 	 * Since the table is empty, it is zero-ed.
+	 *
+	 * Large tables are probed randomly for each query we route, so we
+	 * request huge pages for them to limit TLB misses.
 	 */
 
 	slots = rt->slots / 8;			/* 8 bits per byte, table is compacted */
-	rt->arena = halloc0(slots);
+	if (vmm_huge_eligible(slots)) {
+		rt->arena = vmm_huge_alloc0(slots);
+		rt->huge = TRUE;
+	} else {
+		rt->arena = halloc0(slots);
+	}
 	rt->len = slots;
 
 	gnet_prop_set_guint32_val(PROP_QRP_MEMORY,
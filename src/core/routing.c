@@ -60,6 +60,7 @@
 #include "lib/str.h"
 #include "lib/stringify.h"
 #include "lib/tm.h"
+#include "lib/vmm.h"
 #include "lib/walloc.h"
 
 #include "lib/override.h"	/* Must be the last header included */
@@ -173,6 +174,7 @@ static const char *debug_msg[256];
 #define CHUNK_MESSAGES		(1 << CHUNK_BITS)
 #define CHUNK_INDEX(x)		(((x) & ~(CHUNK_MESSAGES - 1)) >> CHUNK_BITS)
 #define ENTRY_INDEX(x)		((x) & (CHUNK_MESSAGES - 1))
+#define CHUNK_SIZE			(CHUNK_MESSAGES * sizeof(struct message *))
 
 static struct {
 	struct message **chunks[MAX_CHUNKS];
@@ -182,6 +184,7 @@ static struct {
 	unsigned nchunks;			 /**< Amount of allocated chunks */
 	hset_t *messages_hashed;	 /**< All messages (key = struct message) */
 	time_t last_rotation;		 /**< Last time we restarted from idx=0 */
+	bool huge;					 /**< Chunks allocated via vmm_huge_alloc() */
 } routing;
 
 /**
@@ -976,7 +979,15 @@ routing_chunk_move(struct message **chunk, unsigned chunk_idx)
 	g_assert(chunk_idx < MAX_CHUNKS);
 	g_assert(chunk == routing.chunks[chunk_idx]);
 
-	nchunk = hrealloc(chunk, CHUNK_MESSAGES * sizeof(struct message *));
+	/*
+	 * Chunks backed by huge pages are not relocated: they sit in their
+	 * own aligned regions and would lose their huge page backing.
+	 */
+
+	if (routing.huge)
+		return chunk;
+
+	nchunk = hrealloc(chunk, CHUNK_SIZE);
 	if (nchunk == chunk)
 		return chunk;
 
@@ -1067,7 +1078,12 @@ routing_clear(unsigned idx)
 		}
 
 		routing.capacity -= CHUNK_MESSAGES;
-		HFREE_NULL(routing.chunks[i]);
+		if (routing.huge) {
+			vmm_huge_free(rchunk, CHUNK_SIZE);
+			routing.chunks[i] = NULL;
+		} else {
+			HFREE_NULL(routing.chunks[i]);
+		}
 	}
 
 	routing.nchunks = idx;
@@ -1200,8 +1216,8 @@ get_next_slot(bool advance, unsigned *cidx)
 
 			routing.nchunks++;
 			routing.capacity += CHUNK_MESSAGES;
-			routing.chunks[chunk_idx] =
-				halloc0(CHUNK_MESSAGES * sizeof(struct message *));
+			routing.chunks[chunk_idx] = routing.huge ?
+				vmm_huge_alloc0(CHUNK_SIZE) : halloc0(CHUNK_SIZE);
 
 			gnet_stats_inc_general(GNR_ROUTING_TABLE_CHUNKS);
 			gnet_stats_count_general(GNR_ROUTING_TABLE_CAPACITY,
@@ -1561,6 +1577,13 @@ routing_init(void)
 		message_hash_func2, message_compare_func);
 	routing.last_rotation = tm_time();
 
+	/*
+	 * Chunks are randomly accessed through the message slots, request
+	 * huge pages for them if we can.
+	 */
+
+	routing.huge = vmm_huge_eligible(CHUNK_SIZE);
+
 	/*
 	 * Push proxification and starving GUIDs.
 	 */
@@ -3208,7 +3231,10 @@ routing_close(void)
 					WFREE(m);
 				}
 			}
-			HFREE_NULL(chunk);
+			if (routing.huge)
+				vmm_huge_free(chunk, CHUNK_SIZE);
+			else
+				HFREE_NULL(chunk);
 		}
 	}
 
@@ -182,15 +182,14 @@ rx_inflate_init(rxdrv_t *rx, const void *args)
 	rx_check(rx);
 	g_assert(rargs->cb != NULL);
 
-	WALLOC(inz);
-	inz->zalloc = zlib_alloc_func;
-	inz->zfree = zlib_free_func;
-	inz->opaque = NULL;
+	/*
+	 * The window size is chosen by the remote compressor, so we must be
+	 * ready to handle the largest one.
+	 */
 
-	ret = inflateInit(inz);
+	ret = zlib_inflate_stream_get(&inz, MAX_WBITS);
 
 	if (ret != Z_OK) {
-		WFREE(inz);
 		g_warning("unable to initialize decompressor for peer %s: %s",
 			gnet_host_to_string(&rx->host), zlib_strerror(ret));
 		return NULL;
@@ -216,12 +215,12 @@ rx_inflate_destroy(rxdrv_t *rx)
 
 	g_assert(attr->inz);
 
-	ret = inflateEnd(attr->inz);
+	ret = zlib_stream_put(attr->inz);
 	if (ret != Z_OK)
 		g_warning("while freeing decompressor for peer %s: %s",
 			gnet_host_to_string(&rx->host), zlib_strerror(ret));
 
-	WFREE_TYPE_NULL(attr->inz);
+	attr->inz = NULL;
 	WFREE(attr);
 	rx->opaque = NULL;
 }
@@ -293,4 +292,25 @@ rx_inflate_get_ops(void)
 	return &rx_inflate_ops;
 }
 
+/**
+ * Look for an inflating layer in the RX stack, starting at the given driver
+ * and moving down the stack.
+ *
+ * @return memory used by the decompressor of the inflating layer, 0 if none.
+ */
+size_t
+rx_inflate_memory(const rxdrv_t *rx)
+{
+	for (; rx != NULL; rx = rx->lower) {
+		rx_check(rx);
+
+		if (&rx_inflate_ops == rx->ops) {
+			const struct attr *attr = rx->opaque;
+			return zlib_stream_memory(attr->inz);
+		}
+	}
+
+	return 0;
+}
+
 /* vi: set ts=4 sw=4 cindent: */
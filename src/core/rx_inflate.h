@@ -39,6 +39,7 @@
 #include "rx.h"
 
 const struct rxdrv_ops* rx_inflate_get_ops(void);
+size_t rx_inflate_memory(const rxdrv_t *rx);
 
 /**
  * Callbacks used by the inflating layer.
@@ -63,6 +63,7 @@
 #include "oob_proxy.h"
 #include "pcache.h"			/* For pcache_guess_acknowledge() */
 #include "qhit.h"
+#include "qpool.h"
 #include "qrp.h"
 #include "routing.h"
 #include "settings.h"		/* For listen_ip() */
@@ -5515,11 +5516,14 @@ search_init(void)
 		gnet_host_hash, gnet_host_equal, gnet_host_free_atom2);
 
 	cq_periodic_main_add(SEARCH_GC_PERIOD * 1000, search_gc, NULL);
+	qpool_init();
 }
 
 void G_COLD
 search_shutdown(void)
 {
+	qpool_close();		/* Wait for query matching threads */
+
 	while (sl_search_ctrl != NULL) {
 		search_ctrl_t *sch = sl_search_ctrl->data;
 
@@ -9118,6 +9122,185 @@ drop:
 	return TRUE;
 }
 
+/**
+ * Should hits for the query be delivered out-of-band?
+ */
+static bool
+search_request_should_oob(const gnutella_node_t *n,
+	const search_request_info_t *sri)
+{
+	return sri->oob && !sri->g2_query &&
+		GNET_PROPERTY(process_oob_queries) &&
+		GNET_PROPERTY(recv_solicited_udp) &&
+		udp_active() &&
+		gnutella_header_get_hops(&n->header) > 1 &&
+		settings_running_same_net(sri->addr);
+}
+
+enum search_match_magic { SEARCH_MATCH_MAGIC = 0x2f61c0d9 };
+
+/**
+ * An OOB query whose library matching is deferred to the query matching
+ * threads, via the thread pool.
+ */
+struct search_match {
+	enum search_match_magic magic;
+	search_request_info_t *sri;		/**< Private copy of query information */
+	struct query_context *qctx;		/**< Matching context */
+	const char *query;				/**< (atom) The query string */
+	const guid_t *muid;				/**< (atom) The query MUID */
+	struct nid *node_id;			/**< Node from which query came */
+	uint32 max_replies;				/**< Maximum amount of hits to return */
+	uint32 flags;					/**< SHARE_FM_* flags, for matching */
+};
+
+static inline void
+search_match_check(const struct search_match * const sm)
+{
+	g_assert(sm != NULL);
+	g_assert(SEARCH_MATCH_MAGIC == sm->magic);
+}
+
+/**
+ * Free deferred query matching, along with any results not handed over.
+ *
+ * This is the "drop" callback for the thread pool.
+ */
+static void
+search_match_free(void *arg)
+{
+	struct search_match *sm = arg;
+
+	search_match_check(sm);
+
+	shared_file_slist_free_null(&sm->qctx->files);
+	share_query_context_free(sm->qctx);
+	search_request_info_free_null(&sm->sri);
+	atom_str_free_null(&sm->query);
+	atom_guid_free_null(&sm->muid);
+	nid_unref(sm->node_id);
+	sm->magic = 0;
+	WFREE(sm);
+}
+
+/**
+ * Match query against the library.
+ *
+ * This is the "match" callback for the thread pool, run from one of the
+ * query matching threads.  We do not need to fill the query hash vector,
+ * this was done by search_request() when it deferred matching.
+ */
+static void
+search_match_run(void *arg)
+{
+	struct search_match *sm = arg;
+
+	search_match_check(sm);
+
+	shared_files_match(sm->query, sm->sri,
+		got_match, sm->qctx, sm->max_replies, sm->flags, NULL);
+}
+
+/**
+ * Hand over results to the OOB layer, now that matching is done.
+ *
+ * This is the "done" callback for the thread pool, run from the main thread.
+ */
+static void
+search_match_done(void *arg)
+{
+	struct search_match *sm = arg;
+	struct query_context *qctx;
+	const search_request_info_t *sri;
+
+	search_match_check(sm);
+
+	qctx = sm->qctx;
+	sri = sm->sri;
+
+	if (GNET_PROPERTY(query_debug) > 14) {
+		g_debug("QUERY #%s \"%s\" has %u hit%s (threaded matching)",
+			guid_hex_str(sm->muid), lazy_safe_search(sm->query),
+			qctx->found, plural(qctx->found));
+	}
+
+	/*
+	 * Conditions may have changed whilst the query was queued.
+	 */
+
+	if (
+		qctx->found > 0 &&
+		GNET_PROPERTY(process_oob_queries) && udp_active()
+	) {
+		gnutella_node_t *n = node_active_by_id(sm->node_id);
+		unsigned flags = 0;
+
+		if (n != NULL && settings_is_leaf() && node_ultra_received_qrp(n))
+			node_inc_qrp_match(n);
+
+		flags |= (sri->flags & QUERY_F_GGEP_H) ? QHIT_F_GGEP_H : 0;
+		flags |= sri->ipv6 ? QHIT_F_IPV6 : 0;
+		flags |= sri->ipv6_only ? QHIT_F_IPV6_ONLY : 0;
+
+		oob_got_query_results(sm->muid, qctx->files, qctx->found,
+			sri->addr, sri->port, sri->secure_oob, sri->sr_udp, flags);
+
+		qctx->files = NULL;		/* Handed over to the OOB layer */
+	}
+
+	search_match_free(sm);
+}
+
+/**
+ * Defer matching of an OOB query to the query matching threads.
+ *
+ * When the matching queue is full, the least important queries are dropped.
+ * Queries having travelled more hops have been seen by more servents, so
+ * our hits are less likely to be needed.  Secure OOB queries are favoured
+ * since their reply address cannot be spoofed.
+ *
+ * @param n				the node from which the query comes from
+ * @param sri			the information gathered during the pre-processing stage
+ * @param search		the query string
+ * @param max_replies	maximum amount of hits to return
+ */
+static void
+search_request_defer(const gnutella_node_t *n,
+	const search_request_info_t *sri, const char *search, uint32 max_replies)
+{
+	struct search_match *sm;
+	uint8 hops = gnutella_header_get_hops(&n->header);
+	uint prio;
+
+	WALLOC0(sm);
+	sm->magic = SEARCH_MATCH_MAGIC;
+	sm->sri = search_request_info_alloc();
+	*sm->sri = *sri;					/* Struct copy */
+	sm->sri->extended_query = NULL;		/* Not needed, query given below */
+	sm->qctx = share_query_context_make(sm->sri);
+	sm->query = atom_str_get(search);
+	sm->muid = atom_guid_get(gnutella_header_get_muid(&n->header));
+	sm->node_id = nid_ref(NODE_ID(n));
+	sm->max_replies = max_replies;
+	sm->flags = sri->partials ? SHARE_FM_PARTIALS : 0;
+
+	prio = (sri->secure_oob ? 256 : 0) + (255 - hops);
+
+	if (qpool_submit(prio,
+		search_match_run, search_match_done, search_match_free, sm)
+	) {
+		gnet_stats_inc_general(GNR_OOB_QUERIES_THREADED);
+	} else {
+		gnet_stats_inc_general(GNR_OOB_QUERIES_SHED);
+
+		if (GNET_PROPERTY(query_debug) > 2) {
+			g_debug("QUERY OOB #%s \"%s\" shed: %zu queries pending matching",
+				guid_hex_str(gnutella_header_get_muid(&n->header)),
+				lazy_safe_search(search), qpool_pending());
+		}
+	}
+}
+
 /**
  * Searches requests (from others nodes)
  * Basic matching. The search request is made lowercase and
@@ -9316,11 +9499,28 @@ search_request(gnutella_node_t *n,
 			}
 		}
 
-		qctx = share_query_context_make(sri);
 		max_replies = GNET_PROPERTY(search_max_items) == (uint32) -1
 				? 255
 				: GNET_PROPERTY(search_max_items);
 
+		/*
+		 * Keyword matching of OOB queries can be deferred to the query
+		 * matching threads since hits are not sent back through the
+		 * connection where the query came from.  The query hash vector
+		 * needed to route the query will be filled below, at "finish".
+		 */
+
+		if (
+			!sri->whats_new && !sri->skip_file_search &&
+			0 == sri->exv_sha1cnt && qpool_is_enabled() &&
+			search_request_should_oob(n, sri)
+		) {
+			search_request_defer(n, sri, search, max_replies);
+			goto finish;
+		}
+
+		qctx = share_query_context_make(sri);
+
 		/*
 		 * Search each SHA1.
 		 */
@@ -9446,12 +9646,7 @@ search_request(gnutella_node_t *n,
 			flags |= sri->ipv6 ? QHIT_F_IPV6 : 0;
 			flags |= sri->ipv6_only ? QHIT_F_IPV6_ONLY : 0;
 
-			should_oob = oob && !sri->g2_query &&
-							GNET_PROPERTY(process_oob_queries) &&
-							GNET_PROPERTY(recv_solicited_udp) &&
-							udp_active() &&
-							gnutella_header_get_hops(&n->header) > 1 &&
-							settings_running_same_net(sri->addr);
+			should_oob = search_request_should_oob(n, sri);
 
 			if (should_oob) {
 				oob_got_results(n, qctx->files, qctx->found,
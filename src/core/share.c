@@ -149,6 +149,8 @@ struct shared_file {
 
 	int refcnt;					/**< Reference count */
 	uint32 flags;				/**< See below for definition */
+
+	struct qhit_record *qhit_rec[QHIT_RECORD_SLOTS];	/**< Cached hit entries */
 };
 
 /**
@@ -208,6 +210,12 @@ static spinlock_t shared_libfile_slk = SPINLOCK_INIT;
 #define assert_shared_libfile_locked()	\
 	g_assert(spinlock_is_held(&shared_libfile_slk))
 
+/*
+ * Protects the query hit entries cached in shared files, which are
+ * used concurrently by threads building hits.
+ */
+static spinlock_t shared_file_qhit_slk = SPINLOCK_INIT;
+
 #define GENERATE_ACCESSOR(type, field)	\
 static inline type field() {			\
 	type result;						\
@@ -545,6 +553,7 @@ shared_file_free(shared_file_t **sf_ptr)
 	g_assert(sf_ptr);
 	if (*sf_ptr) {
 		shared_file_t *sf = *sf_ptr;
+		uint i;
 
 		g_assert(0 == sf->refcnt);
 
@@ -554,6 +563,9 @@ shared_file_free(shared_file_t **sf_ptr)
 		g_assert_log(0 == (sf->flags & SHARE_F_INDEXED),
 			"%s(): invoked on file still indexed", G_STRFUNC);
 
+		for (i = 0; i < N_ITEMS(sf->qhit_rec); i++)
+			qhit_record_unref(&sf->qhit_rec[i]);
+
 		atom_sha1_free_null(&sf->sha1);
 		atom_tth_free_null(&sf->tth);
 		atom_str_free_null(&sf->relative_path);
@@ -3836,6 +3848,63 @@ shared_file_set_path(shared_file_t *sf, const char *pathname)
 	atom_str_change(&sf->file_path, pathname);
 }
 
+/**
+ * Get the pre-encoded query hit entry cached for the file.
+ *
+ * The entries are built and checked for accuracy by the query hit builder,
+ * we only keep them around until the file is freed.
+ *
+ * @param sf		the shared file
+ * @param slot		the cache slot, as chosen by the query hit builder
+ *
+ * @return a new reference on the cached entry, NULL if none.
+ */
+struct qhit_record *
+shared_file_qhit_record(const shared_file_t *sf, uint slot)
+{
+	struct qhit_record *r;
+
+	shared_file_check(sf);
+	g_assert(slot < N_ITEMS(sf->qhit_rec));
+
+	spinlock(&shared_file_qhit_slk);
+	r = sf->qhit_rec[slot];
+	if (r != NULL)
+		qhit_record_ref(r);
+	spinunlock(&shared_file_qhit_slk);
+
+	return r;
+}
+
+/**
+ * Cache pre-encoded query hit entry for the file, replacing any previous
+ * entry in the slot.
+ *
+ * @param sf		the shared file
+ * @param slot		the cache slot, as chosen by the query hit builder
+ * @param r			the entry, on which a new reference is taken
+ */
+void
+shared_file_set_qhit_record(const shared_file_t *sf, uint slot,
+	struct qhit_record *r)
+{
+	shared_file_t *wsf = deconstify_pointer(sf);
+	struct qhit_record *old;
+
+	shared_file_check(sf);
+	g_assert(slot < N_ITEMS(sf->qhit_rec));
+
+	if (r != NULL)
+		qhit_record_ref(r);
+
+	spinlock(&shared_file_qhit_slk);
+	old = wsf->qhit_rec[slot];
+	wsf->qhit_rec[slot] = r;
+	spinunlock(&shared_file_qhit_slk);
+
+	qhit_record_unref(&old);
+}
+
 void
 shared_file_from_fileinfo(fileinfo_t *fi)
 {
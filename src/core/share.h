@@ -118,6 +118,12 @@ void shared_file_set_tth(shared_file_t *, const struct tth *tth);
 void shared_file_set_modification_time(shared_file_t *sf, time_t mtime);
 void shared_file_set_path(shared_file_t *sf, const char *pathname);
 
+struct qhit_record;
+
+struct qhit_record *shared_file_qhit_record(const shared_file_t *sf, uint slot);
+void shared_file_set_qhit_record(const shared_file_t *sf, uint slot,
+	struct qhit_record *r);
+
 void shared_file_check(const shared_file_t * const sf);
 void shared_file_name_check(const shared_file_t * const sf);
 bool sha1_hash_available(const shared_file_t *sf) G_PURE;
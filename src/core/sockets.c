@@ -115,6 +115,13 @@
 #define UDP_QUEUED_GUESS	65536	/**< Guess amount of pending RX input */
 #define UDP_QUEUE_DELAY_MS	250		/**< RX queue processing delay */
 #define TLS_BAN_FREQ		300		/**< Avoid TLS for 5 minutes */
+#define SOCK_ACCEPT_BATCH	32		/**< Max connections accepted per wakeup */
+#define SOCK_LISTEN_BACKLOG	128		/**< Pending connections queued by kernel */
+#define SOCK_TUNE_MIN		4096	/**< Buffer size for idle Gnutella links */
+#define SOCK_TUNE_MAX		4194304	/**< 4M - Max buffer for HTTP transfers */
+#define SOCK_TUNE_IDLE		60000	/**< ms without data before link is idle */
+#define SOCK_TUNE_SLOW		256		/**< Slower links (bytes/s) are idle */
+#define SOCK_TUNE_RTT		100000	/**< Default RTT, in usecs */
 
 enum {
 	SOCK_ADNS_PENDING	= 1 << 0,	/**< Don't free() the socket too early */
@@ -132,6 +139,9 @@ struct gnutella_socket *s_local_listen = NULL;
 static aging_table_t *tls_ban;
 static once_flag_t tls_ban_inited;
 
+static struct socket_bufstats socket_buffers;
+static unsigned socket_buf_max[2];	/**< Kernel cap on RX / TX buffers */
+
 static bool socket_is_shutdowning;	/**< Layer shutdown has started */
 static bool socket_shutdowned;		/**< Set when layer has been shutdowned */
 
@@ -1540,6 +1550,42 @@ socket_udp_qfree(void *item, void *unused_data)
 	socket_udpq_free(item);
 }
 
+/**
+ * Record new configured buffer size for the socket, keeping the global
+ * accounting of kernel socket buffers up-to-date.
+ */
+static void
+socket_buf_account(struct gnutella_socket *s,
+	enum socket_buftype type, unsigned size)
+{
+	switch (type) {
+	case SOCK_BUF_RX:
+		socket_buffers.rcvbuf -= s->so_rcvbuf;
+		socket_buffers.rcvbuf += size;
+		s->so_rcvbuf = size;
+		return;
+	case SOCK_BUF_TX:
+		socket_buffers.sndbuf -= s->so_sndbuf;
+		socket_buffers.sndbuf += size;
+		s->so_sndbuf = size;
+		return;
+	}
+
+	g_assert_not_reached();
+}
+
+/**
+ * Forget about the buffer sizes configured on the socket, when its file
+ * descriptor is closed.
+ */
+static void
+socket_buf_forget(struct gnutella_socket *s)
+{
+	socket_buf_account(s, SOCK_BUF_RX, 0);
+	socket_buf_account(s, SOCK_BUF_TX, 0);
+	s->so_rcvbase = s->so_sndbase = 0;
+}
+
 /**
  * Dispose of socket, closing connection, removing input callback, and
  * reclaiming attached getline buffer.
@@ -1619,6 +1665,7 @@ socket_free(struct gnutella_socket *s)
 		}
 		s->file_desc = INVALID_SOCKET;
 	}
+	socket_buf_forget(s);
 	s->pos = 0;				/* Ensure no complain from socket_free_buffer() */
 	socket_free_buffer(s);
 	socket_dealloc(&s);
@@ -2103,10 +2150,13 @@ socket_read(void *data, int source, inputevt_cond_t cond)
 	}
 
 	/*
-	 * Deny connections from hostile IP addresses.
+	 * Deny connections from shunned IP addresses.
 	 *
-	 * We do this after banning checks so that if they hammer us, they
-	 * get banned silently.
+	 * Addresses flagged as bad are already closed by socket_accept_reject()
+	 * when the connection is accepted, so only shunned addresses (or bad
+	 * ones loaded after the connection was accepted) can reach this point.
+	 * We do this after banning checks so that if they hammer us, they get
+	 * banned silently.
 	 */
 
 	hostile = hostiles_check(s->addr);
@@ -2482,40 +2532,108 @@ socket_local_port(const struct gnutella_socket *s)
 }
 
 /**
- * Someone is connecting to us.
+ * Accept a new connection on listening socket.
+ *
+ * The returned file descriptor is non-blocking and closed on exec().  When
+ * accept4() is available, these flags are set atomically by the kernel,
+ * which saves a few system calls per connection.
+ *
+ * @param s		the listening socket
+ * @param addr	where the address of the peer is written
+ *
+ * @return new file descriptor, -1 on error with errno set.
  */
-static void
-socket_accept(void *data, int unused_source, inputevt_cond_t cond)
+static int
+socket_accept_fd(const struct gnutella_socket *s, socket_addr_t *addr)
 {
-	socket_addr_t addr;
 	socklen_t addr_len;
-	struct gnutella_socket *s = data;
-	struct gnutella_socket *t = NULL;
 	int fd;
 
-	(void) unused_source;
-	socket_check(s);
-	g_assert(s->flags & (SOCK_F_TCP | SOCK_F_LOCAL));
+#ifdef HAS_ACCEPT4
+	static bool no_accept4;
 
-	if G_UNLIKELY(cond & INPUT_EVENT_EXCEPTION) {
-		g_warning("%s(): input exception on TCP listening socket #%d!",
-			G_STRFUNC, s->file_desc);
-		return;		/* Ignore it, what else can we do? */
+	if G_LIKELY(!no_accept4) {
+		addr_len = socket_addr_init(addr, s->net);
+		fd = accept4(s->file_desc, socket_addr_get_sockaddr(addr), &addr_len,
+				SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+		if (fd >= 0 || (ENOSYS != errno && EINVAL != errno))
+			return fd;
+
+		/*
+		 * ENOSYS: kernel does not implement accept4().
+		 * EINVAL: kernel does not know about the flags we pass.
+		 */
+
+		no_accept4 = TRUE;
 	}
+#endif	/* HAS_ACCEPT4 */
 
-	switch (s->type) {
-	case SOCK_TYPE_CONTROL:
-		break;
-	default:
-		g_warning("%s(): unknown listening socket type %d !",
-			G_STRFUNC, s->type);
-		socket_destroy(s, NULL);
-		return;
+	addr_len = socket_addr_init(addr, s->net);
+	fd = compat_accept(s->file_desc, socket_addr_get_sockaddr(addr), &addr_len);
+
+	if (fd >= 0) {
+		fd_set_close_on_exec(fd);
+		fd_set_nonblocking(fd);
+	}
+
+	return fd;
+}
+
+/**
+ * Cheap IP-level screening of incoming TCP connections, performed before
+ * any resource is allocated for them.
+ *
+ * @return TRUE if connection from `addr' must be dropped.
+ */
+static bool
+socket_accept_reject(const host_addr_t addr, uint16 port)
+{
+	if (ctl_limit(addr, CTL_S_ANY_TCP | CTL_D_STEALTH)) {
+		if (GNET_PROPERTY(ctl_debug) > 2) {
+			g_debug("%s(): CTL closing incoming TCP connection from %s [%s]",
+				G_STRFUNC, host_addr_port_to_string(addr, port),
+				gip_country_cc(addr));
+		}
+		return TRUE;
+	}
+
+	/*
+	 * Close connections from bad hostile addresses right away, without
+	 * reading their request.  This happens before socket_read() so the
+	 * ban_allow() and PARQ banning accounting is skipped and no 550 reply
+	 * is sent: since these addresses are refused anyway, there is no point
+	 * in counting their attempts towards a ban, and giving them no reply
+	 * costs us the least during connection storms.
+	 */
+
+	if (hostiles_flags_are_bad(hostiles_check(addr))) {
+		if (GNET_PROPERTY(socket_debug) > 1) {
+			g_debug("%s(): closing incoming TCP connection from hostile %s",
+				G_STRFUNC, host_addr_port_to_string(addr, port));
+		}
+		return TRUE;
 	}
 
-	addr_len = socket_addr_init(&addr, s->net);
-	fd = compat_accept(s->file_desc,
-			socket_addr_get_sockaddr(&addr), &addr_len);
+	return FALSE;
+}
+
+/**
+ * Accept one pending connection on the listening socket.
+ *
+ * @return TRUE if a connection was dequeued, FALSE if there are no more
+ * pending connections or we cannot accept them right now.
+ */
+static bool
+socket_accept_one(struct gnutella_socket *s)
+{
+	socket_addr_t addr;
+	struct gnutella_socket *t = NULL;
+	host_addr_t peer = zero_host_addr;
+	uint16 port = 0;
+	int fd, nfd;
+
+	fd = socket_accept_fd(s, &addr);
 
 	if (fd < 0) {
 		/*
@@ -2527,9 +2645,7 @@ socket_accept(void *data, int unused_source, inputevt_cond_t cond)
 			(errno == EMFILE || errno == ENFILE) &&
 			reclaim_fd != NULL && (*reclaim_fd)()
 		) {
-			addr_len = socket_addr_init(&addr, s->net);
-			fd = compat_accept(s->file_desc, socket_addr_get_sockaddr(&addr),
-					&addr_len);
+			fd = socket_accept_fd(s, &addr);
 		}
 
 		if (fd < 0) {
@@ -2543,22 +2659,51 @@ socket_accept(void *data, int unused_source, inputevt_cond_t cond)
 					socket_evt_clear(s);
 				}
 			}
-			return;
+			return ECONNABORTED == errno;
 		}
 
 		g_warning("had to close a banned fd to accept new connection");
 	}
-	fd = fd_get_non_stdio(fd);
+
+	nfd = fd_get_non_stdio(fd);
+	if (nfd != fd) {
+		fd = nfd;
+		fd_set_close_on_exec(fd);	/* Flag is not inherited by dup() */
+	}
 
 	if (s->flags & SOCK_F_TCP)
 		bws_sock_accepted(SOCK_TYPE_HTTP);	/* Do not charge Gnet for that */
 
 	/*
-	 * Create a new struct socket for this incoming connection
+	 * Identify the remote TCP peer and screen it before allocating anything.
 	 */
 
-	fd_set_close_on_exec(fd);
-	fd_set_nonblocking(fd);
+	if (SOCK_F_TCP & s->flags) {
+		peer = socket_addr_get_addr(&addr);
+		port = socket_addr_get_port(&addr);
+
+		if (!is_host_addr(peer)) {
+			if (socket_addr_getpeername(&addr, fd)) {
+				g_warning("getpeername() failed: %m");
+				goto drop;
+			}
+			peer = socket_addr_get_addr(&addr);
+			port = socket_addr_get_port(&addr);
+			if (!is_host_addr(peer)) {
+				g_warning("incoming TCP connection from unidentifiable source");
+				goto drop;
+			}
+			g_warning("had to use getpeername() after accept(): peer=%s",
+				host_addr_port_to_string(peer, port));
+		}
+
+		if (socket_accept_reject(peer, port))
+			goto drop;
+	}
+
+	/*
+	 * Create a new struct socket for this incoming connection
+	 */
 
 	t = socket_alloc();
 
@@ -2567,8 +2712,8 @@ socket_accept(void *data, int unused_source, inputevt_cond_t cond)
 	t->type = s->type;
 
 	if (SOCK_F_TCP & s->flags) {
-		t->addr = socket_addr_get_addr(&addr);
-		t->port = socket_addr_get_port(&addr);
+		t->addr = peer;
+		t->port = port;
 		t->local_port = s->local_port;
 		t->flags |= SOCK_F_TCP;
 	} else {
@@ -2578,36 +2723,6 @@ socket_accept(void *data, int unused_source, inputevt_cond_t cond)
 	}
 	t->net = host_addr_net(t->addr);
 
-	if ((SOCK_F_TCP & t->flags) && !is_host_addr(t->addr)) {
-		if (socket_addr_getpeername(&addr, t->file_desc)) {
-			g_warning("getpeername() failed: %m");
-			socket_free_null(&t);
-			return;
-		}
-		t->addr = socket_addr_get_addr(&addr);
-		t->port = socket_addr_get_port(&addr);
-		if (!is_host_addr(t->addr)) {
-			g_warning("incoming TCP connection from unidentifiable source");
-			socket_free_null(&t);
-			return;
-		}
-		g_warning("had to use getpeername() after accept(): peer=%s",
-			host_addr_port_to_string(t->addr, t->port));
-	}
-
-	if (
-		(t->flags & SOCK_F_TCP) &&
-		ctl_limit(t->addr, CTL_S_ANY_TCP | CTL_D_STEALTH)
-	) {
-		if (GNET_PROPERTY(ctl_debug) > 2) {
-			g_debug("%s(): CTL closing incoming TCP connection from %s [%s]",
-				G_STRFUNC, host_addr_port_to_string(t->addr, t->port),
-				gip_country_cc(t->addr));
-		}
-		socket_free_null(&t);
-		return;
-	}
-
 	t->tls.enabled = s->tls.enabled; /* Inherit from listening socket */
 	t->tls.stage = SOCK_TLS_NONE;
 	t->tls.ctx = NULL;
@@ -2659,6 +2774,60 @@ socket_accept(void *data, int unused_source, inputevt_cond_t cond)
 	inet_got_incoming(t->addr);	/* Signal we got an incoming connection */
 	if (!GNET_PROPERTY(force_local_ip))
 		guess_local_addr(t);
+
+	return TRUE;
+
+drop:
+	bws_sock_closed(SOCK_TYPE_HTTP, FALSE);
+	compat_socket_close(fd);
+	return TRUE;
+}
+
+/**
+ * Someone is connecting to us.
+ */
+static void
+socket_accept(void *data, int unused_source, inputevt_cond_t cond)
+{
+	struct gnutella_socket *s = data;
+	uint i;
+
+	(void) unused_source;
+	socket_check(s);
+	g_assert(s->flags & (SOCK_F_TCP | SOCK_F_LOCAL));
+
+	if G_UNLIKELY(cond & INPUT_EVENT_EXCEPTION) {
+		g_warning("%s(): input exception on TCP listening socket #%d!",
+			G_STRFUNC, s->file_desc);
+		return;		/* Ignore it, what else can we do? */
+	}
+
+	switch (s->type) {
+	case SOCK_TYPE_CONTROL:
+		break;
+	default:
+		g_warning("%s(): unknown listening socket type %d !",
+			G_STRFUNC, s->type);
+		socket_destroy(s, NULL);
+		return;
+	}
+
+	/*
+	 * Drain all the pending connections, so that the kernel backlog does
+	 * not overflow during connection storms, but bound the amount of work
+	 * done at each wakeup: the listening socket remains readable when
+	 * more connections are pending and we'll be called again.
+	 */
+
+	for (i = 0; i < SOCK_ACCEPT_BATCH; i++) {
+		if (!socket_accept_one(s))
+			break;
+	}
+
+	if (i > 1 && GNET_PROPERTY(socket_debug) > 1) {
+		g_debug("%s(): dequeued %u connection%s on listening socket #%d",
+			G_STRFUNC, i, plural(i), s->file_desc);
+	}
 }
 
 #if defined(CMSG_FIRSTHDR) && defined(CMSG_NXTHDR)
@@ -3786,6 +3955,7 @@ socket_reconnect(struct gnutella_socket *s)
 	socket_evt_clear(s);
 	s_close(s->file_desc);
 	s->file_desc = INVALID_SOCKET;
+	socket_buf_forget(s);
 	s->flags = 0;
 	if (socket_with_tls(s)) {
 		tls_free(s);
@@ -3868,6 +4038,7 @@ socket_connect_by_name_helper(const host_addr_t *addrs, size_t n,
 		if (is_valid_fd(s->file_desc)) {
 			s_close(s->file_desc);
 			s->file_desc = INVALID_SOCKET;
+			socket_buf_forget(s);
 		}
 		if (can_tls) {
 			s->flags |= SOCK_F_TLS;
@@ -4197,7 +4368,7 @@ socket_local_listen(const char *pathname)
 
 	/* listen() the socket */
 
-	if (compat_listen(fd, 5) == -1) {
+	if (compat_listen(fd, SOCK_LISTEN_BACKLOG) == -1) {
 		g_warning("unable to listen() on the socket: %m");
 		socket_destroy(s, "Unable to listen on socket");
 		return NULL;
@@ -4240,7 +4411,7 @@ socket_tcp_listen(host_addr_t bind_addr, uint16 port)
 
 	/* listen() the socket */
 
-	if (listen(fd, 5) == -1) {
+	if (listen(fd, SOCK_LISTEN_BACKLOG) == -1) {
 		g_warning("%s(): unable to listen() on the socket: %m", G_STRFUNC);
 		socket_destroy(s, "Unable to listen on socket");
 		return NULL;
@@ -4471,6 +4642,28 @@ socket_cork(struct gnutella_socket *s, bool on)
 }
 #endif /* TCP_CORK || TCP_NOPUSH */
 
+/*
+ * Read current size of the send/receive buffer, warning if it cannot be done.
+ *
+ * @return the size of the socket buffer, 0 if unknown.
+ */
+static unsigned
+socket_get_intern(int fd, int option, const char *type)
+{
+	unsigned len = 0;
+	socklen_t optlen = sizeof(len);
+
+	if (-1 == getsockopt(fd, SOL_SOCKET, option, &len, &optlen))
+		g_warning("cannot read %s buffer length on fd #%d: %m", type, fd);
+
+/* FIXME: needs to add metaconfig test */
+#ifdef LINUX_SYSTEM
+	len >>= 1;		/* Linux returns twice the real amount */
+#endif
+
+	return len;
+}
+
 /*
  * Internal routine for socket_send_buf() and socket_recv_buf().
  * Set send/receive buffer to specified size, and warn if it cannot be done.
@@ -4484,23 +4677,15 @@ static unsigned
 socket_set_intern(int fd, int option, unsigned size,
 	const char *type, bool shrink)
 {
-	unsigned old_len = 0;
-	unsigned new_len = 0;
-	socklen_t len;
+	unsigned old_len;
+	unsigned new_len;
 
 	if (0 == size)
 		return 0;
 
 	size = (size + 1) & ~0x1U;	/* Must be even, round to upper boundary */
 
-	len = sizeof(old_len);
-	if (-1 == getsockopt(fd, SOL_SOCKET, option, &old_len, &len))
-		g_warning("cannot read old %s buffer length on fd #%d: %m", type, fd);
-
-/* FIXME: needs to add metaconfig test */
-#ifdef LINUX_SYSTEM
-	old_len >>= 1;		/* Linux returns twice the real amount */
-#endif
+	old_len = socket_get_intern(fd, option, type);
 
 	if (!shrink && old_len >= size) {
 		if (GNET_PROPERTY(socket_debug) > 5)
@@ -4514,13 +4699,7 @@ socket_set_intern(int fd, int option, unsigned size,
 		g_warning("%s(): cannot set new %s buffer length to %u on fd #%d: %m",
 			G_STRFUNC, type, size, fd);
 
-	len = sizeof(new_len);
-	if (-1 == getsockopt(fd, SOL_SOCKET, option, &new_len, &len))
-		g_warning("cannot read new %s buffer length on fd #%d: %m", type, fd);
-
-#ifdef LINUX_SYSTEM
-	new_len >>= 1;		/* Linux returns twice the real amount */
-#endif
+	new_len = socket_get_intern(fd, option, type);
 
 	if (GNET_PROPERTY(socket_debug) > 5)
 		g_debug("%s(): socket %s buffer on fd #%d: %u -> %u bytes (now %u) %s",
@@ -4539,8 +4718,9 @@ socket_send_buf(struct gnutella_socket *s, int size, bool shrink)
 {
 	socket_check(s);
 	g_return_if_fail(!(s->flags & SOCK_F_SHUTDOWN));
-	s->so_sndbuf =
-		socket_set_intern(s->file_desc, SO_SNDBUF, size, "send", shrink);
+	socket_buf_account(s, SOCK_BUF_TX,
+		socket_set_intern(s->file_desc, SO_SNDBUF, size, "send", shrink));
+	s->so_sndbase = s->so_sndbuf;
 }
 
 /**
@@ -4552,8 +4732,164 @@ socket_recv_buf(struct gnutella_socket *s, int size, bool shrink)
 {
 	socket_check(s);
 	g_return_if_fail(!(s->flags & SOCK_F_SHUTDOWN));
-	s->so_rcvbuf =
-		socket_set_intern(s->file_desc, SO_RCVBUF, size, "receive", shrink);
+	socket_buf_account(s, SOCK_BUF_RX,
+		socket_set_intern(s->file_desc, SO_RCVBUF, size, "receive", shrink));
+	s->so_rcvbase = s->so_rcvbuf;
+}
+
+/**
+ * Fill supplied structure with the kernel socket buffer accounting.
+ */
+void
+socket_buffer_stats(struct socket_bufstats *sbs)
+{
+	g_assert(sbs != NULL);
+
+	*sbs = socket_buffers;		/* Struct copy */
+}
+
+/**
+ * Fetch the smoothed round-trip time of a TCP connection, along with the
+ * time elapsed since data was last sent or received, depending on `type'.
+ *
+ * @param s		the TCP socket
+ * @param type	whether we're interested in the RX or TX side
+ * @param rtt	where RTT is written, in usecs
+ * @param idle	where idle time is written, in ms
+ *
+ * @return TRUE if information could be retrieved from the kernel.
+ */
+static bool
+socket_tcp_info(const struct gnutella_socket *s, enum socket_buftype type,
+	unsigned *rtt, unsigned *idle)
+{
+#ifdef HAS_TCP_INFO
+	struct tcp_info ti;
+	socklen_t len = sizeof ti;
+
+	ZERO(&ti);
+
+	if (-1 == getsockopt(s->file_desc, sol_tcp(), TCP_INFO, &ti, &len))
+		return FALSE;
+
+	*rtt = ti.tcpi_rtt;
+	*idle = SOCK_BUF_RX == type ?
+		ti.tcpi_last_data_recv : ti.tcpi_last_data_sent;
+
+	return TRUE;
+#else
+	(void) s;
+	(void) type;
+	(void) rtt;
+	(void) idle;
+	return FALSE;
+#endif /* HAS_TCP_INFO */
+}
+
+/**
+ * Adapt the kernel buffer size of a TCP connection to its traffic.
+ *
+ * Gnutella links carry small messages and spend most of their time idle:
+ * their buffers are shrunk when no data flows, and restored to the size
+ * the owner requested as soon as traffic resumes.  HTTP transfers get
+ * buffers sized to twice their bandwidth-delay product, never below the
+ * size requested by the owner.
+ *
+ * Sockets whose buffers were never explicitly sized are left to the kernel.
+ *
+ * @param wio	the wrapped I/O object of the socket
+ * @param type	whether to tune the RX or TX buffer
+ * @param bps	measured bandwidth on that side, in bytes/s
+ */
+static void
+socket_buf_autotune(struct wrap_io *wio, enum socket_buftype type, uint64 bps)
+{
+	struct gnutella_socket *s = wio->ctx;
+	unsigned base, cur, target, size;
+	unsigned rtt = SOCK_TUNE_RTT, idle = 0;
+	int option = SOCK_BUF_RX == type ? SO_RCVBUF : SO_SNDBUF;
+	const char *what = SOCK_BUF_RX == type ? "receive" : "send";
+
+	socket_check(s);
+
+	if (!(s->flags & SOCK_F_TCP) || (s->flags & SOCK_F_SHUTDOWN))
+		return;
+
+	if (!is_valid_fd(s->file_desc))
+		return;
+
+	base = SOCK_BUF_RX == type ? s->so_rcvbase : s->so_sndbase;
+	cur  = SOCK_BUF_RX == type ? s->so_rcvbuf : s->so_sndbuf;
+
+	if (0 == base)
+		return;
+
+	if (socket_tcp_info(s, type, &rtt, &idle) && 0 == rtt)
+		rtt = SOCK_TUNE_RTT;
+
+	switch (s->type) {
+	case SOCK_TYPE_CONTROL:
+		if (idle >= SOCK_TUNE_IDLE || bps < SOCK_TUNE_SLOW)
+			target = MIN(base, SOCK_TUNE_MIN);
+		else
+			target = base;
+		break;
+	case SOCK_TYPE_DOWNLOAD:
+	case SOCK_TYPE_UPLOAD:
+		{
+			uint64 bdp = bps * rtt / 1000000;
+			target = MIN(2 * bdp, SOCK_TUNE_MAX);
+			target = MAX(target, base);
+		}
+		break;
+	default:
+		return;
+	}
+
+	if (socket_buf_max[type] != 0)
+		target = MIN(target, socket_buf_max[type]);
+
+	/*
+	 * Avoid changing the buffer size for small variations: only act when
+	 * the new size differs by at least 25% from the current one.
+	 */
+
+	if (target == cur)
+		return;
+
+	if (target > cur ? target - cur < cur / 4 : cur - target < cur / 4)
+		return;
+
+	/*
+	 * The kernel silently caps the buffer size to its configured maximum,
+	 * in which case socket_set_intern() reports the old size although the
+	 * buffer did change: read back the actual size, and remember the cap
+	 * so that we stop asking for more than we can get.
+	 */
+
+	(void) socket_set_intern(s->file_desc, option, target, what, TRUE);
+	size = socket_get_intern(s->file_desc, option, what);
+
+	if (target > cur && size < target && size != 0)
+		socket_buf_max[type] = size;
+
+	if (0 == size || size == cur)
+		return;
+
+	if (size > cur)
+		socket_buffers.grown++;
+	else
+		socket_buffers.shrunk++;
+
+	if (GNET_PROPERTY(socket_debug) > 2) {
+		g_debug("%s(): %s %s buffer on fd #%d: %u -> %u bytes "
+			"(%s bytes/s, RTT %u us, idle %u ms)",
+			G_STRFUNC, SOCK_TYPE_CONTROL == s->type ? "Gnutella" : "HTTP",
+			SOCK_BUF_RX == type ? "RX" : "TX", s->file_desc, cur, size,
+			uint64_to_string(bps), rtt, idle);
+	}
+
+	socket_buf_account(s, type, size);
 }
 
 /**
@@ -4782,6 +5118,15 @@ socket_no_flush(struct wrap_io *unused_wio)
 	return 0;
 }
 
+static void
+socket_no_autotune(struct wrap_io *unused_wio,
+	enum socket_buftype unused_type, uint64 unused_bps)
+{
+	(void) unused_wio;
+	(void) unused_type;
+	(void) unused_bps;
+}
+
 static void
 socket_wio_link(struct gnutella_socket *s)
 {
@@ -4793,14 +5138,17 @@ socket_wio_link(struct gnutella_socket *s)
 	s->wio.fd = socket_get_fd;
 	s->wio.flush = socket_no_flush;
 	s->wio.bufsize = socket_get_bufsize;
+	s->wio.autotune = socket_buf_autotune;
 
 	if (s->flags & SOCK_F_UDP) {
+		s->wio.autotune = socket_no_autotune;
 		s->wio.write = socket_no_write;
 		s->wio.read = socket_plain_read;
 		s->wio.writev = socket_no_writev;
 		s->wio.readv = socket_plain_readv;
 		s->wio.sendto = socket_plain_sendto;
 	} else if (SOCK_CONN_LISTENING == s->direction) {
+		s->wio.autotune = socket_no_autotune;
 		s->wio.write = socket_no_write;
 		s->wio.read = socket_no_read;
 		s->wio.writev = socket_no_writev;
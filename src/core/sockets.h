@@ -121,8 +121,20 @@ typedef struct gnutella_socket {
 
 	unsigned so_rcvbuf;	/**< Configured RX buffer size, 0 if unknown */
 	unsigned so_sndbuf;	/**< Configured TX buffer size, 0 if unknown */
+	unsigned so_rcvbase;	/**< RX buffer size requested by owner */
+	unsigned so_sndbase;	/**< TX buffer size requested by owner */
 } gnutella_socket_t;
 
+/**
+ * Kernel socket buffer accounting, filled by socket_buffer_stats().
+ */
+struct socket_bufstats {
+	uint64 rcvbuf;		/**< Configured RX buffer bytes, all sockets */
+	uint64 sndbuf;		/**< Configured TX buffer bytes, all sockets */
+	uint64 grown;		/**< Amount of buffers grown by autotuning */
+	uint64 shrunk;		/**< Amount of buffers shrunk by autotuning */
+};
+
 /**
  * The UDP data indication callback.
  *
@@ -279,6 +291,7 @@ void socket_evt_clear(struct gnutella_socket *s);
 void socket_cork(struct gnutella_socket *s, bool on);
 void socket_send_buf(struct gnutella_socket *s, int size, bool shrink);
 void socket_recv_buf(struct gnutella_socket *s, int size, bool shrink);
+void socket_buffer_stats(struct socket_bufstats *sbs);
 void socket_nodelay(struct gnutella_socket *s, bool on);
 void socket_tx_shutdown(struct gnutella_socket *s);
 void socket_tos_default(const struct gnutella_socket *s);
@@ -48,6 +48,7 @@
 
 #include "xml/vxml.h"
 #include "xml/xnode.h"
+#include "xml/xsax.h"
 
 #include "if/gnet_property_priv.h"
 
@@ -174,29 +175,223 @@ thex_download_data_ind(rxdrv_t *rx, pmsg_t *mb)
 	return !error && DOWNLOAD_IS_RUNNING(d);
 }
 
-/* XML helper functions */
-static xnode_t *
-find_element_by_name(xnode_t *p, const char *name)
+/*
+ * XML helper functions.
+ *
+ * The THEX record is a small document from which we only need a few
+ * attributes of the children of the root element, so we stream through
+ * it, collecting these attributes, instead of building an XML tree.
+ *
+ * The streaming scanner only handles UTF-8 records, so the tree parser is
+ * still used for records it cannot process.
+ */
+
+enum thex_xml_elem {
+	THEX_XML_FILE = 0,
+	THEX_XML_DIGEST,
+	THEX_XML_SERIALIZEDTREE,
+
+	THEX_XML_ELEMS
+};
+
+static const char * const thex_xml_elem_name[THEX_XML_ELEMS] = {
+	"file",							/* THEX_XML_FILE */
+	"digest",						/* THEX_XML_DIGEST */
+	"serializedtree",				/* THEX_XML_SERIALIZEDTREE */
+};
+
+enum thex_xml_attr {
+	THEX_XML_SIZE = 0,
+	THEX_XML_SEGMENTSIZE,
+	THEX_XML_ALGORITHM,
+	THEX_XML_OUTPUTSIZE,
+	THEX_XML_TYPE,
+	THEX_XML_URI,
+	THEX_XML_DEPTH,
+
+	THEX_XML_ATTRS
+};
+
+static const struct thex_xml_attr_desc {
+	enum thex_xml_elem elem;		/* Element holding the attribute */
+	const char *name;				/* Attribute name */
+} thex_xml_attr_desc[THEX_XML_ATTRS] = {
+	{ THEX_XML_FILE,			"size" },			/* THEX_XML_SIZE */
+	{ THEX_XML_FILE,			"segmentsize" },	/* THEX_XML_SEGMENTSIZE */
+	{ THEX_XML_DIGEST,			"algorithm" },		/* THEX_XML_ALGORITHM */
+	{ THEX_XML_DIGEST,			"outputsize" },		/* THEX_XML_OUTPUTSIZE */
+	{ THEX_XML_SERIALIZEDTREE,	"type" },			/* THEX_XML_TYPE */
+	{ THEX_XML_SERIALIZEDTREE,	"uri" },			/* THEX_XML_URI */
+	{ THEX_XML_SERIALIZEDTREE,	"depth" },			/* THEX_XML_DEPTH */
+};
+
+/**
+ * Attributes collected whilst scanning the THEX record.
+ */
+struct thex_xml {
+	char *value[THEX_XML_ATTRS];	/* Attribute values, NULL if missing */
+	bool seen[THEX_XML_ELEMS];		/* Whether we saw the element */
+	int current;					/* Current element, -1 if not tracked */
+	bool bad_root;					/* Root is not a "hashtree" element */
+};
+
+static void
+thex_xml_start(xsax_t *xs, const char *name, size_t len, void *data)
+{
+	struct thex_xml *tx = data;
+	uint i;
+
+	tx->current = -1;
+
+	if (1 == xsax_depth(xs)) {
+		if (!xsax_eq(name, len, "hashtree")) {
+			tx->bad_root = TRUE;
+			xsax_stop(xs);
+		}
+		return;
+	}
+
+	if (2 != xsax_depth(xs))
+		return;
+
+	/*
+	 * Only the first element of a given name is considered.
+	 */
+
+	for (i = 0; i < N_ITEMS(thex_xml_elem_name); i++) {
+		if (!tx->seen[i] && xsax_eq(name, len, thex_xml_elem_name[i])) {
+			tx->seen[i] = TRUE;
+			tx->current = i;
+			break;
+		}
+	}
+}
+
+static void
+thex_xml_attr(xsax_t *xs, const char *name, size_t nlen,
+	const char *value, size_t vlen, void *data)
+{
+	struct thex_xml *tx = data;
+	uint i;
+
+	(void) xs;
+
+	if (-1 == tx->current)
+		return;
+
+	for (i = 0; i < N_ITEMS(thex_xml_attr_desc); i++) {
+		const struct thex_xml_attr_desc *d = &thex_xml_attr_desc[i];
+
+		if (
+			UNSIGNED(tx->current) == d->elem &&
+			NULL == tx->value[i] &&
+			xsax_eq(name, nlen, d->name)
+		) {
+			tx->value[i] = h_strndup(value, vlen);
+			break;
+		}
+	}
+}
+
+/**
+ * Discard all the attributes collected so far.
+ */
+static void
+thex_xml_clear(struct thex_xml *tx)
 {
-   xnode_t *xn;
+	uint i;
+
+	for (i = 0; i < N_ITEMS(tx->value); i++)
+		HFREE_NULL(tx->value[i]);
 
-    for (xn = xnode_first_child(p); xn != NULL; xn = xnode_next_sibling(xn)) {
-        if (xnode_is_element(xn) && 0 == strcmp(xnode_element_name(xn), name))
-			return xn;
-    }
-    return NULL;
+	ZERO(tx);
+}
+
+/**
+ * Collect the attributes of an element from the XML tree.
+ */
+static void
+thex_xml_tree_attrs(struct thex_xml *tx, const xnode_t *xn,
+	enum thex_xml_elem elem)
+{
+	uint i;
+
+	for (i = 0; i < N_ITEMS(thex_xml_attr_desc); i++) {
+		const struct thex_xml_attr_desc *d = &thex_xml_attr_desc[i];
+		const char *value;
+
+		if (d->elem != elem)
+			continue;
+
+		value = xnode_prop_get(xn, d->name);
+		if (value != NULL)
+			tx->value[i] = h_strdup(value);
+	}
+}
+
+/**
+ * Parse the THEX record into an XML tree and collect the attributes we need.
+ *
+ * @return VXML_E_OK if the record was parsed, the parsing error otherwise.
+ */
+static vxml_error_t
+thex_xml_parse_tree(const char *data, size_t size, struct thex_xml *tx)
+{
+	vxml_parser_t *vp;
+	vxml_error_t e;
+	xnode_t *hashtree = NULL, *xn;
+
+	vp = vxml_parser_make("THEX record", VXML_O_STRIP_BLANKS);
+	vxml_parser_add_data(vp, data, size);
+	e = vxml_parse_tree(vp, &hashtree);
+	vxml_parser_free(vp);
+
+	if (VXML_E_OK != e)
+		return e;
+
+	if (0 != strcmp("hashtree", xnode_element_name(hashtree))) {
+		tx->bad_root = TRUE;
+		goto done;
+	}
+
+	for (xn = xnode_first_child(hashtree); xn; xn = xnode_next_sibling(xn)) {
+		uint i;
+
+		if (!xnode_is_element(xn))
+			continue;
+
+		/*
+		 * Only the first element of a given name is considered.
+		 */
+
+		for (i = 0; i < N_ITEMS(thex_xml_elem_name); i++) {
+			if (
+				!tx->seen[i] &&
+				0 == strcmp(xnode_element_name(xn), thex_xml_elem_name[i])
+			) {
+				tx->seen[i] = TRUE;
+				thex_xml_tree_attrs(tx, xn, i);
+				break;
+			}
+		}
+	}
+
+done:
+	xnode_tree_free_null(&hashtree);
+	return VXML_E_OK;
 }
 
 static bool
-verify_element(xnode_t *node, const char *prop, const char *expect)
+verify_element(const struct thex_xml *tx, enum thex_xml_attr attr,
+	const char *expect)
 {
-	const char *value;
+	const struct thex_xml_attr_desc *d = &thex_xml_attr_desc[attr];
+	const char *value = tx->value[attr];
 
-	value = xnode_prop_get(node, prop);
-  	if (NULL == value) {
+	if (NULL == value) {
 		if (GNET_PROPERTY(tigertree_debug)) {
 			g_debug("TTH couldn't find property \"%s\" of node \"%s\"",
-				prop, xnode_element_name(node));
+				d->name, thex_xml_elem_name[d->elem]);
 		}
 		return FALSE;
 	}
@@ -204,7 +399,7 @@ verify_element(xnode_t *node, const char *prop, const char *expect)
 		if (GNET_PROPERTY(tigertree_debug)) {
 			g_debug("TTH property %s/%s doesn't match expected value \"%s\", "
 				"got \"%s\"",
-				xnode_element_name(node), prop, expect, value);
+				thex_xml_elem_name[d->elem], d->name, expect, value);
 		}
 		return FALSE;
 	}
@@ -216,12 +411,19 @@ static char *
 thex_download_handle_xml(struct thex_download *ctx,
 	const char *data, size_t size)
 {
-	xnode_t *hashtree = NULL, *node;
+	static const struct xsax_ops thex_xml_ops = {
+		thex_xml_start,				/* start */
+		thex_xml_attr,				/* attr */
+		NULL,						/* text */
+		NULL,						/* end */
+	};
+	struct thex_xml tx;
 	char *hashtree_id = NULL;
 	bool success = FALSE;
-	vxml_parser_t *vp;
 	vxml_error_t e;
 
+	ZERO(&tx);
+
 	if (size <= 0) {
 		if (GNET_PROPERTY(tigertree_debug)) {
 			g_debug("TTH XML record has no data");
@@ -230,34 +432,46 @@ thex_download_handle_xml(struct thex_download *ctx,
 	}
 
 	/*
-	 * Parse the XML record.
+	 * Scan the XML record.
 	 */
 
-	vp = vxml_parser_make("THEX record", VXML_O_STRIP_BLANKS);
-	vxml_parser_add_data(vp, data, size);
-	e = vxml_parse_tree(vp, &hashtree);
-	vxml_parser_free(vp);
+	e = xsax_parse(data, size, 0, &thex_xml_ops, &tx);
 
-	if (VXML_E_OK != e) {
+	/*
+	 * VXML_E_USER means we stopped the scanning ourselves.  Any other
+	 * error may come from a record the scanner cannot handle (e.g. one
+	 * not encoded in UTF-8), so try again by building the XML tree.
+	 */
+
+	if (VXML_E_OK != e && VXML_E_USER != e) {
 		if (GNET_PROPERTY(tigertree_debug)) {
-			g_warning("TTH cannot parse XML record: %s", vxml_strerror(e));
-			dump_hex(stderr, "XML record", data, size);
+			g_debug("TTH cannot scan XML record (%s), parsing it as a tree",
+				vxml_strerror(e));
 		}
-		goto finish;
+		thex_xml_clear(&tx);
+		e = thex_xml_parse_tree(data, size, &tx);
 	}
 
-	if (0 != strcmp("hashtree", xnode_element_name(hashtree))) {
+	if (tx.bad_root) {
 		if (GNET_PROPERTY(tigertree_debug)) {
 			g_debug("TTH couldn't find root hashtree element");
 		}
 		goto finish;
 	}
 
-	node = find_element_by_name(hashtree, "file");
-	if (node) {
-		if (!verify_element(node, "size", filesize_to_string(ctx->filesize)))
+	if (VXML_E_OK != e) {
+		if (GNET_PROPERTY(tigertree_debug)) {
+			g_warning("TTH cannot parse XML record: %s", vxml_strerror(e));
+			dump_hex(stderr, "XML record", data, size);
+		}
+		goto finish;
+	}
+
+	if (tx.seen[THEX_XML_FILE]) {
+		if (!verify_element(&tx, THEX_XML_SIZE,
+				filesize_to_string(ctx->filesize)))
 			goto finish;
-		if (!verify_element(node, "segmentsize", THEX_SEGMENT_SIZE))
+		if (!verify_element(&tx, THEX_XML_SEGMENTSIZE, THEX_SEGMENT_SIZE))
 			goto finish;
 	} else {
 		if (GNET_PROPERTY(tigertree_debug)) {
@@ -266,42 +480,40 @@ thex_download_handle_xml(struct thex_download *ctx,
 		goto finish;
 	}
 
-	node = find_element_by_name(hashtree, "digest");
-	if (node) {
-		if (!verify_element(node, "algorithm", THEX_HASH_ALGO))
+	if (tx.seen[THEX_XML_DIGEST]) {
+		if (!verify_element(&tx, THEX_XML_ALGORITHM, THEX_HASH_ALGO))
 			goto finish;
-		if (!verify_element(node, "outputsize", THEX_HASH_SIZE))
+		if (!verify_element(&tx, THEX_XML_OUTPUTSIZE, THEX_HASH_SIZE))
 			goto finish;
 	} else {
 		if (GNET_PROPERTY(tigertree_debug)) {
 			g_debug("TTH couldn't find hashtree/digest element");
 		}
-    	goto finish;
+		goto finish;
 	}
 
-	node = find_element_by_name(hashtree, "serializedtree");
-	if (node) {
+	if (tx.seen[THEX_XML_SERIALIZEDTREE]) {
 		const char *value;
 		int error;
 
-		if (!verify_element(node, "type", THEX_TREE_TYPE))
-    		goto finish;
+		if (!verify_element(&tx, THEX_XML_TYPE, THEX_TREE_TYPE))
+			goto finish;
 
-		value = xnode_prop_get(node, "uri");
+		value = tx.value[THEX_XML_URI];
 		if (NULL == value) {
 			if (GNET_PROPERTY(tigertree_debug)) {
 				g_debug("TTH couldn't find property \"uri\" of node \"%s\"",
-					xnode_element_name(node));
+					thex_xml_elem_name[THEX_XML_SERIALIZEDTREE]);
 			}
 			goto finish;
 		}
 		hashtree_id = h_strdup(value);
 
-		value = xnode_prop_get(node, "depth");
+		value = tx.value[THEX_XML_DEPTH];
 		if (NULL == value) {
 			if (GNET_PROPERTY(tigertree_debug)) {
 				g_debug("TTH couldn't find property \"depth\" of node \"%s\"",
-					xnode_element_name(node));
+					thex_xml_elem_name[THEX_XML_SERIALIZEDTREE]);
 			}
 			goto finish;
 		}
@@ -311,7 +523,7 @@ thex_download_handle_xml(struct thex_download *ctx,
 		if (error) {
 			ctx->depth = 0;
 			g_warning("TTH bad value for \"depth\" of node \"%s\": \"%s\"",
-				xnode_element_name(node), value);
+				thex_xml_elem_name[THEX_XML_SERIALIZEDTREE], value);
 		}
 		if (error)
 			goto finish;
@@ -326,7 +538,7 @@ thex_download_handle_xml(struct thex_download *ctx,
 finish:
 	if (!success)
 		HFREE_NULL(hashtree_id);
-	xnode_tree_free_null(&hashtree);
+	thex_xml_clear(&tx);
 
 	return hashtree_id;
 }
@@ -56,6 +56,7 @@
 
 #include "lib/atoms.h"
 #include "lib/base32.h"
+#include "lib/executor.h"
 #include "lib/fd.h"
 #include "lib/file.h"
 #include "lib/ftw.h"
@@ -67,7 +68,6 @@
 #include "lib/spinlock.h"
 #include "lib/str.h"
 #include "lib/stringify.h"
-#include "lib/thread.h"
 #include "lib/tigertree.h"
 #include "lib/timestamp.h"
 #include "lib/walloc.h"
@@ -501,6 +501,9 @@ tth_cache_cleanup_unlink(
 {
 	const hset_t *shared = data;
 
+	if (executor_is_cancelled())
+		return FTW_STATUS_CANCELLED;
+
 	if (FTW_F_DIR & info->flags)
 		return FTW_STATUS_OK;
 
@@ -582,10 +585,10 @@ tth_cache_cleanup_unlink(
 static int tth_cache_cleanups;
 
 /**
- * Main entry point for the thread that cleans up the TTH cache.
+ * Executor job cleaning up the TTH cache.
  */
-static void *
-tth_cache_cleanup_thread(void *unused_arg)
+static void
+tth_cache_cleanup_job(void *unused_arg)
 {
 	hset_t *shared;
 	const char *rootdir = tth_cache_directory();
@@ -609,6 +612,9 @@ tth_cache_cleanup_thread(void *unused_arg)
 	res = ftw_foreach(rootdir, flags, 0, tth_cache_cleanup_unlink, shared);
 	share_tthset_free(shared);
 
+	if (FTW_STATUS_CANCELLED == res)
+		goto done;
+
 	if (res != FTW_STATUS_OK) {
 		g_warning("%s(): initial traversal failed with %d, aborting",
 			G_STRFUNC, res);
@@ -628,7 +634,6 @@ tth_cache_cleanup_thread(void *unused_arg)
 
 done:
 	atomic_int_dec(&tth_cache_cleanups);
-	return NULL;
 }
 
 /**
@@ -638,12 +643,13 @@ void
 tth_cache_cleanup(void)
 {
 	if (0 == atomic_int_inc(&tth_cache_cleanups)) {
-		int id = thread_create(tth_cache_cleanup_thread,
-					NULL, THREAD_F_DETACH | THREAD_F_WARN, THREAD_STACK_MIN);
-		if (-1 == id)
+		executor_job_t *j = executor_submit(EXECUTOR_BULK_IO,
+					tth_cache_cleanup_job, NULL, NULL);
+		if (NULL == j)
 			atomic_int_dec(&tth_cache_cleanups);
-	} else if (debugging(0)) {
-		g_warning("%s(): concurrent cleanup in progress", G_STRFUNC);
+	} else {
+		if (debugging(0))
+			g_warning("%s(): concurrent cleanup in progress", G_STRFUNC);
 		atomic_int_dec(&tth_cache_cleanups);
 	}
 }
@@ -90,6 +90,7 @@ struct attr {
 	z_streamp outz;				/**< Compressing stream */
 	txdrv_t *nd;				/**< Network driver, underneath us */
 	size_t unflushed;			/**< Amount of input bytes since last flush */
+	uint32 unflushed_stamp;		/**< When first unflushed byte came (ms) */
 	size_t flushed;				/**< Amount of output bytes since last flush */
 	size_t total_input;			/**< Total amount of input bytes flushed */
 	size_t total_output;		/**< Total amount of output bytes flushed */
@@ -362,6 +363,16 @@ deflate_flushed(txdrv_t *tx)
 
 		flush = 1.0 - ((double) attr->flushed / attr->unflushed);
 		attr->ratio_ema += (flush / 2.0) - (attr->ratio_ema / 2.0);
+
+		/*
+		 * Report how long the input was held before being flushed, which
+		 * includes any Nagle delay.
+		 */
+
+		if (NULL != attr->cb->add_tx_delay) {
+			attr->cb->add_tx_delay(tx->owner,
+				tm_stamp_ms() - attr->unflushed_stamp);
+		}
 	}
 
 	if (tx_deflate_debugging(4)) {
@@ -572,6 +583,9 @@ deflate_add(txdrv_t *tx, const void *data, int len)
 	if G_UNLIKELY(tx->flags & TX_ERROR)
 		return -1;
 
+	if (0 == attr->unflushed)
+		attr->unflushed_stamp = tm_stamp_ms();
+
 	while (added < len) {
 		struct buffer *b = &attr->buf[attr->fill_idx];	/* Buffer we fill */
 		int ret;
@@ -832,11 +846,6 @@ tx_deflate_init(txdrv_t *tx, void *args)
 	g_assert(tx);
 	g_assert(NULL != targs->cb);
 
-	WALLOC(outz);
-	outz->zalloc = zlib_alloc_func;
-	outz->zfree = zlib_free_func;
-	outz->opaque = NULL;
-
 	/*
 	 * Reduce memory requirements for deflation when running as an ultrapeer.
 	 *
@@ -868,10 +877,15 @@ tx_deflate_init(txdrv_t *tx, void *args)
 	 * of compression).
 	 *
 	 *		--RAM, 2011-11-29
+	 *
+	 * The window size and memory level can be further overridden by the
+	 * caller, so that memory can be traded against bandwidth on nodes
+	 * with many connections.  Streams come from a pool, to avoid setting
+	 * up the whole compression state for short-lived connections.
 	 */
 
 	{
-		int window_bits = MAX_WBITS;		/* Must be 8 .. MAX_WBITS */
+		int window_bits = MAX_WBITS;		/* Must be 9 .. MAX_WBITS */
 		int mem_level = MAX_MEM_LEVEL;		/* Must be 1 .. MAX_MEM_LEVEL */
 		int level = Z_BEST_COMPRESSION;
 
@@ -882,20 +896,23 @@ tx_deflate_init(txdrv_t *tx, void *args)
 			level = Z_DEFAULT_COMPRESSION;
 		}
 
-		g_assert(window_bits >= 8 && window_bits <= MAX_WBITS);
+		if (targs->window_bits != 0)
+			window_bits = targs->window_bits;
+		if (targs->mem_level != 0)
+			mem_level = targs->mem_level;
+
+		g_assert(window_bits >= 9 && window_bits <= MAX_WBITS);
 		g_assert(mem_level >= 1 && mem_level <= MAX_MEM_LEVEL);
 		g_assert(level == Z_DEFAULT_COMPRESSION ||
 			(level >= Z_BEST_SPEED && level <= Z_BEST_COMPRESSION));
 
-		ret = deflateInit2(outz, level, Z_DEFLATED,
-				targs->gzip ? (-window_bits) : window_bits, mem_level,
-				Z_DEFAULT_STRATEGY);
+		ret = zlib_deflate_stream_get(&outz, level,
+				targs->gzip ? (-window_bits) : window_bits, mem_level);
 	}
 
 	if (Z_OK != ret) {
 		g_warning("unable to initialize compressor for peer %s: %s",
 			gnet_host_to_string(&tx->host), zlib_strerror(ret));
-		WFREE(outz);
 		return NULL;
 	}
 
@@ -972,13 +989,12 @@ tx_deflate_destroy(txdrv_t *tx)
 	 * We ignore Z_DATA_ERROR errors (discarded data, probably).
 	 */
 
-	ret = deflateEnd(attr->outz);
+	ret = zlib_stream_put(attr->outz);
 
 	if (Z_OK != ret && Z_DATA_ERROR != ret)
 		g_warning("while freeing compressor for peer %s: %s",
 			gnet_host_to_string(&tx->host), zlib_strerror(ret));
 
-	WFREE(attr->outz);
 	cq_cancel(&attr->tm_ev);
 	WFREE(attr);
 }
@@ -1232,4 +1248,25 @@ tx_deflate_get_ops(void)
 	return &tx_deflate_ops;
 }
 
+/**
+ * Look for a deflating layer in the TX stack, starting at the given driver
+ * and moving down the stack.
+ *
+ * @return memory used by the compressor of the deflating layer, 0 if none.
+ */
+size_t
+tx_deflate_memory(const txdrv_t *tx)
+{
+	for (; tx != NULL; tx = tx->lower) {
+		tx_check(tx);
+
+		if (&tx_deflate_ops == tx->ops) {
+			const struct attr *attr = tx->opaque;
+			return zlib_stream_memory(attr->outz);
+		}
+	}
+
+	return 0;
+}
+
 /* vi: set ts=4 sw=4 cindent: */
@@ -40,6 +40,7 @@
 #include "lib/cq.h"
 
 const struct txdrv_ops *tx_deflate_get_ops(void);
+size_t tx_deflate_memory(const txdrv_t *tx);
 
 /**
  * Callbacks used by the deflating layer.
@@ -48,6 +49,7 @@ struct tx_deflate_cb {
 	void (*add_tx_deflated)(void *owner, int amount);
 	void (*shutdown)(void *owner, const char *reason, ...);
 	void (*flow_control)(void *owner, size_t amount);
+	void (*add_tx_delay)(void *owner, uint32 ms);
 };
 
 /**
@@ -58,6 +60,8 @@ struct tx_deflate_args {
 	cqueue_t *cq;				/**< Callout queue to use */
 	size_t buffer_size;			/**< Internal buffer size to use */
 	size_t buffer_flush;		/**< Flush after that many bytes */
+	int window_bits;			/**< Window size (log2), 0 for default */
+	int mem_level;				/**< zlib memory level, 0 for default */
 	bool nagle;					/**< Whether to use Nagle or not */
 	bool gzip;					/**< Whether to use gzip encapsulation */
 	bool reduced;				/**< Whether to use reduced compression */
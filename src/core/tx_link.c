@@ -42,6 +42,7 @@
 #include "tx_link.h"
 #include "bsched.h"
 
+#include "lib/iovec.h"
 #include "lib/tm.h"
 #include "lib/walloc.h"
 #include "lib/override.h"		/* Must be the last header included */
@@ -53,6 +54,7 @@ struct attr {
 	wrap_io_t 	 *wio;				/**< Cached wrapped IO object */
 	bio_source_t *bio;				/**< Bandwidth-limited I/O source */
 	const struct tx_link_cb *cb;	/**< Layer-specific callbacks */
+	uint32 stall_stamp;				/**< When servicing was enabled (ms) */
 };
 
 /**
@@ -195,6 +197,21 @@ tx_link_write_error(txdrv_t *tx, const char *func)
 	return 0;		/* Just in case */
 }
 
+/**
+ * Report a write that could not be fully performed, noting whether it was
+ * limited by the bandwidth scheduler or by the kernel.
+ */
+static void
+tx_link_short_write(txdrv_t *tx)
+{
+	struct attr *attr = tx->opaque;
+
+	if (attr->cb->add_tx_short != NULL) {
+		attr->cb->add_tx_short(tx->owner,
+			booleanize(attr->bio->flags & BIO_F_CAPPED));
+	}
+}
+
 /**
  * Write data buffer.
  *
@@ -207,12 +224,19 @@ tx_link_write(txdrv_t *tx, const void *data, size_t len)
 	ssize_t r;
 
 	r = bio_write(attr->bio, data, len);
-	if ((ssize_t) -1 == r)
-		return tx_link_write_error(tx, "tx_link_write");
+	if ((ssize_t) -1 == r) {
+		r = tx_link_write_error(tx, "tx_link_write");
+		if (0 == r)
+			tx_link_short_write(tx);
+		return r;
+	}
 
 	if (attr->cb->add_tx_written != NULL)
 		attr->cb->add_tx_written(tx->owner, r);
 
+	if G_UNLIKELY((size_t) r < len)
+		tx_link_short_write(tx);
+
 	return r;
 }
 
@@ -228,12 +252,19 @@ tx_link_writev(txdrv_t *tx, iovec_t *iov, int iovcnt)
 	ssize_t r;
 
 	r = bio_writev(attr->bio, iov, iovcnt);
-	if ((ssize_t) -1 == r)
-		return tx_link_write_error(tx, "tx_link_writev");
+	if ((ssize_t) -1 == r) {
+		r = tx_link_write_error(tx, "tx_link_writev");
+		if (0 == r)
+			tx_link_short_write(tx);
+		return r;
+	}
 
 	if (attr->cb->add_tx_written != NULL)
 		attr->cb->add_tx_written(tx->owner, r);
 
+	if G_UNLIKELY((size_t) r < iov_calculate_size(iov, iovcnt))
+		tx_link_short_write(tx);
+
 	return r;
 }
 
@@ -245,6 +276,7 @@ tx_link_enable(txdrv_t *tx)
 {
 	struct attr *attr = tx->opaque;
 
+	attr->stall_stamp = tm_stamp_ms();
 	bio_add_callback(attr->bio, is_writable, tx);
 }
 
@@ -258,6 +290,14 @@ tx_link_disable(txdrv_t *tx)
 
 	bio_remove_callback(attr->bio);
 
+	/*
+	 * Servicing is disabled once the upper layer has no more pending
+	 * data: report how long we stalled the stack.
+	 */
+
+	if (attr->cb->add_tx_stall != NULL)
+		attr->cb->add_tx_stall(tx->owner, tm_stamp_ms() - attr->stall_stamp);
+
 	/*
 	 * If we were put in TCP_NODELAY mode by node_flushq(), then go back
 	 * to delaying mode.  Indeed, the send queue is empty, and we want to
@@ -49,6 +49,8 @@ struct tx_link_cb {
 	void (*eof_remove)(void *owner, const char *reason, ...);
 	void (*eof_shutdown)(void *owner, const char *reason, ...);
 	void (*unflushq)(void *owner);
+	void (*add_tx_short)(void *owner, bool capped);
+	void (*add_tx_stall)(void *owner, uint32 ms);
 };
 
 /**
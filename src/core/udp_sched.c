@@ -54,6 +54,20 @@
  * each packet to send also remembers its TX stack origin (for callback
  * processing, which need to get at the TX owner).
  *
+ * When the "udp_sched_paced" property is set, the scheduler switches to a
+ * paced mode: packets are queued in FIFO order per destination and each
+ * priority level serves its destinations in turn, picking the one with the
+ * earliest virtual deadline from a heap (a destination's deadline advances
+ * by the size of each packet sent to it, so that no host can capture the
+ * bandwidth).  Sending is paced by a token bucket refilled every few tens of
+ * milliseconds from the bandwidth configured in the scheduler, instead of
+ * bursting everything at the start of the period, and stale packets are
+ * expired in O(1) from a ring of time buckets.
+ *
+ * In both modes, the depth of the queue seen by each enqueued packet and the
+ * latency of each packet sent after having been queued are accounted for
+ * in the general statistics.
+ *
  * @author Raphael Manfredi
  * @date 2012
  */
@@ -70,15 +84,20 @@
 #include "tx_dgram.h"
 
 #include "lib/atoms.h"
+#include "lib/cq.h"
+#include "lib/elist.h"
 #include "lib/eslist.h"
 #include "lib/host_addr.h"
 #include "lib/gnet_host.h"
 #include "lib/hashing.h"
+#include "lib/halloc.h"
 #include "lib/hashlist.h"
 #include "lib/hset.h"
+#include "lib/htable.h"
 #include "lib/log.h"
 #include "lib/palloc.h"
 #include "lib/pmsg.h"
+#include "lib/pow2.h"
 #include "lib/tm.h"
 #include "lib/unsigned.h"
 #include "lib/walloc.h"
@@ -90,6 +109,11 @@
 #define UDP_SCHED_EXPIRE	5	/**< Seconds before expiring unsent messages */
 #define UDP_SCHED_FACTOR	3	/**< Stop when that many times the b/w queued */
 
+#define UDP_SCHED_TICK		50		/**< Pacing period, in ms */
+#define UDP_SCHED_BURST		100		/**< Max burst, in ms worth of b/w */
+#define UDP_SCHED_BURST_MIN	4096	/**< Minimum burst, in bytes */
+#define UDP_SCHED_RING		128		/**< Expiration ring slots, power of 2 */
+
 #define udp_sched_log(lvl, fmt, ...)						\
 G_STMT_START {												\
 	if G_UNLIKELY(GNET_PROPERTY(udp_sched_debug) >= (lvl))	\
@@ -111,6 +135,23 @@ static const enum net_type udp_sched_net_type[UDP_SCHED_NET_CNT] = {
 	NET_TYPE_IPV6,			/* UDP_SCHED_IPv6 */
 };
 
+struct udp_dest;
+
+/**
+ * Paced scheduling state of a given priority level.
+ *
+ * Destinations with queued traffic are kept in a min-heap, ordered by their
+ * virtual deadline.
+ */
+struct udp_sched_level {
+	htable_t *dests;				/**< Destination -> struct udp_dest */
+	struct udp_dest **heap;			/**< Min-heap of destinations */
+	uint count;						/**< Amount of destinations in heap */
+	uint size;						/**< Allocated heap length */
+	uint64 vclock;					/**< Deadline of last packet sent */
+	size_t queued;					/**< Amount of queued packets */
+};
+
 /**
  * The UDP TX scheduler object.
  *
@@ -131,6 +172,12 @@ struct udp_sched {
 	bio_source_t *bio[UDP_SCHED_NET_CNT];	/**< Bandwidth-limited I/O source */
 	udp_sched_socket_cb_t get_socket;		/**< Get the UDP socket by net */
 	eslist_t lifo[PMSG_P_COUNT];	/**< LIFO stacks of TX descriptors */
+	struct udp_sched_level level[PMSG_P_COUNT];	/**< Paced queues */
+	elist_t ring[UDP_SCHED_RING];	/**< Paced expiration ring */
+	ulong ring_tick;				/**< Next expiration tick to sweep */
+	ulong refill_ms;				/**< Time of last token refill */
+	int64 tokens;					/**< Token bucket for pacing */
+	cevent_t *tick_ev;				/**< Pacing tick */
 	eslist_t tx_released;			/**< Deferred TX descriptor freeing */
 	bsched_bws_t bws;				/**< Bandwidth scheduler to use */
 	hset_t *seen;					/**< Remembers destinations processed */
@@ -138,6 +185,8 @@ struct udp_sched {
 	size_t buffered;				/**< Amount buffered (regular + urgent) */
 	unsigned used_all:1;			/**< Set when all b/w was used */
 	unsigned flow_controlled:1;		/**< Whether we flow-controlled */
+	unsigned paced:1;				/**< Whether we run in paced mode */
+	unsigned limited:1;				/**< Whether b/w is limited (pacing) */
 };
 
 static inline void
@@ -160,6 +209,11 @@ struct udp_tx_desc {
 	const struct tx_dgram_cb *cb;	/**< Callback actions on datagram */
 	slink_t lnk;					/**< LIFO queue link */
 	time_t expire;					/**< Expiration time */
+	ulong queued_ms;				/**< Time when packet was queued */
+	struct udp_dest *dest;			/**< Destination, in paced mode */
+	link_t dlnk;					/**< Paced destination queue link */
+	link_t rlnk;					/**< Paced expiration ring link */
+	uint slot;						/**< Paced expiration ring slot */
 };
 
 static inline void
@@ -169,6 +223,16 @@ udp_tx_desc_check(const struct udp_tx_desc * const txd)
 	g_assert(UDP_TX_DESC_MAGIC == txd->magic);
 }
 
+/**
+ * A destination with traffic queued at a given priority, in paced mode.
+ */
+struct udp_dest {
+	const gnet_host_t *to;			/**< Destination address (atom) */
+	elist_t queue;					/**< FIFO of TX descriptors */
+	uint64 deadline;				/**< Virtual deadline, the heap key */
+	uint idx;						/**< Index in the heap */
+};
+
 /**
  * The TX stacks using us are remembered along with their "is_writable"
  * callback routine so that we can trigger servicing.
@@ -297,6 +361,34 @@ udp_tx_desc_drop(void *data, void *udata)
 	return TRUE;
 }
 
+/**
+ * Account for a message that has expired before we could send it.
+ */
+static void
+udp_tx_desc_timed_out(const struct udp_tx_desc *txd, const udp_sched_t *us)
+{
+	static gnr_stats_t s[] = {
+		GNR_UDP_SCHED_TIMED_OUT_PRIO_DATA,
+		GNR_UDP_SCHED_TIMED_OUT_PRIO_CONTROL,
+		GNR_UDP_SCHED_TIMED_OUT_PRIO_URGENT,
+		GNR_UDP_SCHED_TIMED_OUT_PRIO_HIGHEST,
+	};
+	uint8 prio = pmsg_prio(txd->mb);
+
+	STATIC_ASSERT(PMSG_P_COUNT == N_ITEMS(s));
+
+	g_assert_log(prio < PMSG_P_COUNT,
+		"%s(): prio=%u", G_STRFUNC, prio);
+
+	udp_sched_log(1, "%p: expiring mb=%p (%d bytes) prio=%u",
+		us, txd->mb, pmsg_size(txd->mb), prio);
+
+	gnet_stats_inc_general(s[prio]);
+
+	if (txd->cb->add_tx_dropped != NULL)
+		(*txd->cb->add_tx_dropped)(txd->tx->owner, 1);	/* Dropped in TX */
+}
+
 /**
  * Remove expired messages (eslist iterator).
  *
@@ -312,31 +404,83 @@ udp_tx_desc_expired(void *data, void *udata)
 	udp_tx_desc_check(txd);
 
 	if (delta_time(tm_time(), txd->expire) > 0) {
-		static gnr_stats_t s[] = {
-			GNR_UDP_SCHED_TIMED_OUT_PRIO_DATA,
-			GNR_UDP_SCHED_TIMED_OUT_PRIO_CONTROL,
-			GNR_UDP_SCHED_TIMED_OUT_PRIO_URGENT,
-			GNR_UDP_SCHED_TIMED_OUT_PRIO_HIGHEST,
-		};
-		uint8 prio = pmsg_prio(txd->mb);
+		udp_tx_desc_timed_out(txd, us);
+		return udp_tx_desc_drop(data, udata);			/* Returns TRUE */
+	}
 
-		STATIC_ASSERT(PMSG_P_COUNT == N_ITEMS(s));
+	return FALSE;
+}
 
-		g_assert_log(prio < PMSG_P_COUNT,
-			"%s(): prio=%u", G_STRFUNC, prio);
+/**
+ * @return current time, in milliseconds.
+ */
+static ulong
+udp_sched_now_ms(void)
+{
+	tm_t now;
 
-		udp_sched_log(1, "%p: expiring mb=%p (%d bytes) prio=%u",
-			us, txd->mb, pmsg_size(txd->mb), prio);
+	tm_now_exact(&now);
+	return tm2ms(&now);
+}
 
-		gnet_stats_inc_general(s[prio]);
+/**
+ * Account for the depth of the queue seen by a message being enqueued.
+ */
+static void
+udp_sched_depth_stats(size_t depth)
+{
+	static const struct {
+		size_t limit;
+		gnr_stats_t s;
+	} histogram[] = {
+		{ 1,	GNR_UDP_SCHED_QUEUE_DEPTH_EMPTY },
+		{ 16,	GNR_UDP_SCHED_QUEUE_DEPTH_UNDER_16 },
+		{ 64,	GNR_UDP_SCHED_QUEUE_DEPTH_UNDER_64 },
+		{ 256,	GNR_UDP_SCHED_QUEUE_DEPTH_UNDER_256 },
+		{ 1024,	GNR_UDP_SCHED_QUEUE_DEPTH_UNDER_1024 },
+	};
+	uint i;
 
-		if (txd->cb->add_tx_dropped != NULL)
-			(*txd->cb->add_tx_dropped)(txd->tx->owner, 1);	/* Dropped in TX */
+	for (i = 0; i < N_ITEMS(histogram); i++) {
+		if (depth < histogram[i].limit) {
+			gnet_stats_inc_general(histogram[i].s);
+			return;
+		}
+	}
 
-		return udp_tx_desc_drop(data, udata);			/* Returns TRUE */
+	gnet_stats_inc_general(GNR_UDP_SCHED_QUEUE_DEPTH_OVER_1024);
+}
+
+/**
+ * Account for the time a message spent in the queue before being sent.
+ */
+static void
+udp_sched_latency_stats(const struct udp_tx_desc *txd)
+{
+	static const struct {
+		ulong limit;
+		gnr_stats_t s;
+	} histogram[] = {
+		{ 10,	GNR_UDP_SCHED_LATENCY_UNDER_10MS },
+		{ 50,	GNR_UDP_SCHED_LATENCY_UNDER_50MS },
+		{ 100,	GNR_UDP_SCHED_LATENCY_UNDER_100MS },
+		{ 250,	GNR_UDP_SCHED_LATENCY_UNDER_250MS },
+		{ 500,	GNR_UDP_SCHED_LATENCY_UNDER_500MS },
+		{ 1000,	GNR_UDP_SCHED_LATENCY_UNDER_1S },
+		{ 2000,	GNR_UDP_SCHED_LATENCY_UNDER_2S },
+	};
+	ulong now = udp_sched_now_ms();
+	ulong latency = now > txd->queued_ms ? now - txd->queued_ms : 0;
+	uint i;
+
+	for (i = 0; i < N_ITEMS(histogram); i++) {
+		if (latency < histogram[i].limit) {
+			gnet_stats_inc_general(histogram[i].s);
+			return;
+		}
 	}
 
-	return FALSE;
+	gnet_stats_inc_general(GNR_UDP_SCHED_LATENCY_OVER_2S);
 }
 
 /**
@@ -587,8 +731,11 @@ udp_tx_desc_send(void *data, void *udata)
 	}
 
 	if (udp_sched_mb_sendto(us, txd->mb, txd->to, txd->tx, txd->cb)) {
-		if (PMSG_P_DATA == prio && pmsg_was_sent(txd->mb))
-			hset_insert(us->seen, atom_host_get(txd->to));
+		if (pmsg_was_sent(txd->mb)) {
+			udp_sched_latency_stats(txd);
+			if (PMSG_P_DATA == prio)
+				hset_insert(us->seen, atom_host_get(txd->to));
+		}
 	} else {
 		return FALSE;		/* Unsent, leave it in the queue */
 	}
@@ -616,6 +763,396 @@ udp_sched_bw_per_second(const udp_sched_t *us)
 	return 0;	/* No known I/O source, no bandwidth available */
 }
 
+/**
+ * @return amount of queued messages.
+ */
+static size_t
+udp_sched_queued(const udp_sched_t *us)
+{
+	size_t n = 0;
+	uint i;
+
+	for (i = 0; i < N_ITEMS(us->lifo); i++) {
+		n += eslist_count(&us->lifo[i]) + us->level[i].queued;
+	}
+
+	return n;
+}
+
+/***
+ *** Paced mode.
+ ***/
+
+static void udp_sched_tick(cqueue_t *cq, void *data);
+
+/**
+ * Make sure the pacing tick is armed.
+ */
+static void
+udp_sched_tick_arm(udp_sched_t *us)
+{
+	if (NULL == us->tick_ev)
+		us->tick_ev = cq_main_insert(UDP_SCHED_TICK, udp_sched_tick, us);
+}
+
+/**
+ * Refill the token bucket, according to the time elapsed since last refill.
+ */
+static void
+udp_sched_refill(udp_sched_t *us, ulong now_ms)
+{
+	uint64 bw = udp_sched_bw_per_second(us);
+	ulong elapsed = now_ms > us->refill_ms ? now_ms - us->refill_ms : 0;
+	int64 burst;
+
+	us->refill_ms = now_ms;
+	us->limited = booleanize(bsched_is_enabled(us->bws) && bw != 0);
+
+	if (!us->limited)
+		return;
+
+	burst = MAX(bw * UDP_SCHED_BURST / 1000, UDP_SCHED_BURST_MIN);
+	elapsed = MIN(elapsed, 1000);
+	us->tokens = MIN(burst, us->tokens + (int64) (bw * elapsed / 1000));
+}
+
+/**
+ * @return whether pacing allows us to send traffic of given priority now.
+ */
+static bool
+udp_sched_has_tokens(udp_sched_t *us, uint prio)
+{
+	if (PMSG_P_HIGHEST == prio)
+		return TRUE;			/* Never paced, should be sent at once */
+
+	if (us->tokens <= 0 && us->limited)
+		udp_sched_refill(us, udp_sched_now_ms());
+
+	return !us->limited || us->tokens > 0;
+}
+
+static inline void
+udp_sched_heap_set(struct udp_sched_level *l, uint i, struct udp_dest *d)
+{
+	l->heap[i] = d;
+	d->idx = i;
+}
+
+/**
+ * Move heap item towards the root until the heap property is restored.
+ */
+static void
+udp_sched_heap_up(struct udp_sched_level *l, uint i)
+{
+	struct udp_dest *d = l->heap[i];
+
+	while (i != 0) {
+		uint parent = (i - 1) / 2;
+
+		if (l->heap[parent]->deadline <= d->deadline)
+			break;
+
+		udp_sched_heap_set(l, i, l->heap[parent]);
+		i = parent;
+	}
+
+	udp_sched_heap_set(l, i, d);
+}
+
+/**
+ * Move heap item towards the leaves until the heap property is restored.
+ */
+static void
+udp_sched_heap_down(struct udp_sched_level *l, uint i)
+{
+	struct udp_dest *d = l->heap[i];
+
+	for (;;) {
+		uint c = 2 * i + 1;
+
+		if (c >= l->count)
+			break;
+
+		if (c + 1 < l->count && l->heap[c + 1]->deadline < l->heap[c]->deadline)
+			c++;
+
+		if (d->deadline <= l->heap[c]->deadline)
+			break;
+
+		udp_sched_heap_set(l, i, l->heap[c]);
+		i = c;
+	}
+
+	udp_sched_heap_set(l, i, d);
+}
+
+/**
+ * Get the destination record for traffic to be sent to `to', creating it
+ * if needed.
+ */
+static struct udp_dest *
+udp_sched_dest_get(struct udp_sched_level *l, const gnet_host_t *to)
+{
+	struct udp_dest *d = htable_lookup(l->dests, to);
+
+	if (d != NULL)
+		return d;
+
+	/*
+	 * A new destination starts at the current virtual clock, so that it is
+	 * served in turn with the ones already waiting, without being able to
+	 * claim the bandwidth it did not use in the past.
+	 */
+
+	WALLOC0(d);
+	d->to = atom_host_get(to);
+	d->deadline = l->vclock;
+	elist_init(&d->queue, offsetof(struct udp_tx_desc, dlnk));
+	htable_insert(l->dests, d->to, d);
+
+	if (l->count == l->size) {
+		l->size = MAX(16, l->size * 2);
+		HREALLOC_ARRAY(l->heap, l->size);
+	}
+
+	l->heap[l->count] = d;
+	udp_sched_heap_up(l, l->count++);
+
+	return d;
+}
+
+/**
+ * Dispose of destination record, which no longer has any queued traffic.
+ */
+static void
+udp_sched_dest_free(struct udp_sched_level *l, struct udp_dest *d)
+{
+	uint i = d->idx;
+	struct udp_dest *last;
+
+	g_assert(0 == elist_count(&d->queue));
+	g_assert(i < l->count && l->heap[i] == d);
+
+	last = l->heap[--l->count];
+
+	if (last != d) {
+		udp_sched_heap_set(l, i, last);
+		udp_sched_heap_up(l, i);
+		udp_sched_heap_down(l, last->idx);
+	}
+
+	htable_remove(l->dests, d->to);
+	atom_host_free_null(&d->to);
+	WFREE(d);
+}
+
+/**
+ * Enqueue TX descriptor in paced mode.
+ */
+static void
+udp_sched_paced_enqueue(udp_sched_t *us, struct udp_tx_desc *txd)
+{
+	uint prio = pmsg_prio(txd->mb);
+	struct udp_sched_level *l = &us->level[prio];
+	ulong tick;
+
+	txd->dest = udp_sched_dest_get(l, txd->to);
+	elist_append(&txd->dest->queue, txd);
+	l->queued++;
+
+	/*
+	 * The expiration ring holds UDP_SCHED_RING ticks, which is more than
+	 * the lifetime of a packet, hence all the packets in a slot expire
+	 * during the same tick, unless the slot was not swept in time.
+	 */
+
+	STATIC_ASSERT(UDP_SCHED_RING > UDP_SCHED_EXPIRE * 1000 / UDP_SCHED_TICK);
+	STATIC_ASSERT(IS_POWER_OF_2(UDP_SCHED_RING));
+
+	tick = (txd->queued_ms + UDP_SCHED_EXPIRE * 1000) / UDP_SCHED_TICK;
+	txd->slot = MAX(tick, us->ring_tick) & (UDP_SCHED_RING - 1);
+	elist_append(&us->ring[txd->slot], txd);
+}
+
+/**
+ * Remove TX descriptor from the paced queues.
+ *
+ * @return TRUE if the destination record was freed.
+ */
+static bool
+udp_sched_paced_unlink(udp_sched_t *us, struct udp_tx_desc *txd)
+{
+	struct udp_dest *d = txd->dest;
+	struct udp_sched_level *l = &us->level[pmsg_prio(txd->mb)];
+
+	g_assert(d != NULL);
+	g_assert(l->queued != 0);
+
+	elist_remove(&d->queue, txd);
+	elist_remove(&us->ring[txd->slot], txd);
+	txd->dest = NULL;
+	l->queued--;
+
+	if (0 != elist_count(&d->queue))
+		return FALSE;
+
+	udp_sched_dest_free(l, d);
+	return TRUE;
+}
+
+/**
+ * Expire the paced messages that could not be sent in time.
+ */
+static void
+udp_sched_paced_expire(udp_sched_t *us, ulong now_ms)
+{
+	ulong tick = now_ms / UDP_SCHED_TICK;
+	uint n;
+
+	for (n = 0; us->ring_tick <= tick && n < UDP_SCHED_RING; n++) {
+		elist_t *slot = &us->ring[us->ring_tick++ & (UDP_SCHED_RING - 1)];
+		struct udp_tx_desc *txd;
+
+		while (NULL != (txd = elist_head(slot))) {
+			ulong expire = txd->queued_ms + UDP_SCHED_EXPIRE * 1000;
+
+			if (expire / UDP_SCHED_TICK > tick)
+				break;
+
+			udp_sched_paced_unlink(us, txd);
+			udp_tx_desc_timed_out(txd, us);
+			udp_tx_desc_drop(txd, us);
+		}
+	}
+
+	us->ring_tick = MAX(us->ring_tick, tick + 1);
+}
+
+/**
+ * Send queued paced traffic, serving each destination in turn by order of
+ * deadline, highest priority first, until we run out of tokens or bandwidth.
+ */
+static void
+udp_sched_paced_run(udp_sched_t *us)
+{
+	uint i;
+
+	for (i = N_ITEMS(us->level); i != 0 && !us->used_all; i--) {
+		struct udp_sched_level *l = &us->level[i-1];
+
+		while (0 != l->count && !us->used_all) {
+			struct udp_dest *d = l->heap[0];
+			struct udp_tx_desc *txd = elist_head(&d->queue);
+			int len = pmsg_size(txd->mb);
+
+			if (!udp_sched_has_tokens(us, i-1))
+				return;
+
+			if (!udp_sched_mb_sendto(us, txd->mb, txd->to, txd->tx, txd->cb))
+				return;		/* No more bandwidth, leave it in the queue */
+
+			if (pmsg_was_sent(txd->mb)) {
+				udp_sched_latency_stats(txd);
+				us->tokens -= len;
+			}
+
+			l->vclock = d->deadline;
+			d->deadline += len;
+
+			if (!udp_sched_paced_unlink(us, txd))
+				udp_sched_heap_down(l, d->idx);
+
+			us->buffered = size_saturate_sub(us->buffered, len);
+			udp_tx_desc_flag_release(txd, us);
+		}
+	}
+}
+
+/**
+ * Switch scheduling mode if the "udp_sched_paced" property changed,
+ * moving queued traffic to the proper queues.
+ */
+static void
+udp_sched_mode_sync(udp_sched_t *us)
+{
+	bool paced = GNET_PROPERTY(udp_sched_paced);
+	struct udp_tx_desc *txd;
+	uint i;
+
+	if (booleanize(us->paced) == paced)
+		return;
+
+	udp_sched_log(1, "%p: switching to %s mode, %zu bytes buffered",
+		us, paced ? "paced" : "LIFO", us->buffered);
+
+	us->paced = booleanize(paced);
+
+	if (paced) {
+		ulong now = udp_sched_now_ms();
+
+		us->ring_tick = now / UDP_SCHED_TICK;
+		us->refill_ms = now;
+		us->tokens = 0;
+
+		for (i = 0; i < N_ITEMS(us->lifo); i++) {
+			while (NULL != (txd = eslist_shift(&us->lifo[i])))
+				udp_sched_paced_enqueue(us, txd);
+		}
+
+		if (0 != udp_sched_queued(us))
+			udp_sched_tick_arm(us);
+	} else {
+		cq_cancel(&us->tick_ev);
+
+		for (i = 0; i < N_ITEMS(us->level); i++) {
+			struct udp_sched_level *l = &us->level[i];
+
+			while (0 != l->count) {
+				txd = elist_head(&l->heap[0]->queue);
+				udp_sched_paced_unlink(us, txd);
+				eslist_append(&us->lifo[i], txd);
+			}
+		}
+	}
+}
+
+/**
+ * Forcefully drop all the traffic queued in paced mode.
+ */
+static void
+udp_sched_paced_drop_all(udp_sched_t *us)
+{
+	uint i;
+
+	for (i = 0; i < N_ITEMS(us->level); i++) {
+		struct udp_sched_level *l = &us->level[i];
+
+		while (0 != l->count) {
+			struct udp_tx_desc *txd = elist_head(&l->heap[0]->queue);
+
+			udp_sched_paced_unlink(us, txd);
+			udp_tx_desc_drop(txd, us);
+		}
+	}
+}
+
+/**
+ * @return whether a message of given priority can be sent right away
+ * in paced mode.
+ */
+static bool
+udp_sched_paced_can_send(udp_sched_t *us, uint prio)
+{
+	uint i;
+
+	for (i = prio; i < N_ITEMS(us->level); i++) {
+		if (0 != us->level[i].queued)
+			return FALSE;
+	}
+
+	return udp_sched_has_tokens(us, prio);
+}
+
 /**
  * Send datagram.
  *
@@ -643,11 +1180,20 @@ udp_sched_send(udp_sched_t *us, pmsg_t *mb, const gnet_host_t *to,
 	g_assert_log(prio < PMSG_P_COUNT,
 		"%s(): prio=%u", G_STRFUNC, prio);
 
+	udp_sched_mode_sync(us);
+
 	/*
 	 * Try to send immediately if we have bandwidth.
+	 *
+	 * In paced mode, we also need to have tokens and nothing already
+	 * queued at the same or at a higher priority.
 	 */
 
-	if (!us->used_all && udp_sched_mb_sendto(us, mb, to, tx, cb)) {
+	if (
+		!us->used_all &&
+		(!us->paced || udp_sched_paced_can_send(us, prio)) &&
+		udp_sched_mb_sendto(us, mb, to, tx, cb)
+	) {
 		static gnr_stats_t s[] = {
 			GNR_UDP_SCHED_DIRECTLY_SENT_PRIO_DATA,
 			GNR_UDP_SCHED_DIRECTLY_SENT_PRIO_CONTROL,
@@ -657,6 +1203,9 @@ udp_sched_send(udp_sched_t *us, pmsg_t *mb, const gnet_host_t *to,
 
 		STATIC_ASSERT(PMSG_P_COUNT == N_ITEMS(s));
 
+		if (us->paced && pmsg_was_sent(mb))
+			us->tokens -= len;
+
 		gnet_stats_inc_general(s[prio]);
 		return len;		/*  Message "sent" */
 	}
@@ -714,6 +1263,7 @@ udp_sched_send(udp_sched_t *us, pmsg_t *mb, const gnet_host_t *to,
 	txd->tx = tx;
 	txd->cb = cb;
 	txd->expire = time_advance(tm_time(), UDP_SCHED_EXPIRE);
+	txd->queued_ms = udp_sched_now_ms();
 
 	udp_sched_log(4, "%p: queuing mb=%p (%d bytes) prio=%u",
 		us, mb, pmsg_size(mb), pmsg_prio(mb));
@@ -731,6 +1281,20 @@ udp_sched_send(udp_sched_t *us, pmsg_t *mb, const gnet_host_t *to,
 		gnet_stats_inc_general(s[prio]);
 	}
 
+	udp_sched_depth_stats(udp_sched_queued(us));
+	us->buffered = size_saturate_add(us->buffered, len);
+
+	/*
+	 * In paced mode, the packet is queued behind the other ones for the
+	 * same destination, and the tick will send it when its turn comes.
+	 */
+
+	if (us->paced) {
+		udp_sched_paced_enqueue(us, txd);
+		udp_sched_tick_arm(us);
+		return len;
+	}
+
 	/*
 	 * The queue used is a LIFO to avoid buffering delaying all the messages.
 	 * Since UDP traffic is unordered, it's better to send the most recent
@@ -739,7 +1303,6 @@ udp_sched_send(udp_sched_t *us, pmsg_t *mb, const gnet_host_t *to,
 
 	g_assert(prio < N_ITEMS(us->lifo));
 	eslist_prepend(&us->lifo[prio], txd);
-	us->buffered = size_saturate_add(us->buffered, len);
 
 	return len;		/* Message queued, but tell upper layers it's sent */
 }
@@ -871,17 +1434,78 @@ udp_sched_service(udp_sched_t *us, struct udp_service_ctx *ctx)
 }
 
 /**
- * Invoked each time a new bandwidth timeslice begins.
+ * If we did not use all the bandwidth yet and we flow-controlled
+ * upper layers, service them.
  */
 static void
-udp_sched_begin(void *data, int source, inputevt_cond_t cond)
+udp_sched_unflow(udp_sched_t *us, int source, inputevt_cond_t cond)
+{
+	if (!us->used_all && us->flow_controlled) {
+		struct udp_service_ctx ctx;
+
+		us->flow_controlled = FALSE;
+		ctx.fd = source;
+		ctx.cond = cond;
+		udp_sched_service(us, &ctx);
+	}
+}
+
+/**
+ * Process queued traffic in paced mode.
+ */
+static void
+udp_sched_paced_process(udp_sched_t *us)
+{
+	ulong now = udp_sched_now_ms();
+
+	udp_sched_refill(us, now);
+	udp_sched_paced_expire(us, now);
+	udp_sched_paced_run(us);
+	udp_sched_tx_release(us);		/* May re-queue traffic */
+
+	udp_sched_log(5, "%p: %zu bytes buffered, %'zu tokens, b/w %s",
+		us, us->buffered, (size_t) MAX(us->tokens, 0),
+		us->used_all ? "gone" : "available");
+
+	if (0 != udp_sched_queued(us))
+		udp_sched_tick_arm(us);
+}
+
+/**
+ * Callout queue callback invoked every UDP_SCHED_TICK ms in paced mode,
+ * as long as we have traffic queued.
+ */
+static void
+udp_sched_tick(cqueue_t *cq, void *data)
 {
 	udp_sched_t *us = data;
-	unsigned i;
 
 	udp_sched_check(us);
 
-	udp_sched_log(4, "%p: starting, %zu bytes buffered", us, us->buffered);
+	cq_zero(cq, &us->tick_ev);
+	udp_sched_mode_sync(us);
+
+	if (!us->paced)
+		return;
+
+	udp_sched_paced_process(us);
+
+	/*
+	 * The TX stacks do not care about the file descriptor, which we do
+	 * not have here since we are not called by the bandwidth scheduler.
+	 */
+
+	udp_sched_unflow(us, -1, INPUT_EVENT_W);
+}
+
+/**
+ * Process queued traffic in LIFO mode.
+ */
+static void
+udp_sched_lifo_process(udp_sched_t *us)
+{
+	unsigned i;
+
 	udp_sched_log(5, "%p: messages queued: "
 		"data=%zu, control=%zu, urgent=%zu, highest=%zu",
 		us, eslist_count(&us->lifo[PMSG_P_DATA]),
@@ -902,8 +1526,6 @@ udp_sched_begin(void *data, int source, inputevt_cond_t cond)
 	 * processing the highest priority queue first.
 	 */
 
-	us->used_all = FALSE;
-
 	do {
 		udp_sched_seen_clear(us);
 		for (i = N_ITEMS(us->lifo); i != 0 && !us->used_all; i--) {
@@ -913,20 +1535,29 @@ udp_sched_begin(void *data, int source, inputevt_cond_t cond)
 		udp_sched_log(5, "%p: loop tail: %zu bytes buffered, b/w %s",
 			us, us->buffered, us->used_all ? "gone" : "available");
 	} while (!us->used_all && us->buffered != 0);
+}
 
-	/*
-	 * If we did not use all the bandwidth yet and we flow-controlled
-	 * upper layers, service them.
-	 */
+/**
+ * Invoked each time a new bandwidth timeslice begins.
+ */
+static void
+udp_sched_begin(void *data, int source, inputevt_cond_t cond)
+{
+	udp_sched_t *us = data;
 
-	if (!us->used_all && us->flow_controlled) {
-		struct udp_service_ctx ctx;
+	udp_sched_check(us);
 
-		us->flow_controlled = FALSE;
-		ctx.fd = source;
-		ctx.cond = cond;
-		udp_sched_service(us, &ctx);
-	}
+	udp_sched_log(4, "%p: starting, %zu bytes buffered", us, us->buffered);
+
+	udp_sched_mode_sync(us);
+	us->used_all = FALSE;
+
+	if (us->paced)
+		udp_sched_paced_process(us);
+	else
+		udp_sched_lifo_process(us);
+
+	udp_sched_unflow(us, source, cond);
 
 	udp_sched_log(4, "%p: done (b/w %s, %zu bytes buffered%s)",
 		us, us->used_all ? "gone" : "available", us->buffered,
@@ -1021,6 +1652,11 @@ udp_sched_make(
 	udp_sched_update_sockets(us);
 	for (i = 0; i < N_ITEMS(us->lifo); i++) {
 		eslist_init(&us->lifo[i], offsetof(struct udp_tx_desc, lnk));
+		us->level[i].dests =
+			htable_create_any(gnet_host_hash, gnet_host_hash2, gnet_host_equal);
+	}
+	for (i = 0; i < N_ITEMS(us->ring); i++) {
+		elist_init(&us->ring[i], offsetof(struct udp_tx_desc, rlnk));
 	}
 	eslist_init(&us->tx_released, offsetof(struct udp_tx_desc, lnk));
 	us->seen =
@@ -1048,12 +1684,19 @@ udp_sched_free(udp_sched_t *us)
 
 	g_assert(0 == hash_list_length(us->stacks));
 
+	cq_cancel(&us->tick_ev);
+
 	for (i = 0; i < N_ITEMS(us->lifo); i++) {
 		udp_sched_drop_all(us, &us->lifo[i]);
 	}
+	udp_sched_paced_drop_all(us);
 	udp_sched_tx_release(us);
 	udp_sched_seen_clear(us);
 	pool_free(us->txpool);
+	for (i = 0; i < N_ITEMS(us->level); i++) {
+		htable_free_null(&us->level[i].dests);
+		HFREE_NULL(us->level[i].heap);
+	}
 	hset_free_null(&us->seen);
 	hash_list_free(&us->stacks);
 	udp_sched_clear_sockets(us);
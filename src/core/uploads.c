@@ -3811,6 +3811,7 @@ static const struct tx_deflate_cb upload_tx_deflate_cb = {
 	NULL,				/* add_tx_deflated */
 	upload_tx_error,	/* shutdown */
 	NULL,				/* flow_control */
+	NULL,				/* add_tx_delay */
 };
 
 static void
@@ -3829,6 +3830,8 @@ static const struct tx_link_cb upload_tx_link_cb = {
 	upload_tx_error,		/* eof_remove */
 	upload_tx_error,		/* eof_shutdown */
 	NULL,					/* unflushq -- XXX rename it, it's node specific */
+	NULL,					/* add_tx_short */
+	NULL,					/* add_tx_stall */
 };
 
 /**
@@ -4088,6 +4091,20 @@ prepare_browse_host_upload(struct upload *u, header_t *header,
 		return -1;
 	}
 
+	/*
+	 * Limit the amount of concurrent browse sessions to what our outgoing
+	 * bandwidth can sustain.  This is checked before accounting for the
+	 * request, so that the remote host can retry later on.
+	 */
+
+	if (browse_host_is_busy()) {
+		static const char retry_after[] = "Retry-After: 300\r\n";
+
+		upload_http_extra_line_add(u, retry_after);
+		upload_send_error(u, 503, N_("Too Many Browse Sessions"));
+		return -1;
+	}
+
 	/*
 	 * Throttle browsing requests from indelicate clients...
 	 *
@@ -93,6 +93,7 @@
 #include "lib/dbmw.h"
 #include "lib/dbstore.h"
 #include "lib/glib-missing.h"
+#include "lib/halloc.h"
 #include "lib/hikset.h"
 #include "lib/hset.h"
 #include "lib/patricia.h"
@@ -100,6 +101,7 @@
 #include "lib/pslist.h"
 #include "lib/str.h"
 #include "lib/stringify.h"
+#include "lib/tm.h"
 #include "lib/walloc.h"
 
 #include "lib/override.h"		/* Must be the last header included */
@@ -110,6 +112,9 @@
 #define LOAD_SMOOTH		0.25f	/**< EMA smoothing factor for load */
 #define LOAD_GET_THRESH	5.0		/**< Above that and we're "loaded" */
 #define LOAD_STO_THRESH	8.0		/**< Above that and we're "loaded" */
+#define LOAD_BUDGET		10		/**< Max ms spent per scanning batch */
+#define LOAD_RESUME		250		/**< Delay (ms) before next scanning batch */
+#define LOAD_CHECK		16		/**< Check budget every that many keys */
 #define KBALL_PERIOD	(2*60)	/**< Update k-ball info every 2 minutes */
 #define KBALL_FIRST		60		/**< First k-ball update after 1 minute */
 
@@ -198,6 +203,32 @@ static cevent_t *kball_ev;		/**< Event for periodic k-ball update */
 static cperiodic_t *keys_periodic_ev;
 static cperiodic_t *keys_sync_ev;
 
+/**
+ * Context used by keys_update_load().
+ */
+struct load_ctx {
+	size_t values;
+	time_t now;
+};
+
+/**
+ * Periodic scanning of the keys, to update request loads and expire values.
+ *
+ * Since we can hold many keys, and checking for expired values requires
+ * reading the key data from the database, the scan is done in batches,
+ * each limited by a time budget to avoid stalling the main thread.
+ * The scan works on a snapshot of the KUIDs taken when it starts, the keys
+ * being looked up again when we come to process them.
+ */
+static struct keys_scan {
+	const kuid_t **ids;			/**< Snapshot of key IDs (atoms) to scan */
+	size_t count;				/**< Amount of IDs in snapshot */
+	size_t next;				/**< Index of next ID to process */
+	size_t batches;				/**< Amount of batches run so far */
+	struct load_ctx ctx;		/**< Load update context */
+	cevent_t *resume_ev;		/**< Resuming of the scan */
+} keys_scan;
+
 /**
  * Decimation factor to adjust expiration time depending on the distance
  * in bits from the furthest node in the k-ball.
@@ -1177,24 +1208,13 @@ install_periodic_kball(int period)
 }
 
 /**
- * Context used by keys_update_load().
- */
-struct load_ctx {
-	size_t values;
-	time_t now;
-};
-
-/**
- * Hashtable iterator to update key's request load.
+ * Update key's request load.
  *
- * @return TRUE if the key item holds no value and must be removed.
+ * @return TRUE if the key item held no value and was reclaimed.
  */
 static bool
-keys_update_load(void *val, void *u)
+keys_update_load(struct keyinfo *ki, struct load_ctx *ctx)
 {
-	struct keyinfo *ki = val;
-	struct load_ctx *ctx = u;
-
 	keyinfo_check(ki);
 
 	/*
@@ -1203,7 +1223,7 @@ keys_update_load(void *val, void *u)
 
 	if (ctx->now >= ki->next_expire) {
 		if (!keys_expire_values(ki, ctx->now))
-			return TRUE;		/* ki was freed, delete entry */
+			return TRUE;		/* ki was freed and removed */
 	}
 
 	/*
@@ -1213,7 +1233,7 @@ keys_update_load(void *val, void *u)
 	 */
 
 	if (0 == ki->values) {
-		keys_reclaim(ki, FALSE);
+		keys_reclaim(ki, TRUE);
 		return TRUE;			/* Entry deleted */
 	}
 
@@ -1234,6 +1254,112 @@ keys_update_load(void *val, void *u)
 	return FALSE;				/* Node is kept */
 }
 
+/**
+ * Hash set iterator to snapshot the key IDs.
+ */
+static void
+keys_scan_snapshot(void *val, void *u)
+{
+	const struct keyinfo *ki = val;
+	struct keys_scan *ks = u;
+
+	keyinfo_check(ki);
+	g_assert(ks->count < hikset_count(keys));
+
+	ks->ids[ks->count++] = kuid_get_atom(ki->kuid);
+}
+
+/**
+ * Release the snapshot of the key IDs taken for the scan.
+ */
+static void
+keys_scan_clear(struct keys_scan *ks)
+{
+	size_t i;
+
+	for (i = 0; i < ks->count; i++)
+		kuid_atom_free(ks->ids[i]);
+
+	HFREE_NULL(ks->ids);
+	cq_cancel(&ks->resume_ev);
+	ks->count = ks->next = 0;
+}
+
+static void keys_scan_resume(cqueue_t *cq, void *obj);
+
+/**
+ * Process the next batch of keys, within the allocated time budget.
+ */
+static void
+keys_scan_batch(struct keys_scan *ks)
+{
+	tm_t start;
+	size_t n = 0;
+
+	g_assert(ks->ids != NULL);
+
+	ks->batches++;
+	gnet_stats_inc_general(GNR_DHT_STORAGE_SCAN_BATCHES);
+	tm_now_exact(&start);
+
+	while (ks->next < ks->count) {
+		struct keyinfo *ki = hikset_lookup(keys, ks->ids[ks->next++]);
+
+		if (ki != NULL)
+			(void) keys_update_load(ki, &ks->ctx);
+
+		if (0 == ++n % LOAD_CHECK && ks->next < ks->count) {
+			tm_t now;
+
+			tm_now_exact(&now);
+			if (tm_elapsed_ms(&now, &start) >= LOAD_BUDGET) {
+				gnet_stats_inc_general(GNR_DHT_STORAGE_SCAN_DEFERRED);
+				ks->resume_ev = cq_main_insert(LOAD_RESUME,
+					keys_scan_resume, ks);
+				break;
+			}
+		}
+	}
+
+	gnet_stats_count_general(GNR_DHT_STORAGE_SCANNED_KEYS, n);
+
+	if (ks->next < ks->count)
+		return;			/* Will resume later */
+
+	/*
+	 * The value count can only be checked when the scan was done in one
+	 * single batch: otherwise, values may have been added or removed to
+	 * keys we had already scanned.
+	 */
+
+	g_assert_log(ks->batches > 1 || values_count() == ks->ctx.values,
+		"values_count()=%zu, ctx.values=%zu",
+		values_count(), ks->ctx.values);
+
+	if (GNET_PROPERTY(dht_storage_debug)) {
+		size_t keys_count = hikset_count(keys);
+		g_debug("DHT holding %zu value%s spread over %zu key%s "
+			"(scanned %zu key%s in %zu batch%s)",
+			ks->ctx.values, plural(ks->ctx.values),
+			keys_count, plural(keys_count),
+			ks->count, plural(ks->count), ks->batches, plural_es(ks->batches));
+	}
+
+	keys_scan_clear(ks);
+}
+
+/**
+ * Callout queue callback to resume the scanning of keys.
+ */
+static void
+keys_scan_resume(cqueue_t *cq, void *obj)
+{
+	struct keys_scan *ks = obj;
+
+	cq_zero(cq, &ks->resume_ev);
+	keys_scan_batch(ks);
+}
+
 /**
  * Callout queue periodic event for request load updates.
  * Also reclaims dead keys holding no values.
@@ -1241,23 +1367,32 @@ keys_update_load(void *val, void *u)
 static bool
 keys_periodic_load(void *unused_obj)
 {
-	struct load_ctx ctx;
+	struct keys_scan *ks = &keys_scan;
 
 	(void) unused_obj;
 
-	ctx.values = 0;
-	ctx.now = tm_time();
-	hikset_foreach_remove(keys, keys_update_load, &ctx);
-
-	g_assert_log(values_count() == ctx.values,
-		"values_count()=%zu, ctx.values=%zu", values_count(), ctx.values);
+	/*
+	 * If the previous scan is not finished yet, skip this period.
+	 */
 
-	if (GNET_PROPERTY(dht_storage_debug)) {
-		size_t keys_count = hikset_count(keys);
-		g_debug("DHT holding %zu value%s spread over %zu key%s",
-			ctx.values, plural(ctx.values), keys_count, plural(keys_count));
+	if (ks->ids != NULL) {
+		if (GNET_PROPERTY(dht_storage_debug)) {
+			g_debug("DHT previous key scan still running (%zu/%zu done)",
+				ks->next, ks->count);
+		}
+		return TRUE;
 	}
 
+	ks->ctx.values = 0;
+	ks->ctx.now = tm_time();
+	ks->batches = 0;
+
+	HALLOC_ARRAY(ks->ids, hikset_count(keys) + 1);	/* +1: never NULL */
+	hikset_foreach(keys, keys_scan_snapshot, ks);
+
+	gnet_stats_inc_general(GNR_DHT_STORAGE_SCANS);
+	keys_scan_batch(ks);
+
 	return TRUE;		/* Keep calling */
 }
 
@@ -1824,6 +1959,7 @@ keys_close(void)
 
 	cq_cancel(&kball_ev);
 	cq_periodic_remove(&keys_periodic_ev);
+	keys_scan_clear(&keys_scan);
 	cq_periodic_remove(&keys_sync_ev);
 }
 
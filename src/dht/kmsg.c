@@ -61,7 +61,9 @@
 #include "lib/aging.h"
 #include "lib/bigint.h"
 #include "lib/bstr.h"
+#include "lib/endian.h"
 #include "lib/host_addr.h"
+#include "lib/mempcpy.h"
 #include "lib/pmsg.h"
 #include "lib/pslist.h"
 #include "lib/random.h"
@@ -89,6 +91,18 @@
  */
 #define KMSG_PONG_SIZE			101
 
+/**
+ * Pre-built Kademlia header, holding the contact information of our node.
+ */
+static struct kmsg_header_template {
+	kademlia_header_t header;	/**< Header with our contact filled */
+	kuid_t kuid;				/**< Our KUID when template was built */
+	uint32 addr;				/**< Our IPv4 address when template was built */
+	uint16 port;				/**< Our port when template was built */
+	bool firewalled;			/**< Whether we were firewalled */
+	bool built;					/**< Whether template was built */
+} kmsg_header_template;
+
 /**
  * Ping throttling.
  *
@@ -310,19 +324,46 @@ static void
 kmsg_build_header(kademlia_header_t *header,
 	uint8 op, uint8 major, uint8 minor, const guid_t *muid)
 {
+	struct kmsg_header_template *t = &kmsg_header_template;
+	const kuid_t *kuid = get_our_kuid();
+	uint32 addr = host_addr_ipv4(listen_addr());
+	uint16 port = socket_listen_port();
+	bool firewalled = !dht_is_active();
+
+	/*
+	 * The part of the header describing our node only changes when
+	 * our contact information changes, so we keep it pre-built and
+	 * only patch the message-specific fields.
+	 */
+
+	if G_UNLIKELY(
+		!t->built || addr != t->addr || port != t->port ||
+		firewalled != t->firewalled || !kuid_eq(kuid, &t->kuid)
+	) {
+		kademlia_header_t *th = &t->header;
+
+		ZERO(th);
+		kademlia_header_set_contact_kuid(th, kuid->v);
+		kademlia_header_set_contact_vendor(th, T_GTKG);
+		kademlia_header_set_contact_version(th,
+			KDA_VERSION_MAJOR, KDA_VERSION_MINOR);
+		kademlia_header_set_contact_addr_port(th, addr, port);
+		kademlia_header_set_contact_instance(th, 1);	/* XXX What's this? */
+		kademlia_header_set_contact_flags(th,
+			firewalled ?  KDA_MSG_F_FIREWALLED : 0);
+		kademlia_header_set_extended_length(th, 0);
+
+		t->kuid = *kuid;		/* Struct copy */
+		t->addr = addr;
+		t->port = port;
+		t->firewalled = firewalled;
+		t->built = TRUE;
+	}
+
+	memcpy(header, t->header, KDA_HEADER_SIZE);
 	kademlia_header_set_muid(header, muid);
 	kademlia_header_set_dht(header, major, minor);
 	kademlia_header_set_function(header, op);
-	kademlia_header_set_contact_kuid(header, get_our_kuid()->v);
-	kademlia_header_set_contact_vendor(header, T_GTKG);
-	kademlia_header_set_contact_version(header,
-		KDA_VERSION_MAJOR, KDA_VERSION_MINOR);
-	kademlia_header_set_contact_addr_port(header,
-		host_addr_ipv4(listen_addr()), socket_listen_port());
-	kademlia_header_set_contact_instance(header, 1);	/* XXX What's this? */
-	kademlia_header_set_contact_flags(header,
-		dht_is_active() ?  0 : KDA_MSG_F_FIREWALLED);
-	kademlia_header_set_extended_length(header, 0);
 
 	g_assert(kademlia_header_constants_ok(header));
 }
@@ -375,18 +416,76 @@ serialize_size_estimate(pmsg_t *mb)
 	}
 }
 
+/**
+ * Get the serialized form of a contact, cached in the node.
+ *
+ * The cache is invalidated by knode_contact_invalidate() when the node's
+ * contact information changes.
+ *
+ * @return the length of the serialized contact held in kn->contact.
+ */
+static size_t
+kmsg_contact(const knode_t *kn)
+{
+	knode_t *wkn = deconstify_pointer(kn);
+	uint8 *p;
+
+	knode_check(kn);
+
+	if G_LIKELY(kn->contact_len != 0)
+		return kn->contact_len;
+
+	p = poke_be32(wkn->contact, kn->vcode.u32);
+	*p++ = kn->major;
+	*p++ = kn->minor;
+	p = mempcpy(p, kn->id->v, KUID_RAW_SIZE);
+
+	switch (host_addr_net(kn->addr)) {
+	case NET_TYPE_IPV4:
+		*p++ = 4;
+		p = poke_be32(p, host_addr_ipv4(kn->addr));
+		break;
+	case NET_TYPE_IPV6:
+		*p++ = 16;
+		p = mempcpy(p, host_addr_ipv6(&kn->addr), 16);
+		break;
+	case NET_TYPE_LOCAL:
+	case NET_TYPE_NONE:
+		g_error("%s(): unexpected address for %s",
+			G_STRFUNC, knode_to_string(kn));
+	}
+
+	p = poke_be16(p, kn->port);		/* Port is big-endian in Kademlia */
+
+	g_assert(ptr_diff(p, kn->contact) <= sizeof kn->contact);
+
+	wkn->contact_len = ptr_diff(p, kn->contact);
+	return kn->contact_len;
+}
+
 /**
  * Serialize a contact to message block.
  */
 void
 kmsg_serialize_contact(pmsg_t *mb, const knode_t *kn)
 {
-	pmsg_write_be32(mb, kn->vcode.u32);
-	pmsg_write_u8(mb, kn->major);
-	pmsg_write_u8(mb, kn->minor);
-	pmsg_write(mb, kn->id->v, KUID_RAW_SIZE);
-	pmsg_write_ipv4_or_ipv6_addr(mb, kn->addr);
-	pmsg_write_be16(mb, kn->port);		/* Port is big-endian in Kademlia */
+	size_t len = kmsg_contact(kn);
+
+	pmsg_write(mb, kn->contact, len);
+}
+
+/**
+ * Compute the serialized length of a contact vector.
+ */
+static size_t
+contact_vector_size(knode_t **kvec, size_t klen)
+{
+	size_t i, len = 1;		/* Leading count byte */
+
+	for (i = 0; i < klen; i++)
+		len += kmsg_contact(kvec[i]);
+
+	return len;
 }
 
 /**
@@ -510,10 +609,14 @@ k_send_find_node_response(
 	 * Each contact is made of: Vendor, Version, KUID, IP:port, and asssuming
 	 * an IPv6 address, the maximum size is 4 + 2 + 20 + 19 = 45 bytes.
 	 *
-	 * The maximum payload size is therefore: 1 + 4 + 1 + 20*45 = 906 bytes.
+	 * Since contacts are serialized once and cached in the nodes, we know
+	 * the exact payload size beforehand, which is 727 bytes for a typical
+	 * response with 20 IPv4 contacts, instead of allocating for the
+	 * maximum of 1 + 4 + 1 + 20*45 = 906 bytes.
 	 */
 
-	mb = pmsg_new(PMSG_P_DATA, NULL, KDA_HEADER_SIZE + 906);
+	mb = pmsg_new(PMSG_P_DATA, NULL, KDA_HEADER_SIZE +
+			1 + SECTOKEN_RAW_SIZE + contact_vector_size(kvec, klen));
 
 	header = (kademlia_header_t *) pmsg_phys_base(mb);
 	kmsg_build_header(header, KDA_MSG_FIND_NODE_RESPONSE, 0, 0, muid);
@@ -2524,6 +2627,7 @@ hostile_checked:
 		kn->addr = addr;
 		kn->port = port;
 		kn->flags |= KNODE_F_PCONTACT;
+		knode_contact_invalidate(kn);
 		weird_header = TRUE;
 	}
 
@@ -193,6 +193,7 @@ knode_clone(const knode_t *kn)
 	cn->refcnt = 1;					/* New instance */
 	cn->id = kuid_get_atom(kn->id);	/* Increase reference count */
 	cn->rpc_pending = 0;
+	knode_contact_invalidate(cn);	/* Serialized contact not inherited */
 
 	return cn;
 }
@@ -260,6 +261,7 @@ knode_change_vendor(knode_t *kn, vendor_code_t vcode)
 	}
 
 	kn->vcode = vcode;
+	knode_contact_invalidate(kn);
 }
 
 /**
@@ -278,6 +280,7 @@ knode_change_version(knode_t *kn, uint8 major, uint8 minor)
 
 	kn->major = major;
 	kn->minor = minor;
+	knode_contact_invalidate(kn);
 }
 
 /**
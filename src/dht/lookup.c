@@ -146,6 +146,49 @@ enum parallelism {
 
 struct nlookup;
 
+/**
+ * Sets to which a contact can belong during a lookup.
+ *
+ * All the sets are held in a single vector of contacts sorted by increasing
+ * XOR distance to the target, each contact recording its set memberships
+ * as flag bits.  Contacts are never removed from the vector until the lookup
+ * is freed, hence walking a set remains valid as long as no new contact is
+ * added to the lookup.
+ */
+enum nl_set {
+	NL_SHORTLIST = 0,			/**< Nodes to query */
+	NL_PATH,					/**< Lookup path followed */
+	NL_BALL,					/**< The k-closest nodes we've found so far */
+	NL_QUERIED,					/**< Nodes already queried */
+	NL_PENDING,					/**< Nodes still pending a reply */
+	NL_UNSAFE,					/**< Nodes deemed unsafe */
+	NL_FIXED,					/**< Nodes whose contact address was fixed */
+
+	NL_SET_COUNT
+};
+
+#define NL_SET(s)		(1U << (s))
+
+/**
+ * Sets in which presence of the contact accounts for one reference on
+ * the node, which is taken and released by the callers.
+ */
+#define NL_SET_REFS		(NL_SET(NL_SHORTLIST) | NL_SET(NL_PATH) | \
+	NL_SET(NL_BALL) | NL_SET(NL_QUERIED) | NL_SET(NL_PENDING))
+
+#define NL_CONTACTS		(4 * KDA_K)	/**< Initial size of contact vector */
+
+/**
+ * A contact known to the lookup.
+ */
+struct nl_contact {
+	kuid_t dist;				/**< XOR distance to the target KUID */
+	knode_t *kn;				/**< The node, when in a referencing set */
+	knode_t *alternate;			/**< Alternate address for node */
+	lookup_token_t *token;		/**< Collected security token */
+	uint8 sets;					/**< Sets to which contact belongs */
+};
+
 /**
  * Context for fetching secondary keys.
  */
@@ -190,12 +233,10 @@ struct nlookup {
 	kuid_t *kuid;				/**< The KUID we're looking for */
 	const knode_t *closest;			/**< Closest node found so far */
 	const knode_t *prev_closest;	/**< Previous closest node at last hop */
-	patricia_t *shortlist;		/**< Nodes to query */
-	map_t *queried;				/**< Nodes already queried */
-	map_t *unsafe;				/**< Nodes deemed unsafe */
-	map_t *tokens;				/**< Collected security tokens */
-	patricia_t *path;			/**< Lookup path followed */
-	patricia_t *ball;			/**< The k-closest nodes we've found so far */
+	struct nl_contact *contacts;	/**< Contacts, by increasing distance */
+	size_t ccount;				/**< Amount of contacts in vector */
+	size_t csize;				/**< Allocated size of contact vector */
+	uint count[NL_SET_COUNT];	/**< Amount of contacts in each set */
 	cevent_t *expire_ev;		/**< Global expiration event for lookup */
 	cevent_t *delay_ev;			/**< Delay event for retries */
 	acct_net_t *c_class;		/**< Counts class-C networks in path */
@@ -234,28 +275,6 @@ struct nlookup {
 	tm_t start;					/**< Start time */
 	uint32 hops;				/**< Amount of hops in lookup so far */
 	uint32 flags;				/**< Operating flags */
-	/*
-	 * XXX -- hack alert!
-	 *
-	 * Leave these fields here, or gtk-gnutella crashes quickly with a
-	 * corrupted free list.  Why? (it crashes even if the fields are otherwise
-	 * unused, so it has to do with the structure size and is probably NOT
-	 * related to the code here but something elsewhere).
-	 *
-	 * When REMAP_ZALLOC is on:
-	 * If put above the union {} field, the crash happens within 2-3 minutes,
-	 * unless compiled with MALLOC_SAFE.
-	 * If put here, everything works fine, so memory corruption has to do
-	 * with the structure size.
-	 *
-	 * Without REMAP_ZALLOC, everything works fine, probably because zalloc()
-	 * rounds the block size.
-	 *
-	 *		--RAM, 2009-05-08
-	 */
-	map_t *pending;				/**< Nodes still pending a reply */
-	map_t *alternate;			/**< Alternate address for nodes */
-	map_t *fixed;				/**< Nodes whose contact address was fixed */
 };
 
 /**
@@ -396,17 +415,283 @@ lookup_token_free(lookup_token_t *ltok, bool freedata)
 }
 
 /**
- * Map iterator callback to free lookup tokens.
+ * Locate contact in the lookup.
+ *
+ * @param nl		the node lookup
+ * @param id		the KUID of the contact
+ * @param pos		if non-NULL, written with the index of the contact in the
+ *					vector, or the index where it should be inserted
+ *
+ * @return the contact, NULL if it is not known.
+ */
+static struct nl_contact *
+lookup_contact_find(const nlookup_t *nl, const kuid_t *id, size_t *pos)
+{
+	kuid_t dist;
+	size_t lo = 0, hi = nl->ccount;
+
+	kuid_xor_distance(&dist, id, nl->kuid);
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		int c = kuid_cmp(&dist, &nl->contacts[mid].dist);
+
+		if (0 == c) {
+			if (pos != NULL)
+				*pos = mid;
+			return &nl->contacts[mid];
+		} else if (c < 0) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+
+	if (pos != NULL)
+		*pos = lo;
+
+	return NULL;
+}
+
+/**
+ * Get contact from the lookup, creating a new one if needed.
+ *
+ * @attention
+ * Creating a contact invalidates pointers to other contacts and shifts the
+ * indices of the ones further away from the target.
+ */
+static struct nl_contact *
+lookup_contact_get(nlookup_t *nl, const kuid_t *id)
+{
+	struct nl_contact *c;
+	size_t pos;
+
+	c = lookup_contact_find(nl, id, &pos);
+
+	if (c != NULL)
+		return c;
+
+	if G_UNLIKELY(nl->ccount == nl->csize) {
+		size_t n = nl->csize * 2;
+
+		WREALLOC_ARRAY(nl->contacts, nl->csize, n);
+		nl->csize = n;
+	}
+
+	c = &nl->contacts[pos];
+	memmove(c + 1, c, (nl->ccount - pos) * sizeof *c);
+	nl->ccount++;
+
+	ZERO(c);
+	kuid_xor_distance(&c->dist, id, nl->kuid);
+
+	return c;
+}
+
+/**
+ * Compute the KUID of contact.
  */
 static void
-free_token(void *unused_key, void *value, void *unused_u)
+lookup_contact_id(const nlookup_t *nl, const struct nl_contact *c, kuid_t *id)
 {
-	lookup_token_t *ltok = value;
+	kuid_xor_distance(id, &c->dist, nl->kuid);
+}
 
-	(void) unused_key;
-	(void) unused_u;
+/**
+ * @return whether node bearing the KUID belongs to the set.
+ */
+static bool
+lookup_in(const nlookup_t *nl, enum nl_set set, const kuid_t *id)
+{
+	const struct nl_contact *c = lookup_contact_find(nl, id, NULL);
+
+	return c != NULL && (c->sets & NL_SET(set));
+}
+
+/**
+ * @return the node bearing the KUID in the set, NULL if not present.
+ */
+static knode_t *
+lookup_get(const nlookup_t *nl, enum nl_set set, const kuid_t *id)
+{
+	const struct nl_contact *c = lookup_contact_find(nl, id, NULL);
+
+	g_assert(NL_SET_REFS & NL_SET(set));
+
+	return (c != NULL && (c->sets & NL_SET(set))) ? c->kn : NULL;
+}
+
+/**
+ * Insert node in the set, where it must not already be present.
+ *
+ * For sets referencing the node, the caller is responsible for taking
+ * that reference.
+ */
+static void
+lookup_insert(nlookup_t *nl, enum nl_set set, const knode_t *kn)
+{
+	struct nl_contact *c = lookup_contact_get(nl, kn->id);
+
+	g_assert(!(c->sets & NL_SET(set)));
+
+	if (NL_SET_REFS & NL_SET(set)) {
+		g_assert_log(NULL == c->kn || kn == c->kn,
+			"%s(): %s already known as %s", G_STRFUNC,
+			knode_to_string(kn), knode_to_string2(c->kn));
+
+		c->kn = deconstify_pointer(kn);
+	}
+
+	c->sets |= NL_SET(set);
+	nl->count[set]++;
+}
+
+/**
+ * Remove node bearing the KUID from the set.
+ *
+ * @return TRUE if node was present, in which case the caller is responsible
+ * for releasing the reference held by referencing sets.
+ */
+static bool
+lookup_remove(nlookup_t *nl, enum nl_set set, const kuid_t *id)
+{
+	struct nl_contact *c = lookup_contact_find(nl, id, NULL);
+
+	if (NULL == c || !(c->sets & NL_SET(set)))
+		return FALSE;
+
+	g_assert(nl->count[set] != 0);
+
+	c->sets &= ~NL_SET(set);
+	nl->count[set]--;
+
+	if (0 == (c->sets & NL_SET_REFS))
+		c->kn = NULL;
+
+	return TRUE;
+}
+
+/**
+ * @return amount of nodes in the set.
+ */
+static inline size_t
+lookup_count(const nlookup_t *nl, enum nl_set set)
+{
+	return nl->count[set];
+}
+
+/**
+ * Iterate over the contacts of a set, by increasing distance to the target.
+ *
+ * No contact must be added to the lookup whilst iterating.
+ *
+ * @param nl		the node lookup
+ * @param set		the set to iterate over
+ * @param i			iteration index, set to 0 before the first call
+ *
+ * @return next contact in the set, NULL when done.
+ */
+static struct nl_contact *
+lookup_next(const nlookup_t *nl, enum nl_set set, size_t *i)
+{
+	while (*i < nl->ccount) {
+		struct nl_contact *c = &nl->contacts[(*i)++];
+
+		if (c->sets & NL_SET(set))
+			return c;
+	}
+
+	return NULL;
+}
+
+/**
+ * @return the node closest to the target in the set, NULL if set is empty.
+ */
+static knode_t *
+lookup_closest(const nlookup_t *nl, enum nl_set set)
+{
+	size_t i = 0;
+	const struct nl_contact *c;
+
+	if (0 == lookup_count(nl, set))
+		return NULL;
+
+	c = lookup_next(nl, set, &i);
+	g_assert(c != NULL);
 
-	lookup_token_free(ltok, TRUE);
+	return c->kn;
+}
+
+/**
+ * @return the alternate contact recorded for the KUID, NULL if none.
+ */
+static knode_t *
+lookup_alternate(const nlookup_t *nl, const kuid_t *id)
+{
+	const struct nl_contact *c = lookup_contact_find(nl, id, NULL);
+
+	return NULL == c ? NULL : c->alternate;
+}
+
+/**
+ * Record alternate contact address for a node we already know about.
+ */
+static void
+lookup_alternate_add(nlookup_t *nl, const knode_t *kn)
+{
+	struct nl_contact *c = lookup_contact_find(nl, kn->id, NULL);
+
+	g_assert(c != NULL);
+	g_assert(NULL == c->alternate);
+
+	c->alternate = knode_refcnt_inc(kn);
+}
+
+/**
+ * Create a PATRICIA tree holding the nodes of the set, for routines expecting
+ * to iterate over nodes by distance to some KUID that way.
+ *
+ * The nodes are not referenced by the tree, which must be destroyed before
+ * the set is modified.
+ */
+static patricia_t *
+lookup_set_patricia(const nlookup_t *nl, enum nl_set set)
+{
+	patricia_t *pt = patricia_create(KUID_RAW_BITSIZE);
+	const struct nl_contact *c;
+	size_t i = 0;
+
+	while (NULL != (c = lookup_next(nl, set, &i)))
+		patricia_insert(pt, c->kn->id, c->kn);
+
+	return pt;
+}
+
+/**
+ * Release all the contacts held in the lookup.
+ */
+static void
+lookup_contacts_free(nlookup_t *nl)
+{
+	size_t i;
+
+	for (i = 0; i < nl->ccount; i++) {
+		struct nl_contact *c = &nl->contacts[i];
+		uint set;
+
+		for (set = 0; set < NL_SET_COUNT; set++) {
+			if (NL_SET_REFS & c->sets & NL_SET(set))
+				knode_free(c->kn);
+		}
+
+		if (c->alternate != NULL)
+			knode_free(c->alternate);
+		if (c->token != NULL)
+			lookup_token_free(c->token, TRUE);
+	}
+
+	WFREE_ARRAY(nl->contacts, nl->csize);
+	nl->ccount = nl->csize = 0;
 }
 
 /**
@@ -420,29 +705,12 @@ lookup_free(nlookup_t *nl)
 	if (lookup_is_fetching(nl))
 		lookup_value_free(nl, TRUE);
 
-	map_foreach(nl->tokens, free_token, NULL);
-	patricia_foreach(nl->shortlist, knode_patricia_free, NULL);
-	map_foreach(nl->queried, knode_map_free, NULL);
-	map_foreach(nl->unsafe, knode_map_free, NULL);
-	map_foreach(nl->alternate, knode_map_free, NULL);
-	map_foreach(nl->pending, knode_map_free, NULL);
-	map_foreach(nl->fixed, knode_map_free, NULL);
-	patricia_foreach(nl->path, knode_patricia_free, NULL);
-	patricia_foreach(nl->ball, knode_patricia_free, NULL);
+	lookup_contacts_free(nl);
 
 	cq_cancel(&nl->expire_ev);
 	cq_cancel(&nl->delay_ev);
 	kuid_atom_free_null(&nl->kuid);
 
-	map_destroy(nl->tokens);
-	patricia_destroy(nl->shortlist);
-	map_destroy(nl->queried);
-	map_destroy(nl->unsafe);
-	map_destroy(nl->alternate);
-	map_destroy(nl->pending);
-	map_destroy(nl->fixed);
-	patricia_destroy(nl->path);
-	patricia_destroy(nl->ball);
 	acct_net_free_null(&nl->c_class);
 
 	if (!(nl->flags & NL_F_DONT_REMOVE))
@@ -481,40 +749,35 @@ static lookup_rs_t *
 lookup_create_results(nlookup_t *nl)
 {
 	lookup_rs_t *rs;
-	patricia_iter_t *iter;
+	struct nl_contact *c;
 	size_t len;
-	size_t i = 0;
+	size_t i = 0, j = 0;
 
 	lookup_check(nl);
 
 	WALLOC(rs);
 	rs->magic = LOOKUP_RESULT_MAGIC;
 	rs->refcnt = 1;
-	len = patricia_count(nl->path);
+	len = lookup_count(nl, NL_PATH);
 	WALLOC_ARRAY(rs->path, len);
 	rs->path_len = len;
 
-	iter = patricia_metric_iterator_lazy(nl->path, nl->kuid, TRUE);
-
-	while (patricia_iter_has_next(iter)) {
-		knode_t *kn = patricia_iter_next_value(iter);
-		lookup_token_t *ltok = map_lookup(nl->tokens, kn->id);
+	while (NULL != (c = lookup_next(nl, NL_PATH, &j))) {
+		lookup_token_t *ltok = c->token;
 		lookup_rc_t *rc;
 
 		g_assert(i < len);
 		g_assert(ltok != NULL);		/* Tokens collected during lookup */
 
 		rc = &rs->path[i++];
-		rc->kn = knode_refcnt_inc(kn);
+		rc->kn = knode_refcnt_inc(c->kn);
 		rc->token = ltok->token->v;		/* Becomes owner of token data */
 		rc->token_len = ltok->token->length;
 
 		lookup_token_free(ltok, FALSE);	/* Data copied, do not free them */
-		map_remove(nl->tokens, kn->id);
+		c->token = NULL;
 	}
 
-	patricia_iterator_release(&iter);
-
 	lookup_result_check(rs);
 	return rs;
 }
@@ -657,35 +920,33 @@ lookup_free_value_results(const lookup_val_rs_t *results)
 }
 
 /**
- * Dump a PATRICIA tree, from furthest to closest.
+ * Dump a lookup set, from furthest to closest.
  */
 static void
-log_patricia_dump(nlookup_t *nl, patricia_t *pt, const char *what, uint level)
+log_set_dump(nlookup_t *nl, enum nl_set set, const char *what, uint level)
 {
-	size_t count;
-	patricia_iter_t *iter;
+	size_t count, j;
 	int i = 0;
 
 	lookup_check(nl);
 
-	count = patricia_count(pt);
+	count = lookup_count(nl, set);
 	g_debug("DHT LOOKUP[%s] %s contains %zu item%s:",
 		nid_to_string(&nl->lid), what, count, plural(count));
 
-	iter = patricia_metric_iterator_lazy(pt, nl->kuid, FALSE);
+	for (j = nl->ccount; j != 0; j--) {
+		const struct nl_contact *c = &nl->contacts[j - 1];
 
-	while (patricia_iter_has_next(iter)) {
-		knode_t *kn = patricia_iter_next_value(iter);
+		if (!(c->sets & NL_SET(set)))
+			continue;
 
-		knode_check(kn);
+		knode_check(c->kn);
 
 		if (GNET_PROPERTY(dht_lookup_debug) >= level)
 			g_debug("DHT LOOKUP[%s] %s[%d]: %s",
-				nid_to_string(&nl->lid), what, i, knode_to_string(kn));
+				nid_to_string(&nl->lid), what, i, knode_to_string(c->kn));
 		i++;
 	}
-
-	patricia_iterator_release(&iter);
 }
 
 /**
@@ -706,7 +967,7 @@ lookup_final_stats(const nlookup_t *nl)
 			"hops=%u, path=%u, in=%d bytes, out=%d bytes, %d RPC repl%s",
 			nid_to_string(&nl->lid), lookup_type_to_string(nl),
 			tm_elapsed_f(&end, &nl->start),
-			nl->hops, (unsigned) patricia_count(nl->path),
+			nl->hops, (unsigned) lookup_count(nl, NL_PATH),
 			nl->bw_incoming, nl->bw_outgoing,
 			nl->rpc_replies, plural_y(nl->rpc_replies));
 
@@ -752,6 +1013,26 @@ lookup_abort(nlookup_t *nl, lookup_error_t error)
 	lookup_free(nl);
 }
 
+/**
+ * Record all the security tokens collected during the lookup in the cache.
+ */
+static void
+lookup_record_tokens(const nlookup_t *nl)
+{
+	size_t i;
+
+	for (i = 0; i < nl->ccount; i++) {
+		const struct nl_contact *c = &nl->contacts[i];
+
+		if (c->token != NULL) {
+			kuid_t id;
+
+			lookup_contact_id(nl, c, &id);
+			tcache_record(&id, c->token);
+		}
+	}
+}
+
 /**
  * Terminate the node lookup, notify caller of results.
  */
@@ -784,11 +1065,11 @@ lookup_terminate(nlookup_t *nl)
 		 * collected security tokens to reuse in the next run.
 		 */
 
-		tcache_record(nl->tokens);
+		lookup_record_tokens(nl);
 		/* FALL THROUGH */
 	case LOOKUP_NODE:
 		{
-			size_t path_len = patricia_count(nl->path);
+			size_t path_len = lookup_count(nl, NL_PATH);
 			if (path_len > 0 && nl->u.fn.ok) {
 				lookup_rs_t *rs = lookup_create_results(nl);
 				(*nl->u.fn.ok)(nl->kuid, rs, nl->arg);
@@ -810,29 +1091,6 @@ lookup_terminate(nlookup_t *nl)
 	lookup_free(nl);
 }
 
-/**
- * PATRICIA remove iterator to discard from the ball all the nodes which are
- * still present in the shortlist.
- */
-static bool
-remove_if_in_shortlist(void *key, size_t ukeybits, void *val, void *u)
-{
-	kuid_t *id = key;
-	nlookup_t *nl = u;
-	knode_t *kn = val;
-
-	lookup_check(nl);
-	knode_check(kn);
-	(void) ukeybits;
-
-	if (patricia_contains(nl->shortlist, id)) {
-		knode_refcnt_dec(kn);
-		return TRUE;
-	}
-
-	return FALSE;
-}
-
 /**
  * Cleanup the ball by removing all the nodes that are still in the shortlist,
  * thereby keeping only the ones successfully queried.
@@ -840,21 +1098,32 @@ remove_if_in_shortlist(void *key, size_t ukeybits, void *val, void *u)
 static void
 lookup_cleanup_ball(nlookup_t *nl)
 {
+	struct nl_contact *c;
+	size_t i = 0;
+
 	lookup_check(nl);
 
 	if (GNET_PROPERTY(dht_lookup_debug) > 2) {
-		size_t bcount = patricia_count(nl->ball);
-		size_t pcount = patricia_count(nl->path);
+		size_t bcount = lookup_count(nl, NL_BALL);
+		size_t pcount = lookup_count(nl, NL_PATH);
 		g_debug("DHT LOOKUP[%s] %s lookup "
 			"cleaning up ball (%u item%s), path has %u",
 			nid_to_string(&nl->lid), lookup_type_to_string(nl),
 			(unsigned) bcount, plural(bcount), (unsigned) pcount);
 	}
 
-	patricia_foreach_remove(nl->ball, remove_if_in_shortlist, nl);
+	while (NULL != (c = lookup_next(nl, NL_BALL, &i))) {
+		if (c->sets & NL_SET(NL_SHORTLIST)) {
+			knode_t *kn = c->kn;
+
+			knode_check(kn);
+			lookup_remove(nl, NL_BALL, kn->id);
+			knode_refcnt_dec(kn);
+		}
+	}
 
 	if (GNET_PROPERTY(dht_lookup_debug) > 2) {
-		size_t bcount = patricia_count(nl->ball);
+		size_t bcount = lookup_count(nl, NL_BALL);
 		g_debug("DHT LOOKUP[%s] ball now down to %u item%s",
 			nid_to_string(&nl->lid), (unsigned) bcount, plural(bcount));
 	}
@@ -921,11 +1190,11 @@ lookup_value_terminate(nlookup_t *nl,
 	 * any more and we found a cached replica: do not cache further!
 	 */
 
-	count = patricia_count(nl->path);
+	count = lookup_count(nl, NL_PATH);
 
 	if (!local && count > 0 && count < KDA_K) {
-		knode_t *closest = patricia_closest(nl->path, nl->kuid);
-		lookup_token_t *ltok = map_lookup(nl->tokens, closest->id);
+		knode_t *closest = lookup_closest(nl, NL_PATH);
+		lookup_token_t *ltok = lookup_contact_find(nl, closest->id, NULL)->token;
 		lookup_rc_t rc;
 
 		if (
@@ -979,11 +1248,17 @@ lookup_value_terminate(nlookup_t *nl,
 	 */
 
 	lookup_cleanup_ball(nl);
-	dht_update_subspace_size_estimate(nl->ball, nl->kuid, nl->amount);
-	roots_record(nl->ball, nl->kuid);
+
+	{
+		patricia_t *ball = lookup_set_patricia(nl, NL_BALL);
+
+		dht_update_subspace_size_estimate(ball, nl->kuid, nl->amount);
+		roots_record(ball, nl->kuid);
+		patricia_destroy(ball);
+	}
 
 	if (GNET_PROPERTY(dht_lookup_debug) > 2)
-		log_patricia_dump(nl, nl->ball, "final value path", 3);
+		log_set_dump(nl, NL_BALL, "final value path", 3);
 
 	lookup_free(nl);
 
@@ -1679,7 +1954,8 @@ lookup_value_found(nlookup_t *nl, const knode_t *kn,
 	 * ball later on to keep only successfully queried nodes!
 	 */
 
-	patricia_insert(nl->ball, kn->id, knode_refcnt_inc(kn));
+	if (!lookup_in(nl, NL_BALL, kn->id))
+		lookup_insert(nl, NL_BALL, knode_refcnt_inc(kn));
 
 	/*
 	 * It is possible all the last "alpha" requests we sent out looking for
@@ -1768,7 +2044,7 @@ lookup_value_not_found(nlookup_t *nl)
 	lookup_check(nl);
 	g_assert(LOOKUP_VALUE == nl->type);
 
-	if (patricia_contains(nl->path, nl->kuid))
+	if (lookup_in(nl, NL_PATH, nl->kuid))
 		lookup_abort(nl, LOOKUP_E_NOT_FOUND);
 	else if (nl->rpc_replies < MIN(KDA_ALPHA, nl->initial_contactable))
 		lookup_abort(nl, LOOKUP_E_NO_REPLY);
@@ -1782,11 +2058,13 @@ lookup_value_not_found(nlookup_t *nl)
 static void
 lookup_completed(nlookup_t *nl)
 {
+	patricia_t *path;
+
 	lookup_check(nl);
 
 	if (GNET_PROPERTY(dht_lookup_debug) > 1) {
-		size_t path_len = patricia_count(nl->path);
-		knode_t *closest = patricia_closest(nl->path, nl->kuid);
+		size_t path_len = lookup_count(nl, NL_PATH);
+		knode_t *closest = lookup_closest(nl, NL_PATH);
 
 		g_debug("DHT LOOKUP[%s] %spath holds %lu item%s, closest is %s",
 			nid_to_string(&nl->lid),
@@ -1796,16 +2074,18 @@ lookup_completed(nlookup_t *nl)
 			closest ? knode_to_string(closest) : "unknown");
 
 		if (GNET_PROPERTY(dht_lookup_debug) > 2)
-			log_patricia_dump(nl, nl->path, "final path", 3);
+			log_set_dump(nl, NL_PATH, "final path", 3);
 	}
 
+	path = lookup_set_patricia(nl, NL_PATH);
+
 	/*
 	 * Do not update the size estimate if we had to actively protect the
 	 * path as it distorts our computations (leads to under-estimates).
 	 */
 
 	if (!(nl->flags & NL_F_ACTV_PROTECT))
-		dht_update_subspace_size_estimate(nl->path, nl->kuid, nl->amount);
+		dht_update_subspace_size_estimate(path, nl->kuid, nl->amount);
 
 	/*
 	 * We cache the found nodes so that subsequent lookups for a similar
@@ -1826,10 +2106,12 @@ lookup_completed(nlookup_t *nl)
 	case LOOKUP_STORE:
 	case LOOKUP_NODE:
 	case LOOKUP_VALUE:
-		roots_record(nl->path, nl->kuid);
+		roots_record(path, nl->kuid);
 		break;
 	}
 
+	patricia_destroy(path);
+
 	/*
 	 * All done -- value was not found if it was a value lookup, otherwise
 	 * we end through lookup_value_terminate().
@@ -1879,7 +2161,7 @@ lookup_expired(cqueue_t *cq, void *obj)
 	case LOOKUP_NODE:
 	case LOOKUP_STORE:
 	case LOOKUP_TOKEN:
-		if (0 == patricia_count(nl->path))
+		if (0 == lookup_count(nl, NL_PATH))
 			lookup_abort(nl, LOOKUP_E_EXPIRED);
 		else
 			lookup_terminate(nl);
@@ -1937,38 +2219,38 @@ lookup_shortlist_add(nlookup_t *nl, const knode_t *kn)
 {
 	lookup_check(nl);
 	knode_check(kn);
-	g_assert(!map_contains(nl->queried, kn->id));
-	g_assert(!map_contains(nl->pending, kn->id));
-	g_assert(!patricia_contains(nl->shortlist, kn->id));
-	g_assert(!patricia_contains(nl->ball, kn->id));
+	g_assert(!lookup_in(nl, NL_QUERIED, kn->id));
+	g_assert(!lookup_in(nl, NL_PENDING, kn->id));
+	g_assert(!lookup_in(nl, NL_SHORTLIST, kn->id));
+	g_assert(!lookup_in(nl, NL_BALL, kn->id));
 
-	patricia_insert(nl->shortlist, kn->id, knode_refcnt_inc(kn));
+	lookup_insert(nl, NL_SHORTLIST, knode_refcnt_inc(kn));
 
 	/*
 	 * The ball contains all the nodes in the shortlist plus all
 	 * the successfully queried nodes.
 	 */
 
-	patricia_insert(nl->ball, kn->id, knode_refcnt_inc(kn));
+	lookup_insert(nl, NL_BALL, knode_refcnt_inc(kn));
 }
 
 /**
  * Remove a node from the shortlist.
  */
 static void
-lookup_shortlist_remove(const nlookup_t *nl, knode_t *kn)
+lookup_shortlist_remove(nlookup_t *nl, knode_t *kn)
 {
 	lookup_check(nl);
 	knode_check(kn);
 
-	if (patricia_remove(nl->shortlist, kn->id))
+	if (lookup_remove(nl, NL_SHORTLIST, kn->id))
 		knode_refcnt_dec(kn);
 
 	/*
 	 * Any removal from the shortlist is replicated on the ball.
 	 */
 
-	if (patricia_remove(nl->ball, kn->id))
+	if (lookup_remove(nl, NL_BALL, kn->id))
 		knode_refcnt_dec(kn);
 }
 
@@ -1980,11 +2262,11 @@ lookup_path_add(nlookup_t *nl, const knode_t *kn)
 {
 	lookup_check(nl);
 	knode_check(kn);
-	g_assert(!patricia_contains(nl->path, kn->id));
-	g_assert(!patricia_contains(nl->ball, kn->id));
+	g_assert(!lookup_in(nl, NL_PATH, kn->id));
+	g_assert(!lookup_in(nl, NL_BALL, kn->id));
 
-	patricia_insert(nl->path, kn->id, knode_refcnt_inc(kn));
-	patricia_insert(nl->ball, kn->id, knode_refcnt_inc(kn));
+	lookup_insert(nl, NL_PATH, knode_refcnt_inc(kn));
+	lookup_insert(nl, NL_BALL, knode_refcnt_inc(kn));
 
 	lookup_c_class_update_count(nl, kn, +1);
 }
@@ -1999,7 +2281,7 @@ lookup_reset_closest(nlookup_t *nl, const knode_t *kn)
 	knode_check(kn);
 
 	if (nl->closest == kn) {
-		nl->closest = patricia_closest(nl->ball, nl->kuid);
+		nl->closest = lookup_closest(nl, NL_BALL);
 
 		if (GNET_PROPERTY(dht_lookup_debug)) {
 			g_debug("DHT LOOKUP[%s] removing closest node, new closest is %s",
@@ -2009,7 +2291,7 @@ lookup_reset_closest(nlookup_t *nl, const knode_t *kn)
 	}
 
 	if (nl->prev_closest == kn)
-		nl->prev_closest = patricia_closest(nl->path, nl->kuid);
+		nl->prev_closest = lookup_closest(nl, NL_PATH);
 }
 
 /**
@@ -2027,7 +2309,7 @@ lookup_path_remove(nlookup_t *nl, knode_t *kn)
 			(unsigned) kuid_common_prefix(nl->kuid, kn->id));
 	}
 
-	if (patricia_remove(nl->path, kn->id)) {
+	if (lookup_remove(nl, NL_PATH, kn->id)) {
 		lookup_c_class_update_count(nl, kn, -1);
 		knode_refcnt_dec(kn);
 	}
@@ -2036,7 +2318,7 @@ lookup_path_remove(nlookup_t *nl, knode_t *kn)
 	 * Any removal from the path is replicated on the ball.
 	 */
 
-	if (patricia_remove(nl->ball, kn->id))
+	if (lookup_remove(nl, NL_BALL, kn->id))
 		knode_refcnt_dec(kn);
 
 	lookup_reset_closest(nl, kn);
@@ -2072,20 +2354,19 @@ static size_t
 lookup_path_count_prefixes(const nlookup_t *nl,
 	int bmin, size_t prefix[KDA_C + 1])
 {
-	patricia_iter_t *iter;
+	const struct nl_contact *c;
 	size_t nodes;
-	size_t i;
+	size_t i, idx = 0;
 	int bmax = bmin + KDA_C;
 
 	lookup_check(nl);
 
-	iter = patricia_metric_iterator_lazy(nl->path, nl->kuid, TRUE);
 	nodes = 0;
 	memset(prefix, 0, sizeof prefix[0] * (KDA_C + 1));
 	i = 0;
 
-	while (i++ < KDA_K && patricia_iter_has_next(iter)) {
-		knode_t *kn = patricia_iter_next_value(iter);
+	while (i++ < KDA_K && NULL != (c = lookup_next(nl, NL_PATH, &idx))) {
+		knode_t *kn = c->kn;
 		size_t common;
 
 		knode_check(kn);
@@ -2099,8 +2380,6 @@ lookup_path_count_prefixes(const nlookup_t *nl,
 		}
 	}
 
-	patricia_iterator_release(&iter);
-
 	return nodes;
 }
 
@@ -2190,7 +2469,8 @@ kullback_leibler_div(const nlookup_t *nl, size_t nodes, int bmin,
 static bool
 lookup_path_is_safe(nlookup_t *nl)
 {
-	patricia_iter_t *iter;
+	const struct nl_contact *c;
+	size_t idx = 0;
 	size_t prefix[KDA_C + 1];
 	struct kl_item items[KDA_C + 1];
 	plist_t *nodelist[KDA_C + 1];
@@ -2300,7 +2580,7 @@ compute:
 	if (GNET_PROPERTY(dht_lookup_debug) > 1) {
 		g_debug("DHT LOOKUP[%s] with %u/%u node%s, K-L divergence to %s = %g",
 			nid_to_string(&nl->lid), (unsigned) nodes,
-			(unsigned) patricia_count(nl->path),
+			(unsigned) lookup_count(nl, NL_PATH),
 			plural(nodes), kuid_to_hex_string(nl->kuid), dkl);
 	}
 
@@ -2387,12 +2667,11 @@ compute:
 	 * one list of nodes per prefix size.
 	 */
 
-	iter = patricia_metric_iterator_lazy(nl->path, nl->kuid, TRUE);
 	ZERO(&nodelist);
 	i = 0;
 
-	while (i++ < KDA_K && patricia_iter_has_next(iter)) {
-		knode_t *kn = patricia_iter_next_value(iter);
+	while (i++ < KDA_K && NULL != (c = lookup_next(nl, NL_PATH, &idx))) {
+		knode_t *kn = c->kn;
 		size_t common;
 
 		knode_check(kn);
@@ -2408,8 +2687,6 @@ compute:
 		}
 	}
 
-	patricia_iterator_release(&iter);
-
 	/*
 	 * Now determine which prefix size contributes the most to the
 	 * divergence between the measured and theoretical distributions.
@@ -2483,7 +2760,7 @@ strip_one_node:			/* do {} while () in disguise, avoids indentation */
 	if (GNET_PROPERTY(dht_lookup_debug) > 1) {
 		g_debug("DHT LOOKUP[%s] with %u/%u node%s, K-L divergence down to %g",
 			nid_to_string(&nl->lid), (unsigned) nodes,
-			(unsigned) patricia_count(nl->path), plural(nodes), dkl);
+			(unsigned) lookup_count(nl, NL_PATH), plural(nodes), dkl);
 	}
 
 	/*
@@ -2529,8 +2806,8 @@ done:
 		g_debug("DHT LOOKUP[%s] after counter-measures: path holds %u node%s, "
 			"K-L divergence is %g (%u node%s in window, stripped %u)",
 			nid_to_string(&nl->lid),
-			(unsigned) patricia_count(nl->path),
-			plural(patricia_count(nl->path)), dkl,
+			(unsigned) lookup_count(nl, NL_PATH),
+			plural(lookup_count(nl, NL_PATH)), dkl,
 			(unsigned) nodes, plural(nodes), (unsigned) stripped);
 	}
 
@@ -2548,7 +2825,8 @@ done:
 static bool
 lookup_closest_ok(nlookup_t *nl)
 {
-	patricia_iter_t *iter;
+	const struct nl_contact *c;
+	size_t idx = 0;
 	int i = 0;
 	bool enough = TRUE;
 	knode_t *kn = NULL;
@@ -2560,7 +2838,7 @@ lookup_closest_ok(nlookup_t *nl)
 	 * we can't have the k-closest nodes already.
 	 */
 
-	if (patricia_count(nl->path) < UNSIGNED(nl->amount))
+	if (lookup_count(nl, NL_PATH) < UNSIGNED(nl->amount))
 		return FALSE;
 
 	/*
@@ -2570,21 +2848,17 @@ lookup_closest_ok(nlookup_t *nl)
 	 * we have the k closest nodes in the ball within our lookup path.
 	 */
 
-	iter = patricia_metric_iterator_lazy(nl->ball, nl->kuid, TRUE);
-
-	while (i++ < nl->amount && patricia_iter_has_next(iter)) {
-		kn = patricia_iter_next_value(iter);
+	while (i++ < nl->amount && NULL != (c = lookup_next(nl, NL_BALL, &idx))) {
+		kn = c->kn;
 
 		knode_check(kn);
 
-		if (!patricia_contains(nl->path, kn->id)) {
+		if (!(c->sets & NL_SET(NL_PATH))) {
 			enough = FALSE;
 			break;
 		}
 	}
 
-	patricia_iterator_release(&iter);
-
 	if (!enough && GNET_PROPERTY(dht_lookup_debug) > 2) {
 		g_debug("DHT LOOKUP[%s] still need to query %s",
 			nid_to_string(&nl->lid), knode_to_string(kn));
@@ -2630,7 +2904,7 @@ log_status(nlookup_t *nl)
 	} else {
 		g_debug("DHT LOOKUP[%s] current %s closest node: %s",
 			nid_to_string(&nl->lid),
-			map_contains(nl->queried, nl->closest->id) ?
+			lookup_in(nl, NL_QUERIED, nl->closest->id) ?
 				"queried" : "unqueried",
 			knode_to_string(nl->closest));
 	}
@@ -2693,9 +2967,9 @@ lookup_fix_contact(nlookup_t *nl, const knode_t *kn, const knode_t *an)
 	g_assert(kuid_eq(kn->id, an->id));
 	g_assert(an != kn);
 	g_assert(KNODE_UNKNOWN == kn->status);	/* Not in routing table */
-	g_assert(!patricia_contains(nl->shortlist, kn->id));
+	g_assert(!lookup_in(nl, NL_SHORTLIST, kn->id));
 
-	if (map_contains(nl->fixed, kn->id)) {
+	if (lookup_in(nl, NL_FIXED, kn->id)) {
 		if (GNET_PROPERTY(dht_lookup_debug)) {
 			g_warning("DHT LOOKUP[%s] already fixed %s, not fixing again to %s",
 				nid_to_string(&nl->lid), knode_to_string(kn),
@@ -2714,30 +2988,16 @@ lookup_fix_contact(nlookup_t *nl, const knode_t *kn, const knode_t *an)
 
 	xn->port = an->port;
 	xn->addr = an->addr;
+	knode_contact_invalidate(xn);
 
-	removed = map_remove(nl->queried, kn->id);
+	removed = lookup_remove(nl, NL_QUERIED, kn->id);
 	g_assert(removed);
 
-	map_insert(nl->fixed, kn->id, knode_refcnt_inc(kn));
+	lookup_insert(nl, NL_FIXED, kn);
 	lookup_shortlist_add(nl, kn);
 	knode_refcnt_dec(kn);			/* Removal from nl->queried */
 }
 
-/**
- * Iterator callback to remove nodes from the shortlist if their token is known.
- */
-static bool
-remove_from_shortlist(void *key, size_t keybits, void *value, void *u)
-{
-	map_t *tokens = u;
-	kuid_t *id = key;
-
-	(void) keybits;
-	(void) value;
-
-	return map_contains(tokens, id);
-}
-
 /**
  * Perform passive checks to fight against Sybil attacks.
  *
@@ -2810,9 +3070,9 @@ unsafe:
 	 * Do not count unsafe nodes more than once per lookup.
 	 */
 
-	if (!map_contains(nl->unsafe, kn->id)) {
+	if (!lookup_in(nl, NL_UNSAFE, kn->id)) {
 		gnet_stats_inc_general(gnr_stat);
-		map_insert(nl->unsafe, kn->id, knode_refcnt_inc(kn));
+		lookup_insert(nl, NL_UNSAFE, kn);
 	}
 
 	if (!(nl->flags & NL_F_PASV_PROTECT)) {
@@ -2827,10 +3087,10 @@ unsafe:
  * Record security token for node.
  */
 static void
-lookup_add_token(const nlookup_t *nl,
+lookup_add_token(nlookup_t *nl,
 	const knode_t *kn, const lookup_token_t *ltok)
 {
-	lookup_token_t *old_token;
+	struct nl_contact *c;
 
 	lookup_check(nl);
 	knode_check(kn);
@@ -2844,14 +3104,12 @@ lookup_add_token(const nlookup_t *nl,
 	 * to start querying cached nodes, coming with a known token already.
 	 */
 
-	old_token = map_lookup(nl->tokens, kn->id);
+	c = lookup_contact_get(nl, kn->id);
 
-	if (old_token != NULL) {
-		map_remove(nl->tokens, kn->id);
-		lookup_token_free(old_token, TRUE);
-	}
+	if (c->token != NULL)
+		lookup_token_free(c->token, TRUE);
 
-	map_insert(nl->tokens, kn->id, ltok);
+	c->token = deconstify_pointer(ltok);
 }
 
 /**
@@ -2866,23 +3124,29 @@ lookup_add_token(const nlookup_t *nl,
 static void
 lookup_load_path(nlookup_t *nl)
 {
-	patricia_iter_t *iter;
+	struct nl_contact *c;
+	size_t i = 0;
 	char reason[80];
 	size_t reason_len;
 
 	lookup_check(nl);
 	g_assert(LOOKUP_STORE == nl->type);
 
-	iter = patricia_metric_iterator_lazy(nl->shortlist, nl->kuid, TRUE);
 	reason_len = GNET_PROPERTY(dht_lookup_debug) ? sizeof reason : 0;
 
-	while (patricia_iter_has_next(iter)) {
+	/*
+	 * Contacts already exist for all the nodes in the shortlist, hence
+	 * recording the token below does not reshape the contact vector and
+	 * we can keep iterating whilst moving nodes from the shortlist.
+	 */
+
+	while (NULL != (c = lookup_next(nl, NL_SHORTLIST, &i))) {
 		knode_t *kn;
 		uint8 toklen;
 		const void *token;
 		time_t last_update;
 
-		kn = patricia_iter_next_value(iter);
+		kn = c->kn;
 
 		/*
 		 * See whether we have a valid unexpired security token in cache.
@@ -2906,17 +3170,18 @@ lookup_load_path(nlookup_t *nl)
 				}
 
 				/*
-				 * Since we're going to remove the node from the shortlist,
-				 * there's no need to alter the reference count when adding
-				 * to the path.
+				 * Since we're removing the node from the shortlist, there's
+				 * no need to alter the reference count when adding to the path.
 				 *
 				 * We don't use lookup_path_add() here because nodes were
-				 * in the shortlist and therefore are already in the ball.
+				 * in the shortlist and therefore are already in the ball,
+				 * which we are not touching.
 				 */
 
 				lookup_add_token(nl, kn, ltok);
-				patricia_insert(nl->path, kn->id, kn);
-				map_insert(nl->queried, kn->id, knode_refcnt_inc(kn));
+				lookup_insert(nl, NL_PATH, kn);
+				lookup_remove(nl, NL_SHORTLIST, kn->id);
+				lookup_insert(nl, NL_QUERIED, knode_refcnt_inc(kn));
 				lookup_c_class_update_count(nl, kn, +1);
 			} else if (GNET_PROPERTY(dht_lookup_debug)) {
 				g_debug("DHT LOOKUP[%s] not loading %s in path: %s",
@@ -2925,21 +3190,8 @@ lookup_load_path(nlookup_t *nl)
 		}
 	}
 
-	patricia_iterator_release(&iter);
-
-	/*
-	 * Now that we finished iterating over the shortlist, remove the nodes
-	 * for which we are reusing a cached token.
-	 *
-	 * We're not touching the "ball" since it contains nodes that are either
-	 * in the shortlist or in the path, and we're just moving nodes from the
-	 * shortlist to the path.
-	 */
-
-	patricia_foreach_remove(nl->shortlist, remove_from_shortlist, nl->tokens);
-
 	if (GNET_PROPERTY(dht_lookup_debug) > 2)
-		log_patricia_dump(nl, nl->path, "pre-loaded path", 3);
+		log_set_dump(nl, NL_PATH, "pre-loaded path", 3);
 }
 
 /**
@@ -3099,7 +3351,7 @@ lookup_handle_reply(
 			goto skip;
 		}
 
-		xn = map_lookup(nl->queried, cn->id);
+		xn = lookup_get(nl, NL_QUERIED, cn->id);
 		if (xn != NULL) {
 			/*
 			 * If node is not in our path, check whether the contact
@@ -3112,7 +3364,7 @@ lookup_handle_reply(
 			 * periodically checks the nodes, and we can't change the
 			 * address of a node there from here due to network accounting.
 			 *
-			 * After fixing, node is inserted in the nl->fixed map so that
+			 * After fixing, node is inserted in the fixed set so that
 			 * we do not attempt endless fixes if all our queries report
 			 * different IP:port for the KUID.
 			 */
@@ -3123,9 +3375,9 @@ lookup_handle_reply(
 				KNODE_UNKNOWN == xn->status &&	/* Not in routing table */
 				(xn->port != cn->port ||
 					!host_addr_equiv(xn->addr, cn->addr)) &&
-				!patricia_contains(nl->path, cn->id) &&
-				!map_contains(nl->fixed, cn->id) &&
-				!map_contains(nl->alternate, cn->id) &&
+				!lookup_in(nl, NL_PATH, cn->id) &&
+				!lookup_in(nl, NL_FIXED, cn->id) &&
+				NULL == lookup_alternate(nl, cn->id) &&
 				!kuid_eq(cn->id, kn->id)	/* Not the replying node itself */
 			) {
 				if (GNET_PROPERTY(dht_lookup_debug) > 1) {
@@ -3133,11 +3385,11 @@ lookup_handle_reply(
 						"queried as %s, now mentionned at %s%s",
 						nid_to_string(&nl->lid), n, knode_to_string(xn),
 						host_addr_port_to_string(cn->addr, cn->port),
-						map_contains(nl->pending, cn->id) ?
+						lookup_in(nl, NL_PENDING, cn->id) ?
 							" (RPC pending)" : "");
 				}
 
-				g_assert(!patricia_contains(nl->shortlist, xn->id));
+				g_assert(!lookup_in(nl, NL_SHORTLIST, xn->id));
 
 				/*
 				 * If the RPC to the node is still pending, we do not know
@@ -3146,11 +3398,12 @@ lookup_handle_reply(
 				 * for the actual reply.
 				 *
 				 * We register the possibly new contact information in the
-				 * nl->alternate map, to be tried should a timeout occur...
+				 * alternate slot of the contact, to be tried should a
+				 * timeout occur...
 				 */
 
-				if (map_contains(nl->pending, cn->id)) {
-					map_insert(nl->alternate, cn->id, knode_refcnt_inc(cn));
+				if (lookup_in(nl, NL_PENDING, cn->id)) {
+					lookup_alternate_add(nl, cn);
 
 					if (GNET_PROPERTY(dht_lookup_debug)) {
 						str_bprintf(ARYLEN(msg),
@@ -3176,7 +3429,7 @@ lookup_handle_reply(
 			goto skip;
 		}
 
-		xn = patricia_lookup(nl->shortlist, cn->id);
+		xn = lookup_get(nl, NL_SHORTLIST, cn->id);
 		if (xn != NULL) {
 			/*
 			 * Same IP:port mismatch detection logic as above, here for nodes
@@ -3184,12 +3437,12 @@ lookup_handle_reply(
 			 */
 
 			knode_check(xn);
-			if (!patricia_contains(nl->ball, cn->id)) {
+			if (!lookup_in(nl, NL_BALL, cn->id)) {
 				g_critical("%s(): node %s in shortlist but not in ball: %s",
 					G_STRFUNC, kuid_to_hex_string(cn->id),
 					knode_to_string(xn));
-				log_patricia_dump(nl, nl->shortlist, "shortlist", 0);
-				log_patricia_dump(nl, nl->ball, "ball", 0);
+				log_set_dump(nl, NL_SHORTLIST, "shortlist", 0);
+				log_set_dump(nl, NL_BALL, "ball", 0);
 				g_error("%s(): inconsistency between shortlist and ball for %s",
 					G_STRFUNC, knode_to_string(xn));
 			}
@@ -3200,8 +3453,8 @@ lookup_handle_reply(
 				KNODE_UNKNOWN == xn->status &&	/* Not in routing table */
 				(xn->port != cn->port ||
 					!host_addr_equiv(xn->addr, cn->addr)) &&
-				!map_contains(nl->fixed, cn->id) &&
-				!map_contains(nl->alternate, cn->id)
+				!lookup_in(nl, NL_FIXED, cn->id) &&
+				NULL == lookup_alternate(nl, cn->id)
 			) {
 				if (GNET_PROPERTY(dht_lookup_debug) > 1) {
 					g_debug("DHT LOOKUP[%s] contact #%d "
@@ -3210,7 +3463,7 @@ lookup_handle_reply(
 						host_addr_port_to_string(cn->addr, cn->port));
 				}
 
-				g_assert(!patricia_contains(nl->path, xn->id));
+				g_assert(!lookup_in(nl, NL_PATH, xn->id));
 
 				/*
 				 * Record the alternate contact address, since we don't
@@ -3219,7 +3472,7 @@ lookup_handle_reply(
 				 * contact the host, we'll try the alternate address.
 				 */
 
-				map_insert(nl->alternate, cn->id, knode_refcnt_inc(cn));
+				lookup_alternate_add(nl, cn);
 
 				if (GNET_PROPERTY(dht_lookup_debug)) {
 					str_bprintf(ARYLEN(msg),
@@ -3243,7 +3496,7 @@ lookup_handle_reply(
 		if (GNET_PROPERTY(dht_lookup_debug) > 2)
 			g_debug("DHT LOOKUP[%s] adding %scontact #%d to shortlist: %s%s",
 				nid_to_string(&nl->lid),
-				map_contains(nl->fixed, cn->id) ? "(fixed) " : "",
+				lookup_in(nl, NL_FIXED, cn->id) ? "(fixed) " : "",
 				n, knode_to_string(cn),
 				kuid_cmp3(nl->kuid, kn->id, cn->id) > 0 ? " (CLOSER)" : "");
 
@@ -3255,7 +3508,7 @@ lookup_handle_reply(
 		if (GNET_PROPERTY(dht_lookup_debug) > (unsafe[0] ? 1 : 4))
 			g_debug("DHT LOOKUP[%s] ignoring %scontact #%d: %s",
 				nid_to_string(&nl->lid),
-				map_contains(nl->fixed, cn->id) ? "(fixed) " : "",
+				lookup_in(nl, NL_FIXED, cn->id) ? "(fixed) " : "",
 				n, msg);
 
 		knode_free(cn);
@@ -3285,7 +3538,7 @@ lookup_handle_reply(
 	 * these nodes.
 	 */
 
-	if (LOOKUP_STORE == nl->type && 0 == patricia_count(nl->path)) {
+	if (LOOKUP_STORE == nl->type && 0 == lookup_count(nl, NL_PATH)) {
 		if (GNET_PROPERTY(dht_lookup_debug) > 1) {
 			g_debug("DHT LOOKUP[%s] got first RPC reply, loading STORE path",
 				nid_to_string(&nl->lid));
@@ -3502,9 +3755,9 @@ lk_msg_dropped(void *obj, knode_t *kn, pmsg_t *unused_mb)
 	nl->msg_dropped++;
 	nl->udp_drops++;
 
-	if (map_remove(nl->queried, kn->id))
+	if (lookup_remove(nl, NL_QUERIED, kn->id))
 		knode_refcnt_dec(kn);
-	if (map_remove(nl->pending, kn->id))
+	if (lookup_remove(nl, NL_PENDING, kn->id))
 		knode_refcnt_dec(kn);
 
 	if (!(nl->flags & NL_F_SENDING)) {
@@ -3579,9 +3832,9 @@ lk_handling_rpc(void *obj, enum dht_rpc_ret type,
 	}
 	nl->rpc_pending--;
 
-	removed = map_remove(nl->pending, kn->id);
+	removed = lookup_remove(nl, NL_PENDING, kn->id);
 	g_assert(removed);
-	knode_refcnt_dec(kn);		/* Was referenced in nl->pending */
+	knode_refcnt_dec(kn);		/* Was referenced in pending set */
 
 	/*
 	 * If we have a timeout and an alternate address known, try it:
@@ -3594,11 +3847,10 @@ lk_handling_rpc(void *obj, enum dht_rpc_ret type,
 
 		nl->rpc_timeouts++;
 
-		an = map_lookup(nl->alternate, kn->id);
+		an = lookup_alternate(nl, kn->id);
 		if (an != NULL) {
+			lookup_contact_find(nl, kn->id, NULL)->alternate = NULL;
 			lookup_fix_contact(nl, kn, an);
-			removed = map_remove(nl->alternate, kn->id);
-			g_assert(removed);
 			knode_free(an);
 		}
 	}
@@ -3675,13 +3927,13 @@ lk_handle_reply(void *obj, const knode_t *kn,
 
 	if (
 		LOOKUP_LOOSE == nl->mode &&
-		patricia_count(nl->path) + nl->rpc_pending > UNSIGNED(nl->amount)
+		lookup_count(nl, NL_PATH) + nl->rpc_pending > UNSIGNED(nl->amount)
 	) {
 		if (GNET_PROPERTY(dht_lookup_debug) > 1) {
 			g_debug("DHT LOOKUP[%s] switching from loose to "
 				"bounded parallelism (path has %u items, %d RPC%s pending)",
 				nid_to_string(&nl->lid),
-				(unsigned) patricia_count(nl->path),
+				(unsigned) lookup_count(nl, NL_PATH),
 				nl->rpc_pending, plural(nl->rpc_pending));
 		}
 		nl->mode = LOOKUP_BOUNDED;
@@ -3723,8 +3975,8 @@ lk_handle_reply(void *obj, const knode_t *kn,
 	 * contacted).
 	 */
 
-	if (patricia_count(nl->shortlist)) {
-		knode_t *closest = patricia_closest(nl->shortlist, nl->kuid);
+	if (lookup_count(nl, NL_SHORTLIST)) {
+		knode_t *closest = lookup_closest(nl, NL_SHORTLIST);
 
 		g_assert_log(knode_is_shared(closest, TRUE),
 			"%s(): node = {%s}", G_STRFUNC, knode_to_string(closest));
@@ -3893,8 +4145,8 @@ lookup_send(nlookup_t *nl, knode_t *kn)
 	nl->rpc_pending++;
 	nl->rpc_latest_pending++;
 
-	map_insert(nl->queried, kn->id, knode_refcnt_inc(kn));
-	map_insert(nl->pending, kn->id, knode_refcnt_inc(kn));
+	lookup_insert(nl, NL_QUERIED, knode_refcnt_inc(kn));
+	lookup_insert(nl, NL_PENDING, knode_refcnt_inc(kn));
 
 	switch (nl->type) {
 	case LOOKUP_NODE:
@@ -3922,8 +4174,8 @@ lookup_requery(nlookup_t *nl, const knode_t *kn)
 	knode_check(kn);
 	g_assert(LOOKUP_VALUE == nl->type);
 	g_assert(!lookup_is_fetching(nl));
-	g_assert(map_contains(nl->queried, kn->id));
-	g_assert(!map_contains(nl->pending, kn->id));
+	g_assert(lookup_in(nl, NL_QUERIED, kn->id));
+	g_assert(!lookup_in(nl, NL_PENDING, kn->id));
 
 	if (GNET_PROPERTY(dht_lookup_debug) > 2) {
 		g_debug("DHT LOOKUP[%s] hop %u, re-querying %s",
@@ -3934,7 +4186,7 @@ lookup_requery(nlookup_t *nl, const knode_t *kn)
 	nl->rpc_pending++;
 	nl->rpc_latest_pending++;
 
-	map_insert(nl->pending, kn->id, knode_refcnt_inc(kn));
+	lookup_insert(nl, NL_PENDING, knode_refcnt_inc(kn));
 	revent_find_node(deconstify_pointer(kn),
 		nl->kuid, nl->lid, &lookup_ops, nl->hops);
 }
@@ -3999,7 +4251,8 @@ lookup_async_iterate(nlookup_t *nl)
 static void
 lookup_iterate(nlookup_t *nl)
 {
-	patricia_iter_t *iter;
+	const struct nl_contact *c;
+	size_t idx = 0;
 	pslist_t *to_remove = NULL;
 	pslist_t *ignored = NULL;
 	pslist_t *sl;
@@ -4059,9 +4312,9 @@ lookup_iterate(nlookup_t *nl)
 		log_status(nl);
 
 	if (GNET_PROPERTY(dht_lookup_debug) > 5) {
-		log_patricia_dump(nl, nl->shortlist, "shortlist", 19);
-		log_patricia_dump(nl, nl->path, "path", 19);
-		log_patricia_dump(nl, nl->ball, "ball", 19);
+		log_set_dump(nl, NL_SHORTLIST, "shortlist", 19);
+		log_set_dump(nl, NL_PATH, "path", 19);
+		log_set_dump(nl, NL_BALL, "ball", 19);
 	}
 
 	/*
@@ -4070,13 +4323,17 @@ lookup_iterate(nlookup_t *nl)
 	 */
 
 	reason_len = GNET_PROPERTY(dht_lookup_debug) ? sizeof reason : 0;
-	iter = patricia_metric_iterator_lazy(nl->shortlist, nl->kuid, TRUE);
 
 	nl->flags |= NL_F_SENDING;		/* Protect against synchronous UDP drops */
 	nl->flags &= ~NL_F_UDP_DROP;	/* Clear condition */
 
-	while (i < alpha && patricia_iter_has_next(iter)) {
-		knode_t *kn = patricia_iter_next_value(iter);
+	/*
+	 * Sending only flags existing contacts, so the contact vector is not
+	 * reshaped whilst we iterate over the shortlist.
+	 */
+
+	while (i < alpha && NULL != (c = lookup_next(nl, NL_SHORTLIST, &idx))) {
+		knode_t *kn = c->kn;
 
 		if (!knode_can_recontact(kn))
 			continue;
@@ -4091,7 +4348,7 @@ lookup_iterate(nlookup_t *nl)
 					nid_to_string(&nl->lid), knode_to_string(kn), reason);
 			}
 			ignored = pslist_prepend(ignored, knode_refcnt_inc(kn));
-		} else if (!map_contains(nl->queried, kn->id)) {
+		} else if (!lookup_in(nl, NL_QUERIED, kn->id)) {
 			lookup_send(nl, kn);
 			if (nl->flags & NL_F_UDP_DROP)
 				break;				/* Synchronous UDP drop detected */
@@ -4102,7 +4359,6 @@ lookup_iterate(nlookup_t *nl)
 	}
 
 	nl->flags &= ~NL_F_SENDING;
-	patricia_iterator_release(&iter);
 
 	/*
 	 * Remove the nodes to whom we sent a message, or which we want to ignore.
@@ -4175,6 +4431,7 @@ static bool
 lookup_load_shortlist(nlookup_t *nl)
 {
 	knode_t **kvec;
+	patricia_t *shortlist;
 	int kcnt;
 	int i;
 	int contactable = 0;
@@ -4204,7 +4461,9 @@ lookup_load_shortlist(nlookup_t *nl)
 	 * duplicates, we supply the current shortlist.
 	 */
 
-	kcnt = roots_fill_closest(nl->kuid, kvec, KDA_K, nl->shortlist);
+	shortlist = lookup_set_patricia(nl, NL_SHORTLIST);
+	kcnt = roots_fill_closest(nl->kuid, kvec, KDA_K, shortlist);
+	patricia_destroy(shortlist);
 
 	for (i = 0; i < kcnt; i++) {
 		knode_t *kn = kvec[i];
@@ -4214,13 +4473,13 @@ lookup_load_shortlist(nlookup_t *nl)
 		contactable++;			/* Assume we can: comes from the roots cache */
 	}
 
-	nl->closest = patricia_closest(nl->shortlist, nl->kuid);
+	nl->closest = lookup_closest(nl, NL_SHORTLIST);
 	nl->initial_contactable = contactable;
 
 	WFREE_ARRAY(kvec, KDA_K);
 
 	if (GNET_PROPERTY(dht_lookup_debug) > 3)
-		log_patricia_dump(nl, nl->shortlist, "initial shortlist", 4);
+		log_set_dump(nl, NL_SHORTLIST, "initial shortlist", 4);
 
 	if (0 == contactable && GNET_PROPERTY(dht_lookup_debug) > 1)
 		g_debug("DHT LOOKUP[%s] cancelling %s lookup for %s: "
@@ -4251,15 +4510,8 @@ lookup_create(const kuid_t *kuid, lookup_type_t type,
 	nl->type = type;
 	nl->lid = lookup_id_create();
 	nl->closest = NULL;
-	nl->shortlist = patricia_create(KUID_RAW_BITSIZE);
-	nl->queried = map_create_patricia(KUID_RAW_BITSIZE);
-	nl->unsafe = map_create_patricia(KUID_RAW_BITSIZE);
-	nl->pending = map_create_patricia(KUID_RAW_BITSIZE);
-	nl->alternate = map_create_patricia(KUID_RAW_BITSIZE);
-	nl->fixed = map_create_patricia(KUID_RAW_BITSIZE);
-	nl->tokens = map_create_patricia(KUID_RAW_BITSIZE);
-	nl->path = patricia_create(KUID_RAW_BITSIZE);
-	nl->ball = patricia_create(KUID_RAW_BITSIZE);
+	WALLOC_ARRAY(nl->contacts, NL_CONTACTS);
+	nl->csize = NL_CONTACTS;
 	nl->c_class = acct_net_create();
 	nl->err = error;
 	nl->arg = arg;
@@ -88,6 +88,7 @@
 #include "lib/bigint.h"
 #include "lib/bit_array.h"
 #include "lib/cq.h"
+#include "lib/endian.h"
 #include "lib/file.h"
 #include "lib/getdate.h"
 #include "lib/hashlist.h"
@@ -114,6 +115,8 @@
 #define K_BUCKET_STALE		KDA_K	/* Keep k possibly "stale" contacts */
 #define K_BUCKET_PENDING	KDA_K	/* Keep k pending contacts (replacement) */
 
+#define K_BUCKET_SLOTS	(K_BUCKET_GOOD + K_BUCKET_STALE + K_BUCKET_PENDING)
+
 #define K_BUCKET_MAX_DEPTH	(KUID_RAW_BITSIZE - 1)
 #define K_BUCKET_MAX_DEPTH_PASSIVE	4
 #define K_BUCKET_MIN_DEPTH_PASSIVE	2
@@ -170,6 +173,23 @@
 #define REFRESH_PERIOD			(60*60)		/* 1 hour */
 #define OUR_REFRESH_PERIOD		(15*60)		/* 15 minutes */
 
+/*
+ * Packed view of the nodes held in a leaf k-bucket.
+ *
+ * The hash lists keep nodes ordered by last activity, which is what the
+ * replacement policy needs, but finding the nodes closest to a KUID through
+ * them means dereferencing every node.  The slots hold the same nodes in
+ * parallel arrays, in no particular order, so that distances can be computed
+ * by scanning contiguous memory and only the selected nodes are touched.
+ */
+struct kbslots {
+	uint64 key[K_BUCKET_SLOTS];		/**< Leading 64 bits of KUID, host order */
+	kuid_t id[K_BUCKET_SLOTS];		/**< KUID of node in slot */
+	knode_t *node[K_BUCKET_SLOTS];	/**< Node in slot */
+	uint8 status[K_BUCKET_SLOTS];	/**< Status of node in slot */
+	uint count;						/**< Amount of slots used */
+};
+
 /*
  * K-bucket node information, accessed through the "kbucket" structure.
  */
@@ -183,6 +203,7 @@ struct kbnodes {
 	cevent_t *refresh;			/**< Periodic bucket refresh */
 	cevent_t *staleness;		/**< Periodic staleness checks */
 	time_t last_lookup;			/**< Last time node lookup was performed */
+	struct kbslots slots;		/**< Packed copy of "all", for lookups */
 };
 
 static acct_net_t *c_class;		/**< Counts class-C networks in whole table */
@@ -705,7 +726,105 @@ list_update_stats(knode_status_t status, int delta)
 	/* NOTREACHED */
 }
 
+/**
+ * Locate the slot holding node in the leaf k-bucket.
+ *
+ * @return slot index, -1 if the node is not held in the k-bucket.
+ */
+static int
+slot_index(const struct kbucket *kb, const knode_t *kn)
+{
+	const struct kbslots *ks = &kb->nodes->slots;
+	uint i;
+
+	for (i = 0; i < ks->count; i++) {
+		if (ks->node[i] == kn)
+			return i;
+	}
+
+	return -1;
+}
+
+/**
+ * Record node in the slots of the leaf k-bucket.
+ */
+static void
+slot_add(struct kbucket *kb, knode_t *kn)
+{
+	struct kbslots *ks = &kb->nodes->slots;
+	uint i = ks->count;
+
+	g_assert(i < K_BUCKET_SLOTS);
+	g_assert(kn->status != KNODE_UNKNOWN);
+
+	ks->key[i] = peek_be64(kn->id->v);
+	ks->id[i] = *kn->id;
+	ks->node[i] = kn;
+	ks->status[i] = kn->status;
+	ks->count++;
+}
+
+/**
+ * Remove node from the slots of the leaf k-bucket.
+ *
+ * The last slot is moved into the freed one to keep the arrays packed.
+ */
+static void
+slot_remove(struct kbucket *kb, const knode_t *kn)
+{
+	struct kbslots *ks = &kb->nodes->slots;
+	int i = slot_index(kb, kn);
+	uint last;
+
+	g_assert(i >= 0);
+
+	last = --ks->count;
+
+	if (UNSIGNED(i) != last) {
+		ks->key[i] = ks->key[last];
+		ks->id[i] = ks->id[last];
+		ks->node[i] = ks->node[last];
+		ks->status[i] = ks->status[last];
+	}
+}
+
+/**
+ * Propagate status change of node to the slots of the leaf k-bucket.
+ */
+static void
+slot_set_status(struct kbucket *kb, const knode_t *kn)
+{
+	int i = slot_index(kb, kn);
+
+	g_assert(i >= 0);
+
+	kb->nodes->slots.status[i] = kn->status;
+}
+
 #ifdef DHT_ROUTING_DEBUG
+/**
+ * Check that bucket slots mirror the nodes held in the bucket.
+ */
+static void
+check_leaf_slot_consistency(const struct kbucket *kb)
+{
+	const struct kbslots *ks = &kb->nodes->slots;
+	uint i;
+
+	for (i = 0; i < ks->count; i++) {
+		const knode_t *kn = ks->node[i];
+
+		knode_check(kn);
+		g_assert(kuid_eq(kn->id, &ks->id[i]));
+		g_assert(peek_be64(kn->id->v) == ks->key[i]);
+		g_assert(hikset_lookup(kb->nodes->all, kn->id) == kn);
+		g_assert_log(kn->status == ks->status[i],
+			"kn->status=%s, slot status=%s, kn={%s}",
+			knode_status_to_string(kn->status),
+			knode_status_to_string(ks->status[i]), knode_to_string(kn));
+	}
+}
+
 /**
  * Check bucket list consistency.
  */
@@ -737,6 +856,7 @@ check_leaf_list_consistency(
 	plist_free(nodes);
 }
 #else
+#define check_leaf_slot_consistency(a)
 #define check_leaf_list_consistency(a, b, c)
 #endif	/* DHT_ROUTING_DEBUG */
 
@@ -842,6 +962,7 @@ allocate_node_lists(struct kbucket *kb)
 	kb->nodes->last_lookup = 0;
 	kb->nodes->aliveness = NULL;
 	kb->nodes->refresh = NULL;
+	kb->nodes->slots.count = 0;
 }
 
 /**
@@ -1817,7 +1938,9 @@ check_leaf_bucket_consistency(const struct kbucket *kb)
 	pending = hash_list_length(kb->nodes->pending);
 
 	g_assert(good + stale + pending == total);
+	g_assert(kb->nodes->slots.count == total);
 
+	check_leaf_slot_consistency(kb);
 	check_leaf_list_consistency(kb, kb->nodes->good, KNODE_GOOD);
 	check_leaf_list_consistency(kb, kb->nodes->stale, KNODE_STALE);
 	check_leaf_list_consistency(kb, kb->nodes->pending, KNODE_PENDING);
@@ -1893,6 +2016,7 @@ split_among(void *value, void *user_data)
 
 	hash_list_append(hl, knode_refcnt_inc(kn));
 	hikset_insert_key(target->nodes->all, &kn->id);
+	slot_add(target, kn);
 	c_class_update_count(kn, target, +1);
 
 	/*
@@ -2083,6 +2207,7 @@ add_node_internal(struct kbucket *kb,
 
 	hash_list_append(hl, knode_refcnt_inc(kn));
 	hikset_insert_key(kb->nodes->all, &kn->id);
+	slot_add(kb, kn);
 	c_class_update_count(kn, kb, +1);
 
 	if (GNET_PROPERTY(dht_debug) > 2)
@@ -2302,6 +2427,7 @@ promote_pending_node(struct kbucket *kb)
 		 */
 
 		selected->status = KNODE_GOOD;
+		slot_set_status(kb, selected);
 		hash_list_insert_sorted(kb->nodes->good, selected, knode_seen_cmp);
 		list_update_stats(KNODE_GOOD, +1);
 
@@ -2405,6 +2531,7 @@ dht_remove_node_from_bucket(knode_t *kn, struct kbucket *kb)
 
 	if (hash_list_remove(hl, tkn)) {
 		hikset_remove(kb->nodes->all, tkn->id);
+		slot_remove(kb, tkn);
 		c_class_update_count(tkn, kb, -1);
 
 		if (GNET_PROPERTY(dht_debug) > 2)
@@ -2549,6 +2676,7 @@ dht_set_node_status(knode_t *kn, knode_status_t new)
 	list_update_stats(old, -1);
 
 	tkn->status = new;
+	slot_set_status(kb, tkn);
 	hl = list_for(kb, new);
 	maxsize = list_maxsize_for(new);
 
@@ -2577,6 +2705,7 @@ dht_set_node_status(knode_t *kn, knode_status_t new)
 			g_assert(new != KNODE_PENDING);
 
 			removed->status = KNODE_PENDING;
+			slot_set_status(kb, removed);
 			hash_list_append(kb->nodes->pending, removed);
 			list_update_stats(new, -1);
 			list_update_stats(KNODE_PENDING, +1);
@@ -2589,6 +2718,7 @@ dht_set_node_status(knode_t *kn, knode_status_t new)
 					kbucket_to_string(kb));
 		} else {
 			hikset_remove(kb->nodes->all, removed->id);
+			slot_remove(kb, removed);
 			c_class_update_count(removed, kb, -1);
 
 			if (GNET_PROPERTY(dht_debug))
@@ -4413,16 +4543,50 @@ dht_size(void)
 }
 
 /**
- * GList sort callback.
+ * Candidate node selected by fill_closest_in_bucket().
+ */
+struct slot_dist {
+	uint64 d;			/**< Leading 64 bits of XOR distance to target */
+	uint idx;			/**< Slot index in the bucket */
+};
+
+/**
+ * Is candidate `a' closer to the target `id' than candidate `b'?
+ *
+ * The leading 64 bits of the distance are nearly always enough to decide,
+ * the full KUIDs being compared only when they are equal.
+ */
+static inline bool
+slot_closer(const struct kbslots *ks, const kuid_t *id,
+	const struct slot_dist *a, const struct slot_dist *b)
+{
+	if G_LIKELY(a->d != b->d)
+		return a->d < b->d;
+
+	return kuid_cmp3(id, &ks->id[a->idx], &ks->id[b->idx]) < 0;
+}
+
+/**
+ * Insert candidate in the selection vector, kept sorted by increasing
+ * distance to the target and holding at most `max' entries.
+ *
+ * @return the new amount of entries in the selection vector.
  */
 static int
-distance_to(const void *a, const void *b, void *user_data)
+slot_select(const struct kbslots *ks, const kuid_t *id,
+	struct slot_dist *sel, int n, int max, const struct slot_dist *c)
 {
-	const knode_t *ka = a;
-	const knode_t *kb = b;
-	const kuid_t *id = user_data;
+	int j;
+
+	if (n == max)
+		n--;			/* Caller checked candidate is closer than last */
+
+	for (j = n; j > 0 && slot_closer(ks, id, c, &sel[j - 1]); j--)
+		sel[j] = sel[j - 1];
+
+	sel[j] = *c;
 
-	return kuid_cmp3(id, ka->id, kb->id);
+	return n + 1;
 }
 
 /**
@@ -4444,41 +4608,32 @@ fill_closest_in_bucket(
 	const kuid_t *id, struct kbucket *kb,
 	knode_t **kvec, int kcnt, const kuid_t *exclude, bool alive)
 {
-	plist_t *nodes = NULL, *good, *l;
-	int added;
+	const struct kbslots *ks;
+	struct slot_dist sel[K_BUCKET_SLOTS];
+	uint64 target;
+	int n = 0, max, i;
 	int available = 0;
 
 	g_assert(id);
 	g_assert(is_leaf(kb));
 	g_assert(kvec);
 
-	/*
-	 * If we can determine that we do not have enough good nodes in the bucket
-	 * to fill the vector, consider "stale" nodes and then "pending" nodes
-	 * (excluding shutdowning ones), provided we got traffic from them
-	 * recently (defined by the aliveness period).
-	 */
-
-	good = hash_list_list(kb->nodes->good);
-
-	while (good != NULL) {
-		knode_t *kn = good->data;
-
-		knode_check(kn);
-		g_assert(KNODE_GOOD == kn->status);
-
-		if (
-			(!exclude || !kuid_eq(kn->id, exclude)) &&
-			(!alive || (kn->flags & KNODE_F_ALIVE))
-		) {
-			nodes = plist_prepend(nodes, kn);
-			available++;
-		}
+	if G_UNLIKELY(kcnt <= 0)
+		return 0;
 
-		good = plist_remove(good, kn);
-	}
+	ks = &kb->nodes->slots;
+	max = MIN(kcnt, K_BUCKET_SLOTS);
+	target = peek_be64(id->v);
 
 	/*
+	 * The distances are computed from the packed KUID keys, and a node is
+	 * only looked at when it would enter the selection: once the vector is
+	 * full, farther candidates are discarded without touching the node.
+	 *
+	 * When the vector is full, we also know we have at least `kcnt' good
+	 * or stale nodes available, hence no pending node will be considered
+	 * and we do not need to count the discarded candidates.
+	 *
 	 * Only stale nodes that are still somewhat likely to be alive are
 	 * included in the set, provided we're not limited to only
 	 * known-to-be-alive nodes (which by definition stale nodes might not be).
@@ -4489,44 +4644,71 @@ fill_closest_in_bucket(
 	 * without having to ping them explicitly.
 	 */
 
-	if (!alive) {
-		plist_t *stale = hash_list_list(kb->nodes->stale);
+	for (i = 0; UNSIGNED(i) < ks->count; i++) {
+		const knode_t *kn;
+		struct slot_dist c;
 
-		while (stale != NULL) {
-			knode_t *kn = stale->data;
+		if (KNODE_PENDING == ks->status[i])
+			continue;
 
-			knode_check(kn);
-			g_assert(KNODE_STALE == kn->status);
+		if (alive && KNODE_STALE == ks->status[i])
+			continue;
 
-			if (
-				(!exclude || !kuid_eq(kn->id, exclude)) &&
-				knode_still_alive_probability(kn) >= ALIVE_PROBA_LOW_THRESH
-			) {
-				nodes = plist_prepend(nodes, kn);
-				available++;
-			}
+		c.d = target ^ ks->key[i];
+		c.idx = i;
 
-			stale = plist_remove(stale, kn);
+		if (n == max && !slot_closer(ks, id, &c, &sel[n - 1]))
+			continue;
+
+		if (exclude != NULL && kuid_eq(&ks->id[i], exclude))
+			continue;
+
+		kn = ks->node[i];
+		knode_check(kn);
+
+		if (KNODE_GOOD == ks->status[i]) {
+			if (alive && !(kn->flags & KNODE_F_ALIVE))
+				continue;
+		} else {
+			if (knode_still_alive_probability(kn) < ALIVE_PROBA_LOW_THRESH)
+				continue;
 		}
+
+		available++;
+		n = slot_select(ks, id, sel, n, max, &c);
 	}
 
 	/*
-	 * Pending nodes come last, if we miss nodes.
+	 * If we can determine that we do not have enough good nodes in the bucket
+	 * to fill the vector, consider "pending" nodes (excluding shutdowning
+	 * ones), provided we got traffic from them recently (defined by the
+	 * aliveness period).
 	 */
 
 	if (available < kcnt) {
-		plist_t *pending = hash_list_list(kb->nodes->pending);
 		time_t now = tm_time();
 
-		while (pending != NULL) {
-			knode_t *kn = pending->data;
+		for (i = 0; UNSIGNED(i) < ks->count; i++) {
+			const knode_t *kn;
+			struct slot_dist c;
+
+			if (KNODE_PENDING != ks->status[i])
+				continue;
+
+			c.d = target ^ ks->key[i];
+			c.idx = i;
+
+			if (n == max && !slot_closer(ks, id, &c, &sel[n - 1]))
+				continue;
 
+			if (exclude != NULL && kuid_eq(&ks->id[i], exclude))
+				continue;
+
+			kn = ks->node[i];
 			knode_check(kn);
-			g_assert(KNODE_PENDING == kn->status);
 
 			if (
 				!(kn->flags & KNODE_F_SHUTDOWNING) &&
-				(!exclude || !kuid_eq(kn->id, exclude)) &&
 				(!alive ||
 					(
 						(kn->flags & KNODE_F_ALIVE) &&
@@ -4534,30 +4716,15 @@ fill_closest_in_bucket(
 					)
 				)
 			) {
-				nodes = plist_prepend(nodes, kn);
-				available++;
+				n = slot_select(ks, id, sel, n, max, &c);
 			}
-
-			pending = plist_remove(pending, kn);
 		}
 	}
 
-	/*
-	 * Sort the candidates by increasing distance to the target KUID and
-	 * insert them in the vector.
-	 */
-
-	nodes = plist_sort_with_data(nodes, distance_to, deconstify_pointer(id));
-
-	for (added = 0, l = nodes; l && kcnt; l = plist_next(l)) {
-		*kvec++ = l->data;
-		kcnt--;
-		added++;
-	}
-
-	plist_free(nodes);
+	for (i = 0; i < n; i++)
+		kvec[i] = ks->node[sel[i].idx];
 
-	return added;
+	return n;
 }
 
 /**
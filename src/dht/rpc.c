@@ -248,6 +248,7 @@ dht_fix_contact(knode_t *kn, const char *source)
 
 		kn->addr = rn->addr;	/* Struct copy */
 		kn->port = rn->port;
+		knode_contact_invalidate(kn);
 		return TRUE;
 	}
 
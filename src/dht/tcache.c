@@ -79,7 +79,6 @@
 #include "lib/atoms.h"
 #include "lib/cq.h"
 #include "lib/debug.h"
-#include "lib/map.h"
 #include "lib/dbmw.h"
 #include "lib/dbstore.h"
 #include "lib/misc.h"
@@ -229,17 +228,16 @@ free_tokdata(void *valptr, size_t len)
 }
 
 /**
- * Map iterator to record security tokens in the database.
+ * Record security token collected during a node lookup.
+ *
+ * @param id		the KUID of the node that gave us the token
+ * @param ltok		the token and its retrieval time
  */
-static void
-record_token(void *key, void *value, void *unused_u)
+void
+tcache_record(const kuid_t *id, const lookup_token_t *ltok)
 {
-	kuid_t *id = key;
-	lookup_token_t *ltok = value;
 	struct tokdata td;
 
-	(void) unused_u;
-
 	td.last_update = ltok->retrieved;
 	td.length = ltok->token->length;
 	td.token = td.length ? wcopy(ltok->token->v, td.length) : NULL;
@@ -269,17 +267,6 @@ record_token(void *key, void *value, void *unused_u)
 	}
 }
 
-/**
- * Record security tokens collected during a node lookup from the supplied map.
- *
- * @param tokens	a map containing KUID => lookup_token_t
- */
-void
-tcache_record(map_t *tokens)
-{
-	map_foreach(tokens, record_token, NULL);
-}
-
 /**
  * Retrieve cached security token for a given KUID.
  *
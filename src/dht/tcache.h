@@ -35,7 +35,7 @@
 #define _dht_tcache_h_
 
 #include "if/dht/kuid.h"
-#include "lib/map.h"
+#include "lookup.h"
 
 /*
  * Public interface.
@@ -43,7 +43,7 @@
 
 void tcache_init(void);
 void tcache_close(void);
-void tcache_record(map_t *tokens);
+void tcache_record(const kuid_t *id, const lookup_token_t *ltok);
 bool tcache_get(const kuid_t *id, uint8 *, const void **, time_t *);
 bool tcache_remove(const kuid_t *id);
 
@@ -124,6 +124,9 @@
 
 #define MAX_VALUES		262144	/**< Max # of values we accept to manage */
 #define EXPIRE_PERIOD	30		/**< Asynchronous expire period: 30 secs */
+#define EXPIRE_BUDGET	10		/**< Max ms spent per reclaiming batch */
+#define EXPIRE_RESUME	250		/**< Delay (ms) before next reclaiming batch */
+#define EXPIRE_CHECK	16		/**< Check budget every that many values */
 
 #define VALUES_DB_CACHE_SIZE 1024	/**< Amount of values to keep cached */
 #define RAW_DB_CACHE_SIZE	 512	/**< Amount of raw data to keep cached */
@@ -218,6 +221,7 @@ static char db_expbase[] = "dht_expired";
 static char db_expwhat[] = "DHT expired values";
 
 static cperiodic_t *values_expire_ev;	/**< Value expire periodic event */
+static cevent_t *values_reclaim_ev;		/**< Resuming of expired reclaiming */
 
 /**
  * @return amount of values managed.
@@ -510,6 +514,7 @@ dht_value_patch_creator(dht_value_t *v, host_addr_t addr, uint16 port)
 		wcn->addr = addr;
 		wcn->port = port;
 		wcn->flags |= KNODE_F_PCONTACT;
+		knode_contact_invalidate(wcn);
 	}
 }
 
@@ -1016,7 +1021,81 @@ reclaim_dbkey(const void *key, void *u_data)
 void
 values_reclaim_expired(void)
 {
-	hset_foreach_remove(expired, reclaim_dbkey, NULL);
+	size_t n;
+
+	n = hset_foreach_remove(expired, reclaim_dbkey, NULL);
+	gnet_stats_count_general(GNR_DHT_VALUES_RECLAIMED, n);
+}
+
+static void values_reclaim_resume(cqueue_t *cq, void *unused_obj);
+
+/**
+ * Reclaim expired entries from the database, within a time budget.
+ *
+ * This is used by the periodic expiration, which can face a large amount
+ * of values to physically delete at once, to avoid stalling the main thread
+ * for too long: when the budget is exhausted, the reclaiming resumes a little
+ * bit later.
+ */
+static void
+values_reclaim_batch(void)
+{
+	hset_iter_t *iter;
+	const void *key;
+	tm_t start;
+	size_t n = 0;
+	bool done = TRUE;
+
+	if (0 == hset_count(expired))
+		return;
+
+	gnet_stats_inc_general(GNR_DHT_STORAGE_SCAN_BATCHES);
+	tm_now_exact(&start);
+	iter = hset_iter_new(expired);
+
+	while (hset_iter_next(iter, &key)) {
+		reclaim_dbkey(key, NULL);
+		hset_iter_remove(iter);
+
+		if (0 == ++n % EXPIRE_CHECK) {
+			tm_t now;
+
+			tm_now_exact(&now);
+			if (tm_elapsed_ms(&now, &start) >= EXPIRE_BUDGET) {
+				done = 0 == hset_count(expired);
+				break;
+			}
+		}
+	}
+
+	hset_iter_release(&iter);
+	gnet_stats_count_general(GNR_DHT_VALUES_RECLAIMED, n);
+
+	if (!done) {
+		gnet_stats_inc_general(GNR_DHT_STORAGE_SCAN_DEFERRED);
+
+		if (GNET_PROPERTY(dht_storage_debug)) {
+			g_debug("DHT reclaimed %zu expired value%s, %zu left for later",
+				n, plural(n), hset_count(expired));
+		}
+
+		if (NULL == values_reclaim_ev) {
+			values_reclaim_ev = cq_main_insert(EXPIRE_RESUME,
+				values_reclaim_resume, NULL);
+		}
+	}
+}
+
+/**
+ * Callout queue callback to resume reclaiming of expired values.
+ */
+static void
+values_reclaim_resume(cqueue_t *cq, void *unused_obj)
+{
+	(void) unused_obj;
+
+	cq_zero(cq, &values_reclaim_ev);
+	values_reclaim_batch();
 }
 
 /**
@@ -1027,7 +1106,9 @@ values_periodic_expire(void *unused_obj)
 {
 	(void) unused_obj;
 
-	values_reclaim_expired();
+	if (NULL == values_reclaim_ev)
+		values_reclaim_batch();
+
 	return TRUE;		/* Keep calling */
 }
 
@@ -2217,6 +2298,7 @@ values_close(void)
 	acct_net_free_null(&values_per_ip);
 	acct_net_free_null(&values_per_class_c);
 	cq_periodic_remove(&values_expire_ev);
+	cq_cancel(&values_reclaim_ev);
 	values_managed = 0;
 
 	gnet_stats_set_general(GNR_DHT_VALUES_HELD, 0);
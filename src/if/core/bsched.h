@@ -81,6 +81,7 @@ typedef struct bio_source {
 #define BIO_F_USED			(1 << 3)	/**< Source used this period */
 #define BIO_F_FAVOUR		(1 << 4)	/**< Try to favour source this period */
 #define BIO_F_PASSIVE		(1 << 5)	/**< Don't insert source for events */
+#define BIO_F_CAPPED		(1 << 6)	/**< Last write capped by b/w limits */
 
 #define BIO_F_RW			(BIO_F_READ|BIO_F_WRITE)
 
@@ -52,6 +52,7 @@ typedef struct wrap_io {
 	int (*flush)(struct wrap_io *);
 	int (*fd)(struct wrap_io *);
 	unsigned (*bufsize)(struct wrap_io *, enum socket_buftype);
+	void (*autotune)(struct wrap_io *, enum socket_buftype, uint64);
 } wrap_io_t;
 
 static inline void
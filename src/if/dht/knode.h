@@ -45,6 +45,12 @@ typedef enum {
 	KNODE_MAGIC = 0x247c8d05U
 } knode_magic_t;
 
+/**
+ * Maximum length of a serialized contact: vendor code, version, KUID,
+ * IPv6 address with its length, and port.
+ */
+#define KNODE_CONTACT_MAXLEN	(4 + 2 + KUID_RAW_SIZE + 1 + 16 + 2)
+
 /**
  * A Kademlia node.
  */
@@ -65,6 +71,8 @@ typedef struct knode {
 	uint8 rpc_timeouts;			/**< Amount of consecutive RPC timeouts */
 	uint8 major;				/**< Major version */
 	uint8 minor;				/**< Minor version */
+	uint8 contact_len;			/**< Length of serialized contact, 0 if none */
+	uint8 contact[KNODE_CONTACT_MAXLEN];	/**< Serialized contact */
 } knode_t;
 
 /**
@@ -103,6 +111,16 @@ knode_check(const knode_t *kn)
 	g_assert(kn->refcnt > 0);
 }
 
+/**
+ * Invalidate the serialized contact cached in the node, which must be done
+ * each time the address, port, vendor code or version of the node change.
+ */
+static inline void
+knode_contact_invalidate(knode_t *kn)
+{
+	kn->contact_len = 0;
+}
+
 /**
  * @return amount of references to Kademlia node.
  */
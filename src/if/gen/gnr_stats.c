@@ -1,5 +1,5 @@
 /*
- * Generated on Sun Mar 10 21:55:45 2019 by enum-msg.pl -- DO NOT EDIT
+ * Generated on Mon Oct 19 17:38:37 2026 by enum-msg.pl -- DO NOT EDIT
  *
  * Command: ../../../scripts/enum-msg.pl stats.lst
  */
@@ -41,6 +41,8 @@ static const char *stats_symbols[] = {
 	"oob_queries",
 	"oob_queries_stripped",
 	"oob_queries_ignored",
+	"oob_queries_threaded",
+	"oob_queries_shed",
 	"query_oob_proxied_dups",
 	"oob_hits_for_proxied_queries",
 	"oob_hits_with_alien_ip",
@@ -115,6 +117,8 @@ static const char *stats_symbols[] = {
 	"queue_callbacks",
 	"queue_discarded",
 	"banned_fds_total",
+	"handshake_fast_rejected",
+	"handshake_fast_reject_rendered",
 	"udp_read_ahead_count_sum",
 	"udp_read_ahead_bytes_sum",
 	"udp_read_ahead_old_sum",
@@ -159,6 +163,20 @@ static const char *stats_symbols[] = {
 	"udp_sched_drop_no_socket",
 	"udp_sched_drop_io_error",
 	"udp_sched_drop_no_longer_needed",
+	"udp_sched_queue_depth_empty",
+	"udp_sched_queue_depth_under_16",
+	"udp_sched_queue_depth_under_64",
+	"udp_sched_queue_depth_under_256",
+	"udp_sched_queue_depth_under_1024",
+	"udp_sched_queue_depth_over_1024",
+	"udp_sched_latency_under_10ms",
+	"udp_sched_latency_under_50ms",
+	"udp_sched_latency_under_100ms",
+	"udp_sched_latency_under_250ms",
+	"udp_sched_latency_under_500ms",
+	"udp_sched_latency_under_1s",
+	"udp_sched_latency_under_2s",
+	"udp_sched_latency_over_2s",
 	"udp_ambiguous",
 	"udp_ambiguous_deeper_inspection",
 	"udp_ambiguous_as_semi_reliable",
@@ -427,6 +445,11 @@ static const char *stats_symbols[] = {
 	"dht_successful_push_proxy_lookups",
 	"dht_successful_node_push_entry_lookups",
 	"dht_seeding_of_orphan",
+	"dht_storage_scans",
+	"dht_storage_scan_batches",
+	"dht_storage_scan_deferred",
+	"dht_storage_scanned_keys",
+	"dht_values_reclaimed",
 	"stats_digest",
 	"stats_tcp_digest",
 	"stats_udp_digest",
@@ -477,6 +500,8 @@ static const char *stats_text[] = {
 	N_("Queries requesting OOB hit delivery"),
 	N_("Stripped OOB flag on queries"),
 	N_("Ignored OOB queries due to unclaimed hits"),
+	N_("OOB queries matched by the query matching threads"),
+	N_("OOB queries dropped by the overloaded query matching queue"),
 	N_("Duplicate OOB-proxied queries"),
 	N_("OOB hits received for OOB-proxied queries"),
 	N_("OOB hits bearing alien IP address"),
@@ -551,6 +576,8 @@ static const char *stats_text[] = {
 	N_("QUEUE callbacks received"),
 	N_("QUEUE discarded due to no suitable download"),
 	N_("File descriptors banned running count"),
+	N_("Handshakes rejected by the fast 503 path"),
+	N_("Pre-rendered 503 handshake replies built"),
 	N_("UDP read-ahead datagram running count"),
 	N_("UDP read-ahead datagram running bytes"),
 	N_("UDP read-ahead datagram \"old\" processed"),
@@ -595,6 +622,20 @@ static const char *stats_text[] = {
 	N_("UDP scheduler message dropped: no socket"),
 	N_("UDP scheduler message dropped: I/O error"),
 	N_("UDP scheduler message dropped: no longer needed"),
+	N_("UDP scheduler enqueuing with empty queue"),
+	N_("UDP scheduler enqueuing with depth < 16"),
+	N_("UDP scheduler enqueuing with depth < 64"),
+	N_("UDP scheduler enqueuing with depth < 256"),
+	N_("UDP scheduler enqueuing with depth < 1024"),
+	N_("UDP scheduler enqueuing with depth >= 1024"),
+	N_("UDP scheduler queuing latency < 10 ms"),
+	N_("UDP scheduler queuing latency < 50 ms"),
+	N_("UDP scheduler queuing latency < 100 ms"),
+	N_("UDP scheduler queuing latency < 250 ms"),
+	N_("UDP scheduler queuing latency < 500 ms"),
+	N_("UDP scheduler queuing latency < 1 s"),
+	N_("UDP scheduler queuing latency < 2 s"),
+	N_("UDP scheduler queuing latency >= 2 s"),
 	N_("Ambiguous UDP messages received"),
 	N_("Ambiguous UDP messages inspected more deeply"),
 	N_("Ambiguous UDP messages handled as semi-reliable UDP"),
@@ -863,6 +904,11 @@ static const char *stats_text[] = {
 	N_("DHT successful push-proxy lookups"),
 	N_("DHT successful node push-entry lookups"),
 	N_("DHT re-seeding of orphan downloads"),
+	N_("DHT storage maintenance scans"),
+	N_("DHT storage maintenance batches"),
+	N_("DHT storage maintenance batches deferred on time budget"),
+	N_("DHT keys checked by storage maintenance"),
+	N_("DHT expired values reclaimed"),
 	N_("Digests computed on general statistics"),
 	N_("Digests computed on TCP statistics"),
 	N_("Digests computed on UDP statistics"),
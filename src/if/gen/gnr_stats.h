@@ -1,5 +1,5 @@
 /*
- * Generated on Sun Mar 10 21:55:45 2019 by enum-msg.pl -- DO NOT EDIT
+ * Generated on Mon Oct 19 17:38:37 2026 by enum-msg.pl -- DO NOT EDIT
  *
  * Command: ../../../scripts/enum-msg.pl stats.lst
  */
@@ -8,7 +8,7 @@
 #define _if_gen_gnr_stats_h_
 
 /*
- * Enum count: 415
+ * Enum count: 438
  */
 typedef enum {
 	GNR_ROUTING_ERRORS = 0,
@@ -37,6 +37,8 @@ typedef enum {
 	GNR_OOB_QUERIES,
 	GNR_OOB_QUERIES_STRIPPED,
 	GNR_OOB_QUERIES_IGNORED,
+	GNR_OOB_QUERIES_THREADED,
+	GNR_OOB_QUERIES_SHED,
 	GNR_QUERY_OOB_PROXIED_DUPS,
 	GNR_OOB_HITS_FOR_PROXIED_QUERIES,
 	GNR_OOB_HITS_WITH_ALIEN_IP,
@@ -111,6 +113,8 @@ typedef enum {
 	GNR_QUEUE_CALLBACKS,
 	GNR_QUEUE_DISCARDED,
 	GNR_BANNED_FDS_TOTAL,
+	GNR_HANDSHAKE_FAST_REJECTED,
+	GNR_HANDSHAKE_FAST_REJECT_RENDERED,
 	GNR_UDP_READ_AHEAD_COUNT_SUM,
 	GNR_UDP_READ_AHEAD_BYTES_SUM,
 	GNR_UDP_READ_AHEAD_OLD_SUM,
@@ -155,6 +159,20 @@ typedef enum {
 	GNR_UDP_SCHED_DROP_NO_SOCKET,
 	GNR_UDP_SCHED_DROP_IO_ERROR,
 	GNR_UDP_SCHED_DROP_NO_LONGER_NEEDED,
+	GNR_UDP_SCHED_QUEUE_DEPTH_EMPTY,
+	GNR_UDP_SCHED_QUEUE_DEPTH_UNDER_16,
+	GNR_UDP_SCHED_QUEUE_DEPTH_UNDER_64,
+	GNR_UDP_SCHED_QUEUE_DEPTH_UNDER_256,
+	GNR_UDP_SCHED_QUEUE_DEPTH_UNDER_1024,
+	GNR_UDP_SCHED_QUEUE_DEPTH_OVER_1024,
+	GNR_UDP_SCHED_LATENCY_UNDER_10MS,
+	GNR_UDP_SCHED_LATENCY_UNDER_50MS,
+	GNR_UDP_SCHED_LATENCY_UNDER_100MS,
+	GNR_UDP_SCHED_LATENCY_UNDER_250MS,
+	GNR_UDP_SCHED_LATENCY_UNDER_500MS,
+	GNR_UDP_SCHED_LATENCY_UNDER_1S,
+	GNR_UDP_SCHED_LATENCY_UNDER_2S,
+	GNR_UDP_SCHED_LATENCY_OVER_2S,
 	GNR_UDP_AMBIGUOUS,
 	GNR_UDP_AMBIGUOUS_DEEPER_INSPECTION,
 	GNR_UDP_AMBIGUOUS_AS_SEMI_RELIABLE,
@@ -423,6 +441,11 @@ typedef enum {
 	GNR_DHT_SUCCESSFUL_PUSH_PROXY_LOOKUPS,
 	GNR_DHT_SUCCESSFUL_NODE_PUSH_ENTRY_LOOKUPS,
 	GNR_DHT_SEEDING_OF_ORPHAN,
+	GNR_DHT_STORAGE_SCANS,
+	GNR_DHT_STORAGE_SCAN_BATCHES,
+	GNR_DHT_STORAGE_SCAN_DEFERRED,
+	GNR_DHT_STORAGE_SCANNED_KEYS,
+	GNR_DHT_VALUES_RECLAIMED,
 	GNR_STATS_DIGEST,
 	GNR_STATS_TCP_DIGEST,
 	GNR_STATS_UDP_DIGEST,
@@ -1136,6 +1136,20 @@ gboolean gnet_property_variable_send_oob_ind_reliably     = TRUE;
 static const gboolean gnet_property_variable_send_oob_ind_reliably_default = TRUE;
 guint32  gnet_property_variable_adns_debug     = 0;
 static const guint32  gnet_property_variable_adns_debug_default = 0;
+gboolean gnet_property_variable_udp_sched_paced     = FALSE;
+static const gboolean gnet_property_variable_udp_sched_paced_default = FALSE;
+guint32  gnet_property_variable_node_deflate_window_bits     = 15;
+static const guint32  gnet_property_variable_node_deflate_window_bits_default = 15;
+guint32  gnet_property_variable_node_deflate_mem_level     = 9;
+static const guint32  gnet_property_variable_node_deflate_mem_level_default = 9;
+guint32  gnet_property_variable_node_leaf_deflate_window_bits     = 14;
+static const guint32  gnet_property_variable_node_leaf_deflate_window_bits_default = 14;
+guint32  gnet_property_variable_node_leaf_deflate_mem_level     = 6;
+static const guint32  gnet_property_variable_node_leaf_deflate_mem_level_default = 6;
+guint32  gnet_property_variable_search_match_threads     = 2;
+static const guint32  gnet_property_variable_search_match_threads_default = 2;
+guint32  gnet_property_variable_search_match_queue     = 256;
+static const guint32  gnet_property_variable_search_match_queue_default = 256;
 
 static prop_set_t *gnet_property;
 
@@ -11442,6 +11456,157 @@ gnet_prop_init(void) {
     gnet_property->props[489].data.guint32.max   = 20;
     gnet_property->props[489].data.guint32.min   = 0;
 
+
+    /*
+     * PROP_UDP_SCHED_PACED:
+     *
+     * General data:
+     */
+    gnet_property->props[490].name = "udp_sched_paced";
+    gnet_property->props[490].desc = _("Whether the UDP TX scheduler should pace its traffic over the bandwidth scheduling period, serving destinations in turn, instead of flushing its LIFO queues at the start of each period.");
+    gnet_property->props[490].ev_changed = event_new("udp_sched_paced_changed");
+    gnet_property->props[490].save = TRUE;
+    gnet_property->props[490].internal = FALSE;
+    gnet_property->props[490].vector_size = 1;
+	mutex_init(&gnet_property->props[490].lock);
+
+    /* Type specific data: */
+    gnet_property->props[490].type               = PROP_TYPE_BOOLEAN;
+    gnet_property->props[490].data.boolean.def   = (void *) &gnet_property_variable_udp_sched_paced_default;
+    gnet_property->props[490].data.boolean.value = (void *) &gnet_property_variable_udp_sched_paced;
+
+
+    /*
+     * PROP_NODE_DEFLATE_WINDOW_BITS:
+     *
+     * General data:
+     */
+    gnet_property->props[491].name = "node_deflate_window_bits";
+    gnet_property->props[491].desc = _("Base-2 logarithm of the zlib window size used to compress Gnutella connections to ultrapeers and to leaves when running as a leaf. Smaller windows use less memory per connection at the expense of the compression ratio.");
+    gnet_property->props[491].ev_changed = event_new("node_deflate_window_bits_changed");
+    gnet_property->props[491].save = TRUE;
+    gnet_property->props[491].internal = FALSE;
+    gnet_property->props[491].vector_size = 1;
+	mutex_init(&gnet_property->props[491].lock);
+
+    /* Type specific data: */
+    gnet_property->props[491].type               = PROP_TYPE_GUINT32;
+    gnet_property->props[491].data.guint32.def   = (void *) &gnet_property_variable_node_deflate_window_bits_default;
+    gnet_property->props[491].data.guint32.value = (void *) &gnet_property_variable_node_deflate_window_bits;
+    gnet_property->props[491].data.guint32.choices = NULL;
+    gnet_property->props[491].data.guint32.max   = 15;
+    gnet_property->props[491].data.guint32.min   = 9;
+
+
+    /*
+     * PROP_NODE_DEFLATE_MEM_LEVEL:
+     *
+     * General data:
+     */
+    gnet_property->props[492].name = "node_deflate_mem_level";
+    gnet_property->props[492].desc = _("Amount of memory zlib may use for its internal compression state on Gnutella connections to ultrapeers, from 1 (least memory, slowest) to 9 (most memory, fastest).");
+    gnet_property->props[492].ev_changed = event_new("node_deflate_mem_level_changed");
+    gnet_property->props[492].save = TRUE;
+    gnet_property->props[492].internal = FALSE;
+    gnet_property->props[492].vector_size = 1;
+	mutex_init(&gnet_property->props[492].lock);
+
+    /* Type specific data: */
+    gnet_property->props[492].type               = PROP_TYPE_GUINT32;
+    gnet_property->props[492].data.guint32.def   = (void *) &gnet_property_variable_node_deflate_mem_level_default;
+    gnet_property->props[492].data.guint32.value = (void *) &gnet_property_variable_node_deflate_mem_level;
+    gnet_property->props[492].data.guint32.choices = NULL;
+    gnet_property->props[492].data.guint32.max   = 9;
+    gnet_property->props[492].data.guint32.min   = 1;
+
+
+    /*
+     * PROP_NODE_LEAF_DEFLATE_WINDOW_BITS:
+     *
+     * General data:
+     */
+    gnet_property->props[493].name = "node_leaf_deflate_window_bits";
+    gnet_property->props[493].desc = _("Base-2 logarithm of the zlib window size used to compress Gnutella connections to our leaves when running as an ultrapeer. Leaves are numerous, so a smaller window keeps the memory footprint down.");
+    gnet_property->props[493].ev_changed = event_new("node_leaf_deflate_window_bits_changed");
+    gnet_property->props[493].save = TRUE;
+    gnet_property->props[493].internal = FALSE;
+    gnet_property->props[493].vector_size = 1;
+	mutex_init(&gnet_property->props[493].lock);
+
+    /* Type specific data: */
+    gnet_property->props[493].type               = PROP_TYPE_GUINT32;
+    gnet_property->props[493].data.guint32.def   = (void *) &gnet_property_variable_node_leaf_deflate_window_bits_default;
+    gnet_property->props[493].data.guint32.value = (void *) &gnet_property_variable_node_leaf_deflate_window_bits;
+    gnet_property->props[493].data.guint32.choices = NULL;
+    gnet_property->props[493].data.guint32.max   = 15;
+    gnet_property->props[493].data.guint32.min   = 9;
+
+
+    /*
+     * PROP_NODE_LEAF_DEFLATE_MEM_LEVEL:
+     *
+     * General data:
+     */
+    gnet_property->props[494].name = "node_leaf_deflate_mem_level";
+    gnet_property->props[494].desc = _("Amount of memory zlib may use for its internal compression state on Gnutella connections to our leaves when running as an ultrapeer, from 1 (least memory) to 9 (most memory).");
+    gnet_property->props[494].ev_changed = event_new("node_leaf_deflate_mem_level_changed");
+    gnet_property->props[494].save = TRUE;
+    gnet_property->props[494].internal = FALSE;
+    gnet_property->props[494].vector_size = 1;
+	mutex_init(&gnet_property->props[494].lock);
+
+    /* Type specific data: */
+    gnet_property->props[494].type               = PROP_TYPE_GUINT32;
+    gnet_property->props[494].data.guint32.def   = (void *) &gnet_property_variable_node_leaf_deflate_mem_level_default;
+    gnet_property->props[494].data.guint32.value = (void *) &gnet_property_variable_node_leaf_deflate_mem_level;
+    gnet_property->props[494].data.guint32.choices = NULL;
+    gnet_property->props[494].data.guint32.max   = 9;
+    gnet_property->props[494].data.guint32.min   = 1;
+
+
+    /*
+     * PROP_SEARCH_MATCH_THREADS:
+     *
+     * General data:
+     */
+    gnet_property->props[495].name = "search_match_threads";
+    gnet_property->props[495].desc = _("Maximum amount of threads used to match incoming out-of-band queries against the library, so that heavy query traffic does not delay the main thread. Set to 0 to match all queries from the main thread.");
+    gnet_property->props[495].ev_changed = event_new("search_match_threads_changed");
+    gnet_property->props[495].save = TRUE;
+    gnet_property->props[495].internal = FALSE;
+    gnet_property->props[495].vector_size = 1;
+	mutex_init(&gnet_property->props[495].lock);
+
+    /* Type specific data: */
+    gnet_property->props[495].type               = PROP_TYPE_GUINT32;
+    gnet_property->props[495].data.guint32.def   = (void *) &gnet_property_variable_search_match_threads_default;
+    gnet_property->props[495].data.guint32.value = (void *) &gnet_property_variable_search_match_threads;
+    gnet_property->props[495].data.guint32.choices = NULL;
+    gnet_property->props[495].data.guint32.max   = 8;
+    gnet_property->props[495].data.guint32.min   = 0;
+
+
+    /*
+     * PROP_SEARCH_MATCH_QUEUE:
+     *
+     * General data:
+     */
+    gnet_property->props[496].name = "search_match_queue";
+    gnet_property->props[496].desc = _("Maximum amount of out-of-band queries waiting to be matched by the query matching threads. When the queue is full, the queries with the lowest priority are dropped.");
+    gnet_property->props[496].ev_changed = event_new("search_match_queue_changed");
+    gnet_property->props[496].save = TRUE;
+    gnet_property->props[496].internal = FALSE;
+    gnet_property->props[496].vector_size = 1;
+	mutex_init(&gnet_property->props[496].lock);
+
+    /* Type specific data: */
+    gnet_property->props[496].type               = PROP_TYPE_GUINT32;
+    gnet_property->props[496].data.guint32.def   = (void *) &gnet_property_variable_search_match_queue_default;
+    gnet_property->props[496].data.guint32.value = (void *) &gnet_property_variable_search_match_queue;
+    gnet_property->props[496].data.guint32.choices = NULL;
+    gnet_property->props[496].data.guint32.max   = 4096;
+    gnet_property->props[496].data.guint32.min   = 16;
+
     gnet_property->by_name = htable_create(HASH_KEY_STRING, 0);
     for (n = 0; n < GNET_PROPERTY_NUM; n ++) {
         htable_insert(gnet_property->by_name,
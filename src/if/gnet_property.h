@@ -526,6 +526,13 @@ typedef enum {
     PROP_RUNNING_TOPLESS,
     PROP_SEND_OOB_IND_RELIABLY,
     PROP_ADNS_DEBUG,
+    PROP_UDP_SCHED_PACED,
+    PROP_NODE_DEFLATE_WINDOW_BITS,
+    PROP_NODE_DEFLATE_MEM_LEVEL,
+    PROP_NODE_LEAF_DEFLATE_WINDOW_BITS,
+    PROP_NODE_LEAF_DEFLATE_MEM_LEVEL,
+    PROP_SEARCH_MATCH_THREADS,
+    PROP_SEARCH_MATCH_QUEUE,
     GNET_PROPERTY_END
 } gnet_property_t;
 
@@ -540,6 +540,13 @@ extern const gboolean gnet_property_variable_lock_sleep_trace;
 extern const gboolean gnet_property_variable_running_topless;
 extern const gboolean gnet_property_variable_send_oob_ind_reliably;
 extern const guint32  gnet_property_variable_adns_debug;
+extern const gboolean gnet_property_variable_udp_sched_paced;
+extern const guint32  gnet_property_variable_node_deflate_window_bits;
+extern const guint32  gnet_property_variable_node_deflate_mem_level;
+extern const guint32  gnet_property_variable_node_leaf_deflate_window_bits;
+extern const guint32  gnet_property_variable_node_leaf_deflate_mem_level;
+extern const guint32  gnet_property_variable_search_match_threads;
+extern const guint32  gnet_property_variable_search_match_queue;
 
 
 prop_set_t *gnet_prop_init(void);
@@ -39,8 +39,10 @@
 #include "common.h"
 
 #include "atoms.h"
+#include "ascii.h"
 #include "buf.h"
 #include "constants.h"
+#include "dump_options.h"
 #include "endian.h"
 #include "hashing.h"
 #include "htable.h"
@@ -531,21 +533,38 @@ atom_dealloc(atom_t *a, size_t size)
 typedef size_t (*len_func_t)(const void *v);
 typedef const char *(*str_func_t)(const void *v);
 
+/*
+ * Atoms of a given type are spread among several tables, each with its own
+ * lock, to limit contention between threads creating or releasing atoms.
+ * The stripe holding an atom is selected by the leading bits of its hash
+ * value, since the hash table uses the trailing ones.
+ */
+#define ATOM_STRIPE_BITS	4
+#define ATOM_STRIPES		(1U << ATOM_STRIPE_BITS)
+
+/**
+ * A stripe of atoms.
+ */
+struct atom_stripe {
+	spinlock_t lock;			/**< Lock protecting the hash table */
+	htable_t *table;			/**< Table of atoms: "atom value" -> size */
+	uint64 locks;				/**< Amount of times the lock was taken */
+	uint64 contended;			/**< Amount of times the lock was busy */
+};
+
 /**
  * Description of atom types.
  */
 typedef struct atom_desc {
-	spinlock_t lock;			/**< Lock protecting the hash table */
 	const char *type;			/**< Type of atoms */
-	htable_t *table;			/**< Table of atoms: "atom value" -> size */
 	hash_fn_t hash_func;		/**< Hashing function for atoms */
 	eq_fn_t eq_func;			/**< Atom equality function */
 	len_func_t len_func;		/**< Atom length function */
 	str_func_t str_func;		/**< Atom to human-readable string */
+	struct atom_stripe stripe[ATOM_STRIPES];	/**< Stripes of atoms */
 } atom_desc_t;
 
-#define ATOM_TABLE_LOCK(t)		spinlock(&(t)->lock)
-#define ATOM_TABLE_UNLOCK(t)	spinunlock(&(t)->lock)
+#define ATOM_STRIPE_UNLOCK(s)	spinunlock(&(s)->lock)
 
 static size_t str_xlen(const void *v);
 static const char *str_str(const void *v);
@@ -579,22 +598,23 @@ static const char *packed_host_addr_str(const void *v);
 #define pha_eq		packed_host_addr_equal
 #define pha_len		packed_host_addr_len
 #define pha_str		packed_host_addr_str
-#define S			SPINLOCK_INIT
-#define N			NULL
+#define S			{ { SPINLOCK_INIT, NULL, 0, 0 } }
 
 /**
  * The set of all atom types we know about.
+ *
+ * The stripes are initialized by atoms_init_once().
  */
 static atom_desc_t atoms[] = {
-	{ S, "String", N, str_hash,    str_eq,     str_xlen,   str_str  }, /* 0 */
-	{ S, "GUID",   N, guid_hash,   guid_eq,    guid_len,   guid_str }, /* 1 */
-	{ S, "SHA1",   N, sha1_hash,   sha1_eq,	   sha1_len,   sha1_str }, /* 2 */
-	{ S, "TTH",    N, tth_hash,    tth_eq,	   tth_len,    tth_str },  /* 3 */
-	{ S, "uint64", N, uint64_hash, uint64_eq,  uint64_len, uint64_str},/* 4 */
-	{ S, "filesize", N, fs_hash,   fs_eq,      fs_len,     fs_str },   /* 5 */
-	{ S, "uint32", N, uint32_hash, uint32_eq,  uint32_len, uint32_str},/* 6 */
-	{ S, "host",   N, gnh_hash,    gnh_eq,     gnh_len,    gnh_str },  /* 7 */
-	{ S, "addr",   N, pha_hash,    pha_eq,     pha_len,    pha_str },  /* 8 */
+	{ "String",   str_hash,    str_eq,     str_xlen,   str_str,    S }, /* 0 */
+	{ "GUID",     guid_hash,   guid_eq,    guid_len,   guid_str,   S }, /* 1 */
+	{ "SHA1",     sha1_hash,   sha1_eq,    sha1_len,   sha1_str,   S }, /* 2 */
+	{ "TTH",      tth_hash,    tth_eq,     tth_len,    tth_str,    S }, /* 3 */
+	{ "uint64",   uint64_hash, uint64_eq,  uint64_len, uint64_str, S }, /* 4 */
+	{ "filesize", fs_hash,     fs_eq,      fs_len,     fs_str,     S }, /* 5 */
+	{ "uint32",   uint32_hash, uint32_eq,  uint32_len, uint32_str, S }, /* 6 */
+	{ "host",     gnh_hash,    gnh_eq,     gnh_len,    gnh_str,    S }, /* 7 */
+	{ "addr",     pha_hash,    pha_eq,     pha_len,    pha_str,    S }, /* 8 */
 };
 
 #undef str_hash
@@ -612,7 +632,30 @@ static atom_desc_t atoms[] = {
 #undef pha_len
 #undef pha_str
 #undef S
-#undef N
+
+/**
+ * @return the stripe where atom ``key'' of given type belongs.
+ */
+static inline struct atom_stripe *
+atom_stripe(atom_desc_t *ad, const void *key)
+{
+	uint32 h = hashing_mix32((*ad->hash_func)(key));
+
+	return &ad->stripe[h >> (32 - ATOM_STRIPE_BITS)];
+}
+
+/**
+ * Lock the stripe, accounting for contention.
+ */
+static inline void
+atom_stripe_lock(struct atom_stripe *as)
+{
+	if G_UNLIKELY(!spinlock_try(&as->lock)) {
+		spinlock(&as->lock);
+		as->contended++;
+	}
+	as->locks++;
+}
 
 /**
  * @return length of string + trailing NUL.
@@ -980,8 +1023,14 @@ atoms_init_once(void)
 
 	for (i = 0; i < N_ITEMS(atoms); i++) {
 		atom_desc_t *ad = &atoms[i];
+		uint j;
+
+		for (j = 0; j < N_ITEMS(ad->stripe); j++) {
+			struct atom_stripe *as = &ad->stripe[j];
 
-		ad->table = htable_create_any(ad->hash_func, NULL, ad->eq_func);
+			spinlock_init(&as->lock);
+			as->table = htable_create_any(ad->hash_func, NULL, ad->eq_func);
+		}
 	}
 
 	/*
@@ -1028,12 +1077,20 @@ atoms_init(void)
 bool
 atom_exists(enum atom_type type, const void *key)
 {
+	struct atom_stripe *as;
+	bool exists;
+
 	g_assert(key != NULL);
 
 	if G_UNLIKELY(!ONCE_DONE(atoms_inited))
 		return FALSE;
 
-	return htable_contains(atoms[type].table, key);
+	as = atom_stripe(&atoms[type], key);
+	atom_stripe_lock(as);
+	exists = htable_contains(as->table, key);
+	ATOM_STRIPE_UNLOCK(as);
+
+	return exists;
 }
 
 /**
@@ -1044,26 +1101,32 @@ atom_exists(enum atom_type type, const void *key)
 bool
 atom_is_atom(enum atom_type type, const void *key)
 {
+	struct atom_stripe *as;
 	const void *atom;
+	bool found;
 
 	g_assert(key != NULL);
 
 	if G_UNLIKELY(!ONCE_DONE(atoms_inited))
 		return FALSE;
 
-	return htable_lookup_extended(atoms[type].table, key, &atom, NULL)
-		&& key == atom;
+	as = atom_stripe(&atoms[type], key);
+	atom_stripe_lock(as);
+	found = htable_lookup_extended(as->table, key, &atom, NULL);
+	ATOM_STRIPE_UNLOCK(as);
+
+	return found && key == atom;
 }
 
 /**
  * Increment / decrement the atom reference count.
  *
- * Must be called with the table description locked.
+ * Must be called with the stripe locked.
  *
  * @return new reference count.
  */
 static inline size_t
-atom_refcnt_add(const atom_desc_t *ad, const void *key, void *value, int delta)
+atom_refcnt_add(struct atom_stripe *as, const void *key, void *value, int delta)
 {
 	if (4 == sizeof(void *)) {
 		/* 32-bit machine, we can directly update the atom_info structure */
@@ -1077,7 +1140,7 @@ atom_refcnt_add(const atom_desc_t *ad, const void *key, void *value, int delta)
 			v += delta;
 		else
 			v -= -delta;	/* Necessary since int may be smaller than long */
-		htable_insert(ad->table, key, ulong_to_pointer(v));
+		htable_insert(as->table, key, ulong_to_pointer(v));
 		return ATOM_REFCNT(v);
 	}
 }
@@ -1092,6 +1155,7 @@ const void *
 atom_get(enum atom_type type, const void *key)
 {
 	atom_desc_t *ad;
+	struct atom_stripe *as;
 	const void *orig_key;
 	void *value;
 	size_t size;
@@ -1108,9 +1172,10 @@ atom_get(enum atom_type type, const void *key)
 		atoms_init();
 
 	ad = &atoms[type];		/* Where atoms of this type are held */
-	ATOM_TABLE_LOCK(ad);
+	as = atom_stripe(ad, key);
+	atom_stripe_lock(as);
 
-	if (htable_lookup_extended(ad->table, key, &orig_key, &value)) {
+	if (htable_lookup_extended(as->table, key, &orig_key, &value)) {
 		size_t refcnt;
 
 		size = atom_info_length(value);
@@ -1123,9 +1188,9 @@ atom_get(enum atom_type type, const void *key)
 
 		g_assert(atom_info_refcnt(value) > 0);
 
-		refcnt = atom_refcnt_add(ad, orig_key, value, +1);
+		refcnt = atom_refcnt_add(as, orig_key, value, +1);
 		ATOM_TRACK_REFCNT(orig_key, +1, refcnt);
-		ATOM_TABLE_UNLOCK(ad);
+		ATOM_STRIPE_UNLOCK(as);
 
 		return orig_key;
 	} else {
@@ -1156,13 +1221,13 @@ atom_get(enum atom_type type, const void *key)
 			WALLOC(ai);
 			ai->len = size;
 			ai->refcnt = 1;
-			htable_insert(ad->table, atom_arena(a), ai);
+			htable_insert(as->table, atom_arena(a), ai);
 		} else {
 			ulong v = ATOM_INFO(size) + 1;	/* +1 means refcnt is 1 */
-			htable_insert(ad->table, atom_arena(a), ulong_to_pointer(v));
+			htable_insert(as->table, atom_arena(a), ulong_to_pointer(v));
 		}
 
-		ATOM_TABLE_UNLOCK(ad);
+		ATOM_STRIPE_UNLOCK(as);
 
 		return atom_arena(a);
 	}
@@ -1176,6 +1241,7 @@ void
 atom_free(enum atom_type type, const void *key)
 {
 	atom_desc_t *ad;
+	struct atom_stripe *as;
 	size_t size;
 	atom_t *a;
 	bool found;
@@ -1188,9 +1254,10 @@ atom_free(enum atom_type type, const void *key)
 	ATOM_TRACK_IS_LOCKED();
 
 	ad = &atoms[type];		/* Where atoms of this type are held */
-	ATOM_TABLE_LOCK(ad);
+	as = atom_stripe(ad, key);
+	atom_stripe_lock(as);
 
-	found = htable_lookup_extended(ad->table, key, &orig_key, &value);
+	found = htable_lookup_extended(as->table, key, &orig_key, &value);
 
 	g_assert_log(found,
 		"attempting to free unknown %s atom at %p", ad->type, key);
@@ -1211,7 +1278,7 @@ atom_free(enum atom_type type, const void *key)
 	 */
 
 	if (1 == refcnt) {
-		htable_remove(ad->table, key);
+		htable_remove(as->table, key);
 		if (4 == sizeof(void *)) {
 			/* 32-bit machine */
 			struct atom_info *ai = value;
@@ -1220,11 +1287,11 @@ atom_free(enum atom_type type, const void *key)
 		atom_unprotect(a, size);
 		atom_dealloc(a, size);
 	} else {
-		size_t rcnt = atom_refcnt_add(ad, key, value, -1);
+		size_t rcnt = atom_refcnt_add(as, key, value, -1);
 		ATOM_TRACK_REFCNT(key, -1, rcnt);
 	}
 
-	ATOM_TABLE_UNLOCK(ad);
+	ATOM_STRIPE_UNLOCK(as);
 }
 
 #ifdef TRACK_ATOMS
@@ -1471,12 +1538,67 @@ atoms_close(void)
 
 	for (i = 0; i < N_ITEMS(atoms); i++) {
 		atom_desc_t *ad = &atoms[i];
+		uint j;
+
+		for (j = 0; j < N_ITEMS(ad->stripe); j++) {
+			struct atom_stripe *as = &ad->stripe[j];
 
-		ATOM_TABLE_LOCK(ad);
-		htable_foreach(ad->table, atom_warn_free, ad);
-		htable_free_null(&ad->table);
-		ATOM_TABLE_UNLOCK(ad);
+			spinlock(&as->lock);
+			htable_foreach(as->table, atom_warn_free, ad);
+			htable_free_null(&as->table);
+			spinunlock(&as->lock);
+		}
 	}
 }
 
+/**
+ * Dump atom statistics to specified logagent.
+ */
+void
+atoms_dump_stats_log(logagent_t *la, unsigned options)
+{
+	bool groupped = booleanize(options & DUMP_OPT_PRETTY);
+	uint64 tlocks = 0, tcontended = 0;
+	uint i;
+
+	if G_UNLIKELY(!ONCE_DONE(atoms_inited))
+		return;
+
+	for (i = 0; i < N_ITEMS(atoms); i++) {
+		atom_desc_t *ad = &atoms[i];
+		uint64 locks = 0, contended = 0;
+		size_t count = 0;
+		char name[16];
+		uint j;
+
+		for (j = 0; j < N_ITEMS(ad->stripe); j++) {
+			struct atom_stripe *as = &ad->stripe[j];
+
+			spinlock(&as->lock);
+			count += htable_count(as->table);
+			locks += as->locks;
+			contended += as->contended;
+			spinunlock(&as->lock);
+		}
+
+		tlocks += locks;
+		tcontended += contended;
+
+		ascii_strlower(name, ad->type);
+
+		log_info(la, "ATOMS %s_count = %s", name,
+			size_t_to_string_grp(count, groupped));
+		log_info(la, "ATOMS %s_locks = %s", name,
+			uint64_to_string_grp(locks, groupped));
+		log_info(la, "ATOMS %s_contended = %s", name,
+			uint64_to_string_grp(contended, groupped));
+	}
+
+	log_info(la, "ATOMS stripes = %u", ATOM_STRIPES);
+	log_info(la, "ATOMS total_locks = %s",
+		uint64_to_string_grp(tlocks, groupped));
+	log_info(la, "ATOMS total_contended = %s",
+		uint64_to_string_grp(tcontended, groupped));
+}
+
 /* vi: set ts=4 sw=4 cindent: */
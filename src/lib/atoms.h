@@ -222,6 +222,10 @@ atom_addr_free(const struct packed_host_addr *k)
 void atoms_init(void);
 void atoms_close(void);
 
+struct logagent;
+
+void atoms_dump_stats_log(struct logagent *la, unsigned options);
+
 static inline bool
 atom_is_str(const char *k)
 {
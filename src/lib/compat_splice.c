@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2026 agent
+ *
+ *----------------------------------------------------------------------
+ * This file is part of gtk-gnutella.
+ *
+ *  gtk-gnutella is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gtk-gnutella is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with gtk-gnutella; if not, write to the Free Software
+ *  Foundation, Inc.:
+ *      59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *----------------------------------------------------------------------
+ */
+
+/**
+ * @ingroup lib
+ * @file
+ *
+ * Data transfer between sockets through a kernel pipe.
+ *
+ * On Linux, splice() moves pages between a socket and a pipe without
+ * copying them to user space.  Relaying between two sockets is done by
+ * splicing from the source socket into a pipe, then from the pipe into
+ * the destination socket.
+ *
+ * When splice() is not available, the routines here fail with ENOSYS and
+ * callers are expected to fall back to plain read() and write() calls.
+ *
+ * @author agent
+ * @date 2026
+ */
+
+#include "common.h"
+
+#include "compat_splice.h"
+
+#include "fd.h"
+#include "unsigned.h"
+
+#include "override.h"		/* Must be the last header included */
+
+/**
+ * @return whether splice() can be used on this system.
+ */
+bool
+compat_splice_available(void)
+{
+#ifdef HAS_SPLICE
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
+/**
+ * Create a pipe suitable for splicing data between two sockets.
+ *
+ * Both ends are made non-blocking and are closed on exec().
+ *
+ * @param fd		filled with the reading end (fd[0]) and writing end (fd[1])
+ * @param size		the wanted pipe capacity, 0 to keep the system default
+ *
+ * @return 0 on success, -1 on failure with errno set.
+ */
+int
+compat_splice_pipe(int fd[2], size_t size)
+{
+	g_assert(fd != NULL);
+
+#ifdef HAS_SPLICE
+	if (-1 == pipe(fd))
+		return -1;
+
+	fd_set_close_on_exec(fd[0]);
+	fd_set_close_on_exec(fd[1]);
+	fd_set_nonblocking(fd[0]);
+	fd_set_nonblocking(fd[1]);
+
+#ifdef F_SETPIPE_SZ
+	/*
+	 * Failing to resize the pipe is not fatal: the kernel will refuse
+	 * sizes larger than /proc/sys/fs/pipe-max-size for unprivileged
+	 * processes, and the default capacity will then be used.
+	 */
+
+	if (size != 0)
+		(void) fcntl(fd[1], F_SETPIPE_SZ, (int) MIN(size, INT_MAX));
+#else
+	(void) size;
+#endif	/* F_SETPIPE_SZ */
+
+	return 0;
+#else	/* !HAS_SPLICE */
+	(void) size;
+
+	fd[0] = fd[1] = -1;
+	errno = ENOSYS;
+	return -1;
+#endif	/* HAS_SPLICE */
+}
+
+/**
+ * Move data between two file descriptors, one of which must be a pipe.
+ *
+ * Operations on the pipe never block.  Whether the operation on the other
+ * end can block depends on that file descriptor.
+ *
+ * @param in_fd		the file descriptor opened for reading
+ * @param out_fd	the file descriptor opened for writing
+ * @param count		maximum amount of bytes to transfer
+ *
+ * @return the amount of bytes moved, 0 on EOF, -1 on errors with errno set.
+ */
+ssize_t
+compat_splice(int in_fd, int out_fd, size_t count)
+{
+	g_assert(is_valid_fd(in_fd));
+	g_assert(is_valid_fd(out_fd));
+	g_assert(size_is_positive(count));
+
+#ifdef HAS_SPLICE
+	return splice(in_fd, NULL, out_fd, NULL, count,
+		SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif	/* HAS_SPLICE */
+}
+
+/* vi: set ts=4 sw=4 cindent: */
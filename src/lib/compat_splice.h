@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2026 agent
+ *
+ *----------------------------------------------------------------------
+ * This file is part of gtk-gnutella.
+ *
+ *  gtk-gnutella is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gtk-gnutella is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with gtk-gnutella; if not, write to the Free Software
+ *  Foundation, Inc.:
+ *      59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *----------------------------------------------------------------------
+ */
+
+/**
+ * @ingroup lib
+ * @file
+ *
+ * Data transfer between sockets through a kernel pipe.
+ *
+ * @author agent
+ * @date 2026
+ */
+
+#ifndef _compat_splice_h_
+#define _compat_splice_h_
+
+bool compat_splice_available(void);
+int compat_splice_pipe(int fd[2], size_t size);
+ssize_t compat_splice(int in_fd, int out_fd, size_t count);
+
+#endif /* _compat_splice_h_ */
+
+/* vi: set ts=4 sw=4 cindent: */
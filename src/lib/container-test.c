@@ -0,0 +1,1209 @@
+/*
+ * container-test -- microbenchmark of the container data structures.
+ *
+ * Copyright (c) 2026 agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the authors nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Each container is filled with fixed-size keys looking like GUIDs, SHA1s
+ * or host addresses, then probed with hits and misses, iterated over,
+ * churned (one removal and one insertion per operation) and finally
+ * emptied.  For each phase, the throughput and the latency percentiles are
+ * reported, the latter being measured on a sample of the operations to
+ * keep the timing overhead low.
+ *
+ * The memory used per entry is computed from the amount of memory allocated
+ * through the VMM layer, which ultimately backs all our allocators.  Each
+ * container is run in its own process when possible, so that memory cached
+ * by the allocators after a run does not distort the next measurements.
+ *
+ * Every result is checked, so this also exercises the containers.
+ */
+
+#include "common.h"
+
+#include "aging.h"
+#include "endian.h"
+#include "erbtree.h"
+#include "hashing.h"
+#include "hashlist.h"
+#include "hashtable.h"
+#include "hset.h"
+#include "htable.h"
+#include "log.h"
+#include "map.h"
+#include "ohash_table.h"
+#include "patricia.h"
+#include "progname.h"
+#include "rbtree.h"
+#include "ripening.h"
+#include "sorted_array.h"
+#include "tm.h"
+#include "vmm.h"
+#include "vsort.h"
+#include "walloc.h"
+#include "xmalloc.h"
+
+#include "override.h"		/* Must be the last header included */
+
+#define DELAY		3600		/* Aging delay, entries must not expire */
+
+static unsigned initial_seed;
+static bool verbose;
+static uint32 bench_seed;
+static size_t keylen;
+static size_t sample = 16;
+
+static const struct keytype {
+	const char *name;
+	size_t len;
+} keytypes[] = {
+	{ "guid",	16 },
+	{ "sha1",	20 },
+	{ "addr",	6 },		/* IPv4 address and port */
+};
+
+static void G_NORETURN
+usage(void)
+{
+	fprintf(stderr,
+		"Usage: %s [-hLv] [-c list] [-k key] [-n items] [-o operations]\n"
+		"       [-p passes] [-s period] [-R seed]\n"
+		"  -c : comma-separated list of containers to test (default all)\n"
+		"  -h : prints this help message\n"
+		"  -k : key type: guid, sha1 or addr (default guid)\n"
+		"  -n : amount of items in the containers (default 100000)\n"
+		"  -o : amount of churning operations (default 1000000)\n"
+		"  -p : amount of iteration passes (default 4)\n"
+		"  -s : latency sampling period, in operations (default 16)\n"
+		"  -v : verbose mode\n"
+		"  -L : list known containers\n"
+		"  -R : seed for repeatable random sequence\n"
+		, getprogname());
+	exit(EXIT_FAILURE);
+}
+
+/**
+ * @return random 32-bit number.
+ *
+ * We use our own xorshift generator so that the sequence cannot be perturbed
+ * by other random number consumers, making all the containers see the very
+ * same operations.
+ */
+static inline uint32
+bench_rand(void)
+{
+	bench_seed ^= bench_seed << 13;
+	bench_seed ^= bench_seed >> 17;
+	bench_seed ^= bench_seed << 5;
+
+	return bench_seed;
+}
+
+static uint
+key_hash(const void *key)
+{
+	return binary_hash(key, keylen);
+}
+
+static bool
+key_eq(const void *a, const void *b)
+{
+	return 0 == memcmp(a, b, keylen);
+}
+
+static int
+key_cmp(const void *a, const void *b)
+{
+	return memcmp(a, b, keylen);
+}
+
+static void
+count_data(void *data, void *udata)
+{
+	size_t *n = udata;
+
+	(void) data;
+	(*n)++;
+}
+
+static void
+count_cdata(const void *data, void *udata)
+{
+	size_t *n = udata;
+
+	(void) data;
+	(*n)++;
+}
+
+static void
+count_keyval(void *key, void *value, void *udata)
+{
+	size_t *n = udata;
+
+	(void) key;
+	(void) value;
+	(*n)++;
+}
+
+static void
+count_ckeyval(const void *key, void *value, void *udata)
+{
+	size_t *n = udata;
+
+	(void) key;
+	(void) value;
+	(*n)++;
+}
+
+/*
+ * Container adaptors.
+ *
+ * Keys are inserted with themselves as value, and lookups return the stored
+ * key or value so that we can check it.
+ */
+
+static void *
+hset_make(void)
+{
+	return hset_create(HASH_KEY_FIXED, keylen);
+}
+
+static void
+hset_add(void *c, const void *key)
+{
+	hset_insert(c, key);
+}
+
+static const void *
+hset_get(void *c, const void *key)
+{
+	return hset_lookup(c, key);
+}
+
+static bool
+hset_del(void *c, const void *key)
+{
+	return hset_remove(c, key);
+}
+
+static size_t
+hset_iterate(void *c)
+{
+	size_t n = 0;
+
+	hset_foreach(c, count_cdata, &n);
+	return n;
+}
+
+static void
+hset_destroy(void *c)
+{
+	hset_t *hs = c;
+
+	hset_free_null(&hs);
+}
+
+static void *
+htable_make(void)
+{
+	return htable_create(HASH_KEY_FIXED, keylen);
+}
+
+static void *
+htable_make_groups(void)
+{
+	htable_t *ht = htable_create(HASH_KEY_FIXED, keylen);
+
+	htable_group_probing(ht);
+	return ht;
+}
+
+static void
+htable_add(void *c, const void *key)
+{
+	htable_insert_const(c, key, key);
+}
+
+static const void *
+htable_get(void *c, const void *key)
+{
+	return htable_lookup(c, key);
+}
+
+static bool
+htable_del(void *c, const void *key)
+{
+	return htable_remove(c, key);
+}
+
+static size_t
+htable_iterate(void *c)
+{
+	size_t n = 0;
+
+	htable_foreach(c, count_ckeyval, &n);
+	return n;
+}
+
+static void
+htable_destroy(void *c)
+{
+	htable_t *ht = c;
+
+	htable_free_null(&ht);
+}
+
+static void *
+hashtable_make(void)
+{
+	return hash_table_new_full(key_hash, key_eq);
+}
+
+static void
+hashtable_add(void *c, const void *key)
+{
+	hash_table_insert(c, key, key);
+}
+
+static const void *
+hashtable_get(void *c, const void *key)
+{
+	return hash_table_lookup(c, key);
+}
+
+static bool
+hashtable_del(void *c, const void *key)
+{
+	return hash_table_remove(c, key);
+}
+
+static size_t
+hashtable_iterate(void *c)
+{
+	size_t n = 0;
+
+	hash_table_foreach(c, count_ckeyval, &n);
+	return n;
+}
+
+static void
+hashtable_destroy(void *c)
+{
+	hash_table_destroy(c);
+}
+
+static void *
+ohash_make(void)
+{
+	return ohash_table_new(key_hash, key_eq);
+}
+
+static void
+ohash_add(void *c, const void *key)
+{
+	ohash_table_insert(c, key, key);
+}
+
+static const void *
+ohash_get(void *c, const void *key)
+{
+	return ohash_table_lookup(c, key);
+}
+
+static bool
+ohash_del(void *c, const void *key)
+{
+	return ohash_table_remove(c, key);
+}
+
+static size_t
+ohash_iterate(void *c)
+{
+	size_t n = 0;
+
+	ohash_table_foreach(c, count_keyval, &n);
+	return n;
+}
+
+static void
+ohash_destroy(void *c)
+{
+	ohash_table_destroy(c);
+}
+
+static void *
+hashlist_make(void)
+{
+	return hash_list_new(key_hash, key_eq);
+}
+
+static void
+hashlist_add(void *c, const void *key)
+{
+	hash_list_append(c, key);
+}
+
+static const void *
+hashlist_get(void *c, const void *key)
+{
+	const void *orig;
+
+	return hash_list_find(c, key, &orig) ? orig : NULL;
+}
+
+static bool
+hashlist_del(void *c, const void *key)
+{
+	return NULL != hash_list_remove(c, key);
+}
+
+static size_t
+hashlist_iterate(void *c)
+{
+	hash_list_iter_t *iter;
+	size_t n = 0;
+
+	iter = hash_list_iterator(c);
+	while (hash_list_iter_has_next(iter)) {
+		(void) hash_list_iter_next(iter);
+		n++;
+	}
+	hash_list_iter_release(&iter);
+
+	return n;
+}
+
+static void
+hashlist_destroy(void *c)
+{
+	hash_list_t *hl = c;
+
+	hash_list_free(&hl);
+}
+
+static void *
+map_make(void)
+{
+	return map_create_hash(key_hash, key_eq);
+}
+
+static void
+map_add(void *c, const void *key)
+{
+	map_insert(c, key, key);
+}
+
+static const void *
+map_get(void *c, const void *key)
+{
+	return map_lookup(c, key);
+}
+
+static bool
+map_del(void *c, const void *key)
+{
+	return map_remove(c, key);
+}
+
+static size_t
+map_iterate(void *c)
+{
+	size_t n = 0;
+
+	map_foreach(c, count_keyval, &n);
+	return n;
+}
+
+static void
+map_free(void *c)
+{
+	map_destroy(c);
+}
+
+static void
+count_patricia(void *key, size_t keybits, void *value, void *udata)
+{
+	size_t *n = udata;
+
+	(void) key;
+	(void) keybits;
+	(void) value;
+	(*n)++;
+}
+
+static void *
+patricia_make(void)
+{
+	return patricia_create(keylen * 8);
+}
+
+static void
+patricia_add(void *c, const void *key)
+{
+	patricia_insert(c, key, key);
+}
+
+static const void *
+patricia_get(void *c, const void *key)
+{
+	return patricia_lookup(c, key);
+}
+
+static bool
+patricia_del(void *c, const void *key)
+{
+	return patricia_remove(c, key);
+}
+
+static size_t
+patricia_iterate(void *c)
+{
+	size_t n = 0;
+
+	patricia_foreach(c, count_patricia, &n);
+	return n;
+}
+
+static void
+patricia_free(void *c)
+{
+	patricia_destroy(c);
+}
+
+static void *
+rbtree_make(void)
+{
+	return rbtree_create(key_cmp);
+}
+
+static void
+rbtree_add(void *c, const void *key)
+{
+	rbtree_insert(c, key);
+}
+
+static const void *
+rbtree_get(void *c, const void *key)
+{
+	return rbtree_lookup(c, key);
+}
+
+static bool
+rbtree_del(void *c, const void *key)
+{
+	return rbtree_remove(c, key, NULL);
+}
+
+static size_t
+rbtree_iterate(void *c)
+{
+	size_t n = 0;
+
+	rbtree_foreach(c, count_data, &n);
+	return n;
+}
+
+static void
+rbtree_destroy(void *c)
+{
+	rbtree_t *rbt = c;
+
+	rbtree_free_null(&rbt);
+}
+
+struct erbtree_item {
+	const void *key;
+	rbnode_t node;
+};
+
+static int
+erbtree_item_cmp(const void *a, const void *b)
+{
+	const struct erbtree_item *ia = a, *ib = b;
+
+	return memcmp(ia->key, ib->key, keylen);
+}
+
+static void
+erbtree_item_free(void *data)
+{
+	struct erbtree_item *item = data;
+
+	WFREE(item);
+}
+
+static void *
+erbtree_make(void)
+{
+	erbtree_t *t;
+
+	WALLOC(t);
+	erbtree_init(t, erbtree_item_cmp, offsetof(struct erbtree_item, node));
+	return t;
+}
+
+static void
+erbtree_add(void *c, const void *key)
+{
+	struct erbtree_item *item;
+
+	WALLOC(item);
+	item->key = key;
+	erbtree_insert(c, &item->node);
+}
+
+static const void *
+erbtree_get(void *c, const void *key)
+{
+	struct erbtree_item k, *item;
+
+	k.key = key;
+	item = erbtree_lookup(c, &k);
+	return NULL == item ? NULL : item->key;
+}
+
+static bool
+erbtree_del(void *c, const void *key)
+{
+	struct erbtree_item k, *item;
+
+	k.key = key;
+	item = erbtree_lookup(c, &k);
+	if (NULL == item)
+		return FALSE;
+
+	erbtree_remove(c, &item->node);
+	WFREE(item);
+	return TRUE;
+}
+
+static size_t
+erbtree_iterate(void *c)
+{
+	size_t n = 0;
+
+	erbtree_foreach(c, count_data, &n);
+	return n;
+}
+
+static void
+erbtree_destroy(void *c)
+{
+	erbtree_t *t = c;
+
+	erbtree_discard(t, erbtree_item_free);
+	WFREE(t);
+}
+
+static void *
+aging_create(void)
+{
+	return aging_make(DELAY, key_hash, key_eq, NULL);
+}
+
+static void
+aging_add(void *c, const void *key)
+{
+	aging_insert(c, key, deconstify_pointer(key));
+}
+
+static const void *
+aging_get(void *c, const void *key)
+{
+	return aging_lookup(c, key);
+}
+
+static bool
+aging_del(void *c, const void *key)
+{
+	return aging_remove(c, key);
+}
+
+static void
+aging_free(void *c)
+{
+	aging_table_t *ag = c;
+
+	aging_destroy(&ag);
+}
+
+static void *
+ripening_create(void)
+{
+	return ripening_make(key_hash, key_eq, NULL);
+}
+
+static void
+ripening_add(void *c, const void *key)
+{
+	ripening_insert(c, DELAY, key, deconstify_pointer(key));
+}
+
+static const void *
+ripening_get(void *c, const void *key)
+{
+	return ripening_lookup(c, key);
+}
+
+static bool
+ripening_del(void *c, const void *key)
+{
+	return ripening_remove(c, key);
+}
+
+static void
+ripening_free(void *c)
+{
+	ripening_table_t *rt = c;
+
+	ripening_destroy(&rt);
+}
+
+static void *
+sorted_make(void)
+{
+	return sorted_array_new(keylen, key_cmp);
+}
+
+static void
+sorted_add(void *c, const void *key)
+{
+	sorted_array_add(c, key);
+}
+
+static void
+sorted_sync(void *c)
+{
+	sorted_array_sync(c, NULL);
+}
+
+static const void *
+sorted_get(void *c, const void *key)
+{
+	return sorted_array_lookup(c, key);
+}
+
+static size_t
+sorted_iterate(void *c)
+{
+	size_t i, n = sorted_array_count(c);
+
+	for (i = 0; i < n; i++)
+		(void) sorted_array_item(c, i);
+
+	return n;
+}
+
+static void
+sorted_free(void *c)
+{
+	struct sorted_array *tab = c;
+
+	sorted_array_free(&tab);
+}
+
+/**
+ * Container operations.
+ *
+ * Optional operations are NULL, in which case the corresponding phases
+ * are skipped.
+ */
+static const struct container {
+	const char *name;
+	void *(*make)(void);
+	void (*insert)(void *c, const void *key);
+	void (*sync)(void *c);			/* Optional, ends insertion phase */
+	const void *(*lookup)(void *c, const void *key);
+	bool (*remove)(void *c, const void *key);
+	size_t (*iterate)(void *c);
+	void (*destroy)(void *c);
+} containers[] = {
+	{ "hset", hset_make, hset_add, NULL,
+		hset_get, hset_del, hset_iterate, hset_destroy },
+	{ "htable", htable_make, htable_add, NULL,
+		htable_get, htable_del, htable_iterate, htable_destroy },
+	{ "htable-groups", htable_make_groups, htable_add, NULL,
+		htable_get, htable_del, htable_iterate, htable_destroy },
+	{ "hashtable", hashtable_make, hashtable_add, NULL,
+		hashtable_get, hashtable_del, hashtable_iterate, hashtable_destroy },
+	{ "ohash", ohash_make, ohash_add, NULL,
+		ohash_get, ohash_del, ohash_iterate, ohash_destroy },
+	{ "hashlist", hashlist_make, hashlist_add, NULL,
+		hashlist_get, hashlist_del, hashlist_iterate, hashlist_destroy },
+	{ "map", map_make, map_add, NULL,
+		map_get, map_del, map_iterate, map_free },
+	{ "patricia", patricia_make, patricia_add, NULL,
+		patricia_get, patricia_del, patricia_iterate, patricia_free },
+	{ "rbtree", rbtree_make, rbtree_add, NULL,
+		rbtree_get, rbtree_del, rbtree_iterate, rbtree_destroy },
+	{ "erbtree", erbtree_make, erbtree_add, NULL,
+		erbtree_get, erbtree_del, erbtree_iterate, erbtree_destroy },
+	{ "aging", aging_create, aging_add, NULL,
+		aging_get, aging_del, NULL, aging_free },
+	{ "ripening", ripening_create, ripening_add, NULL,
+		ripening_get, ripening_del, NULL, ripening_free },
+	{ "sorted_array", sorted_make, sorted_add, sorted_sync,
+		sorted_get, NULL, sorted_iterate, sorted_free },
+};
+
+/*
+ * Benchmark phases.
+ */
+
+struct phase {
+	const char *name;
+	uint64 ops;				/* Amount of operations */
+	double elapsed;			/* Wall-clock time spent in phase */
+	uint32 *lat;			/* Sampled latencies, in nanoseconds */
+	size_t nlat;			/* Amount of samples */
+	size_t maxlat;			/* Size of lat[] */
+};
+
+/**
+ * Start new phase.
+ */
+static void
+phase_start(struct phase *ph, const char *name, size_t ops)
+{
+	ZERO(ph);
+	ph->name = name;
+	ph->maxlat = ops / sample + 1;
+	XMALLOC_ARRAY(ph->lat, ph->maxlat);
+}
+
+/**
+ * Record latency sample.
+ */
+static inline void
+phase_record(struct phase *ph, const tm_nano_t *t1, const tm_nano_t *t0)
+{
+	tm_nano_t e;
+
+	tm_precise_elapsed(&e, t1, t0);
+
+	if G_LIKELY(ph->nlat < ph->maxlat)
+		ph->lat[ph->nlat++] = MIN(tmn2ns(&e), MAX_INT_VAL(uint32));
+}
+
+/*
+ * Run operation, timing it if it is part of the sampled operations.
+ */
+#define TIMED(ph, i, op) G_STMT_START {					\
+	if G_UNLIKELY(0 == (i) % sample) {					\
+		tm_nano_t t0_, t1_;								\
+		tm_precise_time(&t0_);							\
+		op;												\
+		tm_precise_time(&t1_);							\
+		phase_record((ph), &t1_, &t0_);					\
+	} else {											\
+		op;												\
+	}													\
+} G_STMT_END
+
+static int
+lat_cmp(const void *a, const void *b)
+{
+	const uint32 *la = a, *lb = b;
+
+	return CMP(*la, *lb);
+}
+
+/**
+ * @return the p-th per-mille latency from sorted samples.
+ */
+static uint32
+phase_percentile(const struct phase *ph, unsigned p)
+{
+	size_t i;
+
+	if (0 == ph->nlat)
+		return 0;
+
+	i = (ph->nlat * p) / 1000;
+	return ph->lat[MIN(i, ph->nlat - 1)];
+}
+
+/**
+ * Report phase results and release its resources.
+ */
+static void
+phase_end(struct phase *ph, const char *container)
+{
+	vsort(ph->lat, ph->nlat, sizeof ph->lat[0], lat_cmp);
+
+	printf("%-13s %-8s %12.0f %8u %8u %8u %8u %8u\n",
+		container, ph->name,
+		0 == ph->elapsed ? 0.0 : ph->ops / ph->elapsed,
+		phase_percentile(ph, 500), phase_percentile(ph, 900),
+		phase_percentile(ph, 990), phase_percentile(ph, 999),
+		0 == ph->nlat ? 0 : ph->lat[ph->nlat - 1]);
+
+	XFREE_NULL(ph->lat);
+}
+
+/**
+ * Key generation.
+ *
+ * The first 4 bytes of each key are a bijection of the key index, which
+ * guarantees that all the keys are distinct, the remaining bytes are random.
+ * For host addresses, this yields distinct IPv4 addresses with random ports.
+ *
+ * @return the key arena.
+ */
+static uint8 *
+keys_make(size_t count)
+{
+	uint8 *keys, *p;
+	size_t i, j;
+
+	keys = xmalloc(count * keylen);
+
+	for (i = 0, p = keys; i < count; i++, p += keylen) {
+		uint32 v = (uint32) i * 0x9e3779b1U;	/* Odd, hence bijective */
+
+		poke_be32(p, v);
+		for (j = 4; j < keylen; j++)
+			p[j] = bench_rand() >> 24;
+	}
+
+	return keys;
+}
+
+#define KEY(i)		(&keys[(i) * keylen])
+
+/**
+ * Run the benchmark on a container.
+ *
+ * @param ct		the container to benchmark
+ * @param n			amount of items in the container
+ * @param ops		amount of churning operations
+ * @param passes	amount of iteration passes
+ */
+static void
+bench_run(const struct container *ct, size_t n, size_t ops, size_t passes)
+{
+	struct phase ph;
+	uint8 *keys;
+	size_t *live;
+	size_t i, next, before, after;
+	tm_nano_t start, end;
+	void *c;
+
+	/*
+	 * Keys [0, n) are initially inserted, keys [n, 2n) are never inserted
+	 * and are used for missed lookups, and keys [2n, 2n + ops) are inserted
+	 * during churning.
+	 */
+
+	bench_seed = initial_seed;		/* Same keys for all the containers */
+	keys = keys_make(2 * n + ops);
+	XMALLOC_ARRAY(live, n);
+
+	before = vmm_memory_allocated();
+	c = (*ct->make)();
+
+	/*
+	 * Insertions.
+	 */
+
+	phase_start(&ph, "insert", n);
+	tm_precise_time(&start);
+	for (i = 0; i < n; i++) {
+		TIMED(&ph, i, (*ct->insert)(c, KEY(i)));
+		live[i] = i;
+	}
+	if (ct->sync != NULL)
+		(*ct->sync)(c);
+	tm_precise_time(&end);
+	ph.ops = n;
+	ph.elapsed = tm_precise_elapsed_f(&end, &start);
+	phase_end(&ph, ct->name);
+
+	after = vmm_memory_allocated();
+
+	/*
+	 * Successful lookups, in random order.
+	 */
+
+	phase_start(&ph, "hit", n);
+	tm_precise_time(&start);
+	for (i = 0; i < n; i++) {
+		const void *key = KEY(live[bench_rand() % n]);
+		const void *v;
+
+		TIMED(&ph, i, v = (*ct->lookup)(c, key));
+		if G_UNLIKELY(NULL == v || !key_eq(v, key))
+			s_error("%s: lookup #%zu failed", ct->name, i);
+	}
+	tm_precise_time(&end);
+	ph.ops = n;
+	ph.elapsed = tm_precise_elapsed_f(&end, &start);
+	phase_end(&ph, ct->name);
+
+	/*
+	 * Failed lookups.
+	 */
+
+	phase_start(&ph, "miss", n);
+	tm_precise_time(&start);
+	for (i = 0; i < n; i++) {
+		const void *key = KEY(n + i);
+		const void *v;
+
+		TIMED(&ph, i, v = (*ct->lookup)(c, key));
+		if G_UNLIKELY(v != NULL)
+			s_error("%s: missed lookup #%zu found something", ct->name, i);
+	}
+	tm_precise_time(&end);
+	ph.ops = n;
+	ph.elapsed = tm_precise_elapsed_f(&end, &start);
+	phase_end(&ph, ct->name);
+
+	/*
+	 * Iterations, where the latency is the per-item cost of each pass.
+	 */
+
+	if (ct->iterate != NULL) {
+		phase_start(&ph, "iterate", passes * sample);
+		tm_precise_time(&start);
+		for (i = 0; i < passes; i++) {
+			tm_nano_t t0, t1, e;
+			size_t count;
+
+			tm_precise_time(&t0);
+			count = (*ct->iterate)(c);
+			tm_precise_time(&t1);
+
+			if G_UNLIKELY(count != n)
+				s_error("%s: iterated over %zu items, expected %zu",
+					ct->name, count, n);
+
+			tm_precise_elapsed(&e, &t1, &t0);
+			ph.lat[ph.nlat++] = 0 == n ? 0 : tmn2ns(&e) / n;
+		}
+		tm_precise_time(&end);
+		ph.ops = passes * n;
+		ph.elapsed = tm_precise_elapsed_f(&end, &start);
+		phase_end(&ph, ct->name);
+	}
+
+	if (NULL == ct->remove)
+		goto done;
+
+	/*
+	 * Churning: each operation removes a random item and inserts a new one.
+	 */
+
+	phase_start(&ph, "churn", ops);
+	tm_precise_time(&start);
+	for (i = 0, next = 2 * n; i < ops; i++, next++) {
+		size_t j = bench_rand() % n;
+		bool ok;
+
+		TIMED(&ph, i,
+			ok = (*ct->remove)(c, KEY(live[j]));
+			(*ct->insert)(c, KEY(next)));
+
+		if G_UNLIKELY(!ok)
+			s_error("%s: churn removal #%zu failed", ct->name, i);
+
+		live[j] = next;
+	}
+	tm_precise_time(&end);
+	ph.ops = ops;
+	ph.elapsed = tm_precise_elapsed_f(&end, &start);
+	phase_end(&ph, ct->name);
+
+	/*
+	 * Removal of all the items.
+	 */
+
+	phase_start(&ph, "remove", n);
+	tm_precise_time(&start);
+	for (i = 0; i < n; i++) {
+		bool ok;
+
+		TIMED(&ph, i, ok = (*ct->remove)(c, KEY(live[i])));
+		if G_UNLIKELY(!ok)
+			s_error("%s: removal #%zu failed", ct->name, i);
+	}
+	tm_precise_time(&end);
+	ph.ops = n;
+	ph.elapsed = tm_precise_elapsed_f(&end, &start);
+	phase_end(&ph, ct->name);
+
+	if (ct->iterate != NULL && 0 != (*ct->iterate)(c))
+		s_error("%s: container not empty after removals", ct->name);
+
+done:
+	printf("%-13s %-8s %12.1f bytes/entry\n", ct->name, "memory",
+		0 == n ? 0.0 : (double) (after - before) / n);
+
+	if (verbose) {
+		s_info("%s: %zu bytes allocated for %zu items",
+			ct->name, after - before, n);
+	}
+
+	(*ct->destroy)(c);
+	xfree(live);
+	xfree(keys);
+}
+
+/**
+ * Run the benchmark on a container from a child process.
+ */
+static void
+bench_fork(const struct container *ct, size_t n, size_t ops, size_t passes)
+{
+#if defined(HAS_FORK) && defined(HAS_WAITPID)
+	pid_t pid;
+	int status;
+
+	fflush(stdout);
+	pid = fork();
+
+	switch (pid) {
+	case -1:
+		s_warning("fork() failed: %m");
+		break;
+	case 0:
+		bench_run(ct, n, ops, passes);
+		fflush(stdout);
+		_exit(EXIT_SUCCESS);
+	default:
+		if (-1 == waitpid(pid, &status, 0))
+			s_error("waitpid() failed: %m");
+		if (!WIFEXITED(status) || 0 != WEXITSTATUS(status))
+			s_error("%s: benchmark failed", ct->name);
+		return;
+	}
+#endif	/* HAS_FORK && HAS_WAITPID */
+
+	bench_run(ct, n, ops, passes);
+}
+
+int
+main(int argc, char **argv)
+{
+	extern int optind;
+	extern char *optarg;
+	int c;
+	size_t n = 100000, ops = 1000000, passes = 4, i;
+	const char *list = NULL, *type = "guid";
+
+	progstart(argc, argv);
+
+	while ((c = getopt(argc, argv, "c:hk:n:o:p:s:vLR:")) != EOF) {
+		switch (c) {
+		case 'c':
+			list = optarg;
+			break;
+		case 'k':
+			type = optarg;
+			break;
+		case 'n':
+			n = atol(optarg);
+			break;
+		case 'o':
+			ops = atol(optarg);
+			break;
+		case 'p':
+			passes = atol(optarg);
+			break;
+		case 's':
+			sample = atol(optarg);
+			break;
+		case 'v':
+			verbose = TRUE;
+			break;
+		case 'L':
+			for (i = 0; i < N_ITEMS(containers); i++)
+				printf("%s\n", containers[i].name);
+			exit(EXIT_SUCCESS);
+		case 'R':
+			initial_seed = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			usage();
+		}
+	}
+
+	if (0 != (argc -= optind) || 0 == n || 0 == sample)
+		usage();
+
+	for (i = 0; i < N_ITEMS(keytypes); i++) {
+		if (0 == strcmp(type, keytypes[i].name))
+			keylen = keytypes[i].len;
+	}
+
+	if (0 == keylen)
+		usage();
+
+	if (0 == initial_seed)
+		initial_seed = tm_time_exact();
+
+	s_info("use '-R %u' to reproduce a failure", initial_seed);
+	s_info("%zu %s keys, %zu churning operations, 1 in %zu timed",
+		n, type, ops, sample);
+
+	printf("%-13s %-8s %12s %8s %8s %8s %8s %8s\n",
+		"container", "phase", "ops/s",
+		"p50 ns", "p90 ns", "p99 ns", "p99.9 ns", "max ns");
+
+	for (i = 0; i < N_ITEMS(containers); i++) {
+		const struct container *ct = &containers[i];
+
+		if (list != NULL) {
+			const char *p = strstr(list, ct->name);
+			size_t len = strlen(ct->name);
+
+			/* Must match a whole item in the comma-separated list */
+
+			while (
+				p != NULL &&
+				!(
+					(p == list || ',' == p[-1]) &&
+					('\0' == p[len] || ',' == p[len])
+				)
+			)
+				p = strstr(p + 1, ct->name);
+
+			if (NULL == p)
+				continue;
+		}
+
+		bench_fork(ct, n, ops, passes);
+	}
+
+	return 0;
+}
+
+/* vi: set ts=4 sw=4 cindent: */
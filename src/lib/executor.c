@@ -0,0 +1,710 @@
+/*
+ * Copyright (c) 2026 agent
+ *
+ *----------------------------------------------------------------------
+ * This file is part of gtk-gnutella.
+ *
+ *  gtk-gnutella is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gtk-gnutella is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with gtk-gnutella; if not, write to the Free Software
+ *  Foundation, Inc.:
+ *      59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *----------------------------------------------------------------------
+ */
+
+/**
+ * @ingroup lib
+ * @file
+ *
+ * Process-wide task executor.
+ *
+ * Instead of creating a dedicated thread for each kind of background work,
+ * subsystems can submit jobs to this executor, which runs them from a set
+ * of worker threads shared by the whole process.  A subsystem with a lot of
+ * pending work can therefore use all the idle workers, and the amount of
+ * threads remains bounded regardless of the amount of subsystems.
+ *
+ * Each worker has its own deque of jobs for each job class.  Jobs submitted
+ * from a worker are queued in that worker's deques, others are spread among
+ * the workers in a round-robin fashion.  A worker processes its own jobs
+ * most-recent first, and when it has nothing left to do it steals the oldest
+ * jobs from the other workers.  Classes are strictly ordered: no bulk job is
+ * started whilst an interactive job is waiting somewhere.
+ *
+ * Once a job has run, its completion callback is delivered to the thread
+ * which submitted it, through its thread event queue (TEQ), or directly from
+ * the worker when that thread has no TEQ.  Jobs can be cancelled: queued
+ * jobs are dropped, their completion callback being told so, and running
+ * jobs can poll executor_is_cancelled() to stop early.
+ *
+ * Workers are created on demand, up to the amount of CPUs, within limits.
+ *
+ * @author agent
+ * @date 2026
+ */
+
+#include "common.h"
+
+#include "executor.h"
+
+#include "atomic.h"
+#include "cond.h"
+#include "dump_options.h"
+#include "elist.h"
+#include "getcpucount.h"
+#include "log.h"
+#include "mutex.h"
+#include "spinlock.h"
+#include "stringify.h"
+#include "teq.h"
+#include "thread.h"
+#include "tm.h"
+#include "walloc.h"
+
+#include "override.h"			/* Must be the last header included */
+
+#define EXECUTOR_WORKERS_MIN	2	/**< Minimum amount of workers */
+#define EXECUTOR_WORKERS_MAX	8	/**< Maximum amount of workers */
+
+enum executor_job_magic { EXECUTOR_JOB_MAGIC = 0x5be2c40d };
+
+/**
+ * A deque of jobs.
+ */
+struct executor_deque {
+	spinlock_t lock;			/**< Thread-safe lock */
+	elist_t jobs;				/**< Queued jobs, oldest first */
+};
+
+/**
+ * A submitted job.
+ */
+struct executor_job {
+	enum executor_job_magic magic;
+	link_t lk;					/**< Embedded link in the deque */
+	struct executor_deque *dq;	/**< Deque where job was queued */
+	executor_run_t run;			/**< Processing routine */
+	executor_done_t done;		/**< Completion callback (optional) */
+	void *arg;					/**< Callback argument */
+	enum executor_class cls;	/**< Job class */
+	uint owner;					/**< Thread which submitted the job */
+	bool running;				/**< Set when dequeued, under deque lock */
+	bool cancelled;				/**< Set when cancelled whilst running */
+	bool skipped;				/**< Cancelled before running */
+};
+
+static inline void
+executor_job_check(const struct executor_job * const j)
+{
+	g_assert(j != NULL);
+	g_assert(EXECUTOR_JOB_MAGIC == j->magic);
+}
+
+/**
+ * A worker thread.
+ */
+struct executor_worker {
+	struct executor_deque dq[EXECUTOR_CLASSES];	/**< Job deques */
+	const executor_job_t *current;	/**< Job being run */
+	uint index;						/**< Index in executor_workers[] */
+	int tid;						/**< Thread ID, -1 if not launched */
+	uint64 ran;						/**< Amount of jobs run */
+	uint64 stolen;					/**< Jobs stolen from other workers */
+};
+
+/**
+ * Statistics for each job class.
+ */
+struct executor_stats {
+	uint64 submitted;			/**< Jobs submitted */
+	uint64 completed;			/**< Jobs run */
+	uint64 cancelled;			/**< Jobs cancelled before running */
+	uint64 runtime;				/**< Total running time, in us */
+};
+
+static mutex_t executor_lock = MUTEX_INIT;	/**< Protects executor_vars */
+static cond_t executor_work = COND_INIT;	/**< Signalled when jobs queued */
+
+/**
+ * The executor state, protected by ``executor_lock''.
+ */
+static struct executor_vars {
+	struct executor_stats stats[EXECUTOR_CLASSES];
+	size_t pending;				/**< Jobs queued, not claimed by workers */
+	uint workers;				/**< Maximum amount of workers */
+	uint threads;				/**< Amount of workers launched */
+	uint idle;					/**< Amount of workers waiting */
+	uint next;					/**< Next worker for foreign submissions */
+	time_t started;				/**< Initialization time */
+	bool initialized;			/**< Whether executor was initialized */
+	bool exiting;				/**< Whether workers should exit */
+	bool closed;				/**< Whether executor_close() was called */
+} executor_vars;
+
+static struct executor_worker executor_workers[EXECUTOR_WORKERS_MAX];
+
+/**
+ * Workers, indexed by thread small ID.
+ */
+static struct executor_worker *executor_by_stid[THREAD_MAX];
+
+#define EXECUTOR_LOCK		mutex_lock(&executor_lock)
+#define EXECUTOR_UNLOCK		mutex_unlock(&executor_lock)
+
+/**
+ * @return name of the job class.
+ */
+const char *
+executor_class_name(enum executor_class cls)
+{
+	switch (cls) {
+	case EXECUTOR_INTERACTIVE:	return "interactive";
+	case EXECUTOR_BULK_IO:		return "bulk_io";
+	case EXECUTOR_BULK_CPU:		return "bulk_cpu";
+	case EXECUTOR_CLASSES:		break;
+	}
+
+	return "unknown";
+}
+
+/**
+ * Initialize the executor, if not already done.
+ *
+ * @attention
+ * Must be called with the executor locked.
+ */
+static void
+executor_init_locked(void)
+{
+	struct executor_vars *v = &executor_vars;
+	long cpus;
+	uint i, j;
+
+	if G_LIKELY(v->initialized)
+		return;
+
+	cpus = getcpucount();
+	v->workers = CLAMP(cpus, EXECUTOR_WORKERS_MIN, EXECUTOR_WORKERS_MAX);
+	v->started = tm_time();
+
+	for (i = 0; i < N_ITEMS(executor_workers); i++) {
+		struct executor_worker *w = &executor_workers[i];
+
+		w->index = i;
+		w->tid = -1;
+
+		for (j = 0; j < N_ITEMS(w->dq); j++) {
+			spinlock_init(&w->dq[j].lock);
+			elist_init(&w->dq[j].jobs, offsetof(struct executor_job, lk));
+		}
+	}
+
+	v->initialized = TRUE;
+}
+
+/**
+ * Free job.
+ */
+static void
+executor_job_free(executor_job_t *j)
+{
+	executor_job_check(j);
+
+	j->magic = 0;
+	WFREE(j);
+}
+
+/**
+ * Deliver job completion, from the thread which submitted the job.
+ */
+static void
+executor_deliver(void *p)
+{
+	executor_job_t *j = p;
+
+	executor_job_check(j);
+
+	(*j->done)(j->arg, j->skipped);
+	executor_job_free(j);
+}
+
+/**
+ * Job is finished, arrange for its completion callback to be delivered.
+ *
+ * @param j			the job
+ * @param skipped	whether job was cancelled before running
+ */
+static void
+executor_job_done(executor_job_t *j, bool skipped)
+{
+	executor_job_check(j);
+
+	if (NULL == j->done) {
+		executor_job_free(j);
+		return;
+	}
+
+	j->skipped = skipped;
+
+	if (!teq_is_supported(j->owner))
+		executor_deliver(j);
+	else if (THREAD_MAIN_ID == j->owner)
+		teq_safe_post(j->owner, executor_deliver, j);
+	else
+		teq_post(j->owner, executor_deliver, j);
+}
+
+/**
+ * Remove a job from the deque.
+ *
+ * @param dq		the deque
+ * @param newest	whether to take the newest job, otherwise the oldest
+ *
+ * @return the job, marked as running, NULL if deque was empty.
+ */
+static executor_job_t *
+executor_deque_take(struct executor_deque *dq, bool newest)
+{
+	executor_job_t *j;
+
+	spinlock(&dq->lock);
+
+	j = newest ? elist_tail(&dq->jobs) : elist_head(&dq->jobs);
+
+	if (j != NULL) {
+		elist_remove(&dq->jobs, j);
+		j->running = TRUE;
+	}
+
+	spinunlock(&dq->lock);
+
+	return j;
+}
+
+/**
+ * @return amount of jobs queued in the deque.
+ */
+static size_t
+executor_deque_count(struct executor_deque *dq)
+{
+	size_t n;
+
+	spinlock(&dq->lock);
+	n = elist_count(&dq->jobs);
+	spinunlock(&dq->lock);
+
+	return n;
+}
+
+/**
+ * Find next job to run for a worker, looking first at its own deque then
+ * at the other workers' ones, one job class at a time.
+ *
+ * @return the job to run, NULL if none was found.
+ */
+static executor_job_t *
+executor_next_job(struct executor_worker *w)
+{
+	uint workers = executor_vars.workers;
+	uint c, i;
+
+	for (c = 0; c < EXECUTOR_CLASSES; c++) {
+		executor_job_t *j;
+
+		j = executor_deque_take(&w->dq[c], TRUE);
+		if (j != NULL)
+			return j;
+
+		for (i = 1; i < workers; i++) {
+			struct executor_worker *o = &executor_workers[(w->index + i) % workers];
+
+			j = executor_deque_take(&o->dq[c], FALSE);
+			if (j != NULL) {
+				w->stolen++;
+				return j;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Worker thread main loop.
+ */
+static void *
+executor_worker_main(void *p)
+{
+	struct executor_worker *w = p;
+	struct executor_vars *v = &executor_vars;
+
+	thread_set_name("executor");
+
+	executor_by_stid[thread_small_id()] = w;
+
+	EXECUTOR_LOCK;
+
+	for (;;) {
+		executor_job_t *j;
+		tm_nano_t start, end;
+		struct executor_stats *s;
+
+		while (!v->exiting && 0 == v->pending) {
+			v->idle++;
+			cond_wait(&executor_work, &executor_lock);
+			v->idle--;
+		}
+
+		if (v->exiting)
+			break;
+
+		v->pending--;
+		EXECUTOR_UNLOCK;
+
+		/*
+		 * The job we were woken up for may have been cancelled since,
+		 * in which case we'll find nothing to do.
+		 */
+
+		j = executor_next_job(w);
+
+		if (j != NULL) {
+			w->current = j;
+			tm_precise_time(&start);
+			(*j->run)(j->arg);
+			tm_precise_time(&end);
+			w->current = NULL;
+
+			EXECUTOR_LOCK;
+			s = &v->stats[j->cls];
+			s->completed++;
+			s->runtime += tm_precise_elapsed_f(&end, &start) * 1e6;
+			w->ran++;
+			EXECUTOR_UNLOCK;
+
+			executor_job_done(j, FALSE);
+		}
+
+		EXECUTOR_LOCK;
+	}
+
+	EXECUTOR_UNLOCK;
+
+	executor_by_stid[thread_small_id()] = NULL;
+
+	return NULL;
+}
+
+/**
+ * Launch a new worker if none is idle, provided we have not reached
+ * the maximum amount of workers.
+ *
+ * @attention
+ * Must be called with the executor locked.
+ */
+static void
+executor_launch_locked(void)
+{
+	struct executor_vars *v = &executor_vars;
+	struct executor_worker *w;
+
+	if (v->idle != 0 || v->threads >= v->workers)
+		return;
+
+	w = &executor_workers[v->threads];
+	w->tid = thread_create(executor_worker_main, w,
+				THREAD_F_NO_CANCEL | THREAD_F_NO_POOL | THREAD_F_WARN,
+				THREAD_STACK_DFLT);
+
+	if (-1 != w->tid)
+		v->threads++;
+}
+
+/**
+ * Submit a job to the executor.
+ *
+ * The completion callback, if any, is invoked from the calling thread
+ * through its TEQ if it has one, from the worker otherwise.  Exactly one
+ * completion is delivered for each job, even when it is cancelled.
+ *
+ * @param cls		the job class
+ * @param run		routine to run from a worker thread
+ * @param done		completion callback (may be NULL)
+ * @param arg		argument passed to both routines
+ *
+ * @return job handle, which remains valid until completion is delivered, or
+ * NULL if the executor has been closed already.  When there is no completion
+ * callback, the handle must not be used.
+ */
+executor_job_t *
+executor_submit(enum executor_class cls,
+	executor_run_t run, executor_done_t done, void *arg)
+{
+	struct executor_vars *v = &executor_vars;
+	struct executor_worker *w;
+	struct executor_deque *dq;
+	executor_job_t *j;
+	uint stid = thread_small_id();
+
+	g_assert(UNSIGNED(cls) < EXECUTOR_CLASSES);
+	g_assert(run != NULL);
+
+	WALLOC0(j);
+	j->magic = EXECUTOR_JOB_MAGIC;
+	j->run = run;
+	j->done = done;
+	j->arg = arg;
+	j->cls = cls;
+	j->owner = stid;
+
+	EXECUTOR_LOCK;
+
+	if G_UNLIKELY(v->closed) {
+		EXECUTOR_UNLOCK;
+		executor_job_free(j);
+		return NULL;
+	}
+
+	executor_init_locked();
+
+	/*
+	 * Jobs submitted by a worker go to its own deque, for locality.
+	 */
+
+	w = stid < N_ITEMS(executor_by_stid) ? executor_by_stid[stid] : NULL;
+	if (NULL == w)
+		w = &executor_workers[v->next++ % v->workers];
+
+	dq = &w->dq[cls];
+	j->dq = dq;
+
+	spinlock(&dq->lock);
+	elist_append(&dq->jobs, j);
+	spinunlock(&dq->lock);
+
+	v->pending++;
+	v->stats[cls].submitted++;
+
+	if (v->idle != 0)
+		cond_signal(&executor_work, &executor_lock);
+	else
+		executor_launch_locked();
+
+	EXECUTOR_UNLOCK;
+
+	return j;
+}
+
+/**
+ * Cancel a job.
+ *
+ * When the job is still queued, it is removed and its completion callback
+ * will be told it was skipped.  When it is already running, it is flagged
+ * so that executor_is_cancelled() returns TRUE from the worker.
+ *
+ * @return TRUE if job was removed before it could run.
+ */
+bool
+executor_cancel(executor_job_t *j)
+{
+	struct executor_deque *dq;
+	bool removed = FALSE;
+
+	executor_job_check(j);
+
+	dq = j->dq;
+	spinlock(&dq->lock);
+
+	if (j->running) {
+		atomic_bool_set(&j->cancelled, TRUE);
+	} else {
+		elist_remove(&dq->jobs, j);
+		removed = TRUE;
+	}
+
+	spinunlock(&dq->lock);
+
+	if (removed) {
+		EXECUTOR_LOCK;
+		executor_vars.stats[j->cls].cancelled++;
+		EXECUTOR_UNLOCK;
+
+		executor_job_done(j, TRUE);
+	}
+
+	return removed;
+}
+
+/**
+ * Check whether the job being run by the current worker should stop.
+ *
+ * This is the case when the job was cancelled or when the executor is being
+ * shutdown.  Long-running jobs should periodically call this routine.
+ *
+ * @return TRUE if the job should stop, FALSE if it can continue or if we
+ * are not called from a worker.
+ */
+bool
+executor_is_cancelled(void)
+{
+	uint stid = thread_small_id();
+	const struct executor_worker *w;
+
+	w = stid < N_ITEMS(executor_by_stid) ? executor_by_stid[stid] : NULL;
+
+	if (NULL == w || NULL == w->current)
+		return FALSE;
+
+	return atomic_bool_get(&w->current->cancelled) ||
+		atomic_bool_get(&executor_vars.exiting);
+}
+
+/**
+ * Dump executor statistics to specified logagent.
+ */
+void
+executor_dump_stats_log(logagent_t *la, unsigned options)
+{
+	struct executor_vars *v = &executor_vars;
+	struct executor_stats stats[EXECUTOR_CLASSES];
+	bool groupped = booleanize(options & DUMP_OPT_PRETTY);
+	uint workers, threads, idle, c, i;
+	time_delta_t life;
+
+	EXECUTOR_LOCK;
+
+	if (!v->initialized) {
+		EXECUTOR_UNLOCK;
+		log_info(la, "EXECUTOR workers = 0");
+		return;
+	}
+
+	STATIC_ASSERT(sizeof stats == sizeof v->stats);
+
+	memcpy(stats, v->stats, sizeof stats);
+	workers = v->workers;
+	threads = v->threads;
+	idle = v->idle;
+	life = delta_time(tm_time(), v->started);
+
+	EXECUTOR_UNLOCK;
+
+	life = MAX(life, 1);
+
+	log_info(la, "EXECUTOR workers = %u", threads);
+	log_info(la, "EXECUTOR workers_max = %u", workers);
+	log_info(la, "EXECUTOR workers_idle = %u", idle);
+
+	for (c = 0; c < EXECUTOR_CLASSES; c++) {
+		const struct executor_stats *s = &stats[c];
+		const char *name = executor_class_name(c);
+		size_t queued = 0;
+
+		for (i = 0; i < workers; i++)
+			queued += executor_deque_count(&executor_workers[i].dq[c]);
+
+		log_info(la, "EXECUTOR %s_queued = %s", name,
+			size_t_to_string_grp(queued, groupped));
+		log_info(la, "EXECUTOR %s_submitted = %s", name,
+			uint64_to_string_grp(s->submitted, groupped));
+		log_info(la, "EXECUTOR %s_completed = %s", name,
+			uint64_to_string_grp(s->completed, groupped));
+		log_info(la, "EXECUTOR %s_cancelled = %s", name,
+			uint64_to_string_grp(s->cancelled, groupped));
+		log_info(la, "EXECUTOR %s_per_minute = %s", name,
+			uint64_to_string_grp(s->completed * 60 / life, groupped));
+		log_info(la, "EXECUTOR %s_avg_runtime_us = %s", name,
+			uint64_to_string_grp(
+				0 == s->completed ? 0 : s->runtime / s->completed, groupped));
+	}
+
+	for (i = 0; i < threads; i++) {
+		struct executor_worker *w = &executor_workers[i];
+
+		log_info(la, "EXECUTOR worker_%u = thread #%d, queued %zu/%zu/%zu, "
+			"ran %s", i, w->tid,
+			executor_deque_count(&w->dq[EXECUTOR_INTERACTIVE]),
+			executor_deque_count(&w->dq[EXECUTOR_BULK_IO]),
+			executor_deque_count(&w->dq[EXECUTOR_BULK_CPU]),
+			uint64_to_string_grp(w->ran, groupped));
+		log_info(la, "EXECUTOR worker_%u_stolen = %s", i,
+			uint64_to_string_grp(w->stolen, groupped));
+	}
+}
+
+/**
+ * Initiate executor shutdown, without waiting.
+ *
+ * No job can be submitted afterwards, running jobs are flagged as cancelled
+ * and idle workers are told to exit.  This can be called from a thread that
+ * is not allowed to block.
+ */
+void G_COLD
+executor_shutdown(void)
+{
+	struct executor_vars *v = &executor_vars;
+
+	EXECUTOR_LOCK;
+	v->closed = TRUE;
+	if (v->initialized) {
+		atomic_bool_set(&v->exiting, TRUE);
+		cond_broadcast(&executor_work, &executor_lock);
+	}
+	EXECUTOR_UNLOCK;
+}
+
+/**
+ * Shutdown the executor.
+ *
+ * Running jobs are flagged as cancelled and waited for, then all the
+ * queued jobs are discarded, their completion callback being invoked
+ * from the calling thread.  No job can be submitted afterwards.
+ *
+ * @attention
+ * This blocks until all the workers have exited.
+ */
+void G_COLD
+executor_close(void)
+{
+	struct executor_vars *v = &executor_vars;
+	uint i, c;
+
+	executor_shutdown();
+
+	if (!v->initialized)
+		return;
+
+	for (i = 0; i < v->threads; i++) {
+		struct executor_worker *w = &executor_workers[i];
+
+		if (-1 == thread_join(w->tid, NULL)) {
+			s_warning("%s(): cannot join with thread #%d: %m",
+				G_STRFUNC, w->tid);
+		}
+	}
+
+	for (i = 0; i < N_ITEMS(executor_workers); i++) {
+		struct executor_worker *w = &executor_workers[i];
+
+		for (c = 0; c < EXECUTOR_CLASSES; c++) {
+			executor_job_t *j;
+
+			while (NULL != (j = executor_deque_take(&w->dq[c], FALSE))) {
+				if (j->done != NULL)
+					(*j->done)(j->arg, TRUE);
+				executor_job_free(j);
+			}
+		}
+	}
+}
+
+/* vi: set ts=4 sw=4 cindent: */
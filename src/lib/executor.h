@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2026 agent
+ *
+ *----------------------------------------------------------------------
+ * This file is part of gtk-gnutella.
+ *
+ *  gtk-gnutella is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gtk-gnutella is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with gtk-gnutella; if not, write to the Free Software
+ *  Foundation, Inc.:
+ *      59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *----------------------------------------------------------------------
+ */
+
+/**
+ * @ingroup lib
+ * @file
+ *
+ * Process-wide task executor.
+ *
+ * @author agent
+ * @date 2026
+ */
+
+#ifndef _executor_h_
+#define _executor_h_
+
+/**
+ * Job classes, by decreasing priority.
+ */
+enum executor_class {
+	EXECUTOR_INTERACTIVE = 0,	/**< Short jobs, someone is waiting */
+	EXECUTOR_BULK_IO,			/**< Long jobs, mostly waiting for I/O */
+	EXECUTOR_BULK_CPU,			/**< Long CPU-bound jobs */
+
+	EXECUTOR_CLASSES
+};
+
+typedef struct executor_job executor_job_t;
+
+/**
+ * Job processing routine, run from one of the executor threads.
+ */
+typedef void (*executor_run_t)(void *arg);
+
+/**
+ * Job completion callback, run from the thread which submitted the job.
+ *
+ * @param arg		the job argument
+ * @param skipped	TRUE if the job was cancelled before it could run
+ */
+typedef void (*executor_done_t)(void *arg, bool skipped);
+
+/*
+ * Public interface.
+ */
+
+executor_job_t *executor_submit(enum executor_class cls,
+	executor_run_t run, executor_done_t done, void *arg);
+bool executor_cancel(executor_job_t *job);
+bool executor_is_cancelled(void);
+void executor_shutdown(void);
+void executor_close(void);
+
+const char *executor_class_name(enum executor_class cls);
+
+struct logagent;
+
+void executor_dump_stats_log(struct logagent *la, unsigned options);
+
+#endif /* _executor_h_ */
+
+/* vi: set ts=4 sw=4 cindent: */
@@ -0,0 +1,278 @@
+/*
+ * hash-test -- benchmark of hash table probing schemes under churn.
+ *
+ * Copyright (c) 2026 agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the authors nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Hash tables holding routing entries, connections or downloads see a
+ * constant churn of insertions and deletions.  This program runs the same
+ * random sequence of operations on a table using the default double-hashing
+ * probes and on a table probing by groups of control bytes, measuring the
+ * time spent in each kind of operation.
+ *
+ * Every result is checked against a reference presence array, and the
+ * tables are finally emptied through an iteration to exercise removals
+ * while iterating.
+ */
+
+#include "common.h"
+
+#include "htable.h"
+#include "log.h"
+#include "progname.h"
+#include "stringify.h"
+#include "tm.h"
+#include "xmalloc.h"
+
+#define BATCH		1024		/* Operations timed at once */
+
+static unsigned initial_seed;
+static bool verbose;
+static uint32 bench_seed;
+
+/*
+ * Keys are made to look like pointers to allocated objects, which is the
+ * most common usage of our hash tables.
+ */
+#define KEY(i)		ulong_to_pointer(((ulong) (i) + 1) * 16)
+#define KEY_IDX(k)	(pointer_to_ulong(k) / 16 - 1)
+
+static void G_NORETURN
+usage(void)
+{
+	fprintf(stderr,
+		"Usage: %s [-hv] [-l lookups] [-n items] [-o operations] [-R seed]\n"
+		"  -h : prints this help message\n"
+		"  -l : amount of lookups per churning operation (default 4)\n"
+		"  -n : average amount of items in the table (default 100000)\n"
+		"  -o : amount of churning operations (default 2000000)\n"
+		"  -v : verbose mode\n"
+		"  -R : seed for repeatable random sequence\n"
+		, getprogname());
+	exit(EXIT_FAILURE);
+}
+
+/**
+ * @return random number between 0 and n - 1.
+ *
+ * We use our own xorshift generator so that the sequence cannot be perturbed
+ * by other random number consumers, making all the runs see the very same
+ * operations.
+ */
+static inline size_t
+bench_rand(size_t n)
+{
+	bench_seed ^= bench_seed << 13;
+	bench_seed ^= bench_seed >> 17;
+	bench_seed ^= bench_seed << 5;
+
+	return bench_seed % n;
+}
+
+struct bench {
+	double churn;				/* CPU time for insertions and deletions */
+	double lookup;				/* CPU time for lookups */
+	uint64 inserts;
+	uint64 deletes;
+	uint64 lookups;
+};
+
+/**
+ * Iteration callback removing all the keys, checking them.
+ */
+static bool
+bench_remove(const void *key, void *value, void *data)
+{
+	uint8 *present = data;
+	ulong i = KEY_IDX(key);
+
+	if (!present[i] || value != key)
+		s_error("iteration found bad key #%lu", i);
+
+	present[i] = FALSE;
+	return TRUE;
+}
+
+/**
+ * Run the benchmark on a table.
+ *
+ * @param b			where results are collected
+ * @param groups	whether to probe by groups
+ * @param n			average amount of items in the table
+ * @param ops		amount of insertions or deletions
+ * @param lookups	amount of lookups per insertion or deletion
+ */
+static void
+bench_run(struct bench *b, bool groups, size_t n, size_t ops, size_t lookups)
+{
+	htable_t *ht;
+	uint8 *present;
+	size_t i, j, count = 0, universe = 2 * n;
+	double start;
+
+	ZERO(b);
+
+	ht = htable_create(HASH_KEY_SELF, 0);
+	if (groups)
+		htable_group_probing(ht);
+
+	present = xmalloc0(universe);
+	bench_seed = initial_seed;		/* Same sequence for all the runs */
+
+	/*
+	 * Half the keys in the universe are present on average.  Each round
+	 * either inserts or removes a key, and is followed by random lookups,
+	 * half of which are expected to succeed.  Rounds are run by batches
+	 * to keep the timing overhead low.
+	 */
+
+	for (i = 0; i < ops; i += BATCH) {
+		size_t k, batch = MIN(BATCH, ops - i);
+
+		start = tm_cputime(NULL, NULL);
+		for (j = 0; j < batch; j++) {
+			k = bench_rand(universe);
+			if (present[k]) {
+				if (!htable_remove(ht, KEY(k)))
+					s_error("cannot remove key #%zu", k);
+				b->deletes++;
+				count--;
+			} else {
+				htable_insert(ht, KEY(k), KEY(k));
+				b->inserts++;
+				count++;
+			}
+			present[k] = !present[k];
+		}
+		b->churn += tm_cputime(NULL, NULL) - start;
+
+		start = tm_cputime(NULL, NULL);
+		for (j = 0; j < batch * lookups; j++) {
+			void *v;
+
+			k = bench_rand(universe);
+			v = htable_lookup(ht, KEY(k));
+			if G_UNLIKELY(v != (present[k] ? KEY(k) : NULL))
+				s_error("lookup of key #%zu returned %p", k, v);
+		}
+		b->lookup += tm_cputime(NULL, NULL) - start;
+		b->lookups += batch * lookups;
+	}
+
+	if (count != htable_count(ht))
+		s_error("table holds %zu items, expected %zu", htable_count(ht), count);
+
+	if (count != htable_foreach_remove(ht, bench_remove, present))
+		s_error("iteration did not remove %zu items", count);
+
+	for (i = 0; i < universe; i++) {
+		if (present[i])
+			s_error("key #%zu was not seen in iteration", i);
+	}
+
+	if (0 != htable_count(ht))
+		s_error("table still holds %zu items", htable_count(ht));
+
+	if (verbose) {
+		s_info("%s: %s inserts, %s deletes, %s lookups",
+			groups ? "groups" : "double",
+			uint64_to_string(b->inserts), uint64_to_string2(b->deletes),
+			uint64_to_string3(b->lookups));
+	}
+
+	htable_free_null(&ht);
+	xfree(present);
+}
+
+static void
+report(const char *what, const struct bench *b)
+{
+	uint64 churn = b->inserts + b->deletes;
+
+	printf("%-7s %8.3f %9.1f %8.3f %9.1f\n", what,
+		b->churn, 0 == churn ? 0.0 : b->churn * 1e9 / churn,
+		b->lookup, 0 == b->lookups ? 0.0 : b->lookup * 1e9 / b->lookups);
+}
+
+int
+main(int argc, char **argv)
+{
+	extern int optind;
+	extern char *optarg;
+	int c;
+	size_t n = 100000, ops = 2000000, lookups = 4;
+	struct bench b;
+
+	progstart(argc, argv);
+
+	while ((c = getopt(argc, argv, "hl:n:o:vR:")) != EOF) {
+		switch (c) {
+		case 'l':
+			lookups = atol(optarg);
+			break;
+		case 'n':
+			n = atol(optarg);
+			break;
+		case 'o':
+			ops = atol(optarg);
+			break;
+		case 'v':
+			verbose = TRUE;
+			break;
+		case 'R':
+			initial_seed = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			usage();
+		}
+	}
+
+	if (0 != (argc -= optind) || 0 == n || 0 == ops)
+		usage();
+
+	if (0 == initial_seed)
+		initial_seed = tm_time_exact();
+
+	s_info("use '-R %u' to reproduce a failure", initial_seed);
+
+	printf("%-7s %8s %9s %8s %9s\n",
+		"probing", "churn s", "ns/op", "lookup s", "ns/op");
+
+	bench_run(&b, FALSE, n, ops, lookups);
+	report("double", &b);
+
+	bench_run(&b, TRUE, n, ops, lookups);
+	report("groups", &b);
+
+	return 0;
+}
+
+/* vi: set ts=4 sw=4 cindent: */
@@ -97,6 +97,22 @@
  * different given that there is no value associated with a key within a set,
  * and the vocabulary is different (we speak of set "items", not "keys").
  *
+ * Tables can also be switched to group probing right after creation.  In
+ * that mode, an additional array of control bytes is kept, one per slot,
+ * holding either a 7-bit tag derived from the hashed value or a marker for
+ * free slots and tombstones.  Slots are grouped by HASH_GROUP_SIZE and the
+ * primary hash selects the home group, whose control bytes are all compared
+ * at once against the tag of the key (with SSE2 when available).  Only the
+ * slots whose tag matches need to be looked at, and the lookup stops at the
+ * first group holding a free slot.  When the home group is full, groups are
+ * probed quadratically, which also visits all the groups of the table.
+ *
+ * Because a group holding a free slot can never have been full, no lookup
+ * path can go past it, so deleting an item from such a group frees the slot
+ * instead of erecting a tombstone.  The hashes array is maintained exactly
+ * as in the default mode so that iterations do not need to know about the
+ * probing scheme being used.
+ *
  * @author Raphael Manfredi
  * @date 2012
  */
@@ -109,15 +125,30 @@
 
 #include "endian.h"
 #include "hashing.h"
+#include "pow2.h"
 #include "rand31.h"
 #include "random.h"
 #include "unsigned.h"
 #include "vmm.h"
 #include "walloc.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "override.h"			/* Must be the last header included */
 
 #define HASH_HOPS_MIN	4		/* Theoretical hops when full at 75% */
+#define HASH_GROUP_HOPS	2		/* Probed groups before flagging a resize */
+
+/*
+ * Control bytes used when probing by groups.  Real slots hold a 7-bit tag,
+ * hence markers have their leading bit set.
+ */
+#define HASH_CTRL_FREE	0x80U	/* Nothing there */
+#define HASH_CTRL_TOMB	0xfeU	/* Item deleted */
+
+#define HASH_CTRL_TAG(hv)	((uint8) ((hv) >> 25))	/* Leading 7 bits */
 
 /*
  * The following definitions help control the amount of hash codes we can keep
@@ -216,11 +247,20 @@ hash_hops_max(const struct hkeys *hk)
 	return HASH_HOPS_MIN + (hk->bits - HASH_MIN_BITS) / 2;
 }
 
+/**
+ * @return minimum amount of bits for the table size.
+ */
+static inline size_t
+hash_min_bits(const struct hkeys *hk)
+{
+	return hk->groups ? HASH_GROUP_BITS : HASH_MIN_BITS;
+}
+
 /**
  * Compute the total size of the arena required for given amount of items.
  */
 static size_t
-hash_arena_size(size_t items, bool has_values)
+hash_arena_size(const struct hkeys *hk, size_t items)
 {
 	size_t size;
 
@@ -238,15 +278,19 @@ hash_arena_size(size_t items, bool has_values)
 	 *
 	 * This allows the hashes array to be correctly aligned since the size
 	 * of a pointer is always larger or equal to the size of an unsigned value.
+	 *
+	 * When probing by groups, the control bytes are appended at the end.
 	 */
 
 	STATIC_ASSERT(sizeof(void *) >= sizeof(unsigned));
 	STATIC_ASSERT(INTSIZE == sizeof(unsigned));
 
 	size = items * sizeof(void *);
-	if (has_values)
+	if (hk->has_values)
 		size *= 2;
 	size += items * sizeof(unsigned);
+	if (hk->groups)
+		size += items * sizeof(uint8);
 
 	return size;
 }
@@ -268,6 +312,8 @@ hash_update_arena_pointers(struct hash *h, void *arena)
 		arena = ptr_add_offset(arena, hk->size * sizeof(void *));
 	}
 	hk->hashes = arena;
+	hk->ctrl = hk->groups ?
+		ptr_add_offset(arena, hk->size * sizeof(unsigned)) : NULL;
 
 	hk->relocate = 0;
 }
@@ -286,7 +332,7 @@ hash_arena_allocate(struct hash *h, size_t bits)
 	void *arena;
 
 	hash_check(h);
-	g_assert(bits >= HASH_MIN_BITS);
+	g_assert(bits >= hash_min_bits(hk));
 
 	hash_random_offset_init();
 
@@ -302,7 +348,7 @@ hash_arena_allocate(struct hash *h, size_t bits)
 	 * For structures in "raw" mode, avoid walloc() and use the VMM layer.
 	 */
 
-	size = hash_arena_size(hk->size, hk->has_values);
+	size = hash_arena_size(hk, hk->size);
 
 	if (size >= compat_pagesize() || hk->raw_memory)
 		arena = vmm_alloc(size);
@@ -311,6 +357,8 @@ hash_arena_allocate(struct hash *h, size_t bits)
 
 	hash_update_arena_pointers(h, arena);
 	memset(hk->hashes, 0, hk->size * sizeof(unsigned));
+	if (hk->groups)
+		memset(hk->ctrl, HASH_CTRL_FREE, hk->size);
 }
 
 /**
@@ -344,7 +392,7 @@ hash_arena_relocate(struct hash *h)
 	if G_LIKELY(0 != ++hk->relocate)
 		return;
 
-	size = hash_arena_size(hk->size, hk->has_values);
+	size = hash_arena_size(hk, hk->size);
 
 	if (size < compat_pagesize() && !hk->raw_memory)
 		return;		/* Not allocated via VMM */
@@ -384,7 +432,7 @@ hash_arena_kset_free(struct hash *h)
 	struct hkeys *hk = &h->kset;
 	size_t size;
 
-	size = hash_arena_size(hk->size, hk->has_values);
+	size = hash_arena_size(hk, hk->size);
 	hash_arena_size_free(hk->keys, size, hk->raw_memory);
 }
 
@@ -556,6 +604,115 @@ hash_keyset_equals(const struct hkeys *hk, const void *k1, const void *k2)
 	g_assert_not_reached();
 }
 
+/**
+ * Match control bytes of a group against a value.
+ *
+ * @param g		the control bytes of the group
+ * @param c		the control byte value we're looking for
+ *
+ * @return bitmask of the group slots holding the value (bit 0 for slot 0).
+ */
+static inline ALWAYS_INLINE uint
+hash_group_match(const uint8 *g, uint8 c)
+{
+#ifdef __SSE2__
+	__m128i v = _mm_loadu_si128((const __m128i *) g);
+
+	STATIC_ASSERT(16 == HASH_GROUP_SIZE);
+
+	return (uint) _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+#else
+	uint i, m = 0;
+
+	for (i = 0; i < HASH_GROUP_SIZE; i++) {
+		if (g[i] == c)
+			m |= 1U << i;
+	}
+
+	return m;
+#endif	/* __SSE2__ */
+}
+
+/**
+ * Lookup key in the key set, probing by groups.
+ *
+ * This has the same semantics as hash_keyset_lookup(), except that no
+ * tomb index is reported when the key is found: keys cannot be moved
+ * around without updating the control bytes.
+ */
+static bool G_HOT
+hash_keyset_group_lookup(struct hkeys *hk, const void *key, unsigned hv,
+	size_t *kidx, size_t *tombidx)
+{
+	size_t gmask, g, probes, base, first_tomb = (size_t) -1;
+	const uint8 tag = HASH_CTRL_TAG(hv);
+	uint m;
+
+	gmask = (hk->size >> HASH_GROUP_BITS) - 1;	/* Amount of groups - 1 */
+	g = hashing_keep(hv, hk->bits) >> HASH_GROUP_BITS;
+
+	/*
+	 * Groups are visited at offsets 0, 1, 3, 6, 10,... from the home group.
+	 * Because the amount of groups is a power of 2, these triangular numbers
+	 * cover all the groups before coming back to the home group.
+	 */
+
+	for (probes = 1; /* empty */; probes++) {
+		const uint8 *ctrl;
+
+		base = g << HASH_GROUP_BITS;
+		ctrl = &hk->ctrl[base];
+
+		for (m = hash_group_match(ctrl, tag); m != 0; m &= m - 1) {
+			size_t idx = base + ctz(m);
+
+			if (
+				hk->hashes[idx] == hv &&
+				hash_keyset_equals(hk, hk->keys[idx], key)
+			) {
+				if G_UNLIKELY(probes > HASH_GROUP_HOPS)
+					hk->resize = TRUE;
+				*kidx = idx;
+				if (tombidx != NULL)
+					*tombidx = (size_t) -1;
+				return TRUE;
+			}
+		}
+
+		if ((size_t) -1 == first_tomb) {
+			m = hash_group_match(ctrl, HASH_CTRL_TOMB);
+			if (m != 0)
+				first_tomb = base + ctz(m);
+		}
+
+		m = hash_group_match(ctrl, HASH_CTRL_FREE);
+		if (m != 0) {
+			base += ctz(m);		/* The first free slot in the group */
+			break;
+		}
+
+		/*
+		 * If we went through all the groups, the table is full.
+		 */
+
+		if G_UNLIKELY(probes > gmask) {
+			hk->resize = TRUE;
+			break;
+		}
+
+		g = (g + probes) & gmask;
+	}
+
+	if G_UNLIKELY(probes > HASH_GROUP_HOPS)
+		hk->resize = TRUE;
+
+	if (tombidx != NULL)
+		*tombidx = first_tomb;
+	*kidx = ((size_t) -1 == first_tomb) ? base : first_tomb;
+
+	return FALSE;
+}
+
 /**
  * Lookup key in the key set.
  *
@@ -582,6 +739,9 @@ hash_keyset_lookup(struct hkeys *hk, const void *key, unsigned hv,
 	size_t first_tomb, mask, hops;
 	bool found;
 
+	if (hk->groups)
+		return hash_keyset_group_lookup(hk, key, hv, kidx, tombidx);
+
 	idx = hashing_keep(hv, hk->bits);
 	ih = hk->hashes[idx];
 
@@ -702,10 +862,24 @@ hash_keyset_lookup(struct hkeys *hk, const void *key, unsigned hv,
 	return found;
 }
 
+/**
+ * Record the hashed value of the key held at the specified index.
+ */
+static inline void
+hash_keyset_set(struct hkeys *hk, size_t idx, unsigned hv)
+{
+	hk->hashes[idx] = hv;
+	if (hk->groups)
+		hk->ctrl[idx] = HASH_CTRL_TAG(hv);
+}
+
 /**
  * Erect a new tombstone at the specified key index.
  *
- * @return TRUE if we erected a new tombstone, FALSE if there was already one.
+ * When probing by groups, the slot is simply freed if its group was never
+ * full, since no lookup path can go through that group.
+ *
+ * @return TRUE if we removed the key, FALSE if there was already a tombstone.
  */
 bool
 hash_erect_tombstone(struct hash *h, size_t idx)
@@ -722,6 +896,21 @@ hash_erect_tombstone(struct hash *h, size_t idx)
 	if G_UNLIKELY(HASH_TOMB == hk->hashes[idx])
 		return FALSE;
 
+	if (hk->groups) {
+		size_t base = idx & ~((size_t) HASH_GROUP_SIZE - 1);
+
+		if G_UNLIKELY(HASH_IS_FREE(hk->hashes[idx]))
+			return FALSE;
+
+		if (0 != hash_group_match(&hk->ctrl[base], HASH_CTRL_FREE)) {
+			hk->hashes[idx] = HASH_FREE;
+			hk->ctrl[idx] = HASH_CTRL_FREE;
+			return TRUE;
+		}
+
+		hk->ctrl[idx] = HASH_CTRL_TOMB;
+	}
+
 	hk->hashes[idx] = HASH_TOMB;
 	hk->tombs++;
 	return TRUE;
@@ -735,18 +924,21 @@ hash_erect_tombstone(struct hash *h, size_t idx)
 static bool
 hash_resize_min(struct hash *h)
 {
+	size_t bits = hash_min_bits(&h->kset);
+
 	assert_hash_locked(h);
 
-	if G_UNLIKELY(HASH_MIN_BITS == h->kset.bits) {
-		memset(h->kset.hashes, 0,
-			(1U << HASH_MIN_BITS) * sizeof h->kset.hashes[0]);
+	if G_UNLIKELY(bits == h->kset.bits) {
+		memset(h->kset.hashes, 0, (1U << bits) * sizeof h->kset.hashes[0]);
+		if (h->kset.groups)
+			memset(h->kset.ctrl, HASH_CTRL_FREE, 1U << bits);
 		h->kset.tombs = 0;
 		h->kset.relocate = 0;
 		h->kset.resize = FALSE;
 		return FALSE;
 	} else {
 		hash_arena_kset_free(h);
-		hash_arena_allocate(h, HASH_MIN_BITS);
+		hash_arena_allocate(h, bits);
 		return TRUE;
 	}
 }
@@ -775,7 +967,7 @@ hash_resize(struct hash *h, enum hash_resize_mode mode)
 	if (h->kset.has_values)
 		old_values = (*h->ops->get_values)(h);
 	old_size = h->kset.size;
-	old_arena_size = hash_arena_size(old_size, h->kset.has_values);
+	old_arena_size = hash_arena_size(&h->kset, old_size);
 
 	switch (mode) {
 	case HASH_RESIZE_SAME:
@@ -792,7 +984,8 @@ hash_resize(struct hash *h, enum hash_resize_mode mode)
 			h->kset.bits--;
 			h->kset.size = 1UL << h->kset.bits;
 		} while
-			(h->kset.items < h->kset.size / 4 && h->kset.bits > HASH_MIN_BITS);
+			(h->kset.items < h->kset.size / 4 &&
+			 h->kset.bits > hash_min_bits(&h->kset));
 		goto size_computed;
 	case HASH_RESIZE_CACHELINE:
 		g_assert(size_is_positive(h->kset.bits));
@@ -802,7 +995,8 @@ hash_resize(struct hash *h, enum hash_resize_mode mode)
 			h->kset.bits--;
 			h->kset.size = 1UL << h->kset.bits;
 		} while
-			(h->kset.items < h->kset.size / 2 && h->kset.bits > HASH_MIN_BITS);
+			(h->kset.items < h->kset.size / 2 &&
+			 h->kset.bits > hash_min_bits(&h->kset));
 		goto size_computed;
 	case HASH_RESIZE_MAXMODE:
 		break;
@@ -828,7 +1022,7 @@ size_computed:
 
 			keys++;
 			h->kset.keys[idx] = *hk;
-			h->kset.hashes[idx] = *hp;
+			hash_keyset_set(&h->kset, idx, *hp);
 			if (old_values != NULL)
 				new_values[idx] = old_values[i];
 		}
@@ -880,7 +1074,7 @@ hash_resize_as_needed(struct hash *h)
 
 		if (
 			h->kset.items + 1 < h->kset.size / 2 &&	/* Note the hysteresis */
-			h->kset.bits > HASH_MIN_BITS
+			h->kset.bits > hash_min_bits(&h->kset)
 		) {
 			hash_resize(h, HASH_RESIZE_CACHELINE);	/* Table is oversized */
 			return TRUE;
@@ -918,7 +1112,7 @@ hash_resize_as_needed(struct hash *h)
 	}
 
 	if (h->kset.items < h->kset.size / 4) {
-		if (h->kset.bits > HASH_MIN_BITS) {
+		if (h->kset.bits > hash_min_bits(&h->kset)) {
 			hash_resize(h, HASH_RESIZE_SHRINK);		/* Table is oversized */
 			return TRUE;
 		}
@@ -1020,7 +1214,7 @@ hash_insert_key(struct hash *h, const void *key)
 			h->kset.tombs--;
 		}
 		h->kset.items++;
-		h->kset.hashes[idx] = hv;
+		hash_keyset_set(&h->kset, idx, hv);
 	}
 
 	h->kset.keys[idx] = key;	/* Could be a new pointer, so always update */
@@ -1331,4 +1525,25 @@ hash_thread_safe(struct hash *h)
 	mutex_init(h->lock);
 }
 
+/**
+ * Switch the hash to probing by groups of control bytes.
+ *
+ * This needs to be done right after creating the hash table, before any
+ * key is inserted.
+ */
+void
+hash_group_probing(struct hash *h)
+{
+	hash_check(h);
+	g_assert(0 == h->kset.items);
+	g_assert(0 == h->refcnt);
+
+	if (h->kset.groups)
+		return;
+
+	hash_arena_kset_free(h);
+	h->kset.groups = TRUE;
+	hash_arena_allocate(h, MAX(h->kset.bits, HASH_GROUP_BITS));
+}
+
 /* vi: set ts=4 sw=4 cindent: */
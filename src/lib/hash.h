@@ -67,6 +67,9 @@ enum hmagic {
 #define HASH_MIN_BITS			1
 #define HASH_MIN_SIZE			(1U << HASH_MIN_BITS)
 
+#define HASH_GROUP_BITS			4		/* log2 of slots in a probing group */
+#define HASH_GROUP_SIZE			(1U << HASH_GROUP_BITS)
+
 /**
  * The key set structure.
  */
@@ -77,6 +80,7 @@ struct hkeys {
 	size_t tombs;				/* Amount of deleted items (tombstones) */
 	const void **keys;			/* Array of keys */
 	unsigned *hashes;			/* Array of hashed keys */
+	uint8 *ctrl;				/* Control bytes, when probing by groups */
 	union {
 		struct {
 			hash_fn_t hash;			/* Primary key hashing function */
@@ -97,6 +101,7 @@ struct hkeys {
 	unsigned has_values:1;		/* Whether keys have associated values */
 	unsigned raw_memory:1;		/* Don't use walloc(), use VMM and xpmalloc() */
 	unsigned relocate:10;		/* Attempts for arena relocation */
+	unsigned groups:1;			/* Probe by groups of control bytes */
 };
 
 #define HASH(x)		((struct hash *) (x))
@@ -152,6 +157,7 @@ struct hash {
  */
 
 void hash_thread_safe(struct hash *h);
+void hash_group_probing(struct hash *h);
 
 #define hash_synchronize(h) G_STMT_START {			\
 	if G_UNLIKELY((h)->lock != NULL) 				\
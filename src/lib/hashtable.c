@@ -238,7 +238,13 @@ hash_vmm_alloc(const hash_table_t *ht, size_t size)
 	else
 #else
 	{
-		(void) ht;
+		/*
+		 * Large arenas are randomly probed, request huge pages for them.
+		 */
+
+		if (!ht->real && vmm_huge_eligible(size))
+			return vmm_huge_alloc(size);
+
 		return vmm_alloc(size);
 	}
 #endif	/* TRACK_VMM */
@@ -253,8 +259,10 @@ hash_vmm_free(const hash_table_t *ht, void *p, size_t size)
 	else
 #else
 	{
-		(void) ht;
-		vmm_free(p, size);
+		if (!ht->real && vmm_huge_eligible(size))
+			vmm_huge_free(p, size);
+		else
+			vmm_free(p, size);
 	}
 #endif	/* TRACK_VMM */
 }
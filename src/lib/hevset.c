@@ -297,6 +297,19 @@ hevset_thread_safe(hevset_t *ht)
 	hash_thread_safe(HASH(ht));
 }
 
+/**
+ * Make hash set probe by groups of control bytes.
+ *
+ * This needs to be done right after creating the set.
+ */
+void
+hevset_group_probing(hevset_t *ht)
+{
+	hevset_check(ht);
+
+	hash_group_probing(HASH(ht));
+}
+
 /**
  * Lock the hash set to allow a sequence of operations to be atomically
  * conducted.
@@ -83,6 +83,7 @@ hevset_t *hevset_create_any_real(size_t offset, hash_fn_t primary,
 void hevset_free_null(hevset_t **);
 void hevset_clear(hevset_t *);
 void hevset_thread_safe(hevset_t *);
+void hevset_group_probing(hevset_t *);
 void hevset_lock(hevset_t *);
 void hevset_unlock(hevset_t *);
 
@@ -414,6 +414,19 @@ hikset_thread_safe(hikset_t *hx)
 	hash_thread_safe(HASH(hx));
 }
 
+/**
+ * Make hash set probe by groups of control bytes.
+ *
+ * This needs to be done right after creating the set.
+ */
+void
+hikset_group_probing(hikset_t *hx)
+{
+	hikset_check(hx);
+
+	hash_group_probing(HASH(hx));
+}
+
 /**
  * Lock the hash set to allow a sequence of operations to be atomically
  * conducted.
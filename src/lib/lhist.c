@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2026 agent
+ *
+ *----------------------------------------------------------------------
+ * This file is part of gtk-gnutella.
+ *
+ *  gtk-gnutella is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gtk-gnutella is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with gtk-gnutella; if not, write to the Free Software
+ *  Foundation, Inc.:
+ *      59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *----------------------------------------------------------------------
+ */
+
+/**
+ * @ingroup lib
+ * @file
+ *
+ * Log-linear histograms, with bounded relative error.
+ *
+ * This is the same bucketing scheme as the one used by HDR histograms: the
+ * value range is split in powers of 2, and each power of 2 is further split
+ * into a fixed amount of linear sub-buckets.  Recording a value is therefore
+ * a constant-time operation involving no floating-point arithmetic, which
+ * makes these histograms cheap enough to be always on, even on hot paths.
+ *
+ * Percentiles are derived from the bucket counts and reported as the upper
+ * bound of the bucket holding the requested rank, so they never understate
+ * the actual value, and overstate it by at most 1 / LHIST_SUB.
+ *
+ * @author agent
+ * @date 2026
+ */
+
+#include "common.h"
+
+#include "lhist.h"
+
+#include "override.h"			/* Must be the last header included */
+
+/**
+ * @return the largest value that can be counted in given bucket.
+ */
+static uint32
+lhist_bucket_upper(uint i)
+{
+	uint g, shift;
+
+	g_assert(i < LHIST_BUCKETS);
+
+	if (i < LHIST_SUB)
+		return i;
+
+	g = i / LHIST_SUB;
+	shift = g - 1;
+
+	return ((LHIST_SUB + (i % LHIST_SUB) + 1) << shift) - 1;
+}
+
+/**
+ * Initialize (clear) histogram.
+ */
+void
+lhist_init(lhist_t *h)
+{
+	g_assert(h != NULL);
+
+	ZERO(h);
+}
+
+/**
+ * Add all the values recorded in the source histogram to the destination.
+ */
+void
+lhist_merge(lhist_t *dest, const lhist_t *src)
+{
+	uint i;
+
+	g_assert(dest != NULL);
+	g_assert(src != NULL);
+
+	for (i = 0; i < LHIST_BUCKETS; i++)
+		dest->bucket[i] += src->bucket[i];
+
+	dest->count += src->count;
+	dest->sum += src->sum;
+	dest->max = MAX(dest->max, src->max);
+}
+
+/**
+ * @return the average of the recorded values, 0 if histogram is empty.
+ */
+double
+lhist_avg(const lhist_t *h)
+{
+	g_assert(h != NULL);
+
+	return 0 == h->count ? 0.0 : (double) h->sum / h->count;
+}
+
+/**
+ * Compute given percentile.
+ *
+ * @param h		the histogram
+ * @param p		the percentile, between 0.0 and 100.0
+ *
+ * @return the value below which lie p% of the recorded values, 0 if the
+ * histogram is empty.
+ */
+uint32
+lhist_percentile(const lhist_t *h, double p)
+{
+	uint64 rank, seen = 0;
+	uint i;
+
+	g_assert(h != NULL);
+	g_assert(p >= 0.0 && p <= 100.0);
+
+	if (0 == h->count)
+		return 0;
+
+	rank = (uint64) (p / 100.0 * h->count + 0.5);
+	rank = MAX(rank, 1);
+
+	for (i = 0; i < LHIST_BUCKETS; i++) {
+		seen += h->bucket[i];
+		if (seen >= rank)
+			return MIN(lhist_bucket_upper(i), h->max);
+	}
+
+	return h->max;
+}
+
+/* vi: set ts=4 sw=4 cindent: */
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2026 agent
+ *
+ *----------------------------------------------------------------------
+ * This file is part of gtk-gnutella.
+ *
+ *  gtk-gnutella is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gtk-gnutella is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with gtk-gnutella; if not, write to the Free Software
+ *  Foundation, Inc.:
+ *      59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *----------------------------------------------------------------------
+ */
+
+/**
+ * @ingroup lib
+ * @file
+ *
+ * Log-linear histograms, with bounded relative error.
+ *
+ * @author agent
+ * @date 2026
+ */
+
+#ifndef _lhist_h_
+#define _lhist_h_
+
+#include "pow2.h"
+
+#define LHIST_SUB_BITS	3		/**< Linear sub-buckets per power of 2, log2 */
+#define LHIST_MAX_BITS	24		/**< Values are capped to 2^24 - 1 */
+
+#define LHIST_SUB		(1U << LHIST_SUB_BITS)
+#define LHIST_MAX		((1U << LHIST_MAX_BITS) - 1)
+#define LHIST_BUCKETS	(LHIST_SUB * (LHIST_MAX_BITS - LHIST_SUB_BITS + 1))
+
+/**
+ * A log-linear histogram.
+ *
+ * Values below LHIST_SUB are counted exactly, then each power of 2 is split
+ * into LHIST_SUB linear buckets, so that the relative error made on any
+ * recorded value is at most 1 / LHIST_SUB.  The structure has a fixed size
+ * and can therefore be embedded in other structures.
+ */
+typedef struct lhist {
+	uint64 count;					/**< Amount of values recorded */
+	uint64 sum;						/**< Sum of recorded values */
+	uint32 max;						/**< Largest value recorded */
+	uint32 bucket[LHIST_BUCKETS];	/**< Value counts, per bucket */
+} lhist_t;
+
+/**
+ * @return the bucket index where value is counted.
+ */
+static inline ALWAYS_INLINE uint
+lhist_index(uint32 v)
+{
+	uint e;
+
+	if (v < LHIST_SUB)
+		return v;
+
+	v = MIN(v, LHIST_MAX);
+	e = 31 - clz(v);		/* Highest bit set, at least LHIST_SUB_BITS */
+
+	return (e - LHIST_SUB_BITS + 1) * LHIST_SUB +
+		((v >> (e - LHIST_SUB_BITS)) & (LHIST_SUB - 1));
+}
+
+/**
+ * Record value into the histogram.
+ */
+static inline void
+lhist_record(lhist_t *h, uint32 v)
+{
+	h->bucket[lhist_index(v)]++;
+	h->count++;
+	h->sum += v;
+	if G_UNLIKELY(v > h->max)
+		h->max = v;
+}
+
+/**
+ * @return amount of values recorded in the histogram.
+ */
+static inline uint64
+lhist_count(const lhist_t *h)
+{
+	return h->count;
+}
+
+/**
+ * @return the largest value recorded in the histogram.
+ */
+static inline uint32
+lhist_max(const lhist_t *h)
+{
+	return h->max;
+}
+
+/*
+ * Public interface.
+ */
+
+void lhist_init(lhist_t *h);
+void lhist_merge(lhist_t *dest, const lhist_t *src);
+double lhist_avg(const lhist_t *h);
+uint32 lhist_percentile(const lhist_t *h, double p);
+
+#endif /* _lhist_h_ */
+
+/* vi: set ts=4 sw=4 cindent: */
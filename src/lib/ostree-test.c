@@ -0,0 +1,274 @@
+/*
+ * ostree-test -- stress test for the order-statistic tree.
+ *
+ * Copyright (c) 2026 agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the authors nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "common.h"
+
+#include "log.h"
+#include "ostree.h"
+#include "progname.h"
+#include "rand31.h"
+#include "tm.h"
+#include "xmalloc.h"
+
+/*
+ * Items mimic PARQ queued entries: they are sorted by order of arrival and
+ * marked when they compete for a slot.
+ */
+struct item {
+	uint64 key;
+	osnode_t node;
+	bool linked;
+	bool marked;
+};
+
+static unsigned initial_seed;
+static bool verbose;
+
+static void G_NORETURN
+usage(void)
+{
+	fprintf(stderr,
+		"Usage: %s [-hv] [-c checks] [-n items] [-o ops] [-R seed]\n"
+		"  -c : full consistency check every that many ops (default 10000)\n"
+		"  -h : prints this help message\n"
+		"  -n : amount of queued items to churn (default 10000)\n"
+		"  -o : amount of operations to perform (default 1000000)\n"
+		"  -R : seed for repeatable random sequence\n"
+		"  -v : verbose mode\n"
+		, getprogname());
+	exit(EXIT_FAILURE);
+}
+
+static int
+item_cmp(const void *a, const void *b)
+{
+	const struct item *ia = a, *ib = b;
+
+	return CMP(ia->key, ib->key);
+}
+
+/**
+ * Check that the tree agrees with the items we know about, walking it both
+ * sequentially and through rank lookups.
+ */
+static void
+full_check(const ostree_t *t, size_t linked, size_t marked)
+{
+	const struct item *it, *prev = NULL, *mprev = NULL;
+	size_t pos = 0, rel = 0;
+
+	g_assert(ostree_verify(t) == linked);
+	g_assert(ostree_count(t) == linked);
+	g_assert(ostree_marked_count(t) == marked);
+
+	for (it = ostree_head(t); it != NULL; it = ostree_next(t, it)) {
+		g_assert(it->linked);
+		g_assert(NULL == prev || prev->key < it->key);
+		g_assert(ostree_rank(t, it) == ++pos);
+		g_assert(ostree_nth(t, pos) == it);
+		g_assert(ostree_prev_marked(t, it) == mprev);
+		g_assert(booleanize(it->marked) == ostree_is_marked(t, it));
+
+		if (it->marked) {
+			g_assert(ostree_marked_rank(t, it) == ++rel);
+			g_assert(ostree_nth_marked(t, rel) == it);
+			mprev = it;
+		} else {
+			g_assert(0 == ostree_marked_rank(t, it));
+		}
+
+		prev = it;
+	}
+
+	g_assert(pos == linked);
+	g_assert(rel == marked);
+	g_assert(ostree_tail_marked(t) == mprev);
+
+	rel = 0;
+	for (it = ostree_head_marked(t); it != NULL; it = ostree_next_marked(t, it))
+		g_assert(it->marked && ++rel == ostree_marked_rank(t, it));
+
+	g_assert(rel == marked);
+	g_assert(NULL == ostree_nth(t, linked + 1));
+	g_assert(NULL == ostree_nth_marked(t, marked + 1));
+}
+
+int
+main(int argc, char **argv)
+{
+	extern int optind;
+	extern char *optarg;
+	int c;
+	size_t i, n = 10000, ops = 1000000, checks = 10000;
+	size_t linked = 0, marked = 0, inserted = 0, removed = 0, toggled = 0;
+	uint64 arrival = 0;
+	struct item *items;
+	ostree_t t;
+	tm_nano_t start, end;
+	double elapsed;
+
+	progstart(argc, argv);
+
+	while ((c = getopt(argc, argv, "c:hn:o:R:v")) != EOF) {
+		switch (c) {
+		case 'c':
+			checks = atol(optarg);
+			break;
+		case 'n':
+			n = atol(optarg);
+			break;
+		case 'o':
+			ops = atol(optarg);
+			break;
+		case 'R':
+			initial_seed = atoi(optarg);
+			break;
+		case 'v':
+			verbose = TRUE;
+			break;
+		case 'h':
+		default:
+			usage();
+		}
+	}
+
+	if (0 != (argc -= optind) || 0 == n || 0 == checks)
+		usage();
+
+	if (0 == initial_seed)
+		initial_seed = tm_time_exact();
+
+	rand31_set_seed(initial_seed);
+	s_info("use '-R %u' to reproduce a failure", initial_seed);
+
+	items = xmalloc0(n * sizeof items[0]);
+	ostree_init(&t, item_cmp, offsetof(struct item, node));
+
+	/*
+	 * Fill the queue first, in arrival order, so that the tree is
+	 * exercised by the degenerate appending pattern of PARQ.
+	 */
+
+	for (i = 0; i < n; i++) {
+		items[i].key = ++arrival;
+		ostree_insert(&t, &items[i]);
+		items[i].linked = TRUE;
+		linked++;
+		if (rand31_value(1)) {
+			ostree_mark(&t, &items[i], TRUE);
+			items[i].marked = TRUE;
+			marked++;
+		}
+	}
+
+	full_check(&t, linked, marked);
+
+	/*
+	 * Now churn: entries leave from anywhere in the queue and new ones are
+	 * appended at the end, or occasionally re-inserted in the middle as
+	 * when the PARQ state is reloaded out of order.  Marks are flipped on
+	 * random entries, like entries getting frozen or being granted a slot.
+	 */
+
+	tm_precise_time(&start);
+
+	for (i = 0; i < ops; i++) {
+		struct item *it = &items[rand31_value(n - 1)];
+		unsigned action = rand31_value(9);
+
+		if (!it->linked) {
+			it->key = 0 == action ?
+				((uint64) rand31_u32() << 32) | ++arrival : ++arrival << 32;
+			ostree_insert(&t, it);
+			it->linked = TRUE;
+			it->marked = FALSE;
+			linked++;
+			inserted++;
+		} else if (action < 4) {
+			g_assert(ostree_contains(&t, it));
+			if (it->marked)
+				marked--;
+			ostree_remove(&t, it);
+			g_assert(!ostree_contains(&t, it));
+			it->linked = FALSE;
+			linked--;
+			removed++;
+		} else {
+			size_t rel = ostree_marked_rank(&t, it);
+			bool was = ostree_mark(&t, it, !it->marked);
+
+			g_assert(booleanize(was) == booleanize(it->marked));
+			g_assert(booleanize(rel) == booleanize(it->marked));
+
+			it->marked = !it->marked;
+			if (it->marked) {
+				marked++;
+				rel = ostree_marked_rank(&t, it);
+				g_assert(ostree_nth_marked(&t, rel) == it);
+			} else {
+				marked--;
+			}
+			toggled++;
+		}
+
+		if (0 == (i + 1) % checks) {
+			full_check(&t, linked, marked);
+			if (verbose) {
+				s_info("%zu ops: %zu linked, %zu marked",
+					i + 1, linked, marked);
+			}
+		}
+	}
+
+	tm_precise_time(&end);
+	elapsed = tm_precise_elapsed_f(&end, &start);
+
+	full_check(&t, linked, marked);
+
+	s_info("%zu ops over %zu items in %.3f s (full check every %zu ops)",
+		ops, n, elapsed, checks);
+	s_info("%zu insertions, %zu removals, %zu mark flips",
+		inserted, removed, toggled);
+
+	for (i = 0; i < n; i++) {
+		if (items[i].linked)
+			ostree_remove(&t, &items[i]);
+	}
+
+	g_assert(0 == ostree_count(&t));
+	g_assert(0 == ostree_marked_count(&t));
+
+	xfree(items);
+	return 0;
+}
+
+/* vi: set ts=4 sw=4 cindent: */
@@ -0,0 +1,671 @@
+/*
+ * Copyright (c) 2026 agent
+ *
+ *----------------------------------------------------------------------
+ * This file is part of gtk-gnutella.
+ *
+ *  gtk-gnutella is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gtk-gnutella is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with gtk-gnutella; if not, write to the Free Software
+ *  Foundation, Inc.:
+ *      59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *----------------------------------------------------------------------
+ */
+
+/**
+ * @ingroup lib
+ * @file
+ *
+ * Embedded order-statistic tree (within another data structure).
+ *
+ * This is an AVL tree where each node is augmented with the size of the
+ * subtree it roots and the amount of "marked" nodes within that subtree.
+ * Items are kept sorted according to the comparison routine given at
+ * initialization time, and one can then compute in O(log n):
+ *
+ * - the rank of an item, i.e. its 1-based position in the tree;
+ * - the rank of an item among the marked items only;
+ * - the item at a given rank, among all the items or among the marked ones.
+ *
+ * Marking an item is also done in O(log n) without restructuring the tree,
+ * which makes it possible to maintain a sub-sequence of the items (e.g. the
+ * ones eligible for some processing) in addition to the whole sequence.
+ *
+ * As with erbtree, the comparison routine compares items, not nodes, and
+ * the offset of the embedded node within the item is given to ostree_init().
+ * Items must compare uniquely: duplicates are not allowed.
+ *
+ * @author agent
+ * @date 2026
+ */
+
+#include "common.h"
+
+#include "ostree.h"
+
+#include "override.h"			/* Must be the last header included */
+
+#define OSTREE_ITEM(t, n)	ptr_add_offset_const((n), -(t)->offset)
+#define OSTREE_NODE(t, i)	((osnode_t *) ptr_add_offset_const((i), (t)->offset))
+
+static inline size_t
+osnode_count(const osnode_t *n)
+{
+	return NULL == n ? 0 : n->count;
+}
+
+static inline size_t
+osnode_marked(const osnode_t *n)
+{
+	return NULL == n ? 0 : n->marked;
+}
+
+static inline int
+osnode_height(const osnode_t *n)
+{
+	return NULL == n ? 0 : n->height;
+}
+
+/**
+ * Recompute the augmented data of a node from its children.
+ */
+static inline void
+osnode_update(osnode_t *n)
+{
+	int lh = osnode_height(n->left), rh = osnode_height(n->right);
+
+	n->count = 1 + osnode_count(n->left) + osnode_count(n->right);
+	n->marked = n->mark + osnode_marked(n->left) + osnode_marked(n->right);
+	n->height = 1 + MAX(lh, rh);
+}
+
+/**
+ * Initialize embedded order-statistic tree.
+ *
+ * @param tree		the tree to initialize
+ * @param cmp		the item comparison routine
+ * @param offset	the offset of the embedded osnode_t within the item
+ */
+void
+ostree_init(ostree_t *tree, cmp_fn_t cmp, size_t offset)
+{
+	g_assert(tree != NULL);
+	g_assert(cmp != NULL);
+
+	tree->magic = OSTREE_MAGIC;
+	tree->root = NULL;
+	tree->cmp = cmp;
+	tree->offset = offset;
+}
+
+/**
+ * Make ``child'' take the place of ``node'' below the parent of ``node''.
+ */
+static void
+ostree_replace_child(ostree_t *tree, osnode_t *node, osnode_t *child)
+{
+	osnode_t *parent = node->parent;
+
+	if (NULL == parent)
+		tree->root = child;
+	else if (parent->left == node)
+		parent->left = child;
+	else
+		parent->right = child;
+
+	if (child != NULL)
+		child->parent = parent;
+}
+
+static osnode_t *
+ostree_rotate_left(ostree_t *tree, osnode_t *x)
+{
+	osnode_t *y = x->right;
+
+	x->right = y->left;
+	if (y->left != NULL)
+		y->left->parent = x;
+	ostree_replace_child(tree, x, y);
+	y->left = x;
+	x->parent = y;
+
+	osnode_update(x);
+	osnode_update(y);
+
+	return y;
+}
+
+static osnode_t *
+ostree_rotate_right(ostree_t *tree, osnode_t *x)
+{
+	osnode_t *y = x->left;
+
+	x->left = y->right;
+	if (y->right != NULL)
+		y->right->parent = x;
+	ostree_replace_child(tree, x, y);
+	y->right = x;
+	x->parent = y;
+
+	osnode_update(x);
+	osnode_update(y);
+
+	return y;
+}
+
+/**
+ * Walk up from node to the root, updating the augmented data and restoring
+ * the AVL balance along the way.
+ */
+static void
+ostree_rebalance(ostree_t *tree, osnode_t *n)
+{
+	while (n != NULL) {
+		int balance;
+
+		osnode_update(n);
+		balance = osnode_height(n->left) - osnode_height(n->right);
+
+		if (balance > 1) {
+			if (osnode_height(n->left->left) < osnode_height(n->left->right))
+				ostree_rotate_left(tree, n->left);
+			n = ostree_rotate_right(tree, n);
+		} else if (balance < -1) {
+			if (osnode_height(n->right->right) < osnode_height(n->right->left))
+				ostree_rotate_right(tree, n->right);
+			n = ostree_rotate_left(tree, n);
+		}
+
+		n = n->parent;
+	}
+}
+
+/**
+ * Insert item in the tree, unmarked.
+ *
+ * The item must not compare equal to any item already held.
+ */
+void
+ostree_insert(ostree_t *tree, void *item)
+{
+	osnode_t *node, *parent = NULL, **link;
+
+	ostree_check(tree);
+	g_assert(item != NULL);
+
+	node = OSTREE_NODE(tree, item);
+	link = &tree->root;
+
+	while (*link != NULL) {
+		int c;
+
+		parent = *link;
+		c = (*tree->cmp)(item, OSTREE_ITEM(tree, parent));
+		g_assert_log(c != 0, "%s(): duplicate item %p", G_STRFUNC, item);
+		link = c < 0 ? &parent->left : &parent->right;
+	}
+
+	node->left = node->right = NULL;
+	node->parent = parent;
+	node->count = 1;
+	node->marked = 0;
+	node->height = 1;
+	node->mark = FALSE;
+	*link = node;
+
+	ostree_rebalance(tree, parent);
+}
+
+/**
+ * Remove item from the tree.
+ */
+void
+ostree_remove(ostree_t *tree, void *item)
+{
+	osnode_t *z, *start;
+
+	ostree_check(tree);
+	g_assert(item != NULL);
+
+	z = OSTREE_NODE(tree, item);
+	g_assert(z->count != 0);		/* Is linked */
+
+	if (z->left != NULL && z->right != NULL) {
+		osnode_t *y = z->right;
+
+		/*
+		 * Replace z with its successor y, which has no left child.
+		 */
+
+		while (y->left != NULL)
+			y = y->left;
+
+		if (y->parent != z) {
+			start = y->parent;
+			start->left = y->right;
+			if (y->right != NULL)
+				y->right->parent = start;
+			y->right = z->right;
+			z->right->parent = y;
+		} else {
+			start = y;
+		}
+
+		y->left = z->left;
+		z->left->parent = y;
+		ostree_replace_child(tree, z, y);
+	} else {
+		start = z->parent;
+		ostree_replace_child(tree, z, NULL == z->left ? z->right : z->left);
+	}
+
+	ostree_rebalance(tree, start);
+
+	z->left = z->right = z->parent = NULL;
+	z->count = z->marked = 0;
+	z->mark = FALSE;
+}
+
+/**
+ * Set or clear the mark on an item held in the tree.
+ *
+ * @return whether the item was marked before the call.
+ */
+bool
+ostree_mark(ostree_t *tree, void *item, bool on)
+{
+	osnode_t *node, *n;
+	bool was;
+
+	ostree_check(tree);
+	g_assert(item != NULL);
+
+	node = OSTREE_NODE(tree, item);
+	g_assert(node->count != 0);
+
+	was = booleanize(node->mark);
+
+	if (was == booleanize(on))
+		return was;
+
+	node->mark = booleanize(on);
+
+	for (n = node; n != NULL; n = n->parent) {
+		if (on)
+			n->marked++;
+		else
+			n->marked--;
+	}
+
+	return was;
+}
+
+/**
+ * @return whether item is currently linked in the tree.
+ */
+bool
+ostree_contains(const ostree_t *tree, const void *item)
+{
+	ostree_check(tree);
+	g_assert(item != NULL);
+
+	return 0 != OSTREE_NODE(tree, item)->count;
+}
+
+/**
+ * @return whether item is linked and marked.
+ */
+bool
+ostree_is_marked(const ostree_t *tree, const void *item)
+{
+	ostree_check(tree);
+	g_assert(item != NULL);
+
+	return booleanize(OSTREE_NODE(tree, item)->mark);
+}
+
+/**
+ * @return the 1-based rank of the item in the tree.
+ */
+size_t
+ostree_rank(const ostree_t *tree, const void *item)
+{
+	const osnode_t *n;
+	size_t r;
+
+	ostree_check(tree);
+	g_assert(item != NULL);
+
+	n = OSTREE_NODE(tree, item);
+	g_assert(n->count != 0);
+
+	r = osnode_count(n->left) + 1;
+
+	for (; n->parent != NULL; n = n->parent) {
+		if (n == n->parent->right)
+			r += osnode_count(n->parent->left) + 1;
+	}
+
+	return r;
+}
+
+/**
+ * @return amount of marked items sorted before the node.
+ */
+static size_t
+ostree_marked_before_node(const osnode_t *n)
+{
+	size_t r = osnode_marked(n->left);
+
+	for (; n->parent != NULL; n = n->parent) {
+		if (n == n->parent->right)
+			r += osnode_marked(n->parent->left) + n->parent->mark;
+	}
+
+	return r;
+}
+
+/**
+ * @return amount of marked items sorted before the item, which needs not
+ * be marked itself.
+ */
+size_t
+ostree_marked_before(const ostree_t *tree, const void *item)
+{
+	const osnode_t *n;
+
+	ostree_check(tree);
+	g_assert(item != NULL);
+
+	n = OSTREE_NODE(tree, item);
+	g_assert(n->count != 0);
+
+	return ostree_marked_before_node(n);
+}
+
+/**
+ * @return the 1-based rank of the item among the marked items, 0 if the
+ * item is not marked.
+ */
+size_t
+ostree_marked_rank(const ostree_t *tree, const void *item)
+{
+	const osnode_t *n;
+
+	ostree_check(tree);
+	g_assert(item != NULL);
+
+	n = OSTREE_NODE(tree, item);
+
+	if (!n->mark)
+		return 0;
+
+	return ostree_marked_before_node(n) + 1;
+}
+
+/**
+ * @return the item at the given 1-based rank, NULL if out of range.
+ */
+void *
+ostree_nth(const ostree_t *tree, size_t rank)
+{
+	osnode_t *n;
+
+	ostree_check(tree);
+
+	if (0 == rank || rank > osnode_count(tree->root))
+		return NULL;
+
+	n = tree->root;
+
+	for (;;) {
+		size_t l = osnode_count(n->left);
+
+		if (rank <= l) {
+			n = n->left;
+		} else if (rank == l + 1) {
+			return OSTREE_ITEM(tree, n);
+		} else {
+			rank -= l + 1;
+			n = n->right;
+		}
+	}
+}
+
+/**
+ * @return the marked item at the given 1-based rank among marked items,
+ * NULL if out of range.
+ */
+void *
+ostree_nth_marked(const ostree_t *tree, size_t rank)
+{
+	osnode_t *n;
+
+	ostree_check(tree);
+
+	if (0 == rank || rank > osnode_marked(tree->root))
+		return NULL;
+
+	n = tree->root;
+
+	for (;;) {
+		size_t l = osnode_marked(n->left);
+
+		if (rank <= l) {
+			n = n->left;
+		} else if (n->mark && rank == l + 1) {
+			return OSTREE_ITEM(tree, n);
+		} else {
+			rank -= l + n->mark;
+			n = n->right;
+		}
+	}
+}
+
+/**
+ * @return first item of the tree, NULL if empty.
+ */
+void *
+ostree_head(const ostree_t *tree)
+{
+	osnode_t *n;
+
+	ostree_check(tree);
+
+	if (NULL == (n = tree->root))
+		return NULL;
+
+	while (n->left != NULL)
+		n = n->left;
+
+	return OSTREE_ITEM(tree, n);
+}
+
+/**
+ * @return item following given one in the tree, NULL if none.
+ */
+void *
+ostree_next(const ostree_t *tree, const void *item)
+{
+	const osnode_t *n;
+
+	ostree_check(tree);
+	g_assert(item != NULL);
+
+	n = OSTREE_NODE(tree, item);
+
+	if (n->right != NULL) {
+		n = n->right;
+		while (n->left != NULL)
+			n = n->left;
+		return OSTREE_ITEM(tree, n);
+	}
+
+	while (n->parent != NULL && n == n->parent->right)
+		n = n->parent;
+
+	return NULL == n->parent ? NULL : OSTREE_ITEM(tree, n->parent);
+}
+
+/**
+ * @return first marked node in the subtree, which must hold marked nodes.
+ */
+static const osnode_t *
+ostree_first_marked(const osnode_t *n)
+{
+	g_assert(osnode_marked(n) != 0);
+
+	for (;;) {
+		if (osnode_marked(n->left) != 0)
+			n = n->left;
+		else if (n->mark)
+			return n;
+		else
+			n = n->right;
+	}
+}
+
+/**
+ * @return first marked item of the tree, NULL if none.
+ */
+void *
+ostree_head_marked(const ostree_t *tree)
+{
+	ostree_check(tree);
+
+	if (0 == osnode_marked(tree->root))
+		return NULL;
+
+	return OSTREE_ITEM(tree, ostree_first_marked(tree->root));
+}
+
+/**
+ * @return last marked item of the tree, NULL if none.
+ */
+void *
+ostree_tail_marked(const ostree_t *tree)
+{
+	ostree_check(tree);
+
+	return ostree_nth_marked(tree, osnode_marked(tree->root));
+}
+
+/**
+ * Get the marked item following the given one, which needs not be marked
+ * itself.  Subtrees holding no marked items are skipped entirely.
+ *
+ * @return next marked item, NULL if none.
+ */
+void *
+ostree_next_marked(const ostree_t *tree, const void *item)
+{
+	const osnode_t *n;
+
+	ostree_check(tree);
+	g_assert(item != NULL);
+
+	n = OSTREE_NODE(tree, item);
+
+	if (osnode_marked(n->right) != 0)
+		return OSTREE_ITEM(tree, ostree_first_marked(n->right));
+
+	for (; n->parent != NULL; n = n->parent) {
+		const osnode_t *p = n->parent;
+
+		if (n != p->left)
+			continue;
+		if (p->mark)
+			return OSTREE_ITEM(tree, p);
+		if (osnode_marked(p->right) != 0)
+			return OSTREE_ITEM(tree, ostree_first_marked(p->right));
+	}
+
+	return NULL;
+}
+
+/**
+ * Get the marked item preceding the given one, which needs not be marked
+ * itself.
+ *
+ * @return previous marked item, NULL if none.
+ */
+void *
+ostree_prev_marked(const ostree_t *tree, const void *item)
+{
+	ostree_check(tree);
+	g_assert(item != NULL);
+
+	return ostree_nth_marked(tree, ostree_marked_before(tree, item));
+}
+
+/**
+ * Recursively check the consistency of a subtree.
+ *
+ * @return amount of nodes in the subtree.
+ */
+static size_t
+ostree_verify_node(const ostree_t *tree, const osnode_t *n,
+	const osnode_t *parent, size_t *marked, int *height)
+{
+	size_t lc, rc, lm = 0, rm = 0;
+	int lh = 0, rh = 0;
+
+	if (NULL == n) {
+		*marked = 0;
+		*height = 0;
+		return 0;
+	}
+
+	g_assert(n->parent == parent);
+
+	if (n->left != NULL) {
+		g_assert((*tree->cmp)(
+			OSTREE_ITEM(tree, n->left), OSTREE_ITEM(tree, n)) < 0);
+	}
+	if (n->right != NULL) {
+		g_assert((*tree->cmp)(
+			OSTREE_ITEM(tree, n), OSTREE_ITEM(tree, n->right)) < 0);
+	}
+
+	lc = ostree_verify_node(tree, n->left, n, &lm, &lh);
+	rc = ostree_verify_node(tree, n->right, n, &rm, &rh);
+
+	g_assert_log(n->count == lc + rc + 1,
+		"count=%zu, left=%zu, right=%zu", n->count, lc, rc);
+	g_assert(n->marked == lm + rm + n->mark);
+	g_assert(n->height == 1 + MAX(lh, rh));
+	g_assert(lh - rh >= -1 && lh - rh <= 1);
+
+	*marked = n->marked;
+	*height = n->height;
+
+	return n->count;
+}
+
+/**
+ * Check the consistency of the whole tree: ordering, parent links, subtree
+ * counts and AVL balance.  This is meant for debugging and is O(n).
+ *
+ * @return amount of items in the tree.
+ */
+size_t
+ostree_verify(const ostree_t *tree)
+{
+	size_t marked;
+	int height;
+
+	ostree_check(tree);
+
+	return ostree_verify_node(tree, tree->root, NULL, &marked, &height);
+}
+
+/* vi: set ts=4 sw=4 cindent: */
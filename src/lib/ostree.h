@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2026 agent
+ *
+ *----------------------------------------------------------------------
+ * This file is part of gtk-gnutella.
+ *
+ *  gtk-gnutella is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gtk-gnutella is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with gtk-gnutella; if not, write to the Free Software
+ *  Foundation, Inc.:
+ *      59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *----------------------------------------------------------------------
+ */
+
+/**
+ * @ingroup lib
+ * @file
+ *
+ * Embedded order-statistic tree (within another data structure).
+ *
+ * @author agent
+ * @date 2026
+ */
+
+#ifndef _ostree_h_
+#define _ostree_h_
+
+/**
+ * A node in an order-statistic tree.
+ *
+ * Each node records the size of the subtree it roots, along with the amount
+ * of "marked" items in that subtree, so that the rank of any item among all
+ * the items or among the marked items only can be computed in O(log n).
+ */
+typedef struct osnode {
+	struct osnode *left, *right, *parent;
+	size_t count;			/* Amount of nodes in subtree, 0 if not linked */
+	size_t marked;			/* Amount of marked nodes in subtree */
+	uint8 height;			/* Height of subtree (AVL balancing) */
+	uint8 mark;				/* Whether node is marked */
+} osnode_t;
+
+enum ostree_magic { OSTREE_MAGIC = 0x4b0c1e57 };
+
+/**
+ * An embedded order-statistic tree is represented by this structure.
+ */
+typedef struct ostree {
+	enum ostree_magic magic;
+	osnode_t *root;
+	cmp_fn_t cmp;		/* Item comparison routine */
+	size_t offset;		/* Offset of embedded node in the item structure */
+} ostree_t;
+
+static inline void
+ostree_check(const ostree_t * const t)
+{
+	g_assert(t != NULL);
+	g_assert(OSTREE_MAGIC == t->magic);
+}
+
+/**
+ * Public interface.
+ */
+
+void ostree_init(ostree_t *tree, cmp_fn_t cmp, size_t offset);
+void ostree_insert(ostree_t *tree, void *item);
+void ostree_remove(ostree_t *tree, void *item);
+bool ostree_mark(ostree_t *tree, void *item, bool on);
+
+bool ostree_contains(const ostree_t *tree, const void *item);
+bool ostree_is_marked(const ostree_t *tree, const void *item);
+size_t ostree_rank(const ostree_t *tree, const void *item);
+size_t ostree_marked_rank(const ostree_t *tree, const void *item);
+size_t ostree_marked_before(const ostree_t *tree, const void *item);
+void *ostree_nth(const ostree_t *tree, size_t rank);
+void *ostree_nth_marked(const ostree_t *tree, size_t rank);
+
+void *ostree_head(const ostree_t *tree);
+void *ostree_next(const ostree_t *tree, const void *item);
+void *ostree_head_marked(const ostree_t *tree);
+void *ostree_tail_marked(const ostree_t *tree);
+void *ostree_next_marked(const ostree_t *tree, const void *item);
+void *ostree_prev_marked(const ostree_t *tree, const void *item);
+
+size_t ostree_verify(const ostree_t *tree);
+
+/**
+ * @return amount of items held in the tree.
+ */
+static inline size_t
+ostree_count(const ostree_t * const t)
+{
+	ostree_check(t);
+	return NULL == t->root ? 0 : t->root->count;
+}
+
+/**
+ * @return amount of marked items held in the tree.
+ */
+static inline size_t
+ostree_marked_count(const ostree_t * const t)
+{
+	ostree_check(t);
+	return NULL == t->root ? 0 : t->root->marked;
+}
+
+#endif /* _ostree_h_ */
+
+/* vi: set ts=4 sw=4 cindent: */
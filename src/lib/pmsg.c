@@ -35,11 +35,16 @@
 
 #include "pmsg.h"
 
+#include "atomic.h"
+#include "dump_options.h"
 #include "halloc.h"
 #include "log.h"				/* For s_carp_once() */
 #include "mempcpy.h"
+#include "once.h"
 #include "stacktrace.h"
+#include "str.h"
 #include "stringify.h"			/* For plural() */
+#include "tmalloc.h"
 #include "unsigned.h"			/* For size_is_non_negative() */
 #include "walloc.h"
 
@@ -87,13 +92,91 @@ cast_to_pmsg(pmsg_ext_t *emb)
 	return &emb->pmsg;
 }
 
+/*
+ * Embedded data buffers are allocated from a few size classes, each backed
+ * by its own thread-magazine depot, so that the messages we keep creating
+ * and freeing on the hot path recycle the same blocks instead of hitting
+ * the general allocator for each odd size.
+ *
+ * The class sizes include the pdata_t header and were chosen to match the
+ * typical Gnutella and G2 message sizes: most queries fit in the first class,
+ * query hits and G2 packets in the next ones.  Larger buffers are directly
+ * allocated through walloc().
+ */
+static const size_t pdata_class_size[] = { 128, 256, 512, 1024, 2048, 4096 };
+
+static struct pdata_class {
+	tmalloc_t *depot;			/**< Thread-magazine depot for the class */
+	AU64(allocations);			/**< Buffers allocated from the class */
+	AU64(freeings);				/**< Buffers returned to the class */
+} pdata_class[N_ITEMS(pdata_class_size)];
+
+static struct pdata_stats {
+	AU64(oversized);			/**< Buffers too large for any class */
+} pdata_stats;
+
+static once_flag_t pdata_class_inited;
+
+/**
+ * Create the depots for the data buffer size classes.
+ */
+static void
+pdata_class_init(void)
+{
+	size_t i;
+
+	for (i = 0; i < N_ITEMS(pdata_class_size); i++) {
+		char name[32];
+
+		str_bprintf(ARYLEN(name), "pdata-%zu", pdata_class_size[i]);
+		pdata_class[i].depot =
+			tmalloc_create(name, pdata_class_size[i], walloc, wfree);
+	}
+}
+
+/**
+ * Get the size class suitable for an embedded data buffer of given size.
+ *
+ * @param size		the size of the arena, including the pdata_t header
+ *
+ * @return the size class, NULL if the size is too large for any class.
+ */
+static struct pdata_class *
+pdata_class_get(size_t size)
+{
+	size_t i;
+
+	ONCE_FLAG_RUN(pdata_class_inited, pdata_class_init);
+
+	for (i = 0; i < N_ITEMS(pdata_class_size); i++) {
+		if (size <= pdata_class_size[i])
+			return &pdata_class[i];
+	}
+
+	return NULL;
+}
+
+/**
+ * Free routine for data buffers allocated from a size class.
+ */
+static void
+pdata_class_free(void *p, void *arg)
+{
+	pdata_t *db = p;
+	struct pdata_class *pc = arg;
+
+	db->magic = 0;
+	tmfree(pc->depot, db);
+	AU64_INC(&pc->freeings);
+}
+
 /**
  * Allocate internal variables.
  */
 void
 pmsg_init(void)
 {
-	/* Nothing to do */
+	ONCE_FLAG_RUN(pdata_class_inited, pdata_class_init);
 }
 
 /**
@@ -134,6 +217,7 @@ pmsg_fill(pmsg_t *mb, pdata_t *db, int prio, bool ext, const void *buf, int len)
 	mb->m_flags = ext ? PMSG_PF_EXT : 0;
 	mb->m_u.m_check = NULL;
 	mb->m_refcnt = 1;
+	mb->m_stamp = 0;
 	db->d_refcnt++;
 
 	if (buf) {
@@ -748,12 +832,26 @@ pdata_t *
 pdata_new(int len)
 {
 	pdata_t *db;
-	char *arena;
+	size_t size;
+	struct pdata_class *pc;
 
 	g_assert(len > 0);
 
-	arena = walloc(len + EMBEDDED_OFFSET);
-	db = pdata_allocb(arena, len + EMBEDDED_OFFSET, NULL, 0);
+	size = len + EMBEDDED_OFFSET;
+	pc = pdata_class_get(size);
+
+	/*
+	 * The arena comes from the size class but we only expose the requested
+	 * length, so that users get the same buffer capacity as they asked for.
+	 */
+
+	if G_LIKELY(pc != NULL) {
+		db = pdata_allocb(tmalloc(pc->depot), size, pdata_class_free, pc);
+		AU64_INC(&pc->allocations);
+	} else {
+		db = pdata_allocb(walloc(size), size, NULL, 0);
+		AU64_INC(&pdata_stats.oversized);
+	}
 
 	g_assert((size_t) len == pdata_len(db));
 	g_assert(db->d_arena == db->d_embedded);
@@ -869,6 +967,28 @@ pdata_free(pdata_t *db)
 	}
 }
 
+/**
+ * Dump data buffer allocation statistics to specified logagent.
+ */
+void G_COLD
+pmsg_dump_stats_log(logagent_t *la, unsigned options)
+{
+	bool groupped = booleanize(options & DUMP_OPT_PRETTY);
+	size_t i;
+
+	for (i = 0; i < N_ITEMS(pdata_class); i++) {
+		struct pdata_class *pc = &pdata_class[i];
+
+		log_info(la, "PMSG pdata_%zu_allocations = %s", pdata_class_size[i],
+			uint64_to_string_grp(AU64_VALUE(&pc->allocations), groupped));
+		log_info(la, "PMSG pdata_%zu_freeings = %s", pdata_class_size[i],
+			uint64_to_string_grp(AU64_VALUE(&pc->freeings), groupped));
+	}
+
+	log_info(la, "PMSG pdata_oversized = %s",
+		uint64_to_string_grp(AU64_VALUE(&pdata_stats.oversized), groupped));
+}
+
 /**
  * Decrease reference count on buffer, and free it when it reaches 0.
  */
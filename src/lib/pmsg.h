@@ -124,6 +124,7 @@ struct pmsg {
 	uint8 m_flags;				/**< Message flags */
 	uint8 m_prio;				/**< Message priority (0 = normal) */
 	uint16 m_refcnt;			/**< Refs to this message block */
+	uint32 m_stamp;				/**< Enqueuing time (ms), for tracing */
 	union {
 		pmsg_check_t m_check;	/**< Optional check before sending */
 		pmsg_hook_t m_hook;		/**< Optional check before transmitting */
@@ -285,6 +286,25 @@ pmsg_mark_sent(pmsg_t *mb)
 	mb->m_flags |= PMSG_PF_SENT;
 }
 
+/**
+ * Record time (in ms, as given by tm_stamp_ms()) when message was queued.
+ */
+static inline void
+pmsg_set_stamp(pmsg_t *mb, uint32 stamp)
+{
+	mb->m_stamp = stamp;
+}
+
+/**
+ * @return time when message was queued, 0 if never recorded.
+ */
+static inline uint32
+pmsg_stamp(const pmsg_t *mb)
+{
+	pmsg_check(mb);
+	return mb->m_stamp;
+}
+
 /**
  * Clear the "sent" marker on message.
  */
@@ -369,6 +389,8 @@ pdata_t *pdata_allocb_ext(void *buf, int len,
 void pdata_free_nop(void *p, void *arg);
 void pdata_unref(pdata_t *db);
 
+void pmsg_dump_stats_log(logagent_t *la, unsigned options);
+
 iovec_t *pmsg_slist_to_iovec(slist_t *slist,
 				int *iovcnt_ptr, size_t *size_ptr);
 void pmsg_slist_discard(slist_t *slist, size_t n_bytes);
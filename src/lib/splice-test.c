@@ -0,0 +1,470 @@
+/*
+ * splice-test -- measures the CPU cost of relaying data between sockets.
+ *
+ * Copyright (c) 2026 agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the authors nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * A sender process streams data to us over a loopback TCP connection, and
+ * we relay everything to a sink process over another loopback connection,
+ * either through a user-space buffer with read() and write(), or through a
+ * kernel pipe with splice().  The CPU time spent by the relaying process is
+ * reported per forwarded MiB for both methods.
+ *
+ * The sink checks the data it gets, so this also exercises the splicing
+ * routines.
+ */
+
+#include "common.h"
+
+#ifdef I_SYS_WAIT
+#include <sys/wait.h>
+#endif
+
+#include "compat_poll.h"
+#include "compat_splice.h"
+#include "fd.h"
+#include "halloc.h"
+#include "log.h"
+#include "progname.h"
+#include "stringify.h"
+#include "tm.h"
+
+#include "override.h"		/* Must be the last header included */
+
+#define PATTERN_MOD		251		/* Byte at offset i is (i % PATTERN_MOD) */
+
+static void G_NORETURN
+usage(void)
+{
+	fprintf(stderr,
+		"Usage: %s [-h] [-b bufsize] [-m MiB]\n"
+		"  -b : relaying buffer / pipe size (default 65536)\n"
+		"  -h : prints this help message\n"
+		"  -m : amount of MiB to relay (default 1024)\n"
+		, getprogname());
+	exit(EXIT_FAILURE);
+}
+
+/*
+ * The sender and the sink run in child processes.
+ */
+#if defined(HAS_FORK) && defined(HAS_WAITPID)
+
+/**
+ * Create listening socket on the loopback interface, on an ephemeral port.
+ *
+ * @param port		where the chosen port is written
+ *
+ * @return the listening socket.
+ */
+static int
+loopback_listen(uint16 *port)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof addr;
+	int fd;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (-1 == fd)
+		s_error("socket() failed: %m");
+
+	ZERO(&addr);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (-1 == bind(fd, (struct sockaddr *) &addr, sizeof addr))
+		s_error("bind() failed: %m");
+	if (-1 == listen(fd, 1))
+		s_error("listen() failed: %m");
+	if (-1 == getsockname(fd, (struct sockaddr *) &addr, &len))
+		s_error("getsockname() failed: %m");
+
+	*port = ntohs(addr.sin_port);
+	return fd;
+}
+
+/**
+ * Connect to loopback port.
+ */
+static int
+loopback_connect(uint16 port)
+{
+	struct sockaddr_in addr;
+	int fd;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (-1 == fd)
+		s_error("socket() failed: %m");
+
+	ZERO(&addr);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+
+	if (-1 == connect(fd, (struct sockaddr *) &addr, sizeof addr))
+		s_error("connect() failed: %m");
+
+	return fd;
+}
+
+/**
+ * Accept connection on listening socket, which is then closed.
+ */
+static int
+loopback_accept(int *lfd)
+{
+	int fd;
+
+	fd = accept(*lfd, NULL, NULL);
+	if (-1 == fd)
+		s_error("accept() failed: %m");
+
+	fd_close(lfd);
+	return fd;
+}
+
+/**
+ * Send `total' bytes of the pattern.
+ */
+static void
+sender(int fd, uint64 total)
+{
+	char buf[PATTERN_MOD * 256];
+	size_t i, pos = 0;
+
+	for (i = 0; i < sizeof buf; i++)
+		buf[i] = i % PATTERN_MOD;
+
+	while (total != 0) {
+		size_t n = MIN(total, sizeof buf - pos);
+		ssize_t r = write(fd, &buf[pos], n);
+
+		if (-1 == r)
+			s_error("%s(): write() failed: %m", G_STRFUNC);
+
+		total -= r;
+		pos += r;
+		if (sizeof buf == pos)
+			pos = 0;
+	}
+}
+
+/**
+ * Receive data and check they follow the pattern.
+ *
+ * @return the amount of bytes received.
+ */
+static uint64
+sink(int fd)
+{
+	char buf[65536];
+	uint64 received = 0;
+	uint pos = 0;
+
+	for (;;) {
+		ssize_t i, r = read(fd, buf, sizeof buf);
+
+		if (-1 == r)
+			s_error("%s(): read() failed: %m", G_STRFUNC);
+		if (0 == r)
+			break;
+
+		for (i = 0; i < r; i++) {
+			if G_UNLIKELY(UNSIGNED(buf[i] & 0xff) != pos) {
+				s_error("%s(): corrupted data at offset %s",
+					G_STRFUNC, uint64_to_string(received + i));
+			}
+			if (++pos == PATTERN_MOD)
+				pos = 0;
+		}
+
+		received += r;
+	}
+
+	return received;
+}
+
+/**
+ * Wait until file descriptor is ready for the specified event.
+ */
+static void
+wait_for(int fd, short events)
+{
+	struct pollfd pfd;
+
+	pfd.fd = fd;
+	pfd.events = events;
+	pfd.revents = 0;
+
+	if (-1 == compat_poll(&pfd, 1, -1) && EINTR != errno)
+		s_error("%s(): poll() failed: %m", G_STRFUNC);
+}
+
+/**
+ * Relay data from `in' to `out' through a user-space buffer.
+ *
+ * @return the amount of bytes relayed.
+ */
+static uint64
+relay_buffered(int in, int out, size_t bufsize)
+{
+	char *buf = halloc(bufsize);
+	uint64 relayed = 0;
+
+	for (;;) {
+		ssize_t r, w, n;
+
+		r = read(in, buf, bufsize);
+		if (0 == r)
+			break;
+		if (-1 == r) {
+			if (!is_temporary_error(errno))
+				s_error("%s(): read() failed: %m", G_STRFUNC);
+			wait_for(in, POLLIN);
+			continue;
+		}
+
+		for (n = 0; n < r; n += w) {
+			w = write(out, &buf[n], r - n);
+			if (-1 == w) {
+				if (!is_temporary_error(errno))
+					s_error("%s(): write() failed: %m", G_STRFUNC);
+				wait_for(out, POLLOUT);
+				w = 0;
+			}
+		}
+
+		relayed += r;
+	}
+
+	hfree(buf);
+	return relayed;
+}
+
+/**
+ * Relay data from `in' to `out' by splicing them through a pipe.
+ *
+ * @return the amount of bytes relayed.
+ */
+static uint64
+relay_spliced(int in, int out, size_t bufsize)
+{
+	int pfd[2];
+	uint64 relayed = 0;
+
+	if (-1 == compat_splice_pipe(pfd, bufsize))
+		s_error("%s(): cannot create pipe: %m", G_STRFUNC);
+
+	for (;;) {
+		ssize_t r, w, n;
+
+		r = compat_splice(in, pfd[1], bufsize);
+		if (0 == r)
+			break;
+		if (-1 == r) {
+			if (!is_temporary_error(errno))
+				s_error("%s(): splice() from socket failed: %m", G_STRFUNC);
+			wait_for(in, POLLIN);
+			continue;
+		}
+
+		for (n = 0; n < r; n += w) {
+			w = compat_splice(pfd[0], out, r - n);
+			if (-1 == w) {
+				if (!is_temporary_error(errno))
+					s_error("%s(): splice() to socket failed: %m", G_STRFUNC);
+				wait_for(out, POLLOUT);
+				w = 0;
+			}
+		}
+
+		relayed += r;
+	}
+
+	fd_close(&pfd[0]);
+	fd_close(&pfd[1]);
+	return relayed;
+}
+
+/**
+ * Wait for child process, which must exit successfully.
+ */
+static void
+wait_child(pid_t pid, const char *what)
+{
+	int status;
+
+	if (-1 == waitpid(pid, &status, 0))
+		s_error("waitpid() failed: %m");
+	if (!WIFEXITED(status) || 0 != WEXITSTATUS(status))
+		s_error("%s process failed", what);
+}
+
+/**
+ * Launch child process running the sender or the sink.
+ */
+static pid_t
+launch(int fd, int other, uint64 total, bool sending)
+{
+	pid_t pid;
+
+	fflush(stdout);
+	pid = fork();
+
+	switch (pid) {
+	case -1:
+		s_error("fork() failed: %m");
+	case 0:
+		close(other);
+		if (sending) {
+			sender(fd, total);
+		} else {
+			uint64 received = sink(fd);
+			if (received != total) {
+				s_error("sink got %s bytes, expected %s",
+					uint64_to_string(received), uint64_to_string2(total));
+			}
+		}
+		_exit(EXIT_SUCCESS);
+	default:
+		break;
+	}
+
+	return pid;
+}
+
+static void
+bench(const char *what, bool spliced, size_t bufsize, uint64 total)
+{
+	uint16 in_port, out_port;
+	int lin, lout, in, out, fd;
+	pid_t sender_pid, sink_pid;
+	double user, sys, cpu_user, cpu_sys, elapsed;
+	tm_nano_t start, end;
+	uint64 relayed;
+	double mib = total / 1048576.0;
+
+	lin = loopback_listen(&in_port);
+	lout = loopback_listen(&out_port);
+
+	/*
+	 * The sink accepts our outgoing connection, whilst we accept the
+	 * incoming connection from the sender.
+	 */
+
+	out = loopback_connect(out_port);
+	fd = loopback_accept(&lout);
+	sink_pid = launch(fd, out, total, FALSE);
+	fd_close(&fd);
+
+	in = loopback_connect(in_port);
+	sender_pid = launch(in, out, total, TRUE);
+	fd_close(&in);
+	in = loopback_accept(&lin);
+
+	fd_set_nonblocking(in);
+	fd_set_nonblocking(out);
+
+	tm_cputime(&cpu_user, &cpu_sys);
+	tm_precise_time(&start);
+
+	relayed = spliced ?
+		relay_spliced(in, out, bufsize) : relay_buffered(in, out, bufsize);
+
+	tm_precise_time(&end);
+	tm_cputime(&user, &sys);
+
+	fd_close(&in);
+	fd_close(&out);
+
+	wait_child(sender_pid, "sender");
+	wait_child(sink_pid, "sink");
+
+	if (relayed != total) {
+		s_error("%s: relayed %s bytes, expected %s", what,
+			uint64_to_string(relayed), uint64_to_string2(total));
+	}
+
+	user -= cpu_user;
+	sys -= cpu_sys;
+	elapsed = tm_precise_elapsed_f(&end, &start);
+
+	printf("%-10s %8.0f %8.3f %8.3f %8.3f %10.3f %9.1f\n", what, mib,
+		elapsed, user, sys, (user + sys) * 1e3 / mib,
+		0 == elapsed ? 0.0 : mib / elapsed);
+}
+#endif	/* HAS_FORK && HAS_WAITPID */
+
+int
+main(int argc, char **argv)
+{
+	extern int optind;
+	extern char *optarg;
+	int c;
+	size_t bufsize = 65536;
+	uint64 mib = 1024;
+
+	progstart(argc, argv);
+
+	while ((c = getopt(argc, argv, "b:hm:")) != EOF) {
+		switch (c) {
+		case 'b':
+			bufsize = atol(optarg);
+			break;
+		case 'm':
+			mib = atol(optarg);
+			break;
+		case 'h':
+		default:
+			usage();
+		}
+	}
+
+	if (0 == bufsize || 0 == mib)
+		usage();
+
+#if defined(HAS_FORK) && defined(HAS_WAITPID)
+	printf("%-10s %8s %8s %8s %8s %10s %9s\n",
+		"method", "MiB", "wall s", "user s", "sys s", "CPU ms/MiB", "MiB/s");
+
+	bench("buffered", FALSE, bufsize, mib * 1048576);
+
+	if (compat_splice_available())
+		bench("spliced", TRUE, bufsize, mib * 1048576);
+	else
+		s_warning("splice() is not available here");
+#else
+	s_warning("fork() is required to run this test");
+#endif	/* HAS_FORK && HAS_WAITPID */
+
+	return 0;
+}
+
+/* vi: set ts=4 sw=4 cindent: */
@@ -281,6 +281,22 @@ tm_time_raw(void)
 	return (time_t) tm_cached_now.tv_sec;
 }
 
+/**
+ * Get current time in milliseconds (cached), truncated to 32 bits.
+ *
+ * This is meant to timestamp events when measuring short delays, which
+ * are computed by unsigned subtraction and are therefore immune to the
+ * wrapping of the returned value every 49 days.
+ */
+static inline uint32
+tm_stamp_ms(void)
+{
+	tm_t now;
+
+	tm_now(&now);
+	return (uint32) tm2ms(&now);
+}
+
 time_t tm_localtime(const tm_t *);
 time_t tm_localtime_exact(void);
 time_t tm_localtime_raw(const tm_t *);
@@ -0,0 +1,333 @@
+/*
+ * utf8-test -- checks and benchmarks query string normalization.
+ *
+ * Copyright (c) 2026 agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the authors nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "common.h"
+
+#include "halloc.h"
+#include "log.h"
+#include "progname.h"
+#include "stats.h"
+#include "str.h"
+#include "tm.h"
+#include "utf8.h"
+#include "wordvec.h"
+
+/*
+ * Corpus of queries and shared filenames, as seen on the network.
+ *
+ * Most of them are plain ASCII, which is representative of the traffic,
+ * but a few carry accented or non-Latin characters to exercise the slow path.
+ */
+static const char *corpus[] = {
+	"madonna",
+	"the beatles let it be",
+	"Pink Floyd - Wish You Were Here.mp3",
+	"linux iso",
+	"ubuntu 22.04 desktop amd64",
+	"Metallica_-_Nothing_Else_Matters_(Live).flac",
+	"avi",
+	"star wars episode iv 1977 dvdrip xvid",
+	"Beethoven Symphony No. 9 in D minor, Op. 125",
+	"mozart requiem",
+	"jazz",
+	"Miles Davis - So What",
+	"creative commons",
+	"public domain audiobook",
+	"Alice's Adventures in Wonderland (Lewis Carroll).txt",
+	"john coltrane a love supreme",
+	"free software song",
+	"the.matrix.1999.720p",
+	"nirvana smells like teen spirit",
+	"tutorial python",
+	"GNU Emacs manual.pdf",
+	"night of the living dead 1968",
+	"Nosferatu (1922) [public domain].mkv",
+	"daft punk",
+	"Bob Marley & The Wailers - Redemption Song",
+	"10 hours white noise",
+	"gtk-gnutella",
+	"vivaldi four seasons spring allegro",
+	"The Complete Works of William Shakespeare",
+	"A",
+	"the file is the one",
+	"Mot\303\266rhead - Ace of Spades",
+	"Bj\303\266rk Gu\303\260mundsd\303\263ttir - Hyperballad",
+	"Sigur R\303\263s - Hopp\303\255polla",
+	"caf\303\251 del mar",
+	"\346\227\245\346\234\254\350\252\236 \343\201\256\346\255\214",
+	"\320\232\320\270\320\275\320\276 - \320\223\321\200\321\203\320\277\320\277\320\260 \320\272\321\200\320\276\320\262\320\270",
+	"Ed\303\255th Pi\303\240f - La Vie en Rose",
+	"Dvo\305\231\303\241k New World Symphony",
+};
+
+#define POINTS		100
+#define OUTLIERS	3.0
+
+static bool verbose;
+
+static void G_NORETURN
+usage(void)
+{
+	fprintf(stderr,
+		"Usage: %s [-hv] [-n loops]\n"
+		"  -h : prints this help message\n"
+		"  -n : amount of passes over the corpus per measure (default 100)\n"
+		"  -v : verbose mode, shows the canonized corpus\n"
+		, getprogname());
+	exit(EXIT_FAILURE);
+}
+
+/**
+ * Byte-at-a-time UTF-8 validation, as we used to do it.
+ */
+static bool
+naive_utf8_is_valid_string(const char *src)
+{
+	const char *s;
+	uint clen;
+
+	for (s = src; '\0' != *s; s += clen) {
+		if (0 == (clen = utf8_char_len(s)))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+enum bench_type {
+	BENCH_NAIVE_VALID,
+	BENCH_VALID,
+	BENCH_ASCII,
+	BENCH_CANONIZE,
+	BENCH_WORDVEC
+};
+
+static const char *
+bench_name(enum bench_type type)
+{
+	switch (type) {
+	case BENCH_NAIVE_VALID:	return "naive validation";
+	case BENCH_VALID:		return "utf8_is_valid_string()";
+	case BENCH_ASCII:		return "is_ascii_string()";
+	case BENCH_CANONIZE:	return "utf8_canonize()";
+	case BENCH_WORDVEC:		return "canonize + word_vec_make()";
+	}
+	g_assert_not_reached();
+}
+
+/**
+ * Run one pass of the given routine over the whole corpus.
+ */
+static void
+bench_pass(enum bench_type type)
+{
+	size_t i;
+
+	for (i = 0; i < N_ITEMS(corpus); i++) {
+		const char *q = corpus[i];
+
+		switch (type) {
+		case BENCH_NAIVE_VALID:
+			g_assert(naive_utf8_is_valid_string(q));
+			break;
+		case BENCH_VALID:
+			g_assert(utf8_is_valid_string(q));
+			break;
+		case BENCH_ASCII:
+			(void) is_ascii_string(q);
+			break;
+		case BENCH_CANONIZE:
+			{
+				char *c = utf8_canonize(q);
+				hfree(c);
+			}
+			break;
+		case BENCH_WORDVEC:
+			{
+				char *c = utf8_canonize(q);
+				word_vec_t *wv;
+				uint n = word_vec_make(c, &wv);
+
+				if (n != 0)
+					word_vec_free(wv, n);
+				hfree(c);
+			}
+			break;
+		}
+	}
+}
+
+/**
+ * Measure throughput of routine over the corpus.
+ *
+ * @return the average time spent for one pass over the corpus, in seconds.
+ */
+static double
+bench(enum bench_type type, size_t loops)
+{
+	statx_t *sx = statx_make();
+	size_t i;
+	double elapsed;
+
+	for (i = 0; i < POINTS; i++) {
+		size_t j;
+		tm_nano_t start, end;
+
+		tm_precise_time(&start);
+
+		for (j = 0; j < loops; j++)
+			bench_pass(type);
+
+		tm_precise_time(&end);
+		statx_add(sx, tm_precise_elapsed_f(&end, &start) / loops);
+	}
+
+	statx_remove_outliers(sx, OUTLIERS);
+	elapsed = statx_avg(sx);
+	statx_free_null(&sx);
+
+	return elapsed;
+}
+
+/**
+ * Check that the fast paths agree with the generic ones.
+ */
+static void
+check_corpus(void)
+{
+	size_t i;
+
+	for (i = 0; i < N_ITEMS(corpus); i++) {
+		const char *q = corpus[i];
+		char *c;
+		word_vec_t *wv;
+		uint n, j;
+
+		g_assert(utf8_is_valid_string(q) == naive_utf8_is_valid_string(q));
+		g_assert(is_ascii_string(q) == ('\0' == q[utf8_ascii_span(q)]));
+
+		c = utf8_canonize(q);
+		n = word_vec_make(c, &wv);
+
+		g_assert(utf8_is_valid_string(c));
+
+		if (verbose) {
+			str_t *s = str_new(80);
+
+			for (j = 0; j < n; j++) {
+				str_catf(s, "%s\"%s\"", 0 == j ? "" : ", ", wv[j].word);
+				if (wv[j].amount > 1)
+					str_catf(s, "x%u", wv[j].amount);
+			}
+			s_info("\"%s\" -> \"%s\" -> (%s)", q, c, str_2c(s));
+			str_destroy_null(&s);
+		}
+
+		for (j = 0; j < n; j++) {
+			g_assert(vstrlen(wv[j].word) == UNSIGNED(wv[j].len));
+			g_assert(NULL == vstrchr(wv[j].word, ' '));
+			g_assert(wv[j].amount >= 1);
+		}
+
+		if (n != 0)
+			word_vec_free(wv, n);
+		hfree(c);
+	}
+
+	/* Invalid UTF-8 sequences must still be caught after ASCII runs */
+
+	g_assert(!utf8_is_valid_string("a long ascii prefix spanning words \377"));
+	g_assert(!utf8_is_valid_string("\300\200"));		/* Overlong NUL */
+	g_assert(!is_ascii_string("0123456789012345678901234567890123\303\251"));
+}
+
+int
+main(int argc, char **argv)
+{
+	extern int optind;
+	extern char *optarg;
+	int c;
+	size_t i, bytes = 0, loops = 100;
+	double naive = 0.0;
+	enum bench_type types[] = {
+		BENCH_NAIVE_VALID, BENCH_VALID, BENCH_ASCII,
+		BENCH_CANONIZE, BENCH_WORDVEC,
+	};
+
+	progstart(argc, argv);
+
+	while ((c = getopt(argc, argv, "hn:v")) != EOF) {
+		switch (c) {
+		case 'n':
+			loops = atol(optarg);
+			break;
+		case 'v':
+			verbose = TRUE;
+			break;
+		case 'h':
+		default:
+			usage();
+		}
+	}
+
+	if (0 != (argc -= optind) || 0 == loops)
+		usage();
+
+	locale_init();
+	word_vec_init();
+
+	utf8_regression_checks();
+	check_corpus();
+
+	for (i = 0; i < N_ITEMS(corpus); i++)
+		bytes += vstrlen(corpus[i]);
+
+	s_info("corpus holds %zu strings, %zu bytes", N_ITEMS(corpus), bytes);
+
+	for (i = 0; i < N_ITEMS(types); i++) {
+		double e = bench(types[i], loops);
+
+		if (BENCH_NAIVE_VALID == types[i])
+			naive = e;
+
+		s_info("%-28s %'10zu ns/pass, %8.2f MB/s%s",
+			bench_name(types[i]), (size_t) (e * 1e9),
+			bytes / e / (1024.0 * 1024.0),
+			BENCH_VALID == types[i] ?
+				str_smsg(" (x%.2f)", naive / e) : "");
+	}
+
+	word_vec_close();
+	return 0;
+}
+
+/* vi: set ts=4 sw=4 cindent: */
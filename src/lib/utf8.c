@@ -74,6 +74,7 @@
 #include "htable.h"
 #include "mempcpy.h"
 #include "misc.h"
+#include "op.h"
 #include "path.h"
 #include "pslist.h"
 #include "random.h"
@@ -109,7 +110,6 @@ static void unicode_compose_init(void);
 static bool unicode_compose_init_passed;
 static bool locale_init_passed;
 
-void utf8_regression_checks(void);
 size_t utf8_decompose_nfd(const char *in, char *out, size_t size);
 size_t utf8_decompose_nfkd(const char *in, char *out, size_t size);
 size_t utf32_strmaxlen(const uint32 *s, size_t maxlen);
@@ -972,9 +972,93 @@ utf8_char_len_probe(const char *s)
 	return 0xE0 == uc ? 3 : 4;
 }
 
+#if CHAR_BIT == 8
+#define IS_NON_NUL_ASCII(p) (*(const int8 *) (p) > 0)
+#else
+#define IS_NON_NUL_ASCII(p) (!(*(p) & ~0x7f) && (*(p) > 0))
+#endif
+
+/*
+ * Word-at-a-time ASCII scanning.
+ *
+ * A memory word holding only ASCII characters has none of the high bits
+ * of its bytes set, and we can combine that with the classic NUL byte
+ * detection to know whether a word can be skipped entirely.
+ *
+ * The main loop inspects UTF8_ASCII_STRIDE words per iteration, i.e. 32 bytes
+ * on 64-bit machines.  Reads are done on blocks aligned on their own size
+ * which, since the page size is a multiple of the block size, can never cross
+ * a page boundary: we may read past the trailing NUL but never fault.
+ */
+
+#define UTF8_ONEMASK	((op_t) -1 / 0xff)		/* 0x01010101 on 32-bit */
+#define UTF8_HIGHMASK	(UTF8_ONEMASK * 0x80)	/* 0x80808080 on 32-bit */
+
+#define UTF8_ASCII_STRIDE	4
+#define UTF8_ASCII_BLOCK	(UTF8_ASCII_STRIDE * OPSIZ)
+
+#define utf8_block_aligned(x)	\
+	(0 == ((op_t) (x) & (UTF8_ASCII_BLOCK - 1)))
+
+/**
+ * @return non-zero if the word contains a NUL or a non-ASCII byte.
+ */
+static inline op_t
+utf8_word_stops(op_t w)
+{
+	return (w | ((w - UTF8_ONEMASK) & ~w)) & UTF8_HIGHMASK;
+}
+
+/**
+ * Compute the length of the leading run of ASCII characters in a string.
+ *
+ * @param s		a NUL-terminated string
+ *
+ * @return offset of the first NUL or non-ASCII byte in the string.
+ */
+size_t G_HOT
+utf8_ascii_span(const char *s)
+{
+	const char *p = s;
+
+	/*
+	 * Reach the first aligned block byte-wise.
+	 */
+
+	while (!utf8_block_aligned(p)) {
+		if (!IS_NON_NUL_ASCII(p))
+			return p - s;
+		p++;
+	}
+
+	for (;; p += UTF8_ASCII_BLOCK) {
+		const op_t *w = (const op_t *) p;
+
+		G_PREFETCH_R(&p[UTF8_ASCII_BLOCK]);
+
+		if G_UNLIKELY(
+			utf8_word_stops(w[0]) | utf8_word_stops(w[1]) |
+			utf8_word_stops(w[2]) | utf8_word_stops(w[3])
+		)
+			break;
+	}
+
+	/*
+	 * The block we stopped at holds the first NUL or non-ASCII byte.
+	 */
+
+	while (IS_NON_NUL_ASCII(p))
+		p++;
+
+	return p - s;
+}
+
 /**
  * Determine whether a string is UTF-8 encoded.
  *
+ * ASCII runs are skipped a memory word at a time, characters being decoded
+ * individually only when we reach a non-ASCII byte.
+ *
  * @param src a NUL-terminated string.
  * @return FALSE if there are any non-UTF-8 characters before the
  *         terminating NUL, otherwise TRUE.
@@ -985,7 +1069,10 @@ utf8_is_valid_string(const char *src)
 	const char *s;
 	uint clen;
 
-	for (s = src; '\0' != *s; s += clen) {
+	for (s = src; /* empty */; s += clen) {
+		s += utf8_ascii_span(s);
+		if ('\0' == *s)
+			break;
 		if (0 == (clen = utf8_char_len(s)))
 			return FALSE;
 	}
@@ -2651,19 +2738,10 @@ charset_to_utf8(const char *cs, const char *src, size_t src_len)
 	return result;
 }
 
-#if CHAR_BIT == 8
-#define IS_NON_NUL_ASCII(p) (*(const int8 *) (p) > 0)
-#else
-#define IS_NON_NUL_ASCII(p) (!(*(p) & ~0x7f) && (*(p) > 0))
-#endif
-
 bool
 is_ascii_string(const char *s)
 {
-	while (IS_NON_NUL_ASCII(s))
-		++s;
-
-	return '\0' == *s;
+	return '\0' == s[utf8_ascii_span(s)];
 }
 
 static inline const char *
@@ -3499,10 +3577,26 @@ utf8_to_utf32(const char *in, uint32 *out, size_t size)
 	g_assert(size == 0 || out != NULL);
 	g_assert(size <= INT_MAX);
 
+	/*
+	 * ASCII runs are located a memory word at a time and widened without
+	 * going through the UTF-8 decoder.
+	 */
+
 	if (size > 0) {
-		uint32 uc;
+		uint32 *end = &out[size - 1];
+
+		while (p != end) {
+			uint32 uc;
+			size_t n;
+
+			n = utf8_ascii_span(s);
+			n = MIN(n, UNSIGNED(end - p));
+			while (n-- != 0)
+				*p++ = (uchar) *s++;
+
+			if (p == end)
+				break;
 
-		while (--size > 0) {
 			uc = utf8_decode_char_fast(s, &retlen);
 			if (!uc)
 				break;
@@ -3513,7 +3607,13 @@ utf8_to_utf32(const char *in, uint32 *out, size_t size)
 	}
 
 	if (*s != '\0') {
-		while (utf8_decode_char_fast(s, &retlen)) {
+		for (;;) {
+			size_t n = utf8_ascii_span(s);
+
+			s += n;
+			p += n;
+			if (!utf8_decode_char_fast(s, &retlen))
+				break;
 			s += retlen;
 			p++;
 		}
@@ -5673,16 +5773,94 @@ utf32_canonize(const uint32 *src0)
 	return dst;
 }
 
+/*
+ * SWAR byte classification, only valid on words holding ASCII bytes.
+ *
+ * UTF8_BYTES_GE() flags with 0x80 each byte greater or equal to `n', for
+ * 0 < n <= 0x80: since both the byte and the added value are below 0x80,
+ * the addition can never carry into the next byte.
+ */
+#define UTF8_BYTES_GE(w, n)	\
+	(((w) + UTF8_ONEMASK * (0x80 - (n))) & UTF8_HIGHMASK)
+#define UTF8_BYTES_IN(w, lo, hi)	\
+	(UTF8_BYTES_GE(w, lo) & ~UTF8_BYTES_GE(w, (hi) + 1))
+
+/**
+ * Canonize a pure ASCII string.
+ *
+ * For ASCII, the UTF-32 canonization pipeline of utf32_canonize() boils
+ * down to lower-casing letters, dropping control characters but '\n', and
+ * collapsing everything else into single spaces, as utf32_filter() does.
+ * Since all ASCII characters belong to the same Unicode block, no space
+ * is ever inserted by utf32_split_blocks().
+ *
+ * Runs of letters and digits are lower-cased a memory word at a time.
+ *
+ * @param src		the ASCII string
+ * @param len		length of the string
+ *
+ * @return canonized string (halloc()-ed).
+ */
+static char *
+utf8_canonize_ascii(const char *src, size_t len)
+{
+	const char *s = src, *end = &src[len];
+	char *dst, *q;
+	bool space = TRUE;	/* prevent adding leading space */
+
+	q = dst = halloc(len + 1);
+
+	while (s != end) {
+		uchar c;
+
+		while (UNSIGNED(end - s) >= OPSIZ) {
+			op_t w, upper;
+
+			memcpy(&w, s, OPSIZ);
+			upper = UTF8_BYTES_IN(w, 'A', 'Z');
+
+			if (
+				UTF8_HIGHMASK != (upper |
+					UTF8_BYTES_IN(w, 'a', 'z') | UTF8_BYTES_IN(w, '0', '9'))
+			)
+				break;
+
+			w |= upper >> 2;		/* 0x80 >> 2 is 0x20, the case bit */
+			memcpy(q, &w, OPSIZ);
+			q += OPSIZ;
+			s += OPSIZ;
+			space = FALSE;
+		}
+
+		if (s == end)
+			break;
+
+		c = *s++;
+
+		if (is_ascii_alnum(c)) {
+			*q++ = ascii_tolower(c);
+			space = FALSE;
+		} else if ('\n' == c) {
+			*q++ = c;
+		} else if (!is_ascii_cntrl(c)) {
+			if (!space && s != end)
+				*q++ = ' ';
+			space = TRUE;
+		}
+	}
+
+	*q = '\0';
+	return dst;
+}
+
 /**
- * Apply the NFKD/NFC algo to have nomalized keywords (string is halloc()-ed)
+ * Canonize string through its UTF-32 representation.
  */
-char *
-utf8_canonize(const char *src)
+static char *
+utf8_canonize_utf32(const char *src)
 {
 	uint32 *dst32;
 
-	g_assert(utf8_is_valid_string(src));
-
 	{
 		size_t n;
 		uint32 buf[1024];
@@ -5710,6 +5888,26 @@ utf8_canonize(const char *src)
 	return cast_to_char_ptr(dst32);
 }
 
+/**
+ * Apply the NFKD/NFC algo to have nomalized keywords (string is halloc()-ed)
+ *
+ * Pure ASCII strings, which are the vast majority of queries and filenames,
+ * take a fast path that does not need the UTF-32 conversion.
+ */
+char *
+utf8_canonize(const char *src)
+{
+	size_t ascii_len;
+
+	g_assert(utf8_is_valid_string(src));
+
+	ascii_len = utf8_ascii_span(src);
+	if ('\0' == src[ascii_len])
+		return utf8_canonize_ascii(src, ascii_len);
+
+	return utf8_canonize_utf32(src);
+}
+
 /**
  * Helper function to sort the lists of ``utf32_compose_roots''.
  */
@@ -6257,6 +6455,48 @@ regression_utf8_strlower(void)
 	}
 }
 
+/**
+ * Make sure the ASCII canonization path agrees with the UTF-32 one.
+ */
+static void
+regression_ascii_canonize(void)
+{
+	static const char *tests[] = {
+		"",
+		" ",
+		"a",
+		"The Beatles - Let It Be (Remastered 2009).mp3",
+		"  leading and trailing  ",
+		"trailing dot.",
+		"dots.instead.of.spaces!!",
+		"MiXeD CaSe 0123456789 WORDS",
+		"tab\tand\nnewline\r\n",
+		"[ABCDEFGHIJKLMNOPQRSTUVWXYZ]{abcdefghijklmnopqrstuvwxyz}@`",
+		"ctrl\001\002\177chars",
+		"long_ascii_run_spanning_several_memory_words_to_test_swar.avi",
+	};
+	uint i;
+
+	for (i = 0; i < N_ITEMS(tests); i++) {
+		const char *src = tests[i];
+		char *a, *b;
+
+		g_assert(is_ascii_string(src));
+		g_assert(utf8_is_valid_string(src));
+		g_assert(vstrlen(src) == utf8_ascii_span(src));
+
+		a = utf8_canonize_ascii(src, vstrlen(src));
+		b = utf8_canonize_utf32(src);
+
+		g_assert_log(0 == strcmp(a, b),
+			"%s(): src=\"%s\", ascii=\"%s\", utf32=\"%s\"",
+			G_STRFUNC, src, a, b);
+
+		HFREE_NULL(a);
+		HFREE_NULL(b);
+	}
+}
+
 /**
  * The following code is supposed to reproduce bug #1211413.
  */
@@ -6885,6 +7125,7 @@ utf8_regression_checks(void)
 	REGRESSION(normalization_character_identity);
 	REGRESSION(normalization_issue);
 	REGRESSION(utf8_strlower);
+	REGRESSION(ascii_canonize);
 	REGRESSION(bug_1211413);
 	REGRESSION(iconv_utf8_to_utf8);
 	REGRESSION(utf8_bijection);
@@ -66,9 +66,11 @@ typedef enum {
 
 void locale_init(void);
 void locale_close(void);
+void utf8_regression_checks(void);
 const char *locale_get_charset(void);
 const char *locale_get_language(void);
 uint utf8_char_len(const char *s);
+size_t utf8_ascii_span(const char *s);
 bool is_ascii_string(const char *str);
 bool utf8_is_valid_string(const char *s);
 bool utf8_is_valid_data(const char *s, size_t n);
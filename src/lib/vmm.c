@@ -195,6 +195,11 @@ static int vmm_oom_detected;
 #define VMM_WARN_THRESH		512	/**< Pages, 2 MiB with 4K pages */
 #define VMM_MOVE_THRESH		16	/**< Pages, user threshold if within region! */
 
+#define VMM_HUGE_REGIONS	256	/**< Max amount of huge page regions */
+#define VMM_HUGE_UNITS		32	/**< Allocation units in shared huge regions */
+#define VMM_HUGE_UNIT_MIN	(64 * 1024)			/**< Minimum allocation unit */
+#define VMM_HUGE_PAGE_DFLT	(2 * 1024 * 1024)	/**< If we don't know better */
+
 #define PMAP_FOREIGN_TRY	512	/**< Amount of foreign pages we try to allocate */
 
 struct page_info {
@@ -344,11 +349,21 @@ static struct vmm_stats {
 	uint64 hole_invalidated;		/**< Times we invalidate cached hole */
 	uint64 hole_updated;			/**< Times we updated the cached hole */
 	uint64 hole_unchanged;			/**< Times we left the cached hole as-is */
+	uint64 huge_allocations;		/**< Allocations from huge page regions */
+	uint64 huge_freeings;			/**< Freeings to huge page regions */
+	uint64 huge_fallbacks;			/**< Huge allocations served by vmm_alloc() */
+	uint64 huge_mmaps;				/**< Huge page regions mapped */
+	uint64 huge_mmaps_hugetlb;		/**< Huge regions mapped via MAP_HUGETLB */
+	uint64 huge_munmaps;			/**< Huge page regions unmapped */
 	size_t user_memory;				/**< Amount of "user" memory allocated */
 	size_t user_pages;				/**< Amount of "user" memory pages used */
 	size_t user_blocks;				/**< Amount of "user" memory blocks */
 	size_t core_memory;				/**< Amount of "core" memory allocated */
 	size_t core_pages;				/**< Amount of "core" memory pages used */
+	size_t huge_regions;			/**< Amount of huge page regions mapped */
+	size_t huge_memory;				/**< Memory mapped in huge page regions */
+	size_t huge_memory_hugetlb;		/**< Part of it backed by MAP_HUGETLB */
+	size_t huge_memory_used;		/**< Huge page memory allocated */
 	/* Tracking core blocks doesn't make sense: "core" can be fragmented */
 	memusage_t *user_mem;			/**< User memory usage statistics */
 	memusage_t *core_mem;			/**< Core usage statistics */
@@ -363,6 +378,30 @@ static spinlock_t vmm_stats_slk = SPINLOCK_INIT;
 
 #define VMM_STATS_INCX(x)	AU64_INC(&vmm_stats.x)
 
+/**
+ * A huge page region.
+ */
+struct vmm_huge_region {
+	char *base;			/**< Start of region, NULL if slot is unused */
+	size_t len;			/**< Length of region */
+	uint32 used;		/**< Bitmap of allocated units, for shared regions */
+	bool shared;		/**< Whether region is carved into allocation units */
+	bool hugetlb;		/**< Whether region is backed by MAP_HUGETLB */
+};
+
+/**
+ * Huge page regions, and how we can map them.
+ */
+static struct vmm_huge {
+	struct vmm_huge_region region[VMM_HUGE_REGIONS];
+	size_t pagesize;	/**< Huge page size, 0 if we cannot use huge pages */
+	size_t unit;		/**< Allocation unit in shared regions */
+	bool thp;			/**< Whether transparent huge pages are enabled */
+	bool hugetlb;		/**< Whether to attempt MAP_HUGETLB mappings */
+} vmm_huge;
+static spinlock_t vmm_huge_slk = SPINLOCK_INIT;
+static once_flag_t vmm_huge_inited;
+
 /**
  * The local version of the process memory map.
  */
@@ -5848,6 +5887,23 @@ vmm_malloc_inited(void)
 #endif
 }
 
+/**
+ * @return amount of memory currently allocated through the VMM layer, for
+ * both user and core memory, including blocks served from huge page regions.
+ */
+size_t
+vmm_memory_allocated(void)
+{
+	size_t n;
+
+	VMM_STATS_LOCK;
+	n = vmm_stats.user_memory + vmm_stats.core_memory +
+		vmm_stats.huge_memory_used;
+	VMM_STATS_UNLOCK;
+
+	return n;
+}
+
 /**
  * Generate a SHA1 digest of the current VMM statistics.
  *
@@ -6036,6 +6092,12 @@ vmm_dump_stats_log(logagent_t *la, unsigned options)
 	DUMP(hole_invalidated);
 	DUMP(hole_updated);
 	DUMP(hole_unchanged);
+	DUMP(huge_allocations);
+	DUMP(huge_freeings);
+	DUMP(huge_fallbacks);
+	DUMP(huge_mmaps);
+	DUMP(huge_mmaps_hugetlb);
+	DUMP(huge_munmaps);
 
 #undef DUMP
 #define DUMP(x) log_info(la, "VMM pmap_%s = %s", #x,	\
@@ -6064,6 +6126,10 @@ vmm_dump_stats_log(logagent_t *la, unsigned options)
 	DUMP(user_blocks);
 	DUMP(core_memory);
 	DUMP(core_pages);
+	DUMP(huge_regions);
+	DUMP(huge_memory);
+	DUMP(huge_memory_hugetlb);
+	DUMP(huge_memory_used);
 
 #undef DUMP
 
@@ -6103,6 +6169,7 @@ vmm_dump_stats_log(logagent_t *la, unsigned options)
 	DUMP("cached_pages", cached_pages);
 	DUMP("mapped_pages", mapped_pages);
 	DUMP("native_pages", native_pages);
+	DUMP("huge_pagesize", vmm_huge.pagesize);
 
 	/*
 	 * "computed_native_pages" MUST be equal to "native_pages" or it means
@@ -6820,6 +6887,589 @@ vmm_munmap(void *addr, size_t length)
 #endif	/* HAS_MMAP */
 }
 
+/***
+ *** Huge page regions.
+ ***/
+
+/*
+ * Large arenas which are accessed randomly and kept around for a long time
+ * (query routing tables, message routing chunks, big hash tables) suffer
+ * from TLB misses when they are spread over regular pages.  The huge page
+ * allocation class maps huge-page aligned regions, backed by MAP_HUGETLB
+ * when the kernel has a huge page pool configured, or advised with
+ * MADV_HUGEPAGE so that transparent huge pages can be used otherwise.
+ *
+ * Requests up to half a huge page are carved from shared regions, in units
+ * tracked by a bitmap.  Larger requests get their own region, rounded up to
+ * a multiple of the huge page size.
+ *
+ * When huge pages are not available, or when we run out of region slots,
+ * allocations are transparently handled by vmm_alloc().  Since vmm_huge_free()
+ * recognizes the blocks it handed out, it can be used on any block allocated
+ * by vmm_huge_alloc().
+ */
+
+#if defined(HAS_MMAP) && !defined(MINGW32)
+#define VMM_HUGE_SUPPORTED
+#endif
+
+#define VMM_HUGE_THP_ENABLED	"/sys/kernel/mm/transparent_hugepage/enabled"
+#define VMM_HUGE_THP_SIZE		"/sys/kernel/mm/transparent_hugepage/hpage_pmd_size"
+#define VMM_HUGE_NR_HUGEPAGES	"/proc/sys/vm/nr_hugepages"
+
+/**
+ * Read small system file into supplied buffer, NUL-terminating it.
+ *
+ * We do not use stdio here since this can be called early, from the
+ * memory allocator.
+ *
+ * @return TRUE if we could read something.
+ */
+static bool
+vmm_huge_read(const char *path, char *buf, size_t len)
+{
+	int fd;
+	ssize_t r;
+
+	fd = open(path, O_RDONLY);
+	if (-1 == fd)
+		return FALSE;
+
+	r = read(fd, buf, len - 1);
+	close(fd);
+
+	if (r <= 0)
+		return FALSE;
+
+	buf[r] = '\0';
+	return TRUE;
+}
+
+/**
+ * Read small system file holding a number.
+ *
+ * @return the number read, 0 if we cannot read or parse it.
+ */
+static uint64
+vmm_huge_read_number(const char *path)
+{
+	char buf[64];
+	const char *end;
+	uint64 v;
+	int error;
+
+	if (!vmm_huge_read(path, buf, sizeof buf))
+		return 0;
+
+	v = parse_uint64(buf, &end, 10, &error);
+	return 0 == error ? v : 0;
+}
+
+/**
+ * Determine whether and how we can use huge pages.
+ */
+static void G_COLD
+vmm_huge_init_once(void)
+{
+#ifdef VMM_HUGE_SUPPORTED
+	uint64 pagesize;
+	char buf[128];
+
+#if defined(HAS_MADVISE) && defined(MADV_HUGEPAGE)
+	if (vmm_huge_read(VMM_HUGE_THP_ENABLED, buf, sizeof buf))
+		vmm_huge.thp = NULL == strstr(buf, "[never]");
+#endif	/* MADV_HUGEPAGE */
+
+#ifdef MAP_HUGETLB
+	vmm_huge.hugetlb = 0 != vmm_huge_read_number(VMM_HUGE_NR_HUGEPAGES);
+#endif	/* MAP_HUGETLB */
+
+	pagesize = vmm_huge_read_number(VMM_HUGE_THP_SIZE);
+
+	if (
+		0 == pagesize || !IS_POWER_OF_2(pagesize) ||
+		pagesize <= compat_pagesize() || pagesize > (1U << 30)
+	)
+		pagesize = VMM_HUGE_PAGE_DFLT;
+
+	if (vmm_huge.thp || vmm_huge.hugetlb) {
+		vmm_huge.pagesize = pagesize;
+		vmm_huge.unit = MAX(VMM_HUGE_UNIT_MIN, pagesize / VMM_HUGE_UNITS);
+	}
+
+	if (vmm_debugging(0)) {
+		s_minidbg("VMM huge pages: %s (%'zuKiB, transparent=%s, hugetlb=%s)",
+			0 == vmm_huge.pagesize ? "disabled" : "enabled",
+			(size_t) pagesize / 1024,
+			vmm_huge.thp ? "y" : "n", vmm_huge.hugetlb ? "y" : "n");
+	}
+#endif	/* VMM_HUGE_SUPPORTED */
+}
+
+/**
+ * Check whether it makes sense to request a block of the given size through
+ * vmm_huge_alloc().
+ *
+ * Huge page regions are not used for blocks smaller than the allocation unit
+ * of shared huge regions, nor when huge pages are not available.
+ *
+ * @return TRUE if block of that size can be allocated from huge pages.
+ */
+bool
+vmm_huge_eligible(size_t size)
+{
+	if G_UNLIKELY(!vmm_is_inited())
+		return FALSE;
+
+	ONCE_FLAG_RUN(vmm_huge_inited, vmm_huge_init_once);
+
+	return 0 != vmm_huge.pagesize && size >= vmm_huge.unit;
+}
+
+/**
+ * Map a new huge-page aligned region.
+ *
+ * @param len		length of the region (multiple of the huge page size)
+ * @param hugetlb	written with TRUE if region is backed by MAP_HUGETLB
+ *
+ * @return the start of the region, NULL if we could not map it.
+ */
+static void *
+vmm_huge_map(size_t len, bool *hugetlb)
+{
+#ifdef VMM_HUGE_SUPPORTED
+	size_t hp = vmm_huge.pagesize;
+	void *p, *q;
+
+	*hugetlb = FALSE;
+
+#ifdef MAP_HUGETLB
+	if (vmm_huge.hugetlb) {
+		p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+		if G_LIKELY(MAP_FAILED != p) {
+			*hugetlb = TRUE;
+			q = p;
+			goto mapped;
+		}
+
+		/*
+		 * The huge page pool is exhausted or was not reserved, do not
+		 * attempt further MAP_HUGETLB mappings.
+		 */
+
+		vmm_huge.hugetlb = FALSE;
+
+		if (vmm_debugging(0)) {
+			s_miniwarn("VMM cannot map %'zuKiB of huge pages, "
+				"disabling MAP_HUGETLB: %m", len / 1024);
+		}
+	}
+#endif	/* MAP_HUGETLB */
+
+	if (!vmm_huge.thp)
+		return NULL;
+
+	/*
+	 * Over-allocate by one huge page so that we can trim the region to
+	 * make it start on a huge page boundary, which is required for the
+	 * kernel to back it with transparent huge pages.
+	 */
+
+	p = vmm_valloc(NULL, len + hp);
+
+	if G_UNLIKELY(MAP_FAILED == p)
+		return NULL;
+
+	q = ulong_to_pointer((pointer_to_ulong(p) + hp - 1) & ~(hp - 1));
+
+	if (q != p)
+		vmm_vfree_fragment(p, ptr_diff(q, p));
+	if (ptr_diff(q, p) != hp)
+		vmm_vfree_fragment(ptr_add_offset(q, len), hp - ptr_diff(q, p));
+
+#if defined(HAS_MADVISE) && defined(MADV_HUGEPAGE)
+	madvise(q, len, MADV_HUGEPAGE);
+#endif	/* MADV_HUGEPAGE */
+
+#ifdef MAP_HUGETLB
+mapped:
+#endif
+	VMM_STATS_INCX(mmaps);
+	pmap_mmap(vmm_pmap(), q, len);
+
+	VMM_STATS_LOCK;
+	vmm_stats.huge_mmaps++;
+	if (*hugetlb) {
+		vmm_stats.huge_mmaps_hugetlb++;
+		vmm_stats.huge_memory_hugetlb += len;
+	}
+	vmm_stats.huge_regions++;
+	vmm_stats.huge_memory += len;
+	VMM_STATS_UNLOCK;
+
+	if (vmm_debugging(5)) {
+		s_minidbg("VMM mapped %'zuKiB huge page region at %p%s",
+			len / 1024, q, *hugetlb ? " (hugetlb)" : "");
+	}
+
+	return q;
+#else	/* !VMM_HUGE_SUPPORTED */
+	(void) len;
+	*hugetlb = FALSE;
+	return NULL;
+#endif	/* VMM_HUGE_SUPPORTED */
+}
+
+/**
+ * Unmap huge page region.
+ */
+static void
+vmm_huge_unmap(void *base, size_t len, bool hugetlb)
+{
+	vmm_munmap(base, len);
+
+	VMM_STATS_LOCK;
+	vmm_stats.huge_munmaps++;
+	if (hugetlb)
+		vmm_stats.huge_memory_hugetlb -= len;
+	vmm_stats.huge_regions--;
+	vmm_stats.huge_memory -= len;
+	VMM_STATS_UNLOCK;
+}
+
+/**
+ * Find a free huge region slot.
+ *
+ * @return free slot, NULL if none is available.
+ */
+static struct vmm_huge_region *
+vmm_huge_slot(void)
+{
+	size_t i;
+
+	g_assert(spinlock_is_held(&vmm_huge_slk));
+
+	for (i = 0; i < N_ITEMS(vmm_huge.region); i++) {
+		struct vmm_huge_region *hr = &vmm_huge.region[i];
+
+		if (NULL == hr->base)
+			return hr;
+	}
+
+	return NULL;
+}
+
+/**
+ * Find the huge region holding a pointer.
+ *
+ * @return the region, NULL if the pointer does not belong to a huge region.
+ */
+static struct vmm_huge_region *
+vmm_huge_lookup(const void *p)
+{
+	const char *c = p;
+	size_t i;
+
+	g_assert(spinlock_is_held(&vmm_huge_slk));
+
+	for (i = 0; i < N_ITEMS(vmm_huge.region); i++) {
+		struct vmm_huge_region *hr = &vmm_huge.region[i];
+
+		if (hr->base != NULL && c >= hr->base && c < hr->base + hr->len)
+			return hr;
+	}
+
+	return NULL;
+}
+
+/**
+ * Count shared huge regions.
+ */
+static size_t
+vmm_huge_shared_count(void)
+{
+	size_t i, n = 0;
+
+	g_assert(spinlock_is_held(&vmm_huge_slk));
+
+	for (i = 0; i < N_ITEMS(vmm_huge.region); i++) {
+		struct vmm_huge_region *hr = &vmm_huge.region[i];
+
+		if (hr->base != NULL && hr->shared)
+			n++;
+	}
+
+	return n;
+}
+
+/**
+ * Compute amount of allocation units required in shared huge regions.
+ */
+static inline size_t
+vmm_huge_units(size_t size)
+{
+	return (size + vmm_huge.unit - 1) / vmm_huge.unit;
+}
+
+/**
+ * Allocate block from a shared huge region, mapping a new region if needed.
+ *
+ * @return allocated block, NULL if we could not allocate it.
+ */
+static void *
+vmm_huge_alloc_shared(size_t size)
+{
+	size_t n = vmm_huge_units(size);
+	uint32 mask = (1U << n) - 1;
+	struct vmm_huge_region *hr;
+	void *base, *p;
+	bool hugetlb;
+	size_t i;
+	unsigned j;
+
+	g_assert(n < VMM_HUGE_UNITS);
+
+	spinlock(&vmm_huge_slk);
+
+	for (i = 0; i < N_ITEMS(vmm_huge.region); i++) {
+		hr = &vmm_huge.region[i];
+
+		if (NULL == hr->base || !hr->shared)
+			continue;
+
+		for (j = 0; j + n <= VMM_HUGE_UNITS; j++) {
+			if (0 == (hr->used & (mask << j)))
+				goto found;
+		}
+	}
+
+	spinunlock(&vmm_huge_slk);
+
+	/*
+	 * No room in existing shared regions, map a new one.
+	 */
+
+	base = vmm_huge_map(vmm_huge.pagesize, &hugetlb);
+
+	if (NULL == base)
+		return NULL;
+
+	spinlock(&vmm_huge_slk);
+
+	hr = vmm_huge_slot();
+
+	if G_UNLIKELY(NULL == hr) {
+		spinunlock(&vmm_huge_slk);
+		vmm_huge_unmap(base, vmm_huge.pagesize, hugetlb);
+		return NULL;
+	}
+
+	hr->base = base;
+	hr->len = vmm_huge.pagesize;
+	hr->used = 0;
+	hr->shared = TRUE;
+	hr->hugetlb = hugetlb;
+	j = 0;
+
+	/* FALL THROUGH */
+
+found:
+	hr->used |= mask << j;
+	p = ptr_add_offset(hr->base, j * vmm_huge.unit);
+
+	spinunlock(&vmm_huge_slk);
+
+	VMM_STATS_LOCK;
+	vmm_stats.huge_allocations++;
+	vmm_stats.huge_memory_used += n * vmm_huge.unit;
+	VMM_STATS_UNLOCK;
+
+	return p;
+}
+
+/**
+ * Allocate block in its own huge region.
+ *
+ * @return allocated block, NULL if we could not allocate it.
+ */
+static void *
+vmm_huge_alloc_region(size_t size)
+{
+	size_t len = round_size_fast(vmm_huge.pagesize, size);
+	struct vmm_huge_region *hr;
+	bool hugetlb;
+	void *p;
+
+	p = vmm_huge_map(len, &hugetlb);
+
+	if (NULL == p)
+		return NULL;
+
+	spinlock(&vmm_huge_slk);
+
+	hr = vmm_huge_slot();
+
+	if G_UNLIKELY(NULL == hr) {
+		spinunlock(&vmm_huge_slk);
+		vmm_huge_unmap(p, len, hugetlb);
+		return NULL;
+	}
+
+	hr->base = p;
+	hr->len = len;
+	hr->used = 0;
+	hr->shared = FALSE;
+	hr->hugetlb = hugetlb;
+
+	spinunlock(&vmm_huge_slk);
+
+	VMM_STATS_LOCK;
+	vmm_stats.huge_allocations++;
+	vmm_stats.huge_memory_used += len;
+	VMM_STATS_UNLOCK;
+
+	return p;
+}
+
+/**
+ * Allocate memory, backed by huge pages when possible.
+ *
+ * This is meant for large arenas that are kept around and accessed randomly,
+ * for which TLB misses matter.  Memory must be freed with vmm_huge_free().
+ *
+ * @param size		size of the block to allocate
+ *
+ * @return allocated block, never NULL.
+ */
+void *
+vmm_huge_alloc(size_t size)
+{
+	void *p;
+
+	g_assert(size_is_positive(size));
+
+	if (!vmm_huge_eligible(size))
+		return vmm_alloc(size);
+
+	if (size <= vmm_huge.pagesize / 2)
+		p = vmm_huge_alloc_shared(size);
+	else
+		p = vmm_huge_alloc_region(size);
+
+	if G_LIKELY(p != NULL)
+		return p;
+
+	VMM_STATS_LOCK;
+	vmm_stats.huge_fallbacks++;
+	VMM_STATS_UNLOCK;
+
+	return vmm_alloc(size);
+}
+
+/**
+ * Allocate zeroed memory, backed by huge pages when possible.
+ *
+ * @param size		size of the block to allocate
+ *
+ * @return allocated block, never NULL.
+ */
+void *
+vmm_huge_alloc0(size_t size)
+{
+	void *p = vmm_huge_alloc(size);
+
+	memset(p, 0, size);
+	return p;
+}
+
+/**
+ * Free memory allocated by vmm_huge_alloc().
+ *
+ * @param p			the allocated block (may be NULL)
+ * @param size		size of the block, as given to vmm_huge_alloc()
+ */
+void
+vmm_huge_free(void *p, size_t size)
+{
+	struct vmm_huge_region *hr;
+	void *base = NULL;
+	size_t len = 0, used;
+	bool hugetlb = FALSE;
+
+	if (NULL == p)
+		return;
+
+	g_assert(size_is_positive(size));
+
+	if (0 == vmm_huge.pagesize)
+		goto not_huge;
+
+	spinlock(&vmm_huge_slk);
+
+	hr = vmm_huge_lookup(p);
+
+	if (NULL == hr) {
+		spinunlock(&vmm_huge_slk);
+		goto not_huge;
+	}
+
+	if (hr->shared) {
+		size_t n = vmm_huge_units(size);
+		size_t j = ptr_diff(p, hr->base) / vmm_huge.unit;
+		uint32 mask = ((1U << n) - 1) << j;
+
+		g_assert_log(p == ptr_add_offset(hr->base, j * vmm_huge.unit),
+			"%s(): p=%p, region base=%p", G_STRFUNC, p, hr->base);
+		g_assert_log(mask == (hr->used & mask),
+			"%s(): p=%p, size=%zu, used=0x%x, mask=0x%x",
+			G_STRFUNC, p, size, hr->used, mask);
+
+		hr->used &= ~mask;
+		used = n * vmm_huge.unit;
+
+		/*
+		 * Keep the last shared region around even when it becomes empty,
+		 * to avoid mapping and unmapping it repeatedly.
+		 */
+
+		if (0 == hr->used && vmm_huge_shared_count() > 1)
+			goto release;
+	} else {
+		g_assert_log(p == hr->base,
+			"%s(): p=%p, region base=%p", G_STRFUNC, p, hr->base);
+
+		used = hr->len;
+		goto release;
+	}
+
+	spinunlock(&vmm_huge_slk);
+	goto done;
+
+release:
+	base = hr->base;
+	len = hr->len;
+	hugetlb = hr->hugetlb;
+	ZERO(hr);
+	spinunlock(&vmm_huge_slk);
+
+	vmm_huge_unmap(base, len, hugetlb);
+
+	/* FALL THROUGH */
+
+done:
+	VMM_STATS_LOCK;
+	vmm_stats.huge_freeings++;
+	vmm_stats.huge_memory_used -= used;
+	VMM_STATS_UNLOCK;
+
+	return;
+
+not_huge:
+	vmm_free(p, size);
+}
+
 /***
  *** Allocation tracking -- enabled by compiling with -DTRACK_VMM.
  ***/
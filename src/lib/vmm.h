@@ -163,12 +163,18 @@ void vmm_dump_pcache_log(struct logagent *la);
 struct sha1;
 
 void vmm_stats_digest(struct sha1 *digest);
+size_t vmm_memory_allocated(void);
 
 void vmm_madvise_free(void *p, size_t size);
 void vmm_madvise_normal(void *p, size_t size);
 void vmm_madvise_sequential(void *p, size_t size);
 void vmm_madvise_willneed(void *p, size_t size);
 
+bool vmm_huge_eligible(size_t size);
+void *vmm_huge_alloc(size_t size) G_MALLOC G_NON_NULL;
+void *vmm_huge_alloc0(size_t size) G_MALLOC G_NON_NULL;
+void vmm_huge_free(void *p, size_t size);
+
 void *vmm_mmap(void *addr, size_t length,
 	int prot, int flags, int fd, fileoffset_t offset);
 int vmm_munmap(void *addr, size_t length);
@@ -122,88 +122,91 @@ word_vec_make(const char *query_str, word_vec_t **wovec)
 	htable_t *seen_word = NULL;
 	uint nv = WOVEC_DFLT;
 	word_vec_t *wv = zalloc(wovec_zone);
-	const char *start = NULL;
 	char * const query_dup = h_strdup(query_str);
-	char *query;
-	uchar c;
+	char *query = query_dup;
 
 	g_assert(wovec != NULL);
 
-	for (query = query_dup; /* empty */; query++) {
-		bool is_separator;
+	for (;;) {
+		char *start, *end;
+		bool last;
+		uint np1;
 
-		c = *(uchar *) query;
 		/*
-	 	 * We can't meet other separators than space, because the
-	 	 * string is normalised.
-	 	 */
-		is_separator = c == ' ' || c == '\0';
-
-		if (start == NULL) {				/* Not in a word yet */
-			if (!is_separator)
-				start = query;
-		} else {
-			uint np1;
-
-			if (!is_separator)
-				continue;
-
-			*query = '\0';
-
-			/* Only create a hash table if there is more than one word. */
-			if G_UNLIKELY(0 == n)
-				np1 = 0;
-			else {
-				if G_UNLIKELY(NULL == seen_word) {
-					seen_word = htable_create(HASH_KEY_STRING, 0);
-					htable_insert(seen_word, wv[0].word, uint_to_pointer(1));
-				}
-
-				/*
-			 	 * If word already seen in query, it's in the seen_word table.
-				 * The associated value is the index in the vector plus 1: that
-				 * way, we can know a word is not present in the table since
-				 * the line below will evaluate to 0.
-		 	 	 */
-
-				np1 = pointer_to_uint(htable_lookup(seen_word, start));
+		 * We can't meet other separators than space, because the
+		 * string is normalised.  Hence we can locate the end of each
+		 * word with vstrchr(), which scans a memory word at a time.
+		 */
+
+		while (' ' == *query)
+			query++;
+
+		if ('\0' == *query)
+			break;
+
+		start = query;
+		end = vstrchr(start, ' ');
+		if (NULL == end)
+			end = start + vstrlen(start);
+
+		last = '\0' == *end;
+		*end = '\0';
+
+		/* Only create a hash table if there is more than one word. */
+		if G_UNLIKELY(0 == n)
+			np1 = 0;
+		else {
+			if G_UNLIKELY(NULL == seen_word) {
+				seen_word = htable_create(HASH_KEY_STRING, 0);
+				htable_insert(seen_word, wv[0].word, uint_to_pointer(1));
 			}
 
-			if (np1--) {
-				/* Word already seen before */
-				g_assert(np1 < n);
-				wv[np1].amount++;
-			} else {
-				/* We are dealing with a new word */
-				word_vec_t *entry;
-
-				if G_UNLIKELY(n == nv) {		/* Filled all the slots */
-					nv *= 2;
-					if (n > WOVEC_DFLT)
-						HREALLOC_ARRAY(wv, nv);
-					else
-						wv = word_vec_zrealloc(wv, nv);
-				}
-				entry = &wv[n++];
-				entry->len = query - start;
-				entry->word = walloc(entry->len + 1);	/* For trailing NUL */
-				memcpy(entry->word, start, entry->len + 1); /* Includes NUL */
-
-				entry->amount = 1;
-
-				/*
-				 * Delay insertion of first word until we find another one.
-				 * The hash table storing duplicates is not created for
-				 * the first word.
-				 */
-
-				if (n > 1)
-					htable_insert(seen_word, entry->word, uint_to_pointer(n));
+			/*
+			 * If word already seen in query, it's in the seen_word table.
+			 * The associated value is the index in the vector plus 1: that
+			 * way, we can know a word is not present in the table since
+			 * the line below will evaluate to 0.
+			 */
+
+			np1 = pointer_to_uint(htable_lookup(seen_word, start));
+		}
+
+		if (np1--) {
+			/* Word already seen before */
+			g_assert(np1 < n);
+			wv[np1].amount++;
+		} else {
+			/* We are dealing with a new word */
+			word_vec_t *entry;
+
+			if G_UNLIKELY(n == nv) {		/* Filled all the slots */
+				nv *= 2;
+				if (n > WOVEC_DFLT)
+					HREALLOC_ARRAY(wv, nv);
+				else
+					wv = word_vec_zrealloc(wv, nv);
 			}
-			start = NULL;
+			entry = &wv[n++];
+			entry->len = end - start;
+			entry->word = walloc(entry->len + 1);	/* For trailing NUL */
+			memcpy(entry->word, start, entry->len + 1); /* Includes NUL */
+
+			entry->amount = 1;
+
+			/*
+			 * Delay insertion of first word until we find another one.
+			 * The hash table storing duplicates is not created for
+			 * the first word.
+			 */
+
+			if (n > 1)
+				htable_insert(seen_word, entry->word, uint_to_pointer(n));
 		}
 
-		if (c == '\0') break;
+		if (last)
+			break;
+
+		query = end + 1;
 	}
 
 	htable_free_null(&seen_word);	/* Key pointers belong to vector */
@@ -0,0 +1,494 @@
+/*
+ * zlib-test -- benchmark of compressed broadcasting over many links.
+ *
+ * Copyright (c) 2026 agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the authors nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * When a query is broadcast, each Gnutella connection compresses the same
+ * message independently in its own deflating stream.  This program measures
+ * what that costs over many links, and compares it with compressing each
+ * message only once into a history-free block (ending with a full flush),
+ * which can then be appended verbatim to any deflating stream at a byte
+ * boundary, since it does not refer to any previously sent data.
+ *
+ * The second strategy trades compression ratio (no back-references across
+ * messages) against CPU and memory (no per-link compression state), and
+ * the aim is to quantify both sides.  The spliced streams are inflated
+ * back to make sure the approach yields valid streams.
+ */
+
+#include "common.h"
+
+#include <zlib.h>
+
+#include "endian.h"
+#include "log.h"
+#include "progname.h"
+#include "rand31.h"
+#include "stringify.h"
+#include "tm.h"
+#include "xmalloc.h"
+#include "zlib_util.h"
+
+#define OUT_BUFSIZ	65536		/* Scratch output buffer for deflate() */
+
+/*
+ * A message to broadcast, along with the links to which it is sent.
+ */
+struct msg {
+	uint8 *data;
+	size_t len;
+	uint8 *dest;				/* Per link: whether message is sent */
+};
+
+/*
+ * A link, with the stream of bytes it sent.
+ */
+struct link {
+	z_streamp z;				/* Compressor, NULL if sharing frames */
+	uint64 out;					/* Amount of bytes sent */
+	uint8 *sent;				/* What was sent, when checked */
+	size_t sent_len;
+	size_t sent_size;
+};
+
+static unsigned initial_seed;
+static bool verbose;
+static uint8 out_buf[OUT_BUFSIZ];
+
+static const char *words[] = {
+	"the", "of", "and", "live", "mix", "remix", "feat", "album", "mp3",
+	"ogg", "flac", "avi", "mkv", "linux", "iso", "pdf", "book", "jazz",
+	"rock", "blues", "best", "greatest", "hits", "2025", "2026", "vol",
+	"edition", "remastered", "bach", "mozart", "beatles", "queen", "disco",
+	"original", "soundtrack", "episode", "season", "documentary", "guide",
+};
+
+static void G_NORETURN
+usage(void)
+{
+	fprintf(stderr,
+		"Usage: %s [-hv] [-c level] [-f flush] [-l links] [-m messages]\n"
+		"       [-M mem_level] [-p percent] [-w window_bits] [-R seed]\n"
+		"  -c : compression level (default 9)\n"
+		"  -f : per-link flush every that many messages (default 1)\n"
+		"  -h : prints this help message\n"
+		"  -l : amount of links (default 64)\n"
+		"  -m : amount of messages to broadcast (default 5000)\n"
+		"  -p : percentage of links to which each message is sent"
+			" (default 75)\n"
+		"  -v : verbose mode\n"
+		"  -w : log2 of compression window size (default 15)\n"
+		"  -M : compression memory level (default 9)\n"
+		"  -R : seed for repeatable random sequence\n"
+		, getprogname());
+	exit(EXIT_FAILURE);
+}
+
+/**
+ * Build a message resembling a Gnutella query: a header with a random
+ * MUID, followed by a few keywords and a random binary trailer standing for
+ * the GGEP extensions, which compress poorly.
+ */
+static void
+msg_fill(struct msg *m, size_t links, unsigned percent)
+{
+	uint8 buf[512];
+	size_t i, len = 0;
+	uint words_cnt = 1 + rand31_value(4);
+
+	for (i = 0; i < 16; i++)
+		buf[len++] = rand31_value(255);		/* MUID */
+
+	buf[len++] = 0x80;						/* Query */
+	buf[len++] = 1 + rand31_value(3);		/* TTL */
+	buf[len++] = rand31_value(3);			/* Hops */
+	len += 4;								/* Size, filled below */
+	buf[len++] = 0;							/* Flags */
+	buf[len++] = 0xe0;
+
+	for (i = 0; i < words_cnt; i++) {
+		const char *w = words[rand31_value(N_ITEMS(words) - 1)];
+		size_t wl = strlen(w);
+
+		if (i != 0)
+			buf[len++] = ' ';
+		memcpy(&buf[len], w, wl);
+		len += wl;
+	}
+	buf[len++] = '\0';
+
+	if (rand31_value(1)) {
+		uint extra = 8 + rand31_value(24);
+
+		buf[len++] = 0xc3;					/* GGEP magic */
+		for (i = 0; i < extra; i++)
+			buf[len++] = rand31_value(255);
+	}
+
+	poke_le32(&buf[19], len - 23);
+
+	m->len = len;
+	m->data = xcopy(buf, len);
+	m->dest = xmalloc(links);
+
+	for (i = 0; i < links; i++)
+		m->dest[i] = (unsigned) rand31_value(99) < percent;
+}
+
+/**
+ * Record bytes sent on link.
+ */
+static void
+link_sent(struct link *l, const void *data, size_t len, bool checked)
+{
+	l->out += len;
+
+	if (!checked)
+		return;
+
+	if (l->sent_len + len > l->sent_size) {
+		l->sent_size = MAX(l->sent_size * 2, l->sent_len + len);
+		l->sent = xrealloc(l->sent, l->sent_size);
+	}
+	memcpy(&l->sent[l->sent_len], data, len);
+	l->sent_len += len;
+}
+
+/**
+ * Compress data through the stream, sending output on the link.
+ */
+static void
+link_deflate(struct link *l, z_streamp z, const void *data, size_t len,
+	int flush, bool checked)
+{
+	int ret;
+
+	z->next_in = deconstify_pointer(data);
+	z->avail_in = len;
+
+	do {
+		z->next_out = out_buf;
+		z->avail_out = sizeof out_buf;
+
+		ret = deflate(z, flush);
+		if (Z_OK != ret && Z_BUF_ERROR != ret)
+			s_error("deflate() failed: %s", zlib_strerror(ret));
+
+		link_sent(l, out_buf, sizeof out_buf - z->avail_out, checked);
+	} while (0 != z->avail_in || 0 == z->avail_out);
+}
+
+/**
+ * Inflate what was sent on the link and check we get back the messages.
+ */
+static void
+link_check(const struct link *l, size_t idx,
+	const struct msg *msgs, size_t count, const char *what)
+{
+	z_stream z;
+	uint8 *expected, *got;
+	size_t i, exp_len = 0;
+	int ret;
+
+	for (i = 0; i < count; i++) {
+		if (msgs[i].dest[idx])
+			exp_len += msgs[i].len;
+	}
+
+	expected = xmalloc(exp_len + 1);
+	got = xmalloc(exp_len + 1);
+
+	for (exp_len = 0, i = 0; i < count; i++) {
+		if (msgs[i].dest[idx]) {
+			memcpy(&expected[exp_len], msgs[i].data, msgs[i].len);
+			exp_len += msgs[i].len;
+		}
+	}
+
+	ZERO(&z);
+	ret = inflateInit(&z);
+	if (Z_OK != ret)
+		s_error("inflateInit() failed: %s", zlib_strerror(ret));
+
+	z.next_in = l->sent;
+	z.avail_in = l->sent_len;
+	z.next_out = got;
+	z.avail_out = exp_len + 1;		/* Catch any spurious output */
+
+	ret = inflate(&z, Z_SYNC_FLUSH);
+	if (Z_OK != ret && Z_BUF_ERROR != ret)
+		s_error("%s: inflate() failed on link #%zu: %s",
+			what, idx, zlib_strerror(ret));
+
+	if (0 != z.avail_in)
+		s_error("%s: %u trailing bytes on link #%zu", what, z.avail_in, idx);
+
+	if (exp_len != z.total_out || 0 != memcmp(expected, got, exp_len))
+		s_error("%s: link #%zu inflated %lu bytes, expected %zu",
+			what, idx, z.total_out, exp_len);
+
+	inflateEnd(&z);
+	xfree(expected);
+	xfree(got);
+
+	if (verbose)
+		s_info("%s: link #%zu checked, %zu bytes", what, idx, exp_len);
+}
+
+/**
+ * Emit the stream header of a link not compressing by itself, followed
+ * by an empty block to align the stream on a byte boundary.
+ */
+static void
+link_header(struct link *l, int level, int window_bits, int mem_level,
+	bool checked)
+{
+	z_streamp z;
+	int ret;
+
+	ret = zlib_deflate_stream_get(&z, level, window_bits, mem_level);
+	if (Z_OK != ret)
+		s_error("cannot create compressor: %s", zlib_strerror(ret));
+
+	link_deflate(l, z, NULL, 0, Z_SYNC_FLUSH, checked);
+	zlib_stream_put(z);
+}
+
+static void
+report(const char *what, double cpu, uint64 sends,
+	uint64 in, uint64 out, size_t memory)
+{
+	printf("%-7s %8.3f %9.3f %12s %12s %6.2f%% %10s\n", what, cpu,
+		0 == sends ? 0.0 : cpu * 1e6 / sends,
+		uint64_to_string(in), uint64_to_string2(out),
+		0 == in ? 0.0 : 100.0 * (double) (int64) (in - out) / in,
+		size_t_to_string(memory));
+}
+
+int
+main(int argc, char **argv)
+{
+	extern int optind;
+	extern char *optarg;
+	int c;
+	size_t i, j, links = 64, count = 5000, flush = 1;
+	int level = Z_BEST_COMPRESSION, window_bits = MAX_WBITS;
+	int mem_level = MAX_MEM_LEVEL;
+	unsigned percent = 75;
+	struct msg *msgs;
+	struct link *l;
+	uint64 sends = 0, in = 0, out;
+	size_t memory;
+	double start, cpu;
+	z_streamp sz;
+	int ret;
+
+	progstart(argc, argv);
+
+	while ((c = getopt(argc, argv, "c:f:hl:m:p:vw:M:R:")) != EOF) {
+		switch (c) {
+		case 'c':
+			level = atoi(optarg);
+			break;
+		case 'f':
+			flush = atol(optarg);
+			break;
+		case 'l':
+			links = atol(optarg);
+			break;
+		case 'm':
+			count = atol(optarg);
+			break;
+		case 'p':
+			percent = atoi(optarg);
+			break;
+		case 'v':
+			verbose = TRUE;
+			break;
+		case 'w':
+			window_bits = atoi(optarg);
+			break;
+		case 'M':
+			mem_level = atoi(optarg);
+			break;
+		case 'R':
+			initial_seed = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			usage();
+		}
+	}
+
+	if (
+		0 != (argc -= optind) || 0 == links || 0 == count || 0 == flush ||
+		percent > 100 || level < Z_BEST_SPEED || level > Z_BEST_COMPRESSION ||
+		window_bits < 9 || window_bits > MAX_WBITS ||
+		mem_level < 1 || mem_level > MAX_MEM_LEVEL
+	)
+		usage();
+
+	if (0 == initial_seed)
+		initial_seed = tm_time_exact();
+
+	rand31_set_seed(initial_seed);
+	s_info("use '-R %u' to reproduce a failure", initial_seed);
+
+	msgs = xmalloc0(count * sizeof msgs[0]);
+	l = xmalloc0(links * sizeof l[0]);
+
+	for (i = 0; i < count; i++) {
+		msg_fill(&msgs[i], links, percent);
+		for (j = 0; j < links; j++) {
+			if (msgs[i].dest[j]) {
+				sends++;
+				in += msgs[i].len;
+			}
+		}
+	}
+
+	printf("%zu messages over %zu links, %s sends, level %d, "
+		"window %d bits, memory level %d\n",
+		count, links, uint64_to_string(sends), level, window_bits, mem_level);
+	printf("mode     CPU (s) us / send     in bytes    out bytes  saved"
+		"  zlib / link\n");
+
+	/*
+	 * Each link compresses what it sends, flushing the stream every
+	 * "flush" messages, as the deflating TX layer does.
+	 */
+
+	for (j = 0; j < links; j++) {
+		ret = zlib_deflate_stream_get(&l[j].z, level, window_bits, mem_level);
+		if (Z_OK != ret)
+			s_error("cannot create compressor: %s", zlib_strerror(ret));
+	}
+
+	start = tm_cputime(NULL, NULL);
+
+	for (i = 0; i < count; i++) {
+		int fl = (0 == (i + 1) % flush || i + 1 == count) ?
+			Z_SYNC_FLUSH : Z_NO_FLUSH;
+
+		for (j = 0; j < links; j++) {
+			if (msgs[i].dest[j]) {
+				link_deflate(&l[j], l[j].z, msgs[i].data, msgs[i].len,
+					fl, 0 == j || links - 1 == j);
+			} else if (Z_SYNC_FLUSH == fl) {
+				link_deflate(&l[j], l[j].z, NULL, 0, fl,
+					0 == j || links - 1 == j);
+			}
+		}
+	}
+
+	cpu = tm_cputime(NULL, NULL) - start;
+
+	for (out = 0, memory = 0, j = 0; j < links; j++) {
+		out += l[j].out;
+		memory += zlib_stream_memory(l[j].z);
+	}
+
+	report("link", cpu, sends, in, out, memory / links);
+
+	link_check(&l[0], 0, msgs, count, "link");
+	link_check(&l[links - 1], links - 1, msgs, count, "link");
+
+	for (j = 0; j < links; j++) {
+		zlib_stream_put(l[j].z);
+		xfree(l[j].sent);
+		ZERO(&l[j]);
+	}
+
+	zlib_stream_pool_close();
+
+	/*
+	 * Each message is compressed once into a history-free block, which is
+	 * then copied to all the links it is sent to.  The links only need to
+	 * emit the stream header, which is done before starting the clock.
+	 */
+
+	for (j = 0; j < links; j++)
+		link_header(&l[j], level, window_bits, mem_level,
+			0 == j || links - 1 == j);
+
+	ret = zlib_deflate_stream_get(&sz, level, -window_bits, mem_level);
+	if (Z_OK != ret)
+		s_error("cannot create compressor: %s", zlib_strerror(ret));
+
+	start = tm_cputime(NULL, NULL);
+
+	for (i = 0; i < count; i++) {
+		struct link frame;
+
+		ZERO(&frame);
+		link_deflate(&frame, sz, msgs[i].data, msgs[i].len, Z_FULL_FLUSH, TRUE);
+
+		for (j = 0; j < links; j++) {
+			if (msgs[i].dest[j]) {
+				link_sent(&l[j], frame.sent, frame.sent_len,
+					0 == j || links - 1 == j);
+			}
+		}
+
+		xfree(frame.sent);
+	}
+
+	cpu = tm_cputime(NULL, NULL) - start;
+
+	for (out = 0, j = 0; j < links; j++)
+		out += l[j].out;
+
+	report("shared", cpu, sends, in, out, 0);
+
+	if (verbose) {
+		s_info("shared compressor uses %s bytes",
+			size_t_to_string(zlib_stream_memory(sz)));
+	}
+
+	link_check(&l[0], 0, msgs, count, "shared");
+	link_check(&l[links - 1], links - 1, msgs, count, "shared");
+
+	zlib_stream_put(sz);
+	zlib_stream_pool_close();
+
+	for (j = 0; j < links; j++)
+		xfree(l[j].sent);
+	for (i = 0; i < count; i++) {
+		xfree(msgs[i].data);
+		xfree(msgs[i].dest);
+	}
+	xfree(l);
+	xfree(msgs);
+
+	return 0;
+}
+
+/* vi: set ts=4 sw=4 cindent: */
@@ -39,6 +39,7 @@
 #include "glib-missing.h"
 #include "misc.h"
 #include "halloc.h"
+#include "spinlock.h"
 #include "unsigned.h"
 #include "walloc.h"
 #include "override.h"		/* Must be the last header included */
@@ -1103,4 +1104,319 @@ zlib_is_valid_header(const void *data, int len)
 	return booleanize(0 == check % 31);
 }
 
+/***
+ *** Pooled zlib streams.
+ ***/
+
+/*
+ * Setting up a zlib stream allocates the whole compression state at once,
+ * which can amount to several hundreds of KiB for deflating streams.  For
+ * network connections that come and go quickly, this is a lot of work
+ * and memory churn for little data, so released streams are reset and kept
+ * in a small pool to be reused by the next stream requiring the same
+ * parameters.
+ *
+ * Because zlib allocates all its memory when the stream is initialized
+ * (and when the inflating window is first needed), and never frees any
+ * of it until the stream is ended, counting the bytes given out through the
+ * allocation routine gives us the exact amount of memory used by a stream.
+ */
+
+#define ZLIB_POOL_MAX	8		/**< Max amount of idle streams we keep */
+
+enum zlib_pooled_magic { ZLIB_POOLED_MAGIC = 0x2a0c4d17 };
+
+struct zlib_pooled {
+	z_stream z;					/**< The zlib stream -- MUST be first */
+	enum zlib_pooled_magic magic;
+	size_t memory;				/**< Memory allocated by zlib for stream */
+	int level;					/**< Compression level, unused for inflating */
+	int window_bits;			/**< Window size, log2, signed as for zlib */
+	int mem_level;				/**< Memory level, 0 for inflating */
+	uint deflating:1;			/**< Whether stream is deflating */
+};
+
+static inline void
+zlib_pooled_check(const struct zlib_pooled * const zp)
+{
+	g_assert(zp != NULL);
+	g_assert(ZLIB_POOLED_MAGIC == zp->magic);
+}
+
+static struct zlib_pooled *zlib_pool[ZLIB_POOL_MAX];
+static uint zlib_pool_count;
+static spinlock_t zlib_pool_slk = SPINLOCK_INIT;
+
+#define ZLIB_POOL_LOCK		spinlock(&zlib_pool_slk)
+#define ZLIB_POOL_UNLOCK	spinunlock(&zlib_pool_slk)
+
+static void *
+zlib_pooled_alloc(void *opaque, uint n, uint m)
+{
+	struct zlib_pooled *zp = opaque;
+	void *p;
+
+	p = zlib_alloc_func(NULL, n, m);
+	if (p != NULL)
+		zp->memory += (size_t) n * m;
+
+	return p;
+}
+
+static void
+zlib_pooled_free(void *unused_opaque, void *p)
+{
+	(void) unused_opaque;
+	hfree(p);
+}
+
+/**
+ * Fetch an idle stream with the given parameters from the pool.
+ *
+ * @return the reset stream, NULL if none was available.
+ */
+static struct zlib_pooled *
+zlib_pool_get(bool deflating, int level, int window_bits, int mem_level)
+{
+	struct zlib_pooled *zp = NULL;
+	uint i;
+
+	ZLIB_POOL_LOCK;
+
+	for (i = 0; i < zlib_pool_count; i++) {
+		struct zlib_pooled *p = zlib_pool[i];
+
+		if (
+			booleanize(deflating) == p->deflating &&
+			level == p->level &&
+			window_bits == p->window_bits &&
+			mem_level == p->mem_level
+		) {
+			zp = p;
+			zlib_pool[i] = zlib_pool[--zlib_pool_count];
+			zlib_pool[zlib_pool_count] = NULL;
+			break;
+		}
+	}
+
+	ZLIB_POOL_UNLOCK;
+
+	return zp;
+}
+
+/**
+ * Get a deflating stream, from the pool if possible.
+ *
+ * The parameters are those of deflateInit2(), with the Z_DEFLATED method
+ * and the default strategy.
+ *
+ * @param zp			where the allocated stream is returned
+ * @param level			compression level
+ * @param window_bits	log2 of window size, negative for raw deflate
+ * @param mem_level		memory level
+ *
+ * @return Z_OK on success, with the stream filled in ``zp'', the zlib error
+ * code otherwise.
+ */
+int
+zlib_deflate_stream_get(z_streamp *zp,
+	int level, int window_bits, int mem_level)
+{
+	struct zlib_pooled *p;
+	int ret;
+
+	g_assert(zp != NULL);
+
+	p = zlib_pool_get(TRUE, level, window_bits, mem_level);
+
+	if (p != NULL) {
+		*zp = &p->z;
+		return Z_OK;
+	}
+
+	WALLOC0(p);
+	p->magic = ZLIB_POOLED_MAGIC;
+	p->level = level;
+	p->window_bits = window_bits;
+	p->mem_level = mem_level;
+	p->deflating = TRUE;
+	p->z.zalloc = zlib_pooled_alloc;
+	p->z.zfree = zlib_pooled_free;
+	p->z.opaque = p;
+
+	ret = deflateInit2(&p->z, level, Z_DEFLATED, window_bits, mem_level,
+			Z_DEFAULT_STRATEGY);
+
+	if (Z_OK != ret) {
+		p->magic = 0;
+		WFREE(p);
+		return ret;
+	}
+
+	*zp = &p->z;
+	return Z_OK;
+}
+
+/**
+ * Get an inflating stream, from the pool if possible.
+ *
+ * @param zp			where the allocated stream is returned
+ * @param window_bits	log2 of window size, as for inflateInit2()
+ *
+ * @return Z_OK on success, with the stream filled in ``zp'', the zlib error
+ * code otherwise.
+ */
+int
+zlib_inflate_stream_get(z_streamp *zp, int window_bits)
+{
+	struct zlib_pooled *p;
+	int ret;
+
+	g_assert(zp != NULL);
+
+	p = zlib_pool_get(FALSE, 0, window_bits, 0);
+
+	if (p != NULL) {
+		*zp = &p->z;
+		return Z_OK;
+	}
+
+	WALLOC0(p);
+	p->magic = ZLIB_POOLED_MAGIC;
+	p->window_bits = window_bits;
+	p->z.zalloc = zlib_pooled_alloc;
+	p->z.zfree = zlib_pooled_free;
+	p->z.opaque = p;
+
+	ret = inflateInit2(&p->z, window_bits);
+
+	if (Z_OK != ret) {
+		p->magic = 0;
+		WFREE(p);
+		return ret;
+	}
+
+	*zp = &p->z;
+	return Z_OK;
+}
+
+/**
+ * End stream, freeing all its memory.
+ *
+ * @return the zlib status of the stream ending.
+ */
+static int
+zlib_pooled_end(struct zlib_pooled *p)
+{
+	int ret;
+
+	zlib_pooled_check(p);
+
+	ret = p->deflating ? deflateEnd(&p->z) : inflateEnd(&p->z);
+	p->magic = 0;
+	WFREE(p);
+
+	return ret;
+}
+
+/**
+ * Release a stream obtained through zlib_deflate_stream_get() or
+ * zlib_inflate_stream_get().
+ *
+ * The stream is reset and put back into the pool when there is room,
+ * otherwise it is ended.
+ *
+ * @return the zlib status of the stream reset or ending.
+ */
+int
+zlib_stream_put(z_streamp z)
+{
+	struct zlib_pooled *p = (struct zlib_pooled *) z;
+	int ret;
+	bool pooled = FALSE;
+
+	zlib_pooled_check(p);
+
+	ret = p->deflating ? deflateReset(&p->z) : inflateReset(&p->z);
+
+	if (Z_OK != ret)
+		return zlib_pooled_end(p);
+
+	ZLIB_POOL_LOCK;
+
+	if (zlib_pool_count < N_ITEMS(zlib_pool)) {
+		zlib_pool[zlib_pool_count++] = p;
+		pooled = TRUE;
+	}
+
+	ZLIB_POOL_UNLOCK;
+
+	if (!pooled)
+		ret = zlib_pooled_end(p);
+
+	return ret;
+}
+
+/**
+ * @return memory allocated by zlib for a stream obtained through
+ * zlib_deflate_stream_get() or zlib_inflate_stream_get().
+ */
+size_t
+zlib_stream_memory(const struct z_stream_s *z)
+{
+	const struct zlib_pooled *p = (const struct zlib_pooled *) z;
+
+	zlib_pooled_check(p);
+
+	return p->memory;
+}
+
+/**
+ * Fetch statistics about idle streams held in the pool.
+ *
+ * @param count		where amount of pooled streams is written
+ * @param memory	where memory used by pooled streams is written
+ */
+void
+zlib_stream_pool_stats(size_t *count, size_t *memory)
+{
+	uint i;
+
+	ZLIB_POOL_LOCK;
+
+	if (count != NULL)
+		*count = zlib_pool_count;
+
+	if (memory != NULL) {
+		size_t total = 0;
+
+		for (i = 0; i < zlib_pool_count; i++)
+			total += zlib_pool[i]->memory;
+
+		*memory = total;
+	}
+
+	ZLIB_POOL_UNLOCK;
+}
+
+/**
+ * Free all the streams held in the pool.
+ */
+void
+zlib_stream_pool_close(void)
+{
+	ZLIB_POOL_LOCK;
+
+	while (zlib_pool_count != 0) {
+		struct zlib_pooled *p = zlib_pool[--zlib_pool_count];
+
+		zlib_pool[zlib_pool_count] = NULL;
+		ZLIB_POOL_UNLOCK;
+		zlib_pooled_end(p);
+		ZLIB_POOL_LOCK;
+	}
+
+	ZLIB_POOL_UNLOCK;
+}
+
 /* vi: set ts=4 sw=4 cindent: */
@@ -42,6 +42,8 @@ typedef struct zlib_deflater zlib_deflater_t;
 struct zlib_inflater;
 typedef struct zlib_inflater zlib_inflater_t;
 
+struct z_stream_s;
+
 /*
  * Public interface.
  */
@@ -93,6 +95,14 @@ bool zlib_is_valid_header(const void *data, int len);
 void zlib_free_func(void *unused_opaque, void *p);
 void *zlib_alloc_func(void *unused_opaque, uint n, uint m);
 
+int zlib_deflate_stream_get(struct z_stream_s **zp,
+	int level, int window_bits, int mem_level);
+int zlib_inflate_stream_get(struct z_stream_s **zp, int window_bits);
+int zlib_stream_put(struct z_stream_s *z);
+size_t zlib_stream_memory(const struct z_stream_s *z);
+void zlib_stream_pool_stats(size_t *count, size_t *memory);
+void zlib_stream_pool_close(void);
+
 #endif	/* _zlib_util_h_ */
 
 /* vi: set ts=4 sw=4 cindent: */
@@ -123,6 +123,7 @@
 #include "lib/entropy.h"
 #include "lib/eval.h"
 #include "lib/evq.h"
+#include "lib/executor.h"
 #include "lib/exit.h"
 #include "lib/exit2str.h"
 #include "lib/fd.h"
@@ -180,6 +181,7 @@
 #include "lib/xsort.h"
 #include "lib/xxtea.h"
 #include "lib/zalloc.h"
+#include "lib/zlib_util.h"
 
 #include "shell/shell.h"
 
@@ -734,6 +736,7 @@ gtk_gnutella_exit(int exit_code)
 	DO(guid_close);
 	DO_BOOL(dht_close, TRUE);
 	DO(ipp_cache_save_all);
+	DO(executor_shutdown);	/* Workers are joined in the final sequence */
 	DO(bg_close);
 
 	/*
@@ -925,6 +928,7 @@ gtk_gnutella_exit(int exit_code)
 
 	thread_set_main(TRUE);				/* Main thread can now block */
 
+	DO(executor_close);		/* Joins with the worker threads */
 	DO(settings_terminate);	/* Entering the final sequence */
 	DO(cq_halt);			/* No more callbacks, with everything shutdown */
 	DO(search_shutdown);	/* Disable now, since we can get queries above */
@@ -954,6 +958,7 @@ gtk_gnutella_exit(int exit_code)
 	DO(bogons_close);	/* Idem, since host_close() can touch the cache */
 	DO(tx_collect);		/* Prevent spurious leak notifications */
 	DO(rx_collect);		/* Idem */
+	DO(zlib_stream_pool_close);	/* After all stacks were collected */
 	DO(hostiles_close);
 	DO(spam_close);
 	DO(gip_close);
@@ -39,6 +39,7 @@
 #include "cmd.h"
 
 #include "lib/ascii.h"
+#include "lib/atoms.h"
 #include "lib/dump_options.h"
 #include "lib/fd.h"
 #include "lib/file.h"
@@ -49,6 +50,7 @@
 #include "lib/omalloc.h"
 #include "lib/palloc.h"
 #include "lib/parse.h"
+#include "lib/pmsg.h"
 #include "lib/str.h"
 #include "lib/stringify.h"
 #include "lib/tmalloc.h"
@@ -435,6 +437,16 @@ memory_stats_unsupported(struct gnutella_shell *sh,
 	return REPLY_ERROR;
 }
 
+static enum shell_reply
+shell_exec_memory_stats_atoms(struct gnutella_shell *sh,
+	unsigned opt, unsigned which)
+{
+	if (which & STATS_USAGE)
+		return memory_stats_unsupported(sh, "atoms", STATS_USAGE_STR);
+
+	return memory_run_opt_shower(sh, atoms_dump_stats_log, "ATOMS ", opt);
+}
+
 static enum shell_reply
 shell_exec_memory_stats_halloc(struct gnutella_shell *sh,
 	unsigned opt, unsigned which)
@@ -455,6 +467,16 @@ shell_exec_memory_stats_palloc(struct gnutella_shell *sh,
 	return memory_run_opt_shower(sh, palloc_dump_stats_log, "PALLOC ", opt);
 }
 
+static enum shell_reply
+shell_exec_memory_stats_pmsg(struct gnutella_shell *sh,
+	unsigned opt, unsigned which)
+{
+	if (which & STATS_USAGE)
+		return memory_stats_unsupported(sh, "pmsg", STATS_USAGE_STR);
+
+	return memory_run_opt_shower(sh, pmsg_dump_stats_log, "PMSG ", opt);
+}
+
 static enum shell_reply
 shell_exec_memory_stats_vmm(struct gnutella_shell *sh,
 	unsigned opt, unsigned which)
@@ -540,8 +562,10 @@ shell_exec_memory_stats(struct gnutella_shell *sh,
 		return shell_exec_memory_stats_## name(sh, opt, which); \
 } G_STMT_END
 
+	CMD(atoms);
 	CMD(halloc);
 	CMD(palloc);
+	CMD(pmsg);
 	CMD(tmalloc);
 	CMD(vmm);
 	CMD(xmalloc);
@@ -768,7 +792,7 @@ shell_help_memory(int argc, const char *argv[])
 				"memory show zones     # display zone usage\n";
 		} else if (0 == ascii_strcasecmp(argv[1], "stats")) {
 			return "memory stats [-pu] "
-				"halloc|omalloc|palloc|tmalloc|vmm|xmalloc|zalloc\n"
+				"atoms|halloc|omalloc|palloc|pmsg|tmalloc|vmm|xmalloc|zalloc\n"
 				"show statistics about specified memory sub-system\n"
 				"-p : pretty-print numbers with thousands separators\n"
 				"-u : show allocation usage statistics, if available\n";
@@ -783,7 +807,8 @@ shell_help_memory(int argc, const char *argv[])
 #endif
 		"memory check xmalloc\n"
 		"memory show hole|magazines|options|pmap|pools|xmalloc|zones\n"
-		"memory stats [-pu] omalloc|palloc|tmalloc|vmm|xmalloc|zalloc\n"
+		"memory stats [-pu] atoms|halloc|omalloc|palloc|pmsg|tmalloc|vmm|\n"
+		"                   xmalloc|zalloc\n"
 		"memory usage zone <size> on|off|show\n"
 		;
 	}
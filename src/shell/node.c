@@ -39,10 +39,15 @@
 #include "core/nodes.h"
 
 #include "if/core/sockets.h"
+#include "if/gnet_property.h"
+#include "if/gnet_property_priv.h"
 
 #include "lib/ascii.h"
+#include "lib/lhist.h"
 #include "lib/misc.h"			/* For clamp_strcpy() */
 #include "lib/parse.h"
+#include "lib/pslist.h"
+#include "lib/stringify.h"
 
 #include "lib/override.h"		/* Must be the last header included */
 
@@ -107,24 +112,26 @@ error:
 	return REPLY_ERROR;
 }
 
-static enum shell_reply
-shell_exec_node_drop(struct gnutella_shell *sh, int argc, const char *argv[])
+/**
+ * Parse "<ip>[:<port>]" or "<ip> [<port>]" from the command arguments.
+ *
+ * A missing port is a wildcard and is returned as 0.
+ *
+ * @return TRUE if OK, FALSE on error with the error message set.
+ */
+static bool
+shell_node_parse_addr(struct gnutella_shell *sh, int argc, const char *argv[],
+	host_addr_t *addr, uint16 *port)
 {
 	const char *endptr, *port_str;
-	host_addr_t addr;
-	uint16 port;
-
-	shell_check(sh);
-	g_assert(argv);
-	g_assert(argc > 0);
 
 	if (argc < 2)
-		goto error;
+		return FALSE;
 
-	if (!string_to_host_addr(argv[1], &endptr, &addr)) {
+	if (!string_to_host_addr(argv[1], &endptr, addr)) {
 		/* Bad address. */
 		shell_set_msg(sh, _("Invalid IP"));
-		goto error;
+		return FALSE;
 	}
 	switch (endptr[0]) {
 	case ':':
@@ -134,21 +141,37 @@ shell_exec_node_drop(struct gnutella_shell *sh, int argc, const char *argv[])
 		port_str = argv[2];
 		break;
 	default:
-		goto error;
+		return FALSE;
 	}
 
 	/* No port is a wild card.. */
 	if (port_str) {
 		int error;
-		port = parse_uint16(port_str, NULL, 10, &error);
-		if (error || 0 == port) {
+		*port = parse_uint16(port_str, NULL, 10, &error);
+		if (error || 0 == *port) {
 			shell_set_msg(sh, _("Invalid port"));
-			goto error;
+			return FALSE;
 		}
 	} else {
-		port = 0;
+		*port = 0;
 	}
 
+	return TRUE;
+}
+
+static enum shell_reply
+shell_exec_node_drop(struct gnutella_shell *sh, int argc, const char *argv[])
+{
+	host_addr_t addr;
+	uint16 port;
+
+	shell_check(sh);
+	g_assert(argv);
+	g_assert(argc > 0);
+
+	if (!shell_node_parse_addr(sh, argc, argv, &addr, &port))
+		return REPLY_ERROR;
+
 	{
 		unsigned n = node_remove_by_addr(addr, port);
 		shell_write_linef(sh, REPLY_READY,
@@ -156,9 +179,96 @@ shell_exec_node_drop(struct gnutella_shell *sh, int argc, const char *argv[])
 	}
 
 	return REPLY_READY;
+}
 
-error:
-	return REPLY_ERROR;
+/**
+ * Print latency histogram summary, values being in ms.
+ */
+static void
+shell_node_print_lhist(struct gnutella_shell *sh,
+	const char *what, const lhist_t *h)
+{
+	shell_write_linef(sh, REPLY_READY,
+		"%-14s %10s %8.1f %6u %6u %6u %6u %6u",
+		what, uint64_to_string(lhist_count(h)), lhist_avg(h),
+		lhist_percentile(h, 50.0), lhist_percentile(h, 90.0),
+		lhist_percentile(h, 99.0), lhist_percentile(h, 99.9),
+		lhist_max(h));
+}
+
+/**
+ * Print the TX/RX stack tracing information for given node.
+ */
+static void
+shell_node_print_trace(struct gnutella_shell *sh, const gnutella_node_t *n)
+{
+	const struct node_txtrace *t = n->txtrace;
+	const bool metric = GNET_PROPERTY(display_metric_units);
+	char s1[SIZE_FIELD_MAX], s2[SIZE_FIELD_MAX], s3[SIZE_FIELD_MAX];
+
+	shell_write_linef(sh, REPLY_READY, "%s %s (%s)",
+		node_type(n), node_gnet_addr(n), node_vendor(n));
+
+	short_byte_size_to_buf(n->tx_given, metric, ARYLEN(s1));
+	short_byte_size_to_buf(n->tx_deflated, metric, ARYLEN(s2));
+	short_byte_size_to_buf(n->tx_written, metric, ARYLEN(s3));
+
+	shell_write_linef(sh, REPLY_READY,
+		"TX: %s given, %s deflated, %s written", s1, s2, s3);
+
+	short_byte_size_to_buf(n->rx_given, metric, ARYLEN(s1));
+	short_byte_size_to_buf(n->rx_inflated, metric, ARYLEN(s2));
+	short_byte_size_to_buf(n->rx_read, metric, ARYLEN(s3));
+
+	shell_write_linef(sh, REPLY_READY,
+		"RX: %s given, %s inflated, %s read", s1, s2, s3);
+
+	if (NULL == t)
+		return;
+
+	shell_write_linef(sh, REPLY_READY,
+		"Link short writes: %s capped by bandwidth, %s blocked by kernel",
+		uint64_to_string(t->link_capped), uint64_to_string2(t->link_blocked));
+
+	shell_write_linef(sh, REPLY_READY,
+		"Delays (ms)         count      avg    p50    p90    p99  p99.9    max");
+
+	shell_node_print_lhist(sh, "message queue", &t->mq_delay);
+	shell_node_print_lhist(sh, "deflate flush", &t->deflate_delay);
+	shell_node_print_lhist(sh, "link stall", &t->link_stall);
+}
+
+static enum shell_reply
+shell_exec_node_trace(struct gnutella_shell *sh, int argc, const char *argv[])
+{
+	const pslist_t *sl;
+	host_addr_t addr;
+	uint16 port;
+	uint found = 0;
+
+	shell_check(sh);
+	g_assert(argv);
+	g_assert(argc > 0);
+
+	if (!shell_node_parse_addr(sh, argc, argv, &addr, &port))
+		return REPLY_ERROR;
+
+	PSLIST_FOREACH(node_all_nodes(), sl) {
+		const gnutella_node_t *n = sl->data;
+
+		if ((0 == port || n->port == port) && host_addr_equiv(n->addr, addr)) {
+			if (found++ != 0)
+				shell_write_line(sh, REPLY_READY, "");
+			shell_node_print_trace(sh, n);
+		}
+	}
+
+	if (0 == found) {
+		shell_set_msg(sh, _("No such node"));
+		return REPLY_ERROR;
+	}
+
+	return REPLY_READY;
 }
 
 /**
@@ -181,6 +291,7 @@ shell_exec_node(struct gnutella_shell *sh, int argc, const char *argv[])
 
 	CMD(add);
 	CMD(drop);
+	CMD(trace);
 
 	shell_set_formatted(sh, _("Unknown operation \"%s\""), argv[1]);
 	return REPLY_ERROR;
@@ -205,11 +316,18 @@ shell_help_node(int argc, const char *argv[])
 		} else if (0 == ascii_strcasecmp(argv[1], "drop")) {
 			return "node drop <ip>[:<port>]\n"
 				"drop connection to specified <ip>[:<port>]\n";
+		} else if (0 == ascii_strcasecmp(argv[1], "trace")) {
+			return "node trace <ip>[:<port>]\n"
+				"show traffic through the TX and RX stacks of the connection\n"
+				"to specified <ip>[:<port>], along with the latencies seen\n"
+				"by messages in the message queue, in the compression layer\n"
+				"and when the link cannot send everything it is given.\n";
 		}
 	} else {
 		return
 			"node add\n"
 			"node drop\n"
+			"node trace\n"
 			"Use \"help node <cmd>\" for additional information\n";
 	}
 	return NULL;
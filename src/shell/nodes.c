@@ -37,14 +37,20 @@
 
 #include "core/nodes.h"
 
+#include "if/gnet_property.h"
+#include "if/gnet_property_priv.h"
+
 #include "lib/ascii.h"
 #include "lib/halloc.h"
 #include "lib/iso3166.h"
+#include "lib/lhist.h"
+#include "lib/misc.h"
 #include "lib/options.h"
 #include "lib/pslist.h"
 #include "lib/str.h"
 #include "lib/stringify.h"
 #include "lib/tm.h"
+#include "lib/zlib_util.h"
 
 #include "lib/override.h"		/* Must be the last header included */
 
@@ -95,28 +101,150 @@ print_node_info(struct gnutella_shell *sh, const gnutella_node_t *n)
 	shell_write(sh, "\n");	/* Terminate line */
 }
 
+/**
+ * Print TX stack latencies (in ms) and per-layer byte counts of node.
+ */
+static void
+print_node_trace(struct gnutella_shell *sh, const gnutella_node_t *n)
+{
+	const struct node_txtrace *t = n->txtrace;
+	const bool metric = GNET_PROPERTY(display_metric_units);
+	char given[SIZE_FIELD_MAX], written[SIZE_FIELD_MAX];
+	char rx_given[SIZE_FIELD_MAX], rx_read[SIZE_FIELD_MAX];
+	char buf[1024];
+
+	g_return_if_fail(sh);
+	g_return_if_fail(n);
+
+	if (NULL == t)
+		return;
+
+	short_byte_size_to_buf(n->tx_given, metric, ARYLEN(given));
+	short_byte_size_to_buf(n->tx_written, metric, ARYLEN(written));
+	short_byte_size_to_buf(n->rx_given, metric, ARYLEN(rx_given));
+	short_byte_size_to_buf(n->rx_read, metric, ARYLEN(rx_read));
+
+	str_bprintf(ARYLEN(buf),
+		"%-21.45s %6u %6u %6u %6u %10s %10s %10s %10s",
+		node_gnet_addr(n),
+		lhist_percentile(&t->mq_delay, 50.0),
+		lhist_percentile(&t->mq_delay, 99.0),
+		lhist_percentile(&t->deflate_delay, 99.0),
+		lhist_percentile(&t->link_stall, 99.0),
+		given, written, rx_given, rx_read);
+
+	shell_write(sh, buf);
+	shell_write(sh, "\n");	/* Terminate line */
+}
+
+/**
+ * Print compression ratios and memory used by the zlib streams of node.
+ *
+ * @return memory used by the zlib streams of the node.
+ */
+static size_t
+print_node_zlib(struct gnutella_shell *sh, const gnutella_node_t *n)
+{
+	const bool metric = GNET_PROPERTY(display_metric_units);
+	char tx_mem[SIZE_FIELD_MAX], rx_mem[SIZE_FIELD_MAX];
+	char buf[1024];
+	size_t tx, rx;
+
+	g_return_val_if_fail(sh, 0);
+	g_return_val_if_fail(n, 0);
+
+	node_zlib_memory(n, &tx, &rx);
+
+	short_byte_size_to_buf(tx, metric, ARYLEN(tx_mem));
+	short_byte_size_to_buf(rx, metric, ARYLEN(rx_mem));
+
+	str_bprintf(ARYLEN(buf),
+		"%-21.45s %5.1f%% %5.1f%% %10s %10s",
+		node_gnet_addr(n),
+		NODE_TX_COMPRESSED(n) ? 100.0 * NODE_TX_COMPRESSION_RATIO(n) : 0.0,
+		NODE_RX_COMPRESSED(n) ? 100.0 * NODE_RX_COMPRESSION_RATIO(n) : 0.0,
+		tx_mem, rx_mem);
+
+	shell_write(sh, buf);
+	shell_write(sh, "\n");	/* Terminate line */
+
+	return tx + rx;
+}
+
+/**
+ * Print total memory used by zlib streams, including pooled ones.
+ */
+static void
+print_zlib_total(struct gnutella_shell *sh, size_t used)
+{
+	const bool metric = GNET_PROPERTY(display_metric_units);
+	char used_buf[SIZE_FIELD_MAX], pool_buf[SIZE_FIELD_MAX];
+	char buf[256];
+	size_t count, pooled;
+
+	zlib_stream_pool_stats(&count, &pooled);
+
+	short_byte_size_to_buf(used, metric, ARYLEN(used_buf));
+	short_byte_size_to_buf(pooled, metric, ARYLEN(pool_buf));
+
+	str_bprintf(ARYLEN(buf),
+		"Total: %s in use, %s in %zu pooled stream%s\n",
+		used_buf, pool_buf, count, plural(count));
+
+	shell_write(sh, buf);
+}
+
 /**
  * Displays all connected nodes
  */
 enum shell_reply
 shell_exec_nodes(struct gnutella_shell *sh, int argc, const char *argv[])
 {
+	const char *opt_t, *opt_z;
+	const option_t options[] = {
+		{ "t", &opt_t },			/* show TX/RX stack tracing */
+		{ "z", &opt_z },			/* show compression ratio and memory */
+	};
 	const pslist_t *sl;
+	size_t zlib_used = 0;
+	int parsed;
 
 	shell_check(sh);
 	g_assert(argv);
 	g_assert(argc > 0);
 
+	parsed = shell_options_parse(sh, argv, options, N_ITEMS(options));
+	if (parsed < 0)
+		return REPLY_ERROR;
+
 	shell_set_msg(sh, "");
 
-	shell_write(sh,
-	  "100~ \n"
-	  "Node                  Flags       CC Since  Uptime User-Agent\n");
+	if (opt_t) {
+		shell_write(sh,
+		  "100~ \n"
+		  "Node                  MQ p50 MQ p99 ZL p99 LK p99"
+		  "   TX given TX written   RX given    RX read\n");
+	} else if (opt_z) {
+		shell_write(sh,
+		  "100~ \n"
+		  "Node                  TX zip RX zip     TX mem     RX mem\n");
+	} else {
+		shell_write(sh,
+		  "100~ \n"
+		  "Node                  Flags       CC Since  Uptime User-Agent\n");
+	}
 
 	PSLIST_FOREACH(node_all_nodes(), sl) {
 		const gnutella_node_t *n = sl->data;
-		print_node_info(sh, n);
+		if (opt_t)
+			print_node_trace(sh, n);
+		else if (opt_z)
+			zlib_used += print_node_zlib(sh, n);
+		else
+			print_node_info(sh, n);
 	}
+	if (opt_z && !opt_t)
+		print_zlib_total(sh, zlib_used);
 	shell_write(sh, ".\n");	/* Terminate message body */
 
 	return REPLY_READY;
@@ -134,7 +262,15 @@ shell_help_nodes(int argc, const char *argv[])
 	g_assert(argv);
 	g_assert(argc > 0);
 
-	return NULL;
+	return "nodes [-t] [-z]\n"
+		"lists connected nodes.\n"
+		"-t : show TX stack latencies (ms) and traffic through the stacks:\n"
+		"     median and 99th percentile of message queueing delay (MQ),\n"
+		"     99th percentile of compression flush delay (ZL) and of link\n"
+		"     stall time (LK).\n"
+		"     Use \"node trace\" for details on a given node.\n"
+		"-z : show compression ratios and memory used by zlib streams,\n"
+		"     followed by the total, including pooled streams.\n";
 }
 
 /* vi: set ts=4 sw=4 cindent: */
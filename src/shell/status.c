@@ -376,6 +376,22 @@ shell_exec_status(struct gnutella_shell *sh, int argc, const char *argv[])
 			short_byte_size(GNET_PROPERTY(ul_byte_count), metric),
 			short_byte_size2(GNET_PROPERTY(dl_byte_count), metric));
 		shell_write(sh, buf);
+	}
+
+	/* Kernel socket buffers */
+	{
+		bool metric = GNET_PROPERTY(display_metric_units);
+		struct socket_bufstats sbs;
+
+		socket_buffer_stats(&sbs);
+		str_bprintf(ARYLEN(buf),
+			"|%s|\n"
+			"| Socket buffers RX: %-9s TX: %-9s Grown: %-6s Shrunk: %-5s|\n",
+			dashes,
+			short_byte_size(sbs.rcvbuf, metric),
+			short_byte_size2(sbs.sndbuf, metric),
+			uint64_to_string(sbs.grown), uint64_to_string2(sbs.shrunk));
+		shell_write(sh, buf);
 		str_bprintf(ARYLEN(buf), "+%s+\n", dashes);
 		shell_write(sh, buf);
 	}
@@ -37,6 +37,10 @@
 
 #include "lib/ascii.h"
 #include "lib/bg.h"
+#include "lib/dump_options.h"
+#include "lib/executor.h"
+#include "lib/log.h"
+#include "lib/options.h"
 #include "lib/pslist.h"
 #include "lib/str.h"
 #include "lib/stringify.h"			/* For compact_time_ms() */
@@ -159,6 +163,44 @@ shell_exec_task_list(struct gnutella_shell *sh,
 	return REPLY_READY;
 }
 
+static enum shell_reply
+shell_exec_task_executor(struct gnutella_shell *sh,
+	int argc, const char *argv[])
+{
+	const char *pretty;
+	const option_t options[] = {
+		{ "p", &pretty },			/* pretty-print */
+	};
+	int parsed;
+	unsigned opt = 0;
+	logagent_t *la = log_agent_string_make(0, "TASK ");
+
+	shell_check(sh);
+
+	parsed = shell_options_parse(sh, argv, options, N_ITEMS(options));
+	if (parsed < 0)
+		return REPLY_ERROR;
+
+	argv += parsed;		/* args[0] is first command argument */
+	argc -= parsed;		/* counts only command arguments now */
+
+	if (0 != argc)
+		return REPLY_ERROR;
+
+	if (pretty != NULL)
+		opt |= DUMP_OPT_PRETTY;
+
+	executor_dump_stats_log(la, opt);
+
+	shell_write(sh, "100~\n");
+	shell_write(sh, log_agent_string_get(la));
+	shell_write(sh, ".\n");
+
+	log_agent_free_null(&la);
+
+	return REPLY_READY;
+}
+
 /**
  * Handles the task command.
  */
@@ -178,6 +220,7 @@ shell_exec_task(struct gnutella_shell *sh, int argc, const char *argv[])
 } G_STMT_END
 
 	CMD(list);
+	CMD(executor);
 
 #undef CMD
 
@@ -203,8 +246,16 @@ shell_help_task(int argc, const char *argv[])
 				"list all running background tasks\n"
 				"-s: show schedulers instead of tasks\n";
 		}
+		else if (0 == ascii_strcasecmp(argv[1], "executor")) {
+			return "task executor [-p]\n"
+				"show executor job queues depth and throughput\n"
+				"-p: pretty-print numbers with thousands separators\n";
+		}
 	} else {
-		return "task list [-s]\n";
+		return
+			"task list [-s]\n"
+			"task executor [-p]\n"
+			;
 	}
 	return NULL;
 }
@@ -37,6 +37,7 @@
 
 #include "lib/ascii.h"
 #include "lib/dump_options.h"
+#include "lib/executor.h"
 #include "lib/log.h"
 #include "lib/options.h"
 #include "lib/pow2.h"			/* For popcount() */
@@ -185,6 +186,44 @@ shell_exec_thread_stats(struct gnutella_shell *sh,
 	return REPLY_READY;
 }
 
+static enum shell_reply
+shell_exec_thread_executor(struct gnutella_shell *sh,
+	int argc, const char *argv[])
+{
+	const char *pretty;
+	const option_t options[] = {
+		{ "p", &pretty },			/* pretty-print */
+	};
+	int parsed;
+	unsigned opt = 0;
+	logagent_t *la = log_agent_string_make(0, "THREAD ");
+
+	shell_check(sh);
+
+	parsed = shell_options_parse(sh, argv, options, N_ITEMS(options));
+	if (parsed < 0)
+		return REPLY_ERROR;
+
+	argv += parsed;		/* args[0] is first command argument */
+	argc -= parsed;		/* counts only command arguments now */
+
+	if (0 != argc)
+		return REPLY_ERROR;
+
+	if (pretty != NULL)
+		opt |= DUMP_OPT_PRETTY;
+
+	executor_dump_stats_log(la, opt);
+
+	shell_write(sh, "100~\n");
+	shell_write(sh, log_agent_string_get(la));
+	shell_write(sh, ".\n");
+
+	log_agent_free_null(&la);
+
+	return REPLY_READY;
+}
+
 static enum shell_reply
 shell_exec_thread_elements(struct gnutella_shell *sh,
 	int argc, const char *argv[])
@@ -244,6 +283,7 @@ shell_exec_thread(struct gnutella_shell *sh, int argc, const char *argv[])
 	CMD(list);
 	CMD(stats);
 	CMD(elements);
+	CMD(executor);
 
 #undef CMD
 
@@ -273,6 +313,11 @@ shell_help_thread(int argc, const char *argv[])
 				"list all initialized thread elements\n"
 				"-a : include all elements, even the reusable ones\n";
 		}
+		else if (0 == ascii_strcasecmp(argv[1], "executor")) {
+			return "thread executor [-p]\n"
+				"show executor workers, queue depth and throughput\n"
+				"-p : pretty-print numbers with thousands separators\n";
+		}
 		else if (0 == ascii_strcasecmp(argv[1], "stats")) {
 			return "thread stats [-p]\n"
 				"show thread global statistics\n"
@@ -282,6 +327,7 @@ shell_help_thread(int argc, const char *argv[])
 		return
 			"thread list\n"
 			"thread elements [-a]\n"
+			"thread executor [-p]\n"
 			"thread stats [-p]\n"
 			;
 	}
@@ -0,0 +1,345 @@
+/*
+ * xsax-test -- compares XML tree parsing with streaming scanning.
+ *
+ * Copyright (c) 2026 agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the authors nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Each XML document given on the command line (captured query hit XML,
+ * THEX descriptors, UPnP replies...) is parsed repeatedly into a tree by
+ * vxml, then scanned repeatedly by xsax, and the CPU time spent by both
+ * is reported.  When no file is given, built-in samples are used.
+ *
+ * The amount of elements and attributes seen by both is also compared, to
+ * make sure they agree on what the document holds.
+ */
+
+#include "common.h"
+
+#include "vxml.h"
+#include "xnode.h"
+#include "xsax.h"
+
+#include "lib/log.h"
+#include "lib/path.h"
+#include "lib/progname.h"
+#include "lib/tm.h"
+#include "lib/xmalloc.h"
+
+#include "lib/override.h"		/* Must be the last header included */
+
+static bool verbose;
+
+static const char sample_hit[] =
+	"<?xml version=\"1.0\"?>"
+	"<audios xsi:noNamespaceSchemaLocation="
+	"\"http://www.limewire.com/schemas/audio.xsd\">"
+	"<audio title=\"Blue in Green\" artist=\"Miles Davis\" "
+	"album=\"Kind of Blue\" genre=\"Jazz\" year=\"1959\" seconds=\"337\" "
+	"bitrate=\"192\" track=\"3\" comments=\"Evans &amp; Davis\" index=\"0\"/>"
+	"<audio title=\"So What\" artist=\"Miles Davis\" "
+	"album=\"Kind of Blue\" genre=\"Jazz\" year=\"1959\" seconds=\"562\" "
+	"bitrate=\"192\" track=\"1\" index=\"1\"/>"
+	"</audios>";
+
+static const char sample_thex[] =
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	"<!DOCTYPE hashtree SYSTEM "
+	"\"http://open-content.net/spec/thex/thex.dtd\">\n"
+	"<hashtree>\n"
+	"\t<file size=\"1048576\" segmentsize=\"1024\"/>\n"
+	"\t<digest algorithm=\"http://open-content.net/spec/digest/tiger\" "
+	"outputsize=\"24\"/>\n"
+	"\t<serializedtree depth=\"9\" "
+	"type=\"http://open-content.net/spec/thex/breadthfirst\" "
+	"uri=\"uuid:09233523-345b-4351-b623-5dsf35sgs5d6\"/>\n"
+	"</hashtree>\n";
+
+static void G_NORETURN
+usage(void)
+{
+	fprintf(stderr,
+		"Usage: %s [-hv] [-n count] [file ...]\n"
+		"  -h : prints this help message\n"
+		"  -n : amount of parsing rounds per document (default 10000)\n"
+		"  -v : verbose mode\n"
+		, getprogname());
+	exit(EXIT_FAILURE);
+}
+
+/**
+ * Load file in memory.
+ *
+ * @return allocated file content, NULL on error.
+ */
+static char *
+load_file(const char *path, size_t *len)
+{
+	FILE *f;
+	long size;
+	char *data = NULL;
+
+	f = fopen(path, "rb");
+	if (NULL == f)
+		return NULL;
+
+	if (0 != fseek(f, 0, SEEK_END) || (size = ftell(f)) < 0)
+		goto done;
+
+	rewind(f);
+	data = xmalloc(size + 1);
+
+	if (UNSIGNED(size) != fread(data, 1, size, f)) {
+		XFREE_NULL(data);
+		goto done;
+	}
+
+	*len = size;
+
+done:
+	fclose(f);
+	return data;
+}
+
+struct counts {
+	size_t elements;
+	size_t attributes;
+	size_t text;
+};
+
+static void
+tree_count_attr(const char *uri, const char *local, const char *value,
+	void *data)
+{
+	struct counts *c = data;
+
+	(void) uri;
+	(void) local;
+	(void) value;
+
+	c->attributes++;
+}
+
+static void
+tree_count(void *node, void *data)
+{
+	xnode_t *xn = node;
+	struct counts *c = data;
+
+	if (xnode_is_element(xn)) {
+		c->elements++;
+		xnode_prop_foreach(xn, tree_count_attr, c);
+	}
+}
+
+static void
+sax_start(xsax_t *xs, const char *name, size_t len, void *data)
+{
+	struct counts *c = data;
+
+	(void) xs;
+	(void) name;
+	(void) len;
+
+	c->elements++;
+}
+
+static void
+sax_attr(xsax_t *xs, const char *name, size_t nlen,
+	const char *value, size_t vlen, void *data)
+{
+	struct counts *c = data;
+
+	(void) xs;
+	(void) name;
+	(void) nlen;
+	(void) value;
+	(void) vlen;
+
+	c->attributes++;
+}
+
+static void
+sax_text(xsax_t *xs, const char *text, size_t len, void *data)
+{
+	struct counts *c = data;
+
+	(void) xs;
+	(void) text;
+
+	c->text += len;
+}
+
+static const struct xsax_ops sax_ops = {
+	sax_start,		/* start */
+	sax_attr,		/* attr */
+	sax_text,		/* text */
+	NULL,			/* end */
+};
+
+/**
+ * Parse document into a tree.
+ */
+static bool
+bench_tree(const char *what, const char *data, size_t len, struct counts *c)
+{
+	vxml_parser_t *vp;
+	vxml_error_t e;
+	xnode_t *root;
+
+	vp = vxml_parser_make(what, VXML_O_NO_NAMESPACES | VXML_O_STRIP_BLANKS);
+	vxml_parser_add_data(vp, data, len);
+	e = vxml_parse_tree(vp, &root);
+	vxml_parser_free(vp);
+
+	if (VXML_E_OK != e) {
+		s_warning("%s: tree parsing failed: %s", what, vxml_strerror(e));
+		return FALSE;
+	}
+
+	if (c != NULL)
+		xnode_tree_foreach(root, tree_count, c);
+
+	xnode_tree_free(root);
+	return TRUE;
+}
+
+/**
+ * Scan document.
+ */
+static bool
+bench_sax(const char *what, const char *data, size_t len, struct counts *c)
+{
+	struct counts dummy;
+	vxml_error_t e;
+
+	e = xsax_parse(data, len, XSAX_O_STRIP_BLANKS, &sax_ops,
+			NULL == c ? &dummy : c);
+
+	if (VXML_E_OK != e) {
+		s_warning("%s: streaming failed: %s", what, vxml_strerror(e));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void
+bench(const char *what, const char *data, size_t len, size_t rounds)
+{
+	struct counts ct, cs;
+	double start, tree, sax;
+	size_t i;
+
+	ZERO(&ct);
+	ZERO(&cs);
+
+	if (!bench_tree(what, data, len, &ct) || !bench_sax(what, data, len, &cs))
+		return;
+
+	if (ct.elements != cs.elements || ct.attributes != cs.attributes) {
+		s_error("%s: tree has %zu elements, %zu attributes; "
+			"scanner saw %zu elements, %zu attributes",
+			what, ct.elements, ct.attributes, cs.elements, cs.attributes);
+	}
+
+	if (verbose) {
+		s_info("%s: %zu bytes, %zu elements, %zu attributes, %zu text bytes",
+			what, len, cs.elements, cs.attributes, cs.text);
+	}
+
+	start = tm_cputime(NULL, NULL);
+	for (i = 0; i < rounds; i++)
+		bench_tree(what, data, len, NULL);
+	tree = tm_cputime(NULL, NULL) - start;
+
+	start = tm_cputime(NULL, NULL);
+	for (i = 0; i < rounds; i++)
+		bench_sax(what, data, len, NULL);
+	sax = tm_cputime(NULL, NULL) - start;
+
+	printf("%-24s %7zu %10.2f %10.2f %7.1fx\n", what, len,
+		tree * 1e6 / rounds, sax * 1e6 / rounds, 0 == sax ? 0.0 : tree / sax);
+}
+
+int
+main(int argc, char **argv)
+{
+	extern int optind;
+	extern char *optarg;
+	int c;
+	size_t rounds = 10000;
+
+	progstart(argc, argv);
+
+	while ((c = getopt(argc, argv, "hn:v")) != EOF) {
+		switch (c) {
+		case 'n':
+			rounds = atol(optarg);
+			break;
+		case 'v':
+			verbose = TRUE;
+			break;
+		case 'h':
+		default:
+			usage();
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if (0 == rounds)
+		usage();
+
+	printf("%-24s %7s %10s %10s %8s\n",
+		"document", "bytes", "tree us", "stream us", "speedup");
+
+	if (0 == argc) {
+		bench("query hit", sample_hit, CONST_STRLEN(sample_hit), rounds);
+		bench("THEX record", sample_thex, CONST_STRLEN(sample_thex), rounds);
+	}
+
+	for (/* empty */; argc > 0; argc--, argv++) {
+		size_t len;
+		char *data = load_file(argv[0], &len);
+
+		if (NULL == data) {
+			s_warning("cannot read %s: %m", argv[0]);
+			continue;
+		}
+
+		bench(filepath_basename(argv[0]), data, len, rounds);
+		xfree(data);
+	}
+
+	return 0;
+}
+
+/* vi: set ts=4 sw=4 cindent: */
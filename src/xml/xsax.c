@@ -0,0 +1,888 @@
+/*
+ * Copyright (c) 2026 agent
+ *
+ *----------------------------------------------------------------------
+ * This file is part of gtk-gnutella.
+ *
+ *  gtk-gnutella is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gtk-gnutella is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with gtk-gnutella; if not, write to the Free Software
+ *  Foundation, Inc.:
+ *      59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *----------------------------------------------------------------------
+ */
+
+/**
+ * @ingroup xml
+ * @file
+ *
+ * Streaming XML scanner.
+ *
+ * The versatile XML parser in vxml.c decodes its input one character at a
+ * time, supports all the character encodings, DTD entities, namespaces, and
+ * is generally used to build a whole tree of the document.  That is overkill
+ * when all we need is to pick a few attributes from a small UTF-8 document,
+ * like the XML metadata carried by query hits or THEX descriptors.
+ *
+ * This scanner works directly on the input buffer, without building any
+ * tree: elements, attributes and text are notified through callbacks as they
+ * are met, and names, attribute values or text are given as slices of the
+ * input buffer.  Only when a value contains an entity or character reference
+ * that needs decoding is the value copied, decoded, into a scratch buffer
+ * which is only valid during the callback.
+ *
+ * The scanner only handles UTF-8 documents (or US-ASCII, a subset), knows
+ * no namespaces (names are given with their prefix), skips any document type
+ * declaration and only knows about the predefined entities.  Duplicate
+ * attributes are not detected.  Callers can always fall back to vxml when
+ * the scanner reports an error.
+ *
+ * @author agent
+ * @date 2026
+ */
+
+#include "common.h"
+
+#include "xsax.h"
+
+#include "lib/ascii.h"
+#include "lib/compat_misc.h"
+#include "lib/misc.h"		/* For CONST_STRLEN() */
+#include "lib/utf8.h"
+#include "lib/xmalloc.h"
+
+#include "lib/override.h"	/* Must be the last header included */
+
+#define XSAX_STACK		16		/* Initial element stack size */
+#define XSAX_BUFLEN		256		/* Initial scratch buffer size */
+
+/**
+ * An element name, as a slice of the input.
+ */
+struct xsax_name {
+	const char *name;
+	size_t len;
+};
+
+enum xsax_magic { XSAX_MAGIC = 0x3bd5a6e1 };
+
+/**
+ * The scanner state.
+ *
+ * This is allocated on the stack of xsax_parse(): the element stack and the
+ * scratch buffer are only allocated when the embedded arrays are too small.
+ */
+struct xsax {
+	enum xsax_magic magic;
+	const char *start;				/**< Start of input */
+	const char *p;					/**< Current position */
+	const char *end;				/**< First byte beyond input */
+	const struct xsax_ops *ops;		/**< Callbacks */
+	void *data;						/**< Callback argument */
+	uint32 options;					/**< Scanning options */
+	vxml_error_t error;				/**< Error condition */
+	struct xsax_name *stack;		/**< Stack of opened elements */
+	size_t depth;					/**< Amount of opened elements */
+	size_t stacklen;				/**< Allocated stack length */
+	char *buf;						/**< Scratch buffer for decoding */
+	size_t buflen;					/**< Scratch buffer length */
+	bool root;						/**< Whether we saw the root element */
+	bool stopped;					/**< Whether user asked to stop */
+	struct xsax_name stack0[XSAX_STACK];
+	char buf0[XSAX_BUFLEN];
+};
+
+static inline void
+xsax_check(const struct xsax * const xs)
+{
+	g_assert(xs != NULL);
+	g_assert(XSAX_MAGIC == xs->magic);
+}
+
+/**
+ * Stop scanning, making xsax_parse() return VXML_E_USER.
+ */
+void
+xsax_stop(xsax_t *xs)
+{
+	xsax_check(xs);
+
+	xs->stopped = TRUE;
+}
+
+/**
+ * @return the amount of opened elements, including the current one.
+ */
+unsigned
+xsax_depth(const xsax_t *xs)
+{
+	xsax_check(xs);
+
+	return xs->depth;
+}
+
+/**
+ * @return the current offset in the input.
+ */
+size_t
+xsax_offset(const xsax_t *xs)
+{
+	xsax_check(xs);
+
+	return xs->p - xs->start;
+}
+
+/**
+ * Record error.
+ *
+ * @return FALSE, so that callers can write "return xsax_error(...)".
+ */
+static bool
+xsax_error(xsax_t *xs, vxml_error_t error)
+{
+	if (VXML_E_OK == xs->error)
+		xs->error = error;
+	return FALSE;
+}
+
+/**
+ * @return whether character is an XML white space.
+ */
+static inline bool
+xsax_is_space(int c)
+{
+	return ' ' == c || '\n' == c || '\t' == c || '\r' == c;
+}
+
+/**
+ * @return whether character can start a name.
+ *
+ * All the non-ASCII characters are accepted, the input having been
+ * validated as UTF-8 already.
+ */
+static inline bool
+xsax_is_name_start(uchar c)
+{
+	return is_ascii_alpha(c) || '_' == c || ':' == c || c >= 0x80;
+}
+
+/**
+ * @return whether character can be part of a name.
+ */
+static inline bool
+xsax_is_name_char(uchar c)
+{
+	return xsax_is_name_start(c) || is_ascii_digit(c) || '-' == c || '.' == c;
+}
+
+/**
+ * @return whether input at the current position starts with the given string.
+ */
+static inline bool
+xsax_at(const xsax_t *xs, const char *s, size_t len)
+{
+	return UNSIGNED(xs->end - xs->p) >= len && 0 == memcmp(xs->p, s, len);
+}
+
+#define XSAX_AT(xs, s)	xsax_at(xs, s, CONST_STRLEN(s))
+
+/**
+ * Skip white spaces.
+ *
+ * @return whether we skipped anything.
+ */
+static bool
+xsax_skip_spaces(xsax_t *xs)
+{
+	const char *p = xs->p;
+
+	while (xs->p < xs->end && xsax_is_space(*xs->p))
+		xs->p++;
+
+	return p != xs->p;
+}
+
+/**
+ * Skip input until after the given marker.
+ *
+ * @return FALSE if marker was not found.
+ */
+static bool
+xsax_skip_past(xsax_t *xs, const char *mark, size_t len)
+{
+	const char *p;
+
+	p = compat_memmem(xs->p, xs->end - xs->p, mark, len);
+
+	if (NULL == p) {
+		xs->p = xs->end;
+		return xsax_error(xs, VXML_E_TRUNCATED_INPUT);
+	}
+
+	xs->p = p + len;
+	return TRUE;
+}
+
+/**
+ * Parse a name at the current position.
+ *
+ * @return FALSE on error.
+ */
+static bool
+xsax_name(xsax_t *xs, struct xsax_name *n)
+{
+	const char *p = xs->p;
+
+	if (p >= xs->end)
+		return xsax_error(xs, VXML_E_TRUNCATED_INPUT);
+
+	if (!xsax_is_name_start(*p))
+		return xsax_error(xs, VXML_E_EXPECTED_NAME_START);
+
+	while (p < xs->end && xsax_is_name_char(*p))
+		p++;
+
+	n->name = xs->p;
+	n->len = p - xs->p;
+	xs->p = p;
+
+	return TRUE;
+}
+
+/**
+ * Make sure the scratch buffer can hold len bytes.
+ */
+static void
+xsax_buffer_grow(xsax_t *xs, size_t len)
+{
+	if (len <= xs->buflen)
+		return;
+
+	if (xs->buf != xs->buf0)
+		xfree(xs->buf);
+
+	xs->buflen = MAX(len, 2 * xs->buflen);
+	xs->buf = xmalloc(xs->buflen);
+}
+
+/**
+ * Decode entity reference starting at ``p'' (on the '&'), writing the
+ * decoded character at ``q''.
+ *
+ * @return pointer past the reference in input, NULL on error, with the
+ * amount of bytes written to ``q'' in ``written''.
+ */
+static const char *
+xsax_decode_ref(xsax_t *xs, const char *p, const char *end,
+	char *q, size_t *written)
+{
+	static const struct {
+		const char *name;
+		size_t len;
+		char c;
+	} entities[] = {
+		{ "lt;",	3,	'<' },
+		{ "gt;",	3,	'>' },
+		{ "amp;",	4,	'&' },
+		{ "apos;",	5,	'\'' },
+		{ "quot;",	5,	'"' },
+	};
+	uint32 uc = 0;
+	uint i;
+
+	g_assert('&' == *p);
+
+	p++;
+
+	if (p < end && '#' == *p) {
+		bool hex = FALSE;
+		const char *s;
+
+		if (++p < end && 'x' == *p) {
+			hex = TRUE;
+			p++;
+		}
+
+		for (s = p; p < end && ';' != *p; p++) {
+			int d = hex ? hex2int_inline(*p) : *p - '0';
+
+			if (d < 0 || d >= (hex ? 16 : 10) || uc > 0x10FFFF) {
+				xsax_error(xs, VXML_E_INVALID_CHAR_REF);
+				return NULL;
+			}
+			uc = uc * (hex ? 16 : 10) + d;
+		}
+
+		if (p >= end || s == p) {
+			xsax_error(xs, VXML_E_INVALID_CHAR_REF);
+			return NULL;
+		}
+
+		if (
+			0 == uc || uc > 0x10FFFF ||
+			(uc >= 0xD800 && uc <= 0xDFFF) || 0xFFFE == uc || 0xFFFF == uc
+		) {
+			xsax_error(xs, VXML_E_INVALID_CHAR_REF);
+			return NULL;
+		}
+
+		/*
+		 * A character reference is at least 4 bytes long, and its UTF-8
+		 * encoding cannot be longer than the reference: the value would
+		 * need to be larger than 0xFFFF for a 4-byte encoding, hence have
+		 * 5 digits at least.
+		 */
+
+		*written = utf8_encode_char(uc, q, 4);
+		return p + 1;
+	}
+
+	for (i = 0; i < N_ITEMS(entities); i++) {
+		size_t len = entities[i].len;
+
+		if (UNSIGNED(end - p) >= len && 0 == memcmp(p, entities[i].name, len)) {
+			*q = entities[i].c;
+			*written = 1;
+			return p + len;
+		}
+	}
+
+	xsax_error(xs, VXML_E_UNKNOWN_ENTITY_REF);
+	return NULL;
+}
+
+/**
+ * Decode text or attribute value into the scratch buffer when needed.
+ *
+ * Entity and character references are expanded, and line endings are
+ * normalized to "\n".  In attribute values, white spaces are further
+ * normalized to " ".
+ *
+ * @param xs		the scanner
+ * @param text		the raw text
+ * @param len		raw text length, updated with decoded length
+ * @param attr		whether we are decoding an attribute value
+ *
+ * @return the (possibly) decoded text, NULL on error.
+ */
+static const char *
+xsax_decode(xsax_t *xs, const char *text, size_t *len, bool attr)
+{
+	const char *p, *end = text + *len;
+	char *q;
+
+	for (p = text; p < end; p++) {
+		uchar c = *p;
+
+		if ('&' == c || '\r' == c || (attr && ('\n' == c || '\t' == c)))
+			break;
+	}
+
+	if (p == end)
+		return text;		/* Nothing to decode, return slice */
+
+	/*
+	 * Decoding can only shrink the text.
+	 */
+
+	xsax_buffer_grow(xs, *len);
+	q = xs->buf;
+
+	for (p = text; p < end; /* empty */) {
+		uchar c = *p;
+
+		if ('&' == c) {
+			size_t n;
+
+			p = xsax_decode_ref(xs, p, end, q, &n);
+			if (NULL == p)
+				return NULL;
+			q += n;
+			continue;
+		} else if ('\r' == c) {
+			if (p + 1 < end && '\n' == p[1])
+				p++;
+			c = '\n';
+		}
+
+		if (attr && xsax_is_space(c))
+			c = ' ';
+
+		*q++ = c;
+		p++;
+	}
+
+	*len = q - xs->buf;
+	return xs->buf;
+}
+
+/**
+ * Handle text up to the next '<'.
+ */
+static bool
+xsax_text(xsax_t *xs)
+{
+	const char *p, *text = xs->p;
+	size_t len;
+
+	p = memchr(xs->p, '<', xs->end - xs->p);
+	if (NULL == p)
+		p = xs->end;
+
+	xs->p = p;
+	len = p - text;
+
+	if (0 == xs->depth) {
+		for (p = text; p < xs->p; p++) {
+			if (!xsax_is_space(*p))
+				return xsax_error(xs, VXML_E_UNEXPECTED_CHARACTER);
+		}
+		return TRUE;
+	}
+
+	if (NULL == xs->ops->text)
+		return TRUE;
+
+	if (xs->options & XSAX_O_STRIP_BLANKS) {
+		while (len != 0 && xsax_is_space(*text)) {
+			text++;
+			len--;
+		}
+		while (len != 0 && xsax_is_space(text[len - 1]))
+			len--;
+	}
+
+	if (0 == len)
+		return TRUE;
+
+	text = xsax_decode(xs, text, &len, FALSE);
+	if (NULL == text)
+		return FALSE;
+
+	(*xs->ops->text)(xs, text, len, xs->data);
+	return TRUE;
+}
+
+/**
+ * Handle a CDATA section, the leading "<![CDATA[" being already swallowed.
+ */
+static bool
+xsax_cdata(xsax_t *xs)
+{
+	const char *text = xs->p;
+
+	if (0 == xs->depth)
+		return xsax_error(xs, VXML_E_UNEXPECTED_CHARACTER);
+
+	if (!xsax_skip_past(xs, "]]>", CONST_STRLEN("]]>")))
+		return FALSE;
+
+	if (xs->ops->text != NULL && xs->p - CONST_STRLEN("]]>") != text) {
+		(*xs->ops->text)(xs,
+			text, xs->p - CONST_STRLEN("]]>") - text, xs->data);
+	}
+
+	return TRUE;
+}
+
+/**
+ * Skip document type declaration, the leading "<!DOCTYPE" being already
+ * swallowed.
+ *
+ * Entities declared in the internal subset are ignored, and will therefore
+ * be flagged as unknown if referenced.
+ */
+static bool
+xsax_doctype(xsax_t *xs)
+{
+	char quote = '\0';
+	int bracket = 0;
+
+	if (xs->root)
+		return xsax_error(xs, VXML_E_NESTED_DOCTYPE_DECL);
+
+	for (/* empty */; xs->p < xs->end; xs->p++) {
+		char c = *xs->p;
+
+		if (quote != '\0') {
+			if (c == quote)
+				quote = '\0';
+		} else if ('"' == c || '\'' == c) {
+			quote = c;
+		} else if ('[' == c) {
+			bracket++;
+		} else if (']' == c) {
+			bracket--;
+		} else if ('>' == c && bracket <= 0) {
+			xs->p++;
+			return TRUE;
+		}
+	}
+
+	return xsax_error(xs, VXML_E_TRUNCATED_INPUT);
+}
+
+/**
+ * Parse attribute value, the opening quote being at the current position.
+ *
+ * @param xs		the scanner
+ * @param value		where the raw value is returned
+ *
+ * @return FALSE on error.
+ */
+static bool
+xsax_attr_value(xsax_t *xs, struct xsax_name *value)
+{
+	const char *p, *end;
+	char quote;
+
+	if (xs->p >= xs->end)
+		return xsax_error(xs, VXML_E_TRUNCATED_INPUT);
+
+	quote = *xs->p;
+	if ('"' != quote && '\'' != quote)
+		return xsax_error(xs, VXML_E_EXPECTED_QUOTE);
+
+	p = xs->p + 1;
+	end = memchr(p, quote, xs->end - p);
+	if (NULL == end) {
+		xs->p = xs->end;
+		return xsax_error(xs, VXML_E_TRUNCATED_INPUT);
+	}
+
+	if (NULL != memchr(p, '<', end - p))
+		return xsax_error(xs, VXML_E_UNEXPECTED_LT);
+
+	value->name = p;
+	value->len = end - p;
+	xs->p = end + 1;
+
+	return TRUE;
+}
+
+/**
+ * Parse attribute, at the current position.
+ *
+ * @param xs		the scanner
+ * @param name		where the attribute name is returned
+ * @param value		where the raw attribute value is returned
+ *
+ * @return FALSE on error.
+ */
+static bool
+xsax_attribute(xsax_t *xs, struct xsax_name *name, struct xsax_name *value)
+{
+	if (!xsax_name(xs, name))
+		return FALSE;
+
+	xsax_skip_spaces(xs);
+
+	if (xs->p >= xs->end)
+		return xsax_error(xs, VXML_E_TRUNCATED_INPUT);
+
+	if ('=' != *xs->p)
+		return xsax_error(xs, VXML_E_UNEXPECTED_CHARACTER);
+
+	xs->p++;
+	xsax_skip_spaces(xs);
+
+	return xsax_attr_value(xs, value);
+}
+
+/**
+ * Handle the XML declaration, the leading "<?xml" being already swallowed.
+ *
+ * We only check that the declared encoding, if any, is one we can handle.
+ */
+static bool
+xsax_xml_decl(xsax_t *xs)
+{
+	for (;;) {
+		struct xsax_name name, value;
+		bool space = xsax_skip_spaces(xs);
+
+		if (XSAX_AT(xs, "?>")) {
+			xs->p += CONST_STRLEN("?>");
+			return TRUE;
+		}
+
+		if (xs->p >= xs->end)
+			return xsax_error(xs, VXML_E_TRUNCATED_INPUT);
+
+		if (!space)
+			return xsax_error(xs, VXML_E_EXPECTED_SPACE);
+
+		if (!xsax_attribute(xs, &name, &value))
+			return FALSE;
+
+		if (
+			xsax_eq(name.name, name.len, "encoding") &&
+			!(
+				(CONST_STRLEN("UTF-8") == value.len &&
+				0 == ascii_strncasecmp(value.name, "UTF-8", value.len)) ||
+				(CONST_STRLEN("US-ASCII") == value.len &&
+				0 == ascii_strncasecmp(value.name, "US-ASCII", value.len))
+			)
+		)
+			return xsax_error(xs, VXML_E_UNSUPPORTED_CHARSET);
+	}
+}
+
+/**
+ * Handle an element start tag, the leading "<" being already swallowed.
+ */
+static bool
+xsax_start_tag(xsax_t *xs)
+{
+	struct xsax_name name;
+	const struct xsax_ops *ops = xs->ops;
+
+	if (xs->root && 0 == xs->depth)
+		return xsax_error(xs, VXML_E_INVALID_TAG_NESTING);
+
+	if (!xsax_name(xs, &name))
+		return FALSE;
+
+	if (xs->depth == xs->stacklen) {
+		size_t len = 2 * xs->stacklen;
+
+		if (xs->stack == xs->stack0) {
+			xs->stack = xmalloc(len * sizeof xs->stack[0]);
+			memcpy(xs->stack, xs->stack0, sizeof xs->stack0);
+		} else {
+			xs->stack = xrealloc(xs->stack, len * sizeof xs->stack[0]);
+		}
+		xs->stacklen = len;
+	}
+
+	xs->stack[xs->depth++] = name;
+	xs->root = TRUE;
+
+	if (ops->start != NULL)
+		(*ops->start)(xs, name.name, name.len, xs->data);
+
+	for (;;) {
+		struct xsax_name attr, value;
+		bool space;
+
+		if (xs->stopped)
+			return FALSE;
+
+		space = xsax_skip_spaces(xs);
+
+		if (xs->p >= xs->end)
+			return xsax_error(xs, VXML_E_TRUNCATED_INPUT);
+
+		if ('>' == *xs->p) {
+			xs->p++;
+			return TRUE;
+		}
+
+		if (XSAX_AT(xs, "/>")) {
+			xs->p += CONST_STRLEN("/>");
+			if (ops->end != NULL)
+				(*ops->end)(xs, name.name, name.len, xs->data);
+			xs->depth--;
+			return TRUE;
+		}
+
+		if (!space)
+			return xsax_error(xs, VXML_E_EXPECTED_SPACE);
+
+		if (!xsax_attribute(xs, &attr, &value))
+			return FALSE;
+
+		if (ops->attr != NULL) {
+			const char *v;
+			size_t len = value.len;
+
+			v = xsax_decode(xs, value.name, &len, TRUE);
+			if (NULL == v)
+				return FALSE;
+
+			(*ops->attr)(xs, attr.name, attr.len, v, len, xs->data);
+		}
+	}
+}
+
+/**
+ * Handle an element end tag, the leading "</" being already swallowed.
+ */
+static bool
+xsax_end_tag(xsax_t *xs)
+{
+	struct xsax_name name;
+	const struct xsax_name *top;
+
+	if (0 == xs->depth)
+		return xsax_error(xs, VXML_E_UNEXPECTED_TAG_END);
+
+	if (!xsax_name(xs, &name))
+		return FALSE;
+
+	top = &xs->stack[xs->depth - 1];
+
+	if (top->len != name.len || 0 != memcmp(top->name, name.name, name.len))
+		return xsax_error(xs, VXML_E_INVALID_TAG_NESTING);
+
+	xsax_skip_spaces(xs);
+
+	if (xs->p >= xs->end)
+		return xsax_error(xs, VXML_E_TRUNCATED_INPUT);
+
+	if ('>' != *xs->p)
+		return xsax_error(xs, VXML_E_EXPECTED_GT);
+
+	xs->p++;
+
+	if (xs->ops->end != NULL)
+		(*xs->ops->end)(xs, name.name, name.len, xs->data);
+
+	xs->depth--;
+	return TRUE;
+}
+
+/**
+ * Handle markup starting at the current position, on a '<'.
+ */
+static bool
+xsax_markup(xsax_t *xs)
+{
+	g_assert('<' == *xs->p);
+
+	if (XSAX_AT(xs, "<?")) {
+		if (XSAX_AT(xs, "<?xml") && xs->p + 5 < xs->end &&
+			xsax_is_space(xs->p[5])
+		) {
+			if (xs->p != xs->start)
+				return xsax_error(xs, VXML_E_UNEXPECTED_XML_PI);
+			xs->p += CONST_STRLEN("<?xml");
+			return xsax_xml_decl(xs);
+		}
+		return xsax_skip_past(xs, "?>", CONST_STRLEN("?>"));
+	}
+
+	if (XSAX_AT(xs, "<!--")) {
+		xs->p += CONST_STRLEN("<!--");
+		return xsax_skip_past(xs, "-->", CONST_STRLEN("-->"));
+	}
+
+	if (XSAX_AT(xs, "<![CDATA[")) {
+		xs->p += CONST_STRLEN("<![CDATA[");
+		return xsax_cdata(xs);
+	}
+
+	if (XSAX_AT(xs, "<!DOCTYPE")) {
+		xs->p += CONST_STRLEN("<!DOCTYPE");
+		return xsax_doctype(xs);
+	}
+
+	if (XSAX_AT(xs, "<!"))
+		return xsax_error(xs, VXML_E_EXPECTED_DECL_TOKEN);
+
+	if (XSAX_AT(xs, "</")) {
+		xs->p += CONST_STRLEN("</");
+		return xsax_end_tag(xs);
+	}
+
+	xs->p++;
+	return xsax_start_tag(xs);
+}
+
+/**
+ * Scan XML document held in memory, invoking callbacks as elements,
+ * attributes and text are met.
+ *
+ * Strings given to callbacks are not NUL-terminated.  They point into the
+ * input buffer, unless they had to be decoded, in which case they point to
+ * a scratch buffer only valid until the callback returns.
+ *
+ * @param data		start of the document
+ * @param len		length of the document
+ * @param options	scanning options
+ * @param ops		callbacks to invoke
+ * @param arg		additional callback argument
+ *
+ * @return VXML_E_OK if the document was well-formed, VXML_E_USER if the
+ * scanning was stopped by a callback, an error code otherwise.
+ */
+vxml_error_t
+xsax_parse(const char *data, size_t len, uint32 options,
+	const struct xsax_ops *ops, void *arg)
+{
+	xsax_t xs;
+
+	g_assert(data != NULL || 0 == len);
+	g_assert(ops != NULL);
+
+	ZERO(&xs);
+	xs.magic = XSAX_MAGIC;
+	xs.start = xs.p = data;
+	xs.end = data + len;
+	xs.ops = ops;
+	xs.data = arg;
+	xs.options = options;
+	xs.stack = xs.stack0;
+	xs.stacklen = N_ITEMS(xs.stack0);
+	xs.buf = xs.buf0;
+	xs.buflen = sizeof xs.buf0;
+
+	/*
+	 * Since we are going to hand out slices of the input, it must be valid
+	 * UTF-8 to begin with, and we may as well check it all at once.
+	 * A leading UTF-8 BOM is skipped, other BOMs flag unsupported encodings.
+	 */
+
+	if (len >= 3 && 0 == memcmp(data, "\xef\xbb\xbf", 3)) {
+		xs.start = xs.p = data + 3;
+	} else if (len >= 2 && (
+		(0xfe == (uchar) data[0] && 0xff == (uchar) data[1]) ||
+		(0xff == (uchar) data[0] && 0xfe == (uchar) data[1]) ||
+		'\0' == data[0] || '\0' == data[1]
+	)) {
+		xs.error = VXML_E_UNSUPPORTED_BYTE_ORDER;
+		goto done;
+	}
+
+	if (
+		NULL != memchr(xs.p, '\0', xs.end - xs.p) ||
+		!utf8_is_valid_data(xs.p, xs.end - xs.p)
+	) {
+		xs.error = VXML_E_ILLEGAL_CHAR_BYTE_SEQUENCE;
+		goto done;
+	}
+
+	while (xs.p < xs.end) {
+		bool ok = '<' == *xs.p ? xsax_markup(&xs) : xsax_text(&xs);
+
+		if (!ok || xs.stopped)
+			break;
+	}
+
+	if (VXML_E_OK == xs.error) {
+		if (xs.stopped)
+			xs.error = VXML_E_USER;
+		else if (!xs.root || xs.depth != 0)
+			xs.error = VXML_E_TRUNCATED_INPUT;
+	}
+
+done:
+	if (xs.stack != xs.stack0)
+		xfree(xs.stack);
+	if (xs.buf != xs.buf0)
+		xfree(xs.buf);
+	xs.magic = 0;
+
+	return xs.error;
+}
+
+/* vi: set ts=4 sw=4 cindent: */
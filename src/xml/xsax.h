@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2026 agent
+ *
+ *----------------------------------------------------------------------
+ * This file is part of gtk-gnutella.
+ *
+ *  gtk-gnutella is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gtk-gnutella is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with gtk-gnutella; if not, write to the Free Software
+ *  Foundation, Inc.:
+ *      59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *----------------------------------------------------------------------
+ */
+
+/**
+ * @ingroup xml
+ * @file
+ *
+ * Streaming XML scanner.
+ *
+ * @author agent
+ * @date 2026
+ */
+
+#ifndef _xml_xsax_h_
+#define _xml_xsax_h_
+
+#include "common.h"
+
+#include "if/gen/vxml.h"		/* For vxml_error_t */
+
+struct xsax;
+typedef struct xsax xsax_t;
+
+/**
+ * Scanning options.
+ */
+#define XSAX_O_STRIP_BLANKS		(1 << 0)  /**< Strip leading/ending blanks */
+
+/**
+ * Element start callback signature.
+ *
+ * The attributes of the element are notified next, through the attribute
+ * callback.
+ *
+ * @param xs		the scanner
+ * @param name		the element name (not NUL-terminated)
+ * @param len		length of element name
+ * @param data		user-specified callback argument
+ */
+typedef void (*xsax_start_cb_t)(xsax_t *xs,
+	const char *name, size_t len, void *data);
+
+/**
+ * Attribute callback signature.
+ *
+ * @param xs		the scanner
+ * @param name		the attribute name (not NUL-terminated)
+ * @param nlen		length of attribute name
+ * @param value		the attribute value (not NUL-terminated)
+ * @param vlen		length of attribute value
+ * @param data		user-specified callback argument
+ */
+typedef void (*xsax_attr_cb_t)(xsax_t *xs,
+	const char *name, size_t nlen, const char *value, size_t vlen, void *data);
+
+/**
+ * Text callback signature.
+ *
+ * @param xs		the scanner
+ * @param text		the text data (not NUL-terminated)
+ * @param len		length of text data
+ * @param data		user-specified callback argument
+ */
+typedef void (*xsax_text_cb_t)(xsax_t *xs,
+	const char *text, size_t len, void *data);
+
+/**
+ * Element end callback signature.
+ *
+ * @param xs		the scanner
+ * @param name		the element name (not NUL-terminated)
+ * @param len		length of element name
+ * @param data		user-specified callback argument
+ */
+typedef void (*xsax_end_cb_t)(xsax_t *xs,
+	const char *name, size_t len, void *data);
+
+/**
+ * Regroups the scanning callbacks.
+ *
+ * Any callback can be specified as NULL in which case it will not be
+ * invoked.
+ */
+struct xsax_ops {
+	xsax_start_cb_t start;
+	xsax_attr_cb_t attr;
+	xsax_text_cb_t text;
+	xsax_end_cb_t end;
+};
+
+/**
+ * Check whether a string slice is equal to a NUL-terminated string.
+ */
+static inline bool
+xsax_eq(const char *s, size_t len, const char *str)
+{
+	return 0 == strncmp(s, str, len) && '\0' == str[len];
+}
+
+/*
+ * Public interface.
+ */
+
+vxml_error_t xsax_parse(const char *data, size_t len, uint32 options,
+	const struct xsax_ops *ops, void *arg);
+
+void xsax_stop(xsax_t *xs);
+unsigned xsax_depth(const xsax_t *xs);
+size_t xsax_offset(const xsax_t *xs);
+
+#endif /* _xml_xsax_h_ */
+
+/* vi: set ts=4 sw=4 cindent: */